@@ -28,6 +28,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <cassert>
 #include <limits>
 #include <type_traits>
@@ -38,6 +39,7 @@
 #include <memory>
 #include <functional>
 #include <sstream>
+#include <string>
 
 #include <backends/cxxrtl/cxxrtl_capi.h>
 
@@ -91,8 +93,81 @@ namespace cxxrtl {
 // invisible to the compiler, (b) we often operate on non-power-of-2 values and have to clear the high bits anyway.
 // Therefore, using relatively wide chunks and clearing the high bits explicitly and only when we know they may be
 // clobbered results in simpler generated code.
+//
+// By default, 32-bit chunks are used. Defining CXXRTL_CHUNK_BITS to 64 when compiling the generated code selects
+// 64-bit chunks, which halves the number of iterations of the carry chains, shifts and comparisons on wide values
+// and quarters the number of partial products in wide multiplications, at the cost of requiring a 128-bit integer
+// type for the latter. Values are still initialized from, and exposed via the C API as, arrays of 32-bit words;
+// this relies on 64-bit chunks being stored in little-endian byte order.
+#ifndef CXXRTL_CHUNK_BITS
+#define CXXRTL_CHUNK_BITS 32
+#endif
+
+#if CXXRTL_CHUNK_BITS == 32
 typedef uint32_t chunk_t;
 typedef uint64_t wide_chunk_t;
+#elif CXXRTL_CHUNK_BITS == 64
+#if !defined(__SIZEOF_INT128__)
+#error "CXXRTL_CHUNK_BITS=64 requires a compiler that provides unsigned __int128"
+#endif
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "CXXRTL_CHUNK_BITS=64 is only supported on little-endian targets"
+#endif
+typedef uint64_t chunk_t;
+__extension__ typedef unsigned __int128 wide_chunk_t;
+#else
+#error "CXXRTL_CHUNK_BITS must be 32 or 64"
+#endif
+
+// Number of 32-bit words used to represent a value of the given width in the C API.
+constexpr size_t words_for_bits(size_t bits) {
+	return (bits + 31) / 32;
+}
+
+// Number of 32-bit words between consecutive elements of a memory of the given width in the C API. Memory
+// elements are arrays of chunks, so with 64-bit chunks this is rounded up to an even number of words.
+constexpr size_t words_per_row(size_t bits) {
+	return (bits + CXXRTL_CHUNK_BITS - 1) / CXXRTL_CHUNK_BITS * (CXXRTL_CHUNK_BITS / 32);
+}
+
+#if CXXRTL_CHUNK_BITS != 32
+template<size_t Words>
+struct init_words {
+	// One extra element so that an empty initializer list remains well-formed.
+	uint32_t word[Words + 1];
+
+	constexpr chunk_t chunk(size_t index) const {
+		return (2 * index     < Words ? chunk_t(word[2 * index])           : 0) |
+		       (2 * index + 1 < Words ? chunk_t(word[2 * index + 1]) << 32 : 0);
+	}
+};
+
+template<size_t... Index>
+struct init_sequence {};
+
+template<class Lower, class Upper>
+struct concat_init_sequence;
+
+template<size_t... Lower, size_t... Upper>
+struct concat_init_sequence<init_sequence<Lower...>, init_sequence<Upper...>> {
+	using type = init_sequence<Lower..., (sizeof...(Lower) + Upper)...>;
+};
+
+// Builds the sequence by halving to keep the template instantiation depth logarithmic in the value width.
+template<size_t Count>
+struct make_init_sequence : concat_init_sequence<typename make_init_sequence<Count / 2>::type,
+                                                 typename make_init_sequence<Count - Count / 2>::type> {};
+
+template<>
+struct make_init_sequence<0> {
+	using type = init_sequence<>;
+};
+
+template<>
+struct make_init_sequence<1> {
+	using type = init_sequence<0>;
+};
+#endif
 
 template<typename T>
 struct chunk_traits {
@@ -118,8 +193,23 @@ struct value : public expr_base<value<Bits>> {
 	chunk::type data[chunks] = {};
 
 	value() = default;
+	// Values are initialized from 32-bit words, least significant first, regardless of the chunk size.
+#if CXXRTL_CHUNK_BITS == 32
 	template<typename... Init>
 	explicit constexpr value(Init ...init) : data{init...} {}
+#else
+	template<typename... Init>
+	explicit constexpr value(Init ...init)
+		: value(init_words<sizeof...(Init)>{{init...}}, typename make_init_sequence<chunks>::type()) {
+		static_assert(sizeof...(Init) <= words_for_bits(Bits), "too many initializers for value<Bits>");
+	}
+
+private:
+	template<size_t Words, size_t... Index>
+	constexpr value(const init_words<Words> &words, init_sequence<Index...>) : data{words.chunk(Index)...} {}
+
+public:
+#endif
 
 	value(const value<Bits> &) = default;
 	value<Bits> &operator=(const value<Bits> &) = default;
@@ -329,14 +419,14 @@ struct value : public expr_base<value<Bits>> {
 	//
 	// These operations are used for computations.
 	bool bit(size_t offset) const {
-		return data[offset / chunk::bits] & (1 << (offset % chunk::bits));
+		return data[offset / chunk::bits] & (chunk::type(1) << (offset % chunk::bits));
 	}
 
 	void set_bit(size_t offset, bool value = true) {
 		size_t offset_chunks = offset / chunk::bits;
 		size_t offset_bits = offset % chunk::bits;
-		data[offset_chunks] &= ~(1 << offset_bits);
-		data[offset_chunks] |= value ? 1 << offset_bits : 0;
+		data[offset_chunks] &= ~(chunk::type(1) << offset_bits);
+		data[offset_chunks] |= value ? chunk::type(1) << offset_bits : 0;
 	}
 
 	explicit operator bool() const {
@@ -351,7 +441,7 @@ struct value : public expr_base<value<Bits>> {
 	}
 
 	bool is_neg() const {
-		return data[chunks - 1] & (1 << ((Bits - 1) % chunk::bits));
+		return data[chunks - 1] & (chunk::type(1) << ((Bits - 1) % chunk::bits));
 	}
 
 	bool operator ==(const value<Bits> &other) const {
@@ -418,6 +508,7 @@ struct value : public expr_base<value<Bits>> {
 			carry = (shift_bits == 0) ? 0
 				: data[n] >> (chunk::bits - shift_bits);
 		}
+		result.data[result.chunks - 1] &= result.msb_mask;
 		return result;
 	}
 
@@ -425,15 +516,16 @@ struct value : public expr_base<value<Bits>> {
 	value<Bits> shr(const value<AmountBits> &amount) const {
 		// Ensure our early return is correct by prohibiting values larger than 4 Gbit.
 		static_assert(Bits <= chunk::mask, "shr() of unreasonably large values is not supported");
+		const bool fill = Signed && is_neg();
 		// Detect shifts definitely large than Bits early.
 		for (size_t n = 1; n < amount.chunks; n++)
 			if (amount.data[n] != 0)
-				return {};
+				return fill ? value<Bits>().bit_not() : value<Bits>();
 		// Past this point we can use the least significant chunk as the shift size.
 		size_t shift_chunks = amount.data[0] / chunk::bits;
 		size_t shift_bits   = amount.data[0] % chunk::bits;
 		if (shift_chunks >= chunks)
-			return {};
+			return fill ? value<Bits>().bit_not() : value<Bits>();
 		value<Bits> result;
 		chunk::type carry = 0;
 		for (size_t n = 0; n < chunks - shift_chunks; n++) {
@@ -441,13 +533,15 @@ struct value : public expr_base<value<Bits>> {
 			carry = (shift_bits == 0) ? 0
 				: data[chunks - 1 - n] << (chunk::bits - shift_bits);
 		}
-		if (Signed && is_neg()) {
-			size_t top_chunk_idx  = (Bits - shift_bits) / chunk::bits;
-			size_t top_chunk_bits = (Bits - shift_bits) % chunk::bits;
+		if (fill && amount.data[0] != 0) {
+			// The sign is replicated into the topmost `amount` bits, which may span any number of chunks.
+			size_t top_bits       = amount.data[0] >= Bits ? 0 : Bits - amount.data[0];
+			size_t top_chunk_idx  = top_bits / chunk::bits;
+			size_t top_chunk_bits = top_bits % chunk::bits;
 			for (size_t n = top_chunk_idx + 1; n < chunks; n++)
 				result.data[n] = chunk::mask;
-			if (shift_bits != 0)
-				result.data[top_chunk_idx] |= chunk::mask << top_chunk_bits;
+			result.data[top_chunk_idx] |= chunk::mask << top_chunk_bits;
+			result.data[chunks - 1] &= msb_mask;
 		}
 		return result;
 	}
@@ -504,15 +598,16 @@ struct value : public expr_base<value<Bits>> {
 	}
 
 	size_t ctlz() const {
+		constexpr size_t msb_chunk_bits = (Bits % chunk::bits != 0) ? Bits % chunk::bits : chunk::bits;
 		size_t count = 0;
 		for (size_t n = 0; n < chunks; n++) {
 			chunk::type x = data[chunks - 1 - n];
-			if (x == 0) {
-				count += (n == 0 ? Bits % chunk::bits : chunk::bits);
-			} else {
+			count += (n == 0 ? msb_chunk_bits : chunk::bits);
+			if (x != 0) {
 				// This loop implements the find first set idiom as recognized by LLVM.
-				for (; x != 0; count++)
+				for (; x != 0; count--)
 					x >>= 1;
+				break;
 			}
 		}
 		return count;
@@ -935,6 +1030,34 @@ std::ostream &operator<<(std::ostream &os, const wire<Bits> &val) {
 	return os;
 }
 
+// The value of a wire as of the last time the logic reading it was evaluated. This is used by the designs
+// generated with `write_cxxrtl -activity` to skip evaluating logic whose inputs have not changed.
+template<size_t Bits>
+struct shadow {
+	value<Bits> seen;
+
+	CXXRTL_ALWAYS_INLINE
+	bool update(const value<Bits> &curr) {
+		if (seen != curr) {
+			seen = curr;
+			return true;
+		}
+		return false;
+	}
+};
+
+// Increments `counters[bit]` for every bit that differs between `prev` and `curr`. This is used by the designs
+// generated with `write_cxxrtl -coverage` to count toggles.
+template<size_t Bits>
+void count_toggles(uint64_t *counters, const value<Bits> &prev, const value<Bits> &curr) {
+	for (size_t n = 0; n < value<Bits>::chunks; n++) {
+		typename value<Bits>::chunk::type diff = prev.data[n] ^ curr.data[n];
+		for (size_t bit = n * value<Bits>::chunk::bits; diff != 0; bit++, diff >>= 1)
+			if (diff & 1)
+				counters[bit]++;
+	}
+}
+
 template<size_t Width>
 struct memory {
 	const size_t depth;
@@ -1093,6 +1216,12 @@ struct debug_item : ::cxxrtl_object {
 
 	debug_item(const ::cxxrtl_object &object) : cxxrtl_object(object) {}
 
+	// The C API exposes chunks as arrays of 32-bit words. With 64-bit chunks, each chunk is viewed as two
+	// consecutive words, least significant first.
+	static uint32_t *words(chunk_t *data) {
+		return reinterpret_cast<uint32_t*>(data);
+	}
+
 	template<size_t Bits>
 	debug_item(value<Bits> &item, size_t lsb_offset = 0, uint32_t flags_ = 0) {
 		static_assert(sizeof(item) == value<Bits>::chunks * sizeof(chunk_t),
@@ -1103,8 +1232,8 @@ struct debug_item : ::cxxrtl_object {
 		lsb_at  = lsb_offset;
 		depth   = 1;
 		zero_at = 0;
-		curr    = item.data;
-		next    = item.data;
+		curr    = words(item.data);
+		next    = words(item.data);
 		outline = nullptr;
 		attrs   = nullptr;
 	}
@@ -1119,7 +1248,7 @@ struct debug_item : ::cxxrtl_object {
 		lsb_at  = lsb_offset;
 		depth   = 1;
 		zero_at = 0;
-		curr    = const_cast<chunk_t*>(item.data);
+		curr    = words(const_cast<chunk_t*>(item.data));
 		next    = nullptr;
 		outline = nullptr;
 		attrs   = nullptr;
@@ -1136,8 +1265,8 @@ struct debug_item : ::cxxrtl_object {
 		lsb_at  = lsb_offset;
 		depth   = 1;
 		zero_at = 0;
-		curr    = item.curr.data;
-		next    = item.next.data;
+		curr    = words(item.curr.data);
+		next    = words(item.next.data);
 		outline = nullptr;
 		attrs   = nullptr;
 	}
@@ -1152,7 +1281,7 @@ struct debug_item : ::cxxrtl_object {
 		lsb_at  = 0;
 		depth   = item.depth;
 		zero_at = zero_offset;
-		curr    = item.data ? item.data[0].data : nullptr;
+		curr    = item.data ? words(item.data[0].data) : nullptr;
 		next    = nullptr;
 		outline = nullptr;
 		attrs   = nullptr;
@@ -1168,7 +1297,7 @@ struct debug_item : ::cxxrtl_object {
 		lsb_at  = lsb_offset;
 		depth   = 1;
 		zero_at = 0;
-		curr    = const_cast<chunk_t*>(item.data);
+		curr    = words(const_cast<chunk_t*>(item.data));
 		next    = nullptr;
 		outline = nullptr;
 		attrs   = nullptr;
@@ -1185,7 +1314,7 @@ struct debug_item : ::cxxrtl_object {
 		lsb_at  = lsb_offset;
 		depth   = 1;
 		zero_at = 0;
-		curr    = const_cast<chunk_t*>(item.curr.data);
+		curr    = words(const_cast<chunk_t*>(item.curr.data));
 		next    = nullptr;
 		outline = nullptr;
 		attrs   = nullptr;
@@ -1201,7 +1330,7 @@ struct debug_item : ::cxxrtl_object {
 		lsb_at  = lsb_offset;
 		depth   = 1;
 		zero_at = 0;
-		curr    = const_cast<chunk_t*>(item.data);
+		curr    = words(const_cast<chunk_t*>(item.data));
 		next    = nullptr;
 		outline = &group;
 		attrs   = nullptr;
@@ -1211,7 +1340,7 @@ struct debug_item : ::cxxrtl_object {
 	IntegerT get() const {
 		assert(width == Bits && depth == 1);
 		value<Bits> item;
-		std::copy(curr, curr + value<Bits>::chunks, item.data);
+		std::memcpy(item.data, curr, words_for_bits(Bits) * sizeof(uint32_t));
 		return item.template get<IntegerT>();
 	}
 
@@ -1220,7 +1349,7 @@ struct debug_item : ::cxxrtl_object {
 		assert(width == Bits && depth == 1);
 		value<Bits> item;
 		item.template set<IntegerT>(other);
-		std::copy(item.data, item.data + value<Bits>::chunks, next);
+		std::memcpy(next, item.data, words_for_bits(Bits) * sizeof(uint32_t));
 	}
 };
 static_assert(std::is_standard_layout<debug_item>::value, "debug_item is not compatible with C layout");
@@ -1280,6 +1409,126 @@ struct debug_items {
 	}
 };
 
+// Flat binary snapshots of the simulation state.
+//
+// The generated `visit_state()` method of a module passes every wire, value, and memory member holding its state
+// to a state visitor, followed by the state of its submodules. A snapshot is a header followed by the raw contents
+// of these members, in the order they are visited, so saving and restoring it costs about as much as copying its
+// contents. The header records the size of the state and a hash of its layout, which are checked when a snapshot
+// is restored or compared; nevertheless, a snapshot should only be used with the same build of the same design.
+class state_visitor {
+public:
+	enum mode_t {
+		MEASURE, // compute the size and the layout hash of the state
+		SAVE,    // copy the state into a snapshot
+		LOAD,    // copy a snapshot into the state
+		DIFF,    // collect the names of the members whose state differs from a snapshot
+	};
+
+	struct header {
+		uint32_t magic;
+		uint32_t layout;
+		uint64_t size;
+	};
+
+	static constexpr uint32_t magic = 0x53525843; // "CXRS"
+
+	const mode_t mode;
+	uint8_t *data;
+	size_t offset = 0;
+	uint32_t layout = 2166136261u;
+	std::string path;
+	std::vector<std::string> *differences = nullptr;
+
+	state_visitor(mode_t mode, uint8_t *data = nullptr) : mode(mode), data(data) {}
+
+	template<size_t Bits>
+	void operator()(value<Bits> &elem, const char *name) {
+		visit(&elem, sizeof(elem), name);
+	}
+
+	template<size_t Bits>
+	void operator()(wire<Bits> &elem, const char *name) {
+		visit(&elem.curr, sizeof(elem.curr), name);
+		visit(&elem.next, sizeof(elem.next), name);
+	}
+
+	template<size_t Width>
+	void operator()(memory<Width> &elem, const char *name) {
+		// Writes are only queued within a step.
+		assert(elem.write_queue.empty());
+		if (mode == DIFF) {
+			for (size_t index = 0; index < elem.depth; index++)
+				visit(&elem.data[index], sizeof(value<Width>), name, index);
+		} else {
+			visit(&elem.data[0], elem.depth * sizeof(value<Width>), name);
+		}
+	}
+
+	// Used by the generated code around the state of a submodule.
+	void enter(const char *name) {
+		if (mode == DIFF)
+			path += std::string(name) + ' ';
+	}
+
+	void leave(const char *name) {
+		if (mode == DIFF)
+			path.resize(path.size() - strlen(name) - 1);
+	}
+
+	void visit(void *elem, size_t size, const char *name, size_t index = (size_t)-1) {
+		layout = (layout ^ (uint32_t)size) * 16777619u;
+		switch (mode) {
+			case MEASURE:
+				break;
+			case SAVE:
+				memcpy(data + offset, elem, size);
+				break;
+			case LOAD:
+				memcpy(elem, data + offset, size);
+				break;
+			case DIFF:
+				if (memcmp(elem, data + offset, size) != 0) {
+					std::string full_name = path + name;
+					if (index != (size_t)-1)
+						full_name += '[' + std::to_string(index) + ']';
+					if (differences->empty() || differences->back() != full_name)
+						differences->push_back(full_name);
+				}
+				break;
+		}
+		offset += size;
+	}
+};
+
+// Describes one of the coverage counters of a design generated with `write_cxxrtl -coverage`.
+struct coverage_point {
+	// Corresponds to `enum cxxrtl_coverage_type` in the C API.
+	enum : uint32_t {
+		// The number of times a bit of a wire changed its value. `detail` is the index of the bit.
+		TOGGLE = 0,
+		// The number of times a `$mux` or `$pmux` cell was evaluated with one of its inputs selected. `detail`
+		// is 0 for the `A` input, and `n + 1` for the `n`-th part of the `B` input.
+		MUX    = 1,
+		// The number of times a `$cover` cell was evaluated with both its `EN` and `A` inputs high.
+		// `detail` is always 0.
+		COVER  = 2,
+	};
+
+	uint32_t type;
+	std::string name;
+	size_t detail;
+	// The index of the counter in the array returned by `module::coverage_counters()`.
+	size_t index;
+};
+
+// Appends `count` coverage points of the same object, with consecutive details and indices.
+inline void add_coverage_points(std::vector<coverage_point> &points, uint32_t type, const std::string &name,
+                                size_t count, size_t index) {
+	for (size_t detail = 0; detail < count; detail++)
+		points.push_back(coverage_point { type, name, detail, index + detail });
+}
+
 // Tag class to disambiguate the default constructor used by the toplevel module that calls reset(),
 // and the constructor of interior modules that should not call it.
 struct interior {};
@@ -1318,6 +1567,88 @@ struct module {
 	virtual void debug_info(debug_items &items, std::string path = "") {
 		(void)items, (void)path;
 	}
+
+	// Returns the coverage counters of the module and all of its submodules, which are kept in a single array of
+	// `coverage_size()` elements. Designs that were not generated with `write_cxxrtl -coverage` have no counters.
+	virtual size_t coverage_size() const {
+		return 0;
+	}
+
+	virtual uint64_t *coverage_counters() {
+		return nullptr;
+	}
+
+	// Describes every coverage counter, adding `offset` to its index.
+	virtual void coverage_info(std::vector<coverage_point> &points, std::string path = "", size_t offset = 0) {
+		(void)points, (void)path, (void)offset;
+	}
+
+	// Passes the state of the module to `visitor`; see `state_visitor` for details. Black box implementations
+	// that have state of their own should override this method, and call the overridden method as well.
+	virtual void visit_state(state_visitor &visitor) {
+		(void)visitor;
+	}
+
+	// Returns the size of a snapshot of the state of the module and its submodules, in bytes.
+	size_t state_size() {
+		state_visitor visitor(state_visitor::MEASURE);
+		visit_state(visitor);
+		return sizeof(state_visitor::header) + visitor.offset;
+	}
+
+	// Writes a snapshot of the state to `data`, which must be at least `state_size()` bytes long.
+	void save_state(uint8_t *data) {
+		state_visitor visitor(state_visitor::SAVE, data + sizeof(state_visitor::header));
+		visit_state(visitor);
+		state_visitor::header header = { state_visitor::magic, visitor.layout, visitor.offset };
+		memcpy(data, &header, sizeof(header));
+	}
+
+	void save_state(std::vector<uint8_t> &buffer) {
+		buffer.resize(state_size());
+		save_state(buffer.data());
+	}
+
+	// Replaces the state with a snapshot previously written by `save_state()`. Returns false, without changing
+	// the state, if the snapshot does not match the layout of the state.
+	bool load_state(const uint8_t *data, size_t size) {
+		if (!check_state(data, size))
+			return false;
+		state_visitor visitor(state_visitor::LOAD, const_cast<uint8_t *>(data) + sizeof(state_visitor::header));
+		visit_state(visitor);
+		return true;
+	}
+
+	bool load_state(const std::vector<uint8_t> &buffer) {
+		return load_state(buffer.data(), buffer.size());
+	}
+
+	// Appends the hierarchical names of the members whose state differs from a snapshot to `differences`
+	// (memory rows are listed individually). Returns false if the snapshot does not match the layout of the state.
+	bool diff_state(const uint8_t *data, size_t size, std::vector<std::string> &differences) {
+		if (!check_state(data, size))
+			return false;
+		state_visitor visitor(state_visitor::DIFF, const_cast<uint8_t *>(data) + sizeof(state_visitor::header));
+		visitor.differences = &differences;
+		visit_state(visitor);
+		return true;
+	}
+
+	bool diff_state(const std::vector<uint8_t> &buffer, std::vector<std::string> &differences) {
+		return diff_state(buffer.data(), buffer.size(), differences);
+	}
+
+private:
+	bool check_state(const uint8_t *data, size_t size) {
+		state_visitor::header header;
+		if (size < sizeof(header))
+			return false;
+		memcpy(&header, data, sizeof(header));
+		state_visitor visitor(state_visitor::MEASURE);
+		visit_state(visitor);
+		return header.magic == state_visitor::magic && header.layout == visitor.layout &&
+		       header.size == visitor.offset && size >= sizeof(header) + visitor.offset;
+	}
 };
 
 } // namespace cxxrtl
@@ -1738,7 +2069,7 @@ std::pair<value<BitsY>, value<BitsY>> divmod_uu(const value<BitsA> &a, const val
 	value<Bits> divisor = b.template zext<Bits>();
 	if (dividend.ucmp(divisor))
 		return {/*quotient=*/value<BitsY> { 0u }, /*remainder=*/dividend.template trunc<BitsY>()};
-	uint32_t divisor_shift = dividend.ctlz() - divisor.ctlz();
+	uint32_t divisor_shift = divisor.ctlz() - dividend.ctlz();
 	divisor = divisor.shl(value<32> { divisor_shift });
 	for (size_t step = 0; step <= divisor_shift; step++) {
 		quotient = quotient.shl(value<1> { 1u });
@@ -637,6 +637,13 @@ std::string get_hdl_name(T *object)
 		return object->name.str().substr(1);
 }
 
+// Public objects are named the same way as in debug_info(); internal ones keep their full names.
+template<class T>
+std::string state_name(T *object)
+{
+	return escape_cxx_string(object->name.isPublic() ? get_hdl_name(object) : object->name.str());
+}
+
 struct WireType {
 	enum Type {
 		// Non-referenced wire; is not a part of the design.
@@ -692,6 +699,9 @@ bool is_valid_clock(const RTLIL::SigSpec& sig) {
 struct CxxrtlWorker {
 	bool split_intf = false;
 	std::string intf_filename;
+	std::string split_dir;
+	int split_size = 0;
+	int split_files_written = 0, split_files_unchanged = 0;
 	std::string design_ns = "cxxrtl_design";
 	std::string print_output = "std::cout";
 	std::ostream *impl_f = nullptr;
@@ -715,6 +725,10 @@ struct CxxrtlWorker {
 	bool debug_alias = false;
 	bool debug_eval = false;
 
+	bool parallel = false;
+	bool activity = false;
+	bool coverage = false;
+
 	std::ostringstream f;
 	std::string indent;
 	int temporary = 0;
@@ -730,6 +744,21 @@ struct CxxrtlWorker {
 	dict<RTLIL::SigBit, bool> bit_has_state;
 	dict<const RTLIL::Module*, pool<std::string>> blackbox_specializations;
 	dict<const RTLIL::Module*, bool> eval_converges;
+	dict<const RTLIL::Module*, bool> parallel_safe_modules;
+	dict<const RTLIL::Cell*, int> parallel_eval_levels;
+	dict<const RTLIL::Module*, std::vector<const RTLIL::Cell*>> parallel_commit_cells;
+	dict<const RTLIL::Module*, std::vector<std::vector<const RTLIL::Wire*>>> activity_inputs;
+	dict<const RTLIL::Module*, std::vector<int>> schedule_activity_groups;
+
+	// The coverage counters of a module are laid out as toggle counters of its wires, followed by counters of
+	// its cells, followed by the counters of each of its submodules.
+	struct CoverageLayout {
+		dict<const RTLIL::Wire*, size_t> wire_offsets;
+		dict<const RTLIL::Cell*, size_t> cell_offsets;
+		dict<const RTLIL::Cell*, size_t> submodule_offsets;
+		size_t size = 0;
+	};
+	dict<const RTLIL::Module*, CoverageLayout> coverage_layouts;
 
 	void inc_indent() {
 		indent += "\t";
@@ -1179,6 +1208,18 @@ struct CxxrtlWorker {
 				}
 	}
 
+	void dump_mux_arm(const RTLIL::Cell *cell, int arm, const RTLIL::SigSpec &sig, bool for_debug)
+	{
+		// Selecting an arm of a mux counts as a hit of its coverage point.
+		if (coverage && !for_debug) {
+			f << "(coverage[" << coverage_layouts.at(cell->module).cell_offsets.at(cell) + arm << "]++, ";
+			dump_sigspec_rhs(sig, for_debug);
+			f << ")";
+		} else {
+			dump_sigspec_rhs(sig, for_debug);
+		}
+	}
+
 	void dump_cell_expr(const RTLIL::Cell *cell, bool for_debug = false)
 	{
 		// Unary cells
@@ -1205,9 +1246,9 @@ struct CxxrtlWorker {
 			f << "(";
 			dump_sigspec_rhs(cell->getPort(ID::S), for_debug);
 			f << " ? ";
-			dump_sigspec_rhs(cell->getPort(ID::B), for_debug);
+			dump_mux_arm(cell, 1, cell->getPort(ID::B), for_debug);
 			f << " : ";
-			dump_sigspec_rhs(cell->getPort(ID::A), for_debug);
+			dump_mux_arm(cell, 0, cell->getPort(ID::A), for_debug);
 			f << ")";
 		// Parallel (one-hot) muxes
 		} else if (cell->type == ID($pmux)) {
@@ -1217,10 +1258,10 @@ struct CxxrtlWorker {
 				f << "(";
 				dump_sigspec_rhs(cell->getPort(ID::S).extract(part), for_debug);
 				f << " ? ";
-				dump_sigspec_rhs(cell->getPort(ID::B).extract(part * width, width), for_debug);
+				dump_mux_arm(cell, part + 1, cell->getPort(ID::B).extract(part * width, width), for_debug);
 				f << " : ";
 			}
-			dump_sigspec_rhs(cell->getPort(ID::A), for_debug);
+			dump_mux_arm(cell, 0, cell->getPort(ID::A), for_debug);
 			for (int part = 0; part < s_width; part++) {
 				f << ")";
 			}
@@ -1261,6 +1302,13 @@ struct CxxrtlWorker {
 
 	void dump_cell_eval(const RTLIL::Cell *cell, bool for_debug = false)
 	{
+		// User cells have already been evaluated by eval(), and their outputs are buffered, so debug_eval() only
+		// needs to read them back.
+		if (for_debug && !is_internal_cell(cell->type)) {
+			dump_user_cell_outputs(cell, /*cell_converged=*/false, /*for_debug=*/true);
+			return;
+		}
+
 		std::vector<const RTLIL::Cell*> inlined_cells;
 		collect_cell_eval(cell, for_debug, inlined_cells);
 		dump_inlined_cells(inlined_cells);
@@ -1406,89 +1454,157 @@ struct CxxrtlWorker {
 				dump_sigspec_rhs(cell->getPort(ID::CLR));
 				f << (cell->getParam(ID::CLR_POLARITY).as_bool() ? "" : ".bit_not()") << ");\n";
 			}
+		// $cover cells (only evaluated if coverage counters are generated)
+		} else if (cell->type == ID($cover)) {
+			log_assert(!for_debug && coverage);
+			f << indent << "if (";
+			dump_sigspec_rhs(cell->getPort(ID::EN));
+			f << " == value<1>{1u} && ";
+			dump_sigspec_rhs(cell->getPort(ID::A));
+			f << " == value<1>{1u}) {\n";
+			inc_indent();
+				f << indent << "coverage[" << coverage_layouts.at(cell->module).cell_offsets.at(cell) << "]++;\n";
+			dec_indent();
+			f << indent << "}\n";
 		// Internal cells
 		} else if (is_internal_cell(cell->type)) {
 			log_cmd_error("Unsupported internal cell `%s'.\n", cell->type.c_str());
 		// User cells
 		} else {
 			log_assert(!for_debug);
-			log_assert(cell->known());
-			bool buffered_inputs = false;
 			const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
-			for (auto conn : cell->connections())
-				if (cell->input(conn.first)) {
-					RTLIL::Module *cell_module = cell->module->design->module(cell->type);
-					log_assert(cell_module != nullptr && cell_module->wire(conn.first));
-					RTLIL::Wire *cell_module_wire = cell_module->wire(conn.first);
-					f << indent << mangle(cell) << access << mangle_wire_name(conn.first);
-					if (!is_cxxrtl_blackbox_cell(cell) && wire_types[cell_module_wire].is_buffered()) {
-						buffered_inputs = true;
-						f << ".next";
-					}
-					f << " = ";
-					dump_sigspec_rhs(conn.second);
-					f << ";\n";
-					if (getenv("CXXRTL_VOID_MY_WARRANTY") && conn.second.is_wire()) {
-						// Until we have proper clock tree detection, this really awful hack that opportunistically
-						// propagates prev_* values for clocks can be used to estimate how much faster a design could
-						// be if only one clock edge was simulated by replacing:
-						//   top.p_clk = value<1>{0u}; top.step();
-						//   top.p_clk = value<1>{1u}; top.step();
-						// with:
-						//   top.prev_p_clk = value<1>{0u}; top.p_clk = value<1>{1u}; top.step();
-						// Don't rely on this; it will be removed without warning.
-						if (edge_wires[conn.second.as_wire()] && edge_wires[cell_module_wire]) {
-							f << indent << mangle(cell) << access << "prev_" << mangle(cell_module_wire) << " = ";
-							f << "prev_" << mangle(conn.second.as_wire()) << ";\n";
-						}
-					}
-				}
-			auto assign_from_outputs = [&](bool cell_converged) {
-				for (auto conn : cell->connections()) {
-					if (cell->output(conn.first)) {
-						if (conn.second.empty())
-							continue; // ignore disconnected ports
-						if (is_cxxrtl_sync_port(cell, conn.first))
-							continue; // fully sync ports are handled in CELL_SYNC nodes
-						f << indent;
-						dump_sigspec_lhs(conn.second);
-						f << " = " << mangle(cell) << access << mangle_wire_name(conn.first);
-						// Similarly to how there is no purpose to buffering cell inputs, there is also no purpose to buffering
-						// combinatorial cell outputs in case the cell converges within one cycle. (To convince yourself that
-						// this optimization is valid, consider that, since the cell converged within one cycle, it would not
-						// have any buffered wires if they were not output ports. Imagine inlining the cell's eval() function,
-						// and consider the fate of the localized wires that used to be output ports.)
-						//
-						// It is not possible to know apriori whether the cell (which may be late bound) will converge immediately.
-						// Because of this, the choice between using .curr (appropriate for buffered outputs) and .next (appropriate
-						// for unbuffered outputs) is made at runtime.
-						if (cell_converged && is_cxxrtl_comb_port(cell, conn.first))
-							f << ".next;\n";
-						else
-							f << ".curr;\n";
-					}
-				}
-			};
+			bool buffered_inputs = dump_user_cell_inputs(cell);
 			if (buffered_inputs) {
 				// If we have any buffered inputs, there's no chance of converging immediately.
 				f << indent << mangle(cell) << access << "eval();\n";
 				f << indent << "converged = false;\n";
-				assign_from_outputs(/*cell_converged=*/false);
+				dump_user_cell_outputs(cell, /*cell_converged=*/false);
 			} else {
 				f << indent << "if (" << mangle(cell) << access << "eval()) {\n";
 				inc_indent();
-					assign_from_outputs(/*cell_converged=*/true);
+					dump_user_cell_outputs(cell, /*cell_converged=*/true);
 				dec_indent();
 				f << indent << "} else {\n";
 				inc_indent();
 					f << indent << "converged = false;\n";
-					assign_from_outputs(/*cell_converged=*/false);
+					dump_user_cell_outputs(cell, /*cell_converged=*/false);
 				dec_indent();
 				f << indent << "}\n";
 			}
 		}
 	}
 
+	// Returns true if any of the inputs of the cell are buffered.
+	bool dump_user_cell_inputs(const RTLIL::Cell *cell)
+	{
+		log_assert(cell->known());
+		bool buffered_inputs = false;
+		const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
+		for (auto conn : cell->connections())
+			if (cell->input(conn.first)) {
+				RTLIL::Module *cell_module = cell->module->design->module(cell->type);
+				log_assert(cell_module != nullptr && cell_module->wire(conn.first));
+				RTLIL::Wire *cell_module_wire = cell_module->wire(conn.first);
+				f << indent << mangle(cell) << access << mangle_wire_name(conn.first);
+				if (!is_cxxrtl_blackbox_cell(cell) && wire_types[cell_module_wire].is_buffered()) {
+					buffered_inputs = true;
+					f << ".next";
+				}
+				f << " = ";
+				dump_sigspec_rhs(conn.second);
+				f << ";\n";
+				if (getenv("CXXRTL_VOID_MY_WARRANTY") && conn.second.is_wire()) {
+					// Until we have proper clock tree detection, this really awful hack that opportunistically
+					// propagates prev_* values for clocks can be used to estimate how much faster a design could
+					// be if only one clock edge was simulated by replacing:
+					//   top.p_clk = value<1>{0u}; top.step();
+					//   top.p_clk = value<1>{1u}; top.step();
+					// with:
+					//   top.prev_p_clk = value<1>{0u}; top.p_clk = value<1>{1u}; top.step();
+					// Don't rely on this; it will be removed without warning.
+					if (edge_wires[conn.second.as_wire()] && edge_wires[cell_module_wire]) {
+						f << indent << mangle(cell) << access << "prev_" << mangle(cell_module_wire) << " = ";
+						f << "prev_" << mangle(conn.second.as_wire()) << ";\n";
+					}
+				}
+			}
+		return buffered_inputs;
+	}
+
+	void dump_user_cell_outputs(const RTLIL::Cell *cell, bool cell_converged, bool for_debug = false)
+	{
+		const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
+		for (auto conn : cell->connections()) {
+			if (cell->output(conn.first)) {
+				if (conn.second.empty())
+					continue; // ignore disconnected ports
+				if (is_cxxrtl_sync_port(cell, conn.first))
+					continue; // fully sync ports are handled in CELL_SYNC nodes
+				f << indent;
+				dump_sigspec_lhs(conn.second, for_debug);
+				f << " = " << mangle(cell) << access << mangle_wire_name(conn.first);
+				// Similarly to how there is no purpose to buffering cell inputs, there is also no purpose to buffering
+				// combinatorial cell outputs in case the cell converges within one cycle. (To convince yourself that
+				// this optimization is valid, consider that, since the cell converged within one cycle, it would not
+				// have any buffered wires if they were not output ports. Imagine inlining the cell's eval() function,
+				// and consider the fate of the localized wires that used to be output ports.)
+				//
+				// It is not possible to know apriori whether the cell (which may be late bound) will converge immediately.
+				// Because of this, the choice between using .curr (appropriate for buffered outputs) and .next (appropriate
+				// for unbuffered outputs) is made at runtime.
+				if (cell_converged && is_cxxrtl_comb_port(cell, conn.first))
+					f << ".next;\n";
+				else
+					f << ".curr;\n";
+			}
+		}
+	}
+
+	// Evaluates a group of user cells that do not depend on each other on the thread pool. All inputs are assigned
+	// before any of the cells are evaluated, and all outputs are assigned after all of them have been evaluated.
+	void dump_parallel_cell_evals(const std::vector<const RTLIL::Cell*> &cells)
+	{
+		f << indent << "{\n";
+		inc_indent();
+			std::vector<bool> buffered_inputs;
+			for (auto cell : cells) {
+				std::vector<const RTLIL::Cell*> inlined_cells;
+				collect_cell_eval(cell, /*for_debug=*/false, inlined_cells);
+				dump_inlined_cells(inlined_cells);
+				buffered_inputs.push_back(dump_user_cell_inputs(cell));
+			}
+			f << indent << "module *cells[] = {";
+			for (auto cell : cells)
+				f << (cell == cells.front() ? " " : ", ") << "&" << mangle(cell);
+			f << " };\n";
+			f << indent << "bool cells_converged[" << cells.size() << "];\n";
+			f << indent << "thread_pool::global().run(" << cells.size() << ", [&](size_t index) {\n";
+			inc_indent();
+				f << indent << "cells_converged[index] = cells[index]->eval();\n";
+			dec_indent();
+			f << indent << "});\n";
+			for (size_t index = 0; index < cells.size(); index++) {
+				const RTLIL::Cell *cell = cells[index];
+				if (buffered_inputs[index]) {
+					f << indent << "converged = false;\n";
+					dump_user_cell_outputs(cell, /*cell_converged=*/false);
+				} else {
+					f << indent << "if (cells_converged[" << index << "]) {\n";
+					inc_indent();
+						dump_user_cell_outputs(cell, /*cell_converged=*/true);
+					dec_indent();
+					f << indent << "} else {\n";
+					inc_indent();
+						f << indent << "converged = false;\n";
+						dump_user_cell_outputs(cell, /*cell_converged=*/false);
+					dec_indent();
+					f << indent << "}\n";
+				}
+			}
+		dec_indent();
+		f << indent << "}\n";
+	}
+
 	void collect_cell_eval(const RTLIL::Cell *cell, bool for_debug, std::vector<const RTLIL::Cell*> &cells)
 	{
 		cells.push_back(cell);
@@ -1942,6 +2058,8 @@ struct CxxrtlWorker {
 	{
 		int mem_init_idx = 0;
 		inc_indent();
+			if (activity_inputs.count(module))
+				f << indent << "activity_reset = true;\n";
 			for (auto wire : module->wires()) {
 				const auto &wire_type = wire_types[wire];
 				if (!wire_type.is_named() || wire_type.is_local()) continue;
@@ -1961,6 +2079,11 @@ struct CxxrtlWorker {
 					dump_const(wire_init.at(wire), wire->width);
 					f << ";\n";
 				}
+				if (coverage && coverage_layouts.at(module).wire_offsets.count(wire) && !wire_types[wire].is_buffered()) {
+					f << indent << "toggle_" << mangle(wire) << " = ";
+					dump_const(wire_init.at(wire), wire->width);
+					f << ";\n";
+				}
 			}
 			for (auto &mem : mod_memories[module]) {
 				for (auto &init : mem.inits) {
@@ -2001,6 +2124,52 @@ struct CxxrtlWorker {
 		dec_indent();
 	}
 
+	void dump_eval_node(FlowGraph::Node &node)
+	{
+		switch (node.type) {
+			case FlowGraph::Node::Type::CONNECT:
+				dump_connect(node.connect);
+				break;
+			case FlowGraph::Node::Type::CELL_SYNC:
+				dump_cell_sync(node.cell);
+				break;
+			case FlowGraph::Node::Type::CELL_EVAL:
+				dump_cell_eval(node.cell);
+				break;
+			case FlowGraph::Node::Type::PRINT_SYNC:
+				dump_sync_print(node.print_sync_cells);
+				break;
+			case FlowGraph::Node::Type::PROCESS_CASE:
+				dump_process_case(node.process);
+				break;
+			case FlowGraph::Node::Type::PROCESS_SYNC:
+				dump_process_syncs(node.process);
+				break;
+			case FlowGraph::Node::Type::MEM_RDPORT:
+				dump_mem_rdport(node.mem, node.portidx);
+				break;
+			case FlowGraph::Node::Type::MEM_WRPORTS:
+				dump_mem_wrports(node.mem);
+				break;
+		}
+	}
+
+	std::string mangle_activity_shadow(int group, const RTLIL::Wire *wire)
+	{
+		return "activity_" + std::to_string(group) + "_" + mangle(wire);
+	}
+
+	void dump_activity_guard(RTLIL::Module *module, int group)
+	{
+		// Every shadow must be updated, so the conditions are combined without short-circuiting.
+		f << indent << "if (activity_reset";
+		for (auto wire : activity_inputs.at(module).at(group)) {
+			f << " |\n" << indent << "    " << mangle_activity_shadow(group, wire) << ".update(";
+			f << mangle(wire) << (wire_types[wire].is_buffered() ? ".curr" : "") << ")";
+		}
+		f << ") {\n";
+	}
+
 	void dump_eval_method(RTLIL::Module *module)
 	{
 		inc_indent();
@@ -2024,34 +2193,37 @@ struct CxxrtlWorker {
 				}
 				for (auto wire : module->wires())
 					dump_wire(wire, /*is_local=*/true);
-				for (auto node : schedule[module]) {
-					switch (node.type) {
-						case FlowGraph::Node::Type::CONNECT:
-							dump_connect(node.connect);
-							break;
-						case FlowGraph::Node::Type::CELL_SYNC:
-							dump_cell_sync(node.cell);
-							break;
-						case FlowGraph::Node::Type::CELL_EVAL:
-							dump_cell_eval(node.cell);
-							break;
-						case FlowGraph::Node::Type::PRINT_SYNC:
-							dump_sync_print(node.print_sync_cells);
-							break;
-						case FlowGraph::Node::Type::PROCESS_CASE:
-							dump_process_case(node.process);
-							break;
-						case FlowGraph::Node::Type::PROCESS_SYNC:
-							dump_process_syncs(node.process);
-							break;
-						case FlowGraph::Node::Type::MEM_RDPORT:
-							dump_mem_rdport(node.mem, node.portidx);
-							break;
-						case FlowGraph::Node::Type::MEM_WRPORTS:
-							dump_mem_wrports(node.mem);
-							break;
+				auto &nodes = schedule[module];
+				for (size_t index = 0; index < nodes.size(); index++) {
+					if (schedule_activity_groups.count(module) && schedule_activity_groups[module][index] != -1) {
+						auto &groups = schedule_activity_groups[module];
+						int group = groups[index];
+						dump_activity_guard(module, group);
+						inc_indent();
+							while (index < nodes.size() && groups[index] == group)
+								dump_eval_node(nodes[index++]);
+							index--;
+						dec_indent();
+						f << indent << "}\n";
+						continue;
+					}
+					auto &node = nodes[index];
+					if (node.type == FlowGraph::Node::Type::CELL_EVAL && parallel_eval_levels.count(node.cell)) {
+						std::vector<const RTLIL::Cell*> cells;
+						int level = parallel_eval_levels.at(node.cell);
+						while (index < nodes.size() &&
+						       nodes[index].type == FlowGraph::Node::Type::CELL_EVAL &&
+						       parallel_eval_levels.count(nodes[index].cell) &&
+						       parallel_eval_levels.at(nodes[index].cell) == level)
+							cells.push_back(nodes[index++].cell);
+						index--;
+						dump_parallel_cell_evals(cells);
+						continue;
 					}
+					dump_eval_node(node);
 				}
+				if (activity_inputs.count(module))
+					f << indent << "activity_reset = false;\n";
 			}
 			f << indent << "return converged;\n";
 		dec_indent();
@@ -2098,6 +2270,17 @@ struct CxxrtlWorker {
 			f << indent << "bool changed = false;\n";
 			for (auto wire : module->wires()) {
 				const auto &wire_type = wire_types[wire];
+				if (coverage && coverage_layouts.at(module).wire_offsets.count(wire)) {
+					size_t offset = coverage_layouts.at(module).wire_offsets.at(wire);
+					if (wire_type.is_buffered()) {
+						f << indent << "count_toggles(coverage + " << offset << ", ";
+						f << mangle(wire) << ".curr, " << mangle(wire) << ".next);\n";
+					} else {
+						f << indent << "count_toggles(coverage + " << offset << ", ";
+						f << "toggle_" << mangle(wire) << ", " << mangle(wire) << ");\n";
+						f << indent << "toggle_" << mangle(wire) << " = " << mangle(wire) << ";\n";
+					}
+				}
 				if (wire_type.type == WireType::MEMBER && edge_wires[wire])
 					f << indent << "prev_" << mangle(wire) << " = " << mangle(wire) << ";\n";
 				if (wire_type.is_buffered())
@@ -2109,8 +2292,29 @@ struct CxxrtlWorker {
 						continue;
 					f << indent << "if (" << mangle(&mem) << ".commit()) changed = true;\n";
 				}
+				pool<const RTLIL::Cell*> parallel_cells;
+				if (parallel_commit_cells.count(module)) {
+					const auto &cells = parallel_commit_cells.at(module);
+					parallel_cells.insert(cells.begin(), cells.end());
+					f << indent << "{\n";
+					inc_indent();
+						f << indent << "module *cells[] = {";
+						for (auto cell : cells)
+							f << (cell == cells.front() ? " " : ", ") << "&" << mangle(cell);
+						f << " };\n";
+						f << indent << "bool cells_changed[" << cells.size() << "];\n";
+						f << indent << "thread_pool::global().run(" << cells.size() << ", [&](size_t index) {\n";
+						inc_indent();
+							f << indent << "cells_changed[index] = cells[index]->commit();\n";
+						dec_indent();
+						f << indent << "});\n";
+						f << indent << "for (bool cell_changed : cells_changed)\n";
+						f << indent << "\tif (cell_changed) changed = true;\n";
+					dec_indent();
+					f << indent << "}\n";
+				}
 				for (auto cell : module->cells()) {
-					if (is_internal_cell(cell->type))
+					if (is_internal_cell(cell->type) || parallel_cells.count(cell))
 						continue;
 					const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
 					f << indent << "if (" << mangle(cell) << access << "commit()) changed = true;\n";
@@ -2120,6 +2324,65 @@ struct CxxrtlWorker {
 		dec_indent();
 	}
 
+	void dump_visit_state_method(RTLIL::Module *module)
+	{
+		inc_indent();
+			for (auto wire : module->wires()) {
+				const auto &wire_type = wire_types[wire];
+				if (!wire_type.is_named() || wire_type.is_local()) continue;
+				if (module->get_bool_attribute(ID(cxxrtl_blackbox)) && wire->port_id == 0) continue;
+				f << indent << "visitor(" << mangle(wire) << ", " << state_name(wire) << ");\n";
+				if (edge_wires[wire] && !wire_type.is_buffered())
+					f << indent << "visitor(prev_" << mangle(wire) << ", " << state_name(wire) << ");\n";
+			}
+			if (!module->get_bool_attribute(ID(cxxrtl_blackbox))) {
+				for (auto &mem : mod_memories[module]) {
+					f << indent << "visitor(" << mangle(&mem) << ", ";
+					f << (mem.packed ? state_name(mem.cell) : state_name(mem.mem)) << ");\n";
+				}
+				for (auto cell : module->cells()) {
+					if (cell->type == ID($print) && !cell->getParam(ID::TRG_ENABLE).as_bool())
+						f << indent << "visitor(" << mangle(cell) << ", " << state_name(cell) << ");\n";
+					if (is_internal_cell(cell->type))
+						continue;
+					const char *access = is_cxxrtl_blackbox_cell(cell) ? "->" : ".";
+					f << indent << "visitor.enter(" << state_name(cell) << ");\n";
+					f << indent << mangle(cell) << access << "visit_state(visitor);\n";
+					f << indent << "visitor.leave(" << state_name(cell) << ");\n";
+				}
+			}
+		dec_indent();
+	}
+
+	void dump_bind_coverage_method(RTLIL::Module *module)
+	{
+		inc_indent();
+			f << indent << "coverage = counters;\n";
+			for (auto &it : coverage_layouts.at(module).submodule_offsets)
+				f << indent << mangle(it.first) << ".bind_coverage(counters + " << it.second << ");\n";
+		dec_indent();
+	}
+
+	void dump_coverage_info_method(RTLIL::Module *module)
+	{
+		const auto &layout = coverage_layouts.at(module);
+		inc_indent();
+			for (auto &it : layout.wire_offsets) {
+				f << indent << "add_coverage_points(points, coverage_point::TOGGLE, path + " << state_name(it.first) << ", ";
+				f << it.first->width << ", offset + " << it.second << ");\n";
+			}
+			for (auto &it : layout.cell_offsets) {
+				const char *type = it.first->type == ID($cover) ? "COVER" : "MUX";
+				f << indent << "add_coverage_points(points, coverage_point::" << type << ", path + " << state_name(it.first) << ", ";
+				f << coverage_cell_points(it.first) << ", offset + " << it.second << ");\n";
+			}
+			for (auto &it : layout.submodule_offsets) {
+				f << indent << mangle(it.first) << ".coverage_info(points, path + ";
+				f << escape_cxx_string(get_hdl_name(it.first) + ' ') << ", offset + " << it.second << ");\n";
+			}
+		dec_indent();
+	}
+
 	void dump_metadata_map(const dict<RTLIL::IdString, RTLIL::Const> &metadata_map)
 	{
 		if (metadata_map.empty()) {
@@ -2361,6 +2624,10 @@ struct CxxrtlWorker {
 				dump_commit_method(module);
 				f << indent << "}\n";
 				f << "\n";
+				f << indent << "void visit_state(state_visitor &visitor) override {\n";
+				dump_visit_state_method(module);
+				f << indent << "}\n";
+				f << "\n";
 				if (debug_info) {
 					f << indent << "void debug_info(debug_items &items, std::string path = \"\") override {\n";
 					dump_debug_info_method(module);
@@ -2435,9 +2702,30 @@ struct CxxrtlWorker {
 				}
 				if (has_cells)
 					f << "\n";
+				if (activity_inputs.count(module)) {
+					f << indent << "bool activity_reset = true;\n";
+					const auto &groups = activity_inputs.at(module);
+					for (int group = 0; group < GetSize(groups); group++)
+						for (auto wire : groups[group])
+							f << indent << "shadow<" << wire->width << "> " << mangle_activity_shadow(group, wire) << ";\n";
+					f << "\n";
+				}
+				if (coverage) {
+					// Only the toplevel module allocates the counters; submodules are bound to a part of them.
+					f << indent << "uint64_t *coverage = nullptr;\n";
+					f << indent << "std::unique_ptr<uint64_t[]> coverage_storage;\n";
+					for (auto &it : coverage_layouts.at(module).wire_offsets)
+						if (!wire_types[it.first].is_buffered())
+							f << indent << "value<" << it.first->width << "> toggle_" << mangle(it.first) << ";\n";
+					f << "\n";
+				}
 				f << indent << mangle(module) << "(interior) {}\n";
 				f << indent << mangle(module) << "() {\n";
 				inc_indent();
+					if (coverage) {
+						f << indent << "coverage_storage.reset(new uint64_t[" << coverage_layouts.at(module).size << "]());\n";
+						f << indent << "bind_coverage(coverage_storage.get());\n";
+					}
 					f << indent << "reset();\n";
 				dec_indent();
 				f << indent << "};\n";
@@ -2445,6 +2733,19 @@ struct CxxrtlWorker {
 				f << indent << "void reset() override;\n";
 				f << indent << "bool eval() override;\n";
 				f << indent << "bool commit() override;\n";
+				f << indent << "void visit_state(state_visitor &visitor) override;\n";
+				if (coverage) {
+					f << "\n";
+					f << indent << "void bind_coverage(uint64_t *counters);\n";
+					f << indent << "size_t coverage_size() const override {\n";
+					f << indent << "\treturn " << coverage_layouts.at(module).size << ";\n";
+					f << indent << "}\n";
+					f << indent << "uint64_t *coverage_counters() override {\n";
+					f << indent << "\treturn coverage;\n";
+					f << indent << "}\n";
+					f << indent << "void coverage_info(std::vector<coverage_point> &points, std::string path = \"\", ";
+					f << "size_t offset = 0) override;\n";
+				}
 				if (debug_info) {
 					if (debug_eval) {
 						f << "\n";
@@ -2481,6 +2782,22 @@ struct CxxrtlWorker {
 		dump_commit_method(module);
 		f << indent << "}\n";
 		f << "\n";
+		f << indent << "void " << mangle(module) << "::visit_state(state_visitor &visitor) {\n";
+		dump_visit_state_method(module);
+		f << indent << "}\n";
+		f << "\n";
+		if (coverage) {
+			f << indent << "void " << mangle(module) << "::bind_coverage(uint64_t *counters) {\n";
+			dump_bind_coverage_method(module);
+			f << indent << "}\n";
+			f << "\n";
+			f << indent << "CXXRTL_EXTREMELY_COLD\n";
+			f << indent << "void " << mangle(module) << "::coverage_info(std::vector<coverage_point> &points, ";
+			f << "std::string path, size_t offset) {\n";
+			dump_coverage_info_method(module);
+			f << indent << "}\n";
+			f << "\n";
+		}
 		if (debug_info) {
 			if (debug_eval) {
 				f << indent << "void " << mangle(module) << "::debug_eval() {\n";
@@ -2527,46 +2844,13 @@ struct CxxrtlWorker {
 		log_assert(no_loops);
 		modules.insert(modules.end(), topo_design.sorted.begin(), topo_design.sorted.end());
 
-		if (split_intf) {
-			// The only thing more depraved than include guards, is mangling filenames to turn them into include guards.
-			std::string include_guard = design_ns + "_header";
-			std::transform(include_guard.begin(), include_guard.end(), include_guard.begin(), ::toupper);
+		if (!split_dir.empty()) {
+			dump_split_design(modules, top_module, has_prints);
+			return;
+		}
 
-			f << "#ifndef " << include_guard << "\n";
-			f << "#define " << include_guard << "\n";
-			f << "\n";
-			if (top_module != nullptr && debug_info) {
-				f << "#include <backends/cxxrtl/cxxrtl_capi.h>\n";
-				f << "\n";
-				f << "#ifdef __cplusplus\n";
-				f << "extern \"C\" {\n";
-				f << "#endif\n";
-				f << "\n";
-				f << "cxxrtl_toplevel " << design_ns << "_create();\n";
-				f << "\n";
-				f << "#ifdef __cplusplus\n";
-				f << "}\n";
-				f << "#endif\n";
-				f << "\n";
-			} else {
-				f << "// The CXXRTL C API is not available because the design is built without debug information.\n";
-				f << "\n";
-			}
-			f << "#ifdef __cplusplus\n";
-			f << "\n";
-			f << "#include <backends/cxxrtl/cxxrtl.h>\n";
-			f << "\n";
-			f << "using namespace cxxrtl;\n";
-			f << "\n";
-			f << "namespace " << design_ns << " {\n";
-			f << "\n";
-			for (auto module : modules)
-				dump_module_intf(module);
-			f << "} // namespace " << design_ns << "\n";
-			f << "\n";
-			f << "#endif // __cplusplus\n";
-			f << "\n";
-			f << "#endif\n";
+		if (split_intf) {
+			dump_design_intf(modules, top_module);
 			*intf_f << f.str(); f.str("");
 		}
 
@@ -2576,16 +2860,10 @@ struct CxxrtlWorker {
 			f << "#include <backends/cxxrtl/cxxrtl.h>\n";
 		if (has_prints)
 			f << "#include <iostream>\n";
+		if (has_parallel_groups())
+			f << "#include <backends/cxxrtl/cxxrtl_parallel.h>\n";
 		f << "\n";
-		f << "#if defined(CXXRTL_INCLUDE_CAPI_IMPL) || \\\n";
-		f << "    defined(CXXRTL_INCLUDE_VCD_CAPI_IMPL)\n";
-		f << "#include <backends/cxxrtl/cxxrtl_capi.cc>\n";
-		f << "#endif\n";
-		f << "\n";
-		f << "#if defined(CXXRTL_INCLUDE_VCD_CAPI_IMPL)\n";
-		f << "#include <backends/cxxrtl/cxxrtl_vcd_capi.cc>\n";
-		f << "#endif\n";
-		f << "\n";
+		dump_capi_impl_includes();
 		f << "using namespace cxxrtl_yosys;\n";
 		f << "\n";
 		f << "namespace " << design_ns << " {\n";
@@ -2597,6 +2875,74 @@ struct CxxrtlWorker {
 		}
 		f << "} // namespace " << design_ns << "\n";
 		f << "\n";
+		dump_toplevel_create(top_module);
+
+		*impl_f << f.str(); f.str("");
+	}
+
+	void dump_design_intf(const std::vector<RTLIL::Module*> &modules, RTLIL::Module *top_module)
+	{
+		// The only thing more depraved than include guards, is mangling filenames to turn them into include guards.
+		std::string include_guard = design_ns + "_header";
+		std::transform(include_guard.begin(), include_guard.end(), include_guard.begin(), ::toupper);
+
+		f << "#ifndef " << include_guard << "\n";
+		f << "#define " << include_guard << "\n";
+		f << "\n";
+		if (top_module != nullptr && debug_info) {
+			f << "#include <backends/cxxrtl/cxxrtl_capi.h>\n";
+			f << "\n";
+			f << "#ifdef __cplusplus\n";
+			f << "extern \"C\" {\n";
+			f << "#endif\n";
+			f << "\n";
+			f << "cxxrtl_toplevel " << design_ns << "_create();\n";
+			f << "\n";
+			f << "#ifdef __cplusplus\n";
+			f << "}\n";
+			f << "#endif\n";
+			f << "\n";
+		} else {
+			f << "// The CXXRTL C API is not available because the design is built without debug information.\n";
+			f << "\n";
+		}
+		f << "#ifdef __cplusplus\n";
+		f << "\n";
+		f << "#include <backends/cxxrtl/cxxrtl.h>\n";
+		f << "\n";
+		f << "using namespace cxxrtl;\n";
+		f << "\n";
+		f << "namespace " << design_ns << " {\n";
+		f << "\n";
+		for (auto module : modules)
+			dump_module_intf(module);
+		f << "} // namespace " << design_ns << "\n";
+		f << "\n";
+		f << "#endif // __cplusplus\n";
+		f << "\n";
+		f << "#endif\n";
+	}
+
+	void dump_capi_impl_includes()
+	{
+		f << "#if defined(CXXRTL_INCLUDE_CAPI_IMPL) || \\\n";
+		f << "    defined(CXXRTL_INCLUDE_VCD_CAPI_IMPL) || \\\n";
+		f << "    defined(CXXRTL_INCLUDE_FST_CAPI_IMPL)\n";
+		f << "#include <backends/cxxrtl/cxxrtl_capi.cc>\n";
+		f << "#endif\n";
+		f << "\n";
+		f << "#if defined(CXXRTL_INCLUDE_VCD_CAPI_IMPL)\n";
+		f << "#include <backends/cxxrtl/cxxrtl_vcd_capi.cc>\n";
+		f << "#endif\n";
+		f << "\n";
+		f << "#if defined(CXXRTL_INCLUDE_FST_CAPI_IMPL)\n";
+		f << "#include <backends/cxxrtl/cxxrtl_fst_capi.cc>\n";
+		f << "#endif\n";
+		f << "\n";
+	}
+
+	void dump_toplevel_create(RTLIL::Module *top_module)
+	{
 		if (top_module != nullptr && debug_info) {
 			f << "extern \"C\"\n";
 			f << "cxxrtl_toplevel " << design_ns << "_create() {\n";
@@ -2608,8 +2954,101 @@ struct CxxrtlWorker {
 			dec_indent();
 			f << "}\n";
 		}
+	}
 
-		*impl_f << f.str(); f.str("");
+	// Files written by -split are left alone if their contents did not change, so that build systems only
+	// recompile the translation units of modules that actually changed.
+	void write_split_file(const std::string &name, const std::string &contents)
+	{
+		std::string filename = split_dir + "/" + name;
+
+		std::ifstream old_f(filename, std::ifstream::binary);
+		if (old_f.is_open()) {
+			std::stringstream old_contents;
+			old_contents << old_f.rdbuf();
+			if (old_contents.str() == contents) {
+				split_files_unchanged++;
+				return;
+			}
+		}
+		old_f.close();
+
+		std::ofstream new_f(filename, std::ofstream::binary | std::ofstream::trunc);
+		if (new_f.fail())
+			log_cmd_error("Can't open file `%s' for writing: %s\n", filename.c_str(), strerror(errno));
+		new_f << contents;
+		split_files_written++;
+	}
+
+	std::string split_file_name(const RTLIL::Module *module)
+	{
+		// Names of parametric modules can get very long; keep them within the limits of common file systems.
+		std::string name = design_ns + "_" + mangle(module);
+		if (name.size() > 120)
+			name = name.substr(0, 110) + stringf("_%08x", hash_ops<std::string>::hash(name));
+		return name + ".cc";
+	}
+
+	// Writes the design as separate translation units that can be compiled in parallel: a header with the
+	// interfaces of all modules, one source file per module (or per chunk of at least split_size bytes of
+	// code), a source file with the C API entry point, and a Makefile fragment listing all of the sources.
+	void dump_split_design(const std::vector<RTLIL::Module*> &modules, RTLIL::Module *top_module, bool has_prints)
+	{
+		std::string intf_name = design_ns + ".h";
+		dump_design_intf(modules, top_module);
+		write_split_file(intf_name, f.str()); f.str("");
+
+		std::vector<std::string> sources;
+
+		f << "#include \"" << intf_name << "\"\n";
+		f << "\n";
+		dump_capi_impl_includes();
+		dump_toplevel_create(top_module);
+		sources.push_back(design_ns + ".cc");
+		write_split_file(sources.back(), f.str()); f.str("");
+
+		std::string prologue = "#include \"" + intf_name + "\"\n";
+		if (has_prints)
+			prologue += "#include <iostream>\n";
+		if (has_parallel_groups())
+			prologue += "#include <backends/cxxrtl/cxxrtl_parallel.h>\n";
+		prologue += "\nusing namespace cxxrtl_yosys;\n\nnamespace " + design_ns + " {\n\n";
+		std::string epilogue = "} // namespace " + design_ns + "\n";
+
+		std::string chunk, chunk_name;
+		for (auto module : modules) {
+			if (module->get_bool_attribute(ID(cxxrtl_blackbox)))
+				continue;
+			dump_module_impl(module);
+			if (chunk_name.empty())
+				chunk_name = split_file_name(module);
+			chunk += f.str(); f.str("");
+			if (GetSize(chunk) >= split_size) {
+				sources.push_back(chunk_name);
+				write_split_file(chunk_name, prologue + chunk + epilogue);
+				chunk.clear();
+				chunk_name.clear();
+			}
+		}
+		if (!chunk.empty()) {
+			sources.push_back(chunk_name);
+			write_split_file(chunk_name, prologue + chunk + epilogue);
+		}
+
+		std::string var = design_ns;
+		f << "# Generated by write_cxxrtl -split. Include this file from a Makefile, then compile\n";
+		f << "# $(" << var << "_SRCS) with -I$(yosys-config --datdir)/include and link $(" << var << "_OBJS).\n";
+		f << var << "_DIR := $(patsubst %/,%,$(dir $(lastword $(MAKEFILE_LIST))))\n";
+		f << var << "_SRCS := $(addprefix $(" << var << "_DIR)/,";
+		for (auto &source : sources)
+			f << " \\\n\t" << source;
+		f << ")\n";
+		f << var << "_OBJS := $(" << var << "_SRCS:.cc=.o)\n";
+		f << "$(" << var << "_OBJS): $(" << var << "_DIR)/" << intf_name << "\n";
+		write_split_file(design_ns + ".mk", f.str()); f.str("");
+
+		log("Wrote %d of %d files to `%s' (%d unchanged).\n", split_files_written,
+		    split_files_written + split_files_unchanged, split_dir.c_str(), split_files_unchanged);
 	}
 
 	// Edge-type sync rules require us to emit edge detectors, which require coordination between
@@ -2637,6 +3076,80 @@ struct CxxrtlWorker {
 		edge_wires.insert(sigbit.wire);
 	}
 
+	// A submodule instance may be evaluated concurrently with other instances if its eval() and commit() only touch
+	// its own state. This excludes black boxes, whose implementation is unknown, and modules that (possibly through
+	// their own submodules) contain $print cells, whose output must appear in a deterministic order.
+	bool is_parallel_safe_module(RTLIL::Module *module)
+	{
+		if (parallel_safe_modules.count(module))
+			return parallel_safe_modules.at(module);
+		bool safe = !module->get_bool_attribute(ID(cxxrtl_blackbox));
+		for (auto cell : module->cells()) {
+			if (!safe)
+				break;
+			if (cell->type == ID($print))
+				safe = false;
+			else if (!is_internal_cell(cell->type)) {
+				RTLIL::Module *cell_module = module->design->module(cell->type);
+				safe = cell_module != nullptr && is_parallel_safe_module(cell_module);
+			}
+		}
+		parallel_safe_modules[module] = safe;
+		return safe;
+	}
+
+	bool is_parallel_safe_cell(const RTLIL::Cell *cell)
+	{
+		if (is_internal_cell(cell->type))
+			return false;
+		RTLIL::Module *cell_module = cell->module->design->module(cell->type);
+		return cell_module != nullptr && is_parallel_safe_module(cell_module);
+	}
+
+	static size_t coverage_cell_points(const RTLIL::Cell *cell)
+	{
+		if (cell->type == ID($pmux))
+			return cell->getParam(ID::S_WIDTH).as_int() + 1;
+		if (cell->type == ID($mux))
+			return 2;
+		log_assert(cell->type == ID($cover));
+		return 1;
+	}
+
+	void compute_coverage_layout(RTLIL::Module *module)
+	{
+		if (coverage_layouts.count(module))
+			return;
+		CoverageLayout layout;
+		if (!module->get_bool_attribute(ID(cxxrtl_blackbox))) {
+			for (auto wire : module->wires())
+				if (wire->name.isPublic() && wire_types[wire].is_member()) {
+					layout.wire_offsets[wire] = layout.size;
+					layout.size += wire->width;
+				}
+			for (auto cell : module->cells())
+				if (cell->type.in(ID($mux), ID($pmux), ID($cover))) {
+					layout.cell_offsets[cell] = layout.size;
+					layout.size += coverage_cell_points(cell);
+				}
+			for (auto cell : module->cells()) {
+				if (is_internal_cell(cell->type) || is_cxxrtl_blackbox_cell(cell))
+					continue;
+				RTLIL::Module *cell_module = module->design->module(cell->type);
+				log_assert(cell_module != nullptr);
+				compute_coverage_layout(cell_module);
+				layout.submodule_offsets[cell] = layout.size;
+				layout.size += coverage_layouts.at(cell_module).size;
+			}
+		}
+		coverage_layouts[module] = layout;
+	}
+
+	bool has_parallel_groups() const
+	{
+		return !parallel_eval_levels.empty() || !parallel_commit_cells.empty();
+	}
+
 	void analyze_design(RTLIL::Design *design)
 	{
 		bool has_feedback_arcs = false;
@@ -2875,6 +3388,8 @@ struct CxxrtlWorker {
 			for (auto node : flow.nodes) {
 				if (node->type == FlowGraph::Node::Type::CELL_EVAL && is_effectful_cell(node->cell->type))
 					worklist.insert(node); // node has effects
+				else if (node->type == FlowGraph::Node::Type::CELL_EVAL && coverage && node->cell->type == ID($cover))
+					worklist.insert(node); // node counts coverage
 				else if (node->type == FlowGraph::Node::Type::PRINT_SYNC)
 					worklist.insert(node); // node is sync $print
 				else if (node->type == FlowGraph::Node::Type::MEM_WRPORTS)
@@ -2932,23 +3447,249 @@ struct CxxrtlWorker {
 				}
 			}
 
+			// If the module has several submodule instances that may be evaluated concurrently, reorder the nodes so that
+			// the instances that do not depend on each other end up next to each other. Each node is assigned a level
+			// one higher than that of any earlier node driving the wires it uses (inlined nodes included, since their
+			// inputs are read at the point of use), and the nodes are then stably sorted by level. Nodes with effects
+			// other than driving wires are kept in their original relative order.
+			std::vector<FlowGraph::Node*> eval_order = node_order;
+			dict<FlowGraph::Node*, int, hash_ptr_ops> node_levels;
+			if (parallel) {
+				auto is_parallel_node = [&](FlowGraph::Node *node) {
+					return node->type == FlowGraph::Node::Type::CELL_EVAL && is_parallel_safe_cell(node->cell);
+				};
+				int parallel_nodes = 0;
+				for (auto node : node_order)
+					if (live_nodes[node] && is_parallel_node(node))
+						parallel_nodes++;
+				if (parallel_nodes > 1) {
+					int effect_level = 0;
+					for (auto node : node_order) {
+						int level = 0;
+						for (auto wire : flow.node_uses[node])
+							for (auto pred_node : flow.wire_comb_defs[wire])
+								if (node_levels.count(pred_node))
+									level = std::max(level, node_levels.at(pred_node) + 1);
+						if (node->type == FlowGraph::Node::Type::CELL_EVAL &&
+						    is_effectful_cell(node->cell->type) && !is_parallel_node(node))
+							level = effect_level = std::max(level, effect_level);
+						node_levels[node] = level;
+					}
+					std::stable_sort(eval_order.begin(), eval_order.end(),
+						[&](FlowGraph::Node *a, FlowGraph::Node *b) {
+							return std::make_pair(node_levels.at(a), !is_parallel_node(a)) <
+							       std::make_pair(node_levels.at(b), !is_parallel_node(b));
+						});
+
+					// Only runs of at least two instances are worth dispatching to the thread pool.
+					std::vector<const RTLIL::Cell*> group;
+					int group_level = -1, group_count = 0, group_cells = 0;
+					auto flush_group = [&]() {
+						if (group.size() > 1) {
+							for (auto cell : group)
+								parallel_eval_levels[cell] = group_level;
+							group_count++;
+							group_cells += group.size();
+						}
+						group.clear();
+					};
+					for (auto node : eval_order) {
+						if (!live_nodes[node])
+							continue;
+						if (!is_parallel_node(node) || node_levels.at(node) != group_level)
+							flush_group();
+						if (is_parallel_node(node)) {
+							group_level = node_levels.at(node);
+							group.push_back(node->cell);
+						}
+					}
+					flush_group();
+					if (group_count > 0)
+						log("Module `%s' evaluates %d submodule instances in %d parallel groups.\n",
+						    log_id(module), group_cells, group_count);
+				}
+
+				for (auto cell : module->cells())
+					if (is_parallel_safe_cell(cell))
+						parallel_commit_cells[module].push_back(cell);
+				if (parallel_commit_cells[module].size() < 2)
+					parallel_commit_cells.erase(module);
+			}
+
+			// If requested, split the combinatorial logic into activity groups, each of which is evaluated only if any
+			// of its inputs changed since the last time it was evaluated. Nodes that are connected through local wires
+			// must be in the same group, since local wires do not retain their value between evaluations; local wires
+			// that are used outside of their group are turned into members for the same reason. Each group is emitted
+			// at the position of its last node, so a group is only formed if none of the wires it drives are used
+			// by other nodes between its first and last node.
+			dict<FlowGraph::Node*, int, hash_ptr_ops> node_activity_groups;
+			std::vector<std::vector<FlowGraph::Node*>> activity_group_nodes;
+			if (activity) {
+				auto is_activity_node = [&](FlowGraph::Node *node) {
+					switch (node->type) {
+						case FlowGraph::Node::Type::CONNECT:
+						case FlowGraph::Node::Type::PROCESS_CASE:
+							break;
+						case FlowGraph::Node::Type::CELL_EVAL:
+							if (!is_internal_cell(node->cell->type) || is_effectful_cell(node->cell->type) ||
+							    is_ff_cell(node->cell->type) || node->cell->type == ID($cover))
+								return false;
+							break;
+						default:
+							return false;
+					}
+					// A wire that is buffered may have other drivers, and must be driven on every evaluation.
+					for (auto wire : flow.node_comb_defs[node])
+						if (wire_types[wire].is_buffered())
+							return false;
+					return true;
+				};
+
+				// Inlined nodes are evaluated at the point of use, so their inputs are inputs of the node using them.
+				std::function<void(FlowGraph::Node*, pool<const RTLIL::Wire*>&)> collect_inputs =
+					[&](FlowGraph::Node *node, pool<const RTLIL::Wire*> &inputs) {
+						for (auto wire : flow.node_uses[node]) {
+							if (wire_types[wire].type == WireType::INLINE) {
+								for (auto def_node : flow.wire_comb_defs[wire])
+									collect_inputs(def_node, inputs);
+							} else {
+								inputs.insert(wire);
+							}
+						}
+					};
+				std::vector<FlowGraph::Node*> live_order;
+				dict<FlowGraph::Node*, int, hash_ptr_ops> node_positions;
+				dict<FlowGraph::Node*, pool<const RTLIL::Wire*>, hash_ptr_ops> node_inputs;
+				dict<const RTLIL::Wire*, pool<FlowGraph::Node*, hash_ptr_ops>> wire_readers;
+				for (auto node : eval_order) {
+					if (!live_nodes[node])
+						continue;
+					node_positions[node] = GetSize(live_order);
+					live_order.push_back(node);
+					collect_inputs(node, node_inputs[node]);
+					for (auto wire : node_inputs[node])
+						wire_readers[wire].insert(node);
+				}
+
+				dict<FlowGraph::Node*, FlowGraph::Node*, hash_ptr_ops> group_roots;
+				auto find_root = [&](FlowGraph::Node *node) {
+					while (group_roots.at(node) != node)
+						node = group_roots.at(node);
+					return node;
+				};
+				for (auto node : live_order)
+					if (is_activity_node(node))
+						group_roots[node] = node;
+				for (auto node : live_order) {
+					if (!group_roots.count(node))
+						continue;
+					for (auto wire : node_inputs[node]) {
+						if (wire_types[wire].type != WireType::LOCAL)
+							continue;
+						for (auto def_node : flow.wire_comb_defs[wire]) {
+							if (!group_roots.count(def_node))
+								continue;
+							FlowGraph::Node *root = find_root(node), *def_root = find_root(def_node);
+							if (root != def_root)
+								group_roots[root] = def_root;
+						}
+					}
+				}
+				std::vector<FlowGraph::Node*> group_order;
+				dict<FlowGraph::Node*, std::vector<FlowGraph::Node*>, hash_ptr_ops> root_nodes;
+				for (auto node : live_order) {
+					if (!group_roots.count(node))
+						continue;
+					FlowGraph::Node *root = find_root(node);
+					if (!root_nodes.count(root))
+						group_order.push_back(root);
+					root_nodes[root].push_back(node);
+				}
+
+				int grouped_nodes = 0;
+				for (auto root : group_order) {
+					const auto &nodes = root_nodes.at(root);
+					pool<FlowGraph::Node*, hash_ptr_ops> members(nodes.begin(), nodes.end());
+					int last_position = node_positions.at(nodes.back());
+					// Groups consisting only of connections do not have enough work to be worth skipping.
+					bool has_logic = false, can_move = true;
+					for (auto node : nodes) {
+						if (node->type != FlowGraph::Node::Type::CONNECT)
+							has_logic = true;
+						for (auto wire : flow.node_comb_defs[node])
+							for (auto reader : wire_readers[wire])
+								if (!members.count(reader) && node_positions.at(reader) < last_position)
+									can_move = false;
+					}
+					if (!has_logic || !can_move)
+						continue;
+
+					std::vector<const RTLIL::Wire*> inputs;
+					pool<const RTLIL::Wire*> seen_inputs;
+					for (auto node : nodes)
+						for (auto wire : node_inputs[node]) {
+							bool driven_inside = !flow.wire_comb_defs[wire].empty();
+							for (auto def_node : flow.wire_comb_defs[wire])
+								if (!members.count(def_node))
+									driven_inside = false;
+							if (!driven_inside && !seen_inputs.count(wire)) {
+								seen_inputs.insert(wire);
+								inputs.push_back(wire);
+							}
+						}
+					for (auto node : nodes)
+						for (auto wire : flow.node_comb_defs[node]) {
+							if (wire_types[wire].type != WireType::LOCAL)
+								continue;
+							for (auto reader : wire_readers[wire])
+								if (!members.count(reader))
+									wire_types[wire] = {WireType::MEMBER};
+						}
+
+					int group = GetSize(activity_group_nodes);
+					for (auto node : nodes)
+						node_activity_groups[node] = group;
+					activity_group_nodes.push_back(nodes);
+					activity_inputs[module].push_back(inputs);
+					grouped_nodes += GetSize(nodes);
+				}
+				if (!activity_group_nodes.empty())
+					log("Module `%s' evaluates %d nodes in %d activity groups.\n",
+					    log_id(module), grouped_nodes, GetSize(activity_group_nodes));
+			}
+
 			// Emit reachable nodes in eval().
 			// Accumulate sync $print cells per trigger condition.
 			dict<std::pair<RTLIL::SigSpec, RTLIL::Const>, std::vector<const RTLIL::Cell*>> sync_print_cells;
-			for (auto node : node_order)
+			std::vector<int> schedule_groups;
+			for (auto node : eval_order)
 				if (live_nodes[node]) {
-					if (node->type == FlowGraph::Node::Type::CELL_EVAL &&
+					if (node_activity_groups.count(node)) {
+						// The nodes of an activity group are emitted together, in place of its last node.
+						int group = node_activity_groups.at(node);
+						if (node != activity_group_nodes[group].back())
+							continue;
+						for (auto group_node : activity_group_nodes[group]) {
+							schedule[module].push_back(*group_node);
+							schedule_groups.push_back(group);
+						}
+					} else if (node->type == FlowGraph::Node::Type::CELL_EVAL &&
 					    node->cell->type == ID($print) &&
-					    node->cell->getParam(ID::TRG_ENABLE).as_bool())
+					    node->cell->getParam(ID::TRG_ENABLE).as_bool()) {
 						sync_print_cells[make_pair(node->cell->getPort(ID::TRG), node->cell->getParam(ID::TRG_POLARITY))].push_back(node->cell);
-					else
+					} else {
 						schedule[module].push_back(*node);
+						schedule_groups.push_back(-1);
+					}
 				}
 
 			for (auto &it : sync_print_cells) {
 				auto node = flow.add_print_sync_node(it.second);
 				schedule[module].push_back(*node);
+				schedule_groups.push_back(-1);
 			}
+			if (!activity_group_nodes.empty())
+				schedule_activity_groups[module] = schedule_groups;
 
 			// For maximum performance, the state of the simulation (which is the same as the set of its double buffered
 			// wires, since using a singly buffered wire for any kind of state introduces a race condition) should contain
@@ -3030,6 +3771,8 @@ struct CxxrtlWorker {
 				while (!worklist.empty()) {
 					auto node = worklist.pop();
 					debug_live_nodes.insert(node);
+					if (node->type == FlowGraph::Node::Type::CELL_EVAL && !is_internal_cell(node->cell->type))
+						continue; // node reads back outputs of a user cell
 					for (auto wire : flow.node_uses[node]) {
 						if (debug_wire_types[wire].is_member())
 							continue; // node uses member
@@ -3132,6 +3875,25 @@ struct CxxrtlWorker {
 			if (!run_proc)
 				log("Converting processes to netlists may eliminate %s from the design.\n", why_pessimistic);
 		}
+		if (coverage) {
+			size_t coverage_points = 0;
+			for (auto module : design->modules())
+				if (design->selected_module(module)) {
+					compute_coverage_layout(module);
+					if (module->get_bool_attribute(ID::top))
+						coverage_points = coverage_layouts.at(module).size;
+				}
+			log("Design has %zu coverage counters.\n", coverage_points);
+		}
+		if (activity && activity_inputs.empty())
+			log_warning("Option -activity was given, but the design contains no combinatorial logic that can be "
+			            "skipped when its inputs do not change.\n");
+		if (parallel && !has_parallel_groups()) {
+			log_warning("Option -parallel was given, but the design contains no submodule instances that can be "
+			            "evaluated concurrently.\n");
+			if (run_flatten)
+				log("Preserving the design hierarchy with -noflatten or (*keep_hierarchy*) may expose such instances.\n");
+		}
 	}
 
 	void check_design(RTLIL::Design *design, bool &has_sync_init)
@@ -3226,6 +3988,11 @@ struct CxxrtlBackend : public Backend {
 		log("subject to race conditions. If, in the example above, the user logic would run\n");
 		log("simultaneously with the rising edge of the clock, the design would malfunction.\n");
 		log("\n");
+		log("Between steps, the complete state of the simulation can be saved to a flat binary\n");
+		log("snapshot with `top.save_state(buffer)', restored with `top.load_state(buffer)',\n");
+		log("and compared with the current state with `top.diff_state(buffer, names)'. Saving\n");
+		log("and restoring a snapshot only copies the contents of the wires and memories.\n");
+		log("\n");
 		log("This backend supports replacing parts of the design with black boxes implemented\n");
 		log("in C++. If a module marked as a CXXRTL black box, its implementation is ignored,\n");
 		log("and the generated code consists only of an interface and a factory function.\n");
@@ -3254,11 +4021,15 @@ struct CxxrtlBackend : public Backend {
 		log("\n");
 		log("      bool eval() override;\n");
 		log("      bool commit() override;\n");
+		log("      void visit_state(state_visitor &visitor) override;\n");
 		log("\n");
 		log("      static std::unique_ptr<bb_p_debug>\n");
 		log("      create(std::string name, metadata_map parameters, metadata_map attributes);\n");
 		log("    };\n");
 		log("\n");
+		log("Black box implementations that have state other than their ports should override\n");
+		log("`visit_state' to include it in snapshots of the simulation state.\n");
+		log("\n");
 		log("The `create' function must be implemented by the driver. For example, it could\n");
 		log("always provide an implementation logging the values to standard error stream:\n");
 		log("\n");
@@ -3323,6 +4094,13 @@ struct CxxrtlBackend : public Backend {
 		log("      return std::make_unique<stderr_debug<8>>();\n");
 		log("    }\n");
 		log("\n");
+		log("By default, the generated code stores values as arrays of 32-bit chunks. On\n");
+		log("little-endian hosts and with compilers that provide `unsigned __int128' (such\n");
+		log("as GCC and Clang), it may be compiled with `-DCXXRTL_CHUNK_BITS=64' to use\n");
+		log("64-bit chunks instead, which speeds up arithmetic, shifts and comparisons on\n");
+		log("wide values. This does not affect the generated code or the C API, except that\n");
+		log("memory rows are padded to a multiple of 64 bits.\n");
+		log("\n");
 		log("The following attributes are recognized by this backend:\n");
 		log("\n");
 		log("    cxxrtl_blackbox\n");
@@ -3363,6 +4141,20 @@ struct CxxrtlBackend : public Backend {
 		log("        of the interface is derived from filename of the implementation.\n");
 		log("        otherwise, interface and implementation are generated together.\n");
 		log("\n");
+		log("    -split <dir>\n");
+		log("        write the design as several translation units into the existing\n");
+		log("        directory <dir>, so that they can be compiled in parallel: <ns-name>.h\n");
+		log("        with the interfaces of all modules, <ns-name>.cc with the C API entry\n");
+		log("        point, <ns-name>_<module>.cc with the implementation of each module,\n");
+		log("        and the Makefile fragment <ns-name>.mk that lists these sources. files\n");
+		log("        whose contents did not change are not rewritten, so that only modules\n");
+		log("        that changed have to be recompiled. must be used without a filename.\n");
+		log("\n");
+		log("    -split-size <kbytes>\n");
+		log("        with -split, put the implementation of several modules into one file\n");
+		log("        until it reaches the given size. larger modules still get a file of\n");
+		log("        their own.\n");
+		log("\n");
 		log("    -namespace <ns-name>\n");
 		log("        place the generated code into namespace <ns-name>. if not specified,\n");
 		log("        \"cxxrtl_design\" is used.\n");
@@ -3388,6 +4180,36 @@ struct CxxrtlBackend : public Backend {
 		log("        processes significantly improves evaluation performance at the cost of\n");
 		log("        slight increase in compilation time.\n");
 		log("\n");
+		log("    -parallel\n");
+		log("        evaluate and commit submodule instances that do not depend on each other\n");
+		log("        within a delta cycle concurrently, using a persistent thread pool. the\n");
+		log("        size of the pool is taken from the CXXRTL_THREADS environment variable,\n");
+		log("        or is the number of hardware threads. only instances of modules that\n");
+		log("        contain no black boxes and no $print cells are evaluated concurrently.\n");
+		log("        as a flattened design has no instances, this option is only useful\n");
+		log("        together with -noflatten or the (*keep_hierarchy*) attribute, and is\n");
+		log("        most effective for designs with many similar blocks, such as tiles.\n");
+		log("        the generated code must be linked with the threading library.\n");
+		log("\n");
+		log("    -activity\n");
+		log("        split the combinatorial logic of each module into groups that are\n");
+		log("        connected only through member wires, and skip evaluating a group if\n");
+		log("        none of its inputs changed since it was last evaluated. this greatly\n");
+		log("        reduces the run time of designs where most of the logic is idle most of\n");
+		log("        the time, at the cost of comparing the inputs of every group in every\n");
+		log("        delta cycle and keeping more wires as members.\n");
+		log("\n");
+		log("    -coverage\n");
+		log("        generate coverage counters into the model. every bit of a public wire\n");
+		log("        that is a class member counts its toggles when committed, every $mux and\n");
+		log("        $pmux cell counts how many times each input was selected when evaluated,\n");
+		log("        and every $cover cell counts how many times it was evaluated with both\n");
+		log("        inputs high. the counters of the whole design are kept in one array that\n");
+		log("        is accessible through `module::coverage_counters()` and described by\n");
+		log("        `module::coverage_info()` (or their C API equivalents). as muxes may be\n");
+		log("        evaluated more than once per step, or not at all if their output is\n");
+		log("        unused, their counts should be treated as hit indications.\n");
+		log("\n");
 		log("    -O <level>\n");
 		log("        set the optimization level. the default is -O%d. higher optimization\n", DEFAULT_OPT_LEVEL);
 		log("        levels dramatically decrease compile and run time, and highest level\n");
@@ -3475,6 +4297,18 @@ struct CxxrtlBackend : public Backend {
 				noproc = true;
 				continue;
 			}
+			if (args[argidx] == "-parallel") {
+				worker.parallel = true;
+				continue;
+			}
+			if (args[argidx] == "-activity") {
+				worker.activity = true;
+				continue;
+			}
+			if (args[argidx] == "-coverage") {
+				worker.coverage = true;
+				continue;
+			}
 			if (args[argidx] == "-Og") {
 				log_warning("The `-Og` option has been removed. Use `-g3` instead for complete "
 				            "design coverage regardless of optimization level.\n");
@@ -3506,6 +4340,19 @@ struct CxxrtlBackend : public Backend {
 				worker.split_intf = true;
 				continue;
 			}
+			if (args[argidx] == "-split" && argidx+1 < args.size()) {
+				worker.split_dir = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-split-size" && argidx+1 < args.size()) {
+				const std::string &arg = args[++argidx];
+				char *end = nullptr;
+				long kbytes = strtol(arg.c_str(), &end, 10);
+				if (arg.empty() || *end != 0 || kbytes < 0 || kbytes > INT_MAX / 1024)
+					log_cmd_error("Invalid split size `%s'.\n", arg.c_str());
+				worker.split_size = kbytes * 1024;
+				continue;
+			}
 			if (args[argidx] == "-namespace" && argidx+1 < args.size()) {
 				worker.design_ns = args[++argidx];
 				continue;
@@ -3572,6 +4419,13 @@ struct CxxrtlBackend : public Backend {
 				log_cmd_error("Invalid debug information level %d.\n", debug_level);
 		}
 
+		if (!worker.split_dir.empty()) {
+			if (filename != "<stdout>" || worker.split_intf)
+				log_cmd_error("Option -split can't be combined with a filename or -header.\n");
+			while (worker.split_dir.size() > 1 && worker.split_dir.back() == '/')
+				worker.split_dir.pop_back();
+		}
+
 		std::ofstream intf_f;
 		if (worker.split_intf) {
 			if (filename == "<stdout>")
@@ -72,6 +72,43 @@ size_t cxxrtl_step(cxxrtl_handle handle) {
 	return handle->module->step();
 }
 
+size_t cxxrtl_state_size(cxxrtl_handle handle) {
+	return handle->module->state_size();
+}
+
+void cxxrtl_save_state(cxxrtl_handle handle, void *buffer) {
+	handle->module->save_state((uint8_t *)buffer);
+}
+
+int cxxrtl_load_state(cxxrtl_handle handle, const void *buffer, size_t size) {
+	return handle->module->load_state((const uint8_t *)buffer, size);
+}
+
+int cxxrtl_diff_state(cxxrtl_handle handle, const void *buffer, size_t size,
+                      void *data, void (*callback)(void *data, const char *name)) {
+	std::vector<std::string> differences;
+	if (!handle->module->diff_state((const uint8_t *)buffer, size, differences))
+		return -1;
+	for (auto &name : differences)
+		callback(data, name.c_str());
+	return differences.size();
+}
+
+uint64_t *cxxrtl_coverage(cxxrtl_handle handle, size_t *count) {
+	*count = handle->module->coverage_size();
+	return *count > 0 ? handle->module->coverage_counters() : nullptr;
+}
+
+void cxxrtl_enum_coverage(cxxrtl_handle handle, void *data,
+                          void (*callback)(void *data, const struct cxxrtl_coverage_point *point)) {
+	std::vector<cxxrtl::coverage_point> points;
+	handle->module->coverage_info(points);
+	for (auto &point : points) {
+		cxxrtl_coverage_point c_point = { point.type, point.name.c_str(), point.detail, point.index };
+		callback(data, &c_point);
+	}
+}
+
 struct cxxrtl_object *cxxrtl_get_parts(cxxrtl_handle handle, const char *name, size_t *parts) {
 	auto it = handle->objects.table.find(name);
 	if (it == handle->objects.table.end())
@@ -86,6 +86,89 @@ int cxxrtl_commit(cxxrtl_handle handle);
 // Returns the number of delta cycles.
 size_t cxxrtl_step(cxxrtl_handle handle);
 
+// Return the size of a snapshot of the design state, in bytes.
+//
+// A snapshot includes the state of every value, wire, and memory in the design, and of black boxes
+// that support it. The size of a snapshot does not change during simulation.
+size_t cxxrtl_state_size(cxxrtl_handle handle);
+
+// Save a snapshot of the design state.
+//
+// The snapshot is written to `buffer`, which must be at least `cxxrtl_state_size` bytes long.
+// Snapshots can only be saved between calls to `cxxrtl_step` (or `cxxrtl_commit`).
+void cxxrtl_save_state(cxxrtl_handle handle, void *buffer);
+
+// Restore a snapshot of the design state.
+//
+// The snapshot of `size` bytes in `buffer` must have been saved from a design handle created from
+// the same build of the design. Interior pointers obtained with e.g. `cxxrtl_get` remain valid.
+//
+// Returns 1 if the snapshot was restored, 0 if it does not match the design (in which case the
+// state is not changed).
+int cxxrtl_load_state(cxxrtl_handle handle, const void *buffer, size_t size);
+
+// Compare the design state with a snapshot.
+//
+// For every object whose state differs from the snapshot of `size` bytes in `buffer`, `callback`
+// is called with the provided `data` and the hierarchical name of the object (as for `cxxrtl_get`,
+// but without the `root` prefix). Rows of memories are reported individually, as `<name>[<index>]`.
+//
+// Returns the number of differing objects, or -1 if the snapshot does not match the design.
+int cxxrtl_diff_state(cxxrtl_handle handle, const void *buffer, size_t size,
+                      void *data, void (*callback)(void *data, const char *name));
+
+// Type of a coverage counter.
+//
+// Coverage counters are only present in designs generated with `write_cxxrtl -coverage`.
+enum cxxrtl_coverage_type {
+	// The counter is incremented every time a bit of a wire changes its value. The `detail` field
+	// of the coverage point is the index of the bit.
+	CXXRTL_COVERAGE_TOGGLE = 0,
+
+	// The counter is incremented every time a `$mux` or `$pmux` cell is evaluated with one of its
+	// inputs selected. The `detail` field is 0 for the `A` input, and `n + 1` for the `n`-th part
+	// of the `B` input.
+	CXXRTL_COVERAGE_MUX = 1,
+
+	// The counter is incremented every time a `$cover` cell is evaluated with both its `EN` and
+	// `A` inputs high. The `detail` field is always 0.
+	CXXRTL_COVERAGE_COVER = 2,
+
+	// More coverage types may be added in the future, but the existing ones will never change.
+};
+
+// Description of a coverage counter.
+struct cxxrtl_coverage_point {
+	// Type of the counter; one of the `cxxrtl_coverage_type` constants.
+	uint32_t type;
+
+	// Hierarchical name of the wire or cell (as for `cxxrtl_get`, but without the `root` prefix).
+	const char *name;
+
+	// Meaning depends on the type of the counter.
+	size_t detail;
+
+	// Index of the counter in the array returned by `cxxrtl_coverage`.
+	size_t index;
+};
+
+// Get the coverage counters of the design.
+//
+// The counters of the whole design are kept in a single array of 64-bit counters, which remains
+// valid until the design is destroyed and may be read (or cleared) between calls to `cxxrtl_step`
+// (or `cxxrtl_commit`). The counters are not changed by `cxxrtl_reset`.
+//
+// Returns a pointer to the array and writes the number of counters to `count`. If the design has
+// no coverage counters, returns NULL and writes 0 to `count`.
+uint64_t *cxxrtl_coverage(cxxrtl_handle handle, size_t *count);
+
+// Enumerate the coverage counters of the design.
+//
+// Calls `callback` with the provided `data` once for each coverage counter. The `point` pointer
+// and the name it refers to are only valid during the call.
+void cxxrtl_enum_coverage(cxxrtl_handle handle, void *data,
+                          void (*callback)(void *data, const struct cxxrtl_coverage_point *point));
+
 // Type of a simulated object.
 //
 // The type of a simulated object indicates the way it is stored and the operations that are legal
@@ -236,6 +319,10 @@ struct cxxrtl_object {
 	// In memories, every element is stored contiguously. Therefore, the total number of chunks
 	// in any object is `((width + 31) / 32) * depth`.
 	//
+	// If the simulation is built with `CXXRTL_CHUNK_BITS=64`, the layout of values and wires is
+	// unchanged, but every memory element is padded to an even number of chunks, i.e. elements are
+	// `((width + 63) / 64) * 2` chunks apart.
+	//
 	// To allow the simulation to be partitioned into multiple independent units communicating
 	// through wires, the bits are double buffered. To avoid race conditions, user code should
 	// always read from `curr` and write to `next`. The `curr` pointer is always valid; for objects
@@ -0,0 +1,268 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2020  whitequark <whitequark@whitequark.org>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef CXXRTL_FST_H
+#define CXXRTL_FST_H
+
+// The FST writer is built on the FST library included with Yosys. Code using it must be linked with
+// `libs/fst/fstapi.cc`, `libs/fst/fastlz.cc`, `libs/fst/lz4.cc`, and zlib. If `fstapi.cc` is compiled with
+// `-DFST_WRITER_PARALLEL` (and linked with the threading library), compression of the value change data
+// can be moved to a background thread; see `fst_writer::parallel()`.
+
+#include <backends/cxxrtl/cxxrtl.h>
+#include <libs/fst/fstapi.h>
+
+namespace cxxrtl {
+
+class fst_writer {
+	struct variable {
+		fstHandle handle;
+		size_t width;
+		uint32_t *curr;
+		size_t cache_offset;
+		debug_outline *outline;
+		bool *outline_warm;
+	};
+
+	void *context;
+	std::vector<std::string> current_scope;
+	std::map<debug_outline*, bool> outlines;
+	std::vector<variable> variables;
+	std::vector<uint32_t> cache;
+	std::map<uint32_t*, fstHandle> aliases;
+	std::string bits;
+	bool streaming = false;
+
+	void emit_scope(const std::vector<std::string> &scope) {
+		assert(!streaming);
+		while (current_scope.size() > scope.size() ||
+		       (current_scope.size() > 0 &&
+			current_scope[current_scope.size() - 1] != scope[current_scope.size() - 1])) {
+			fstWriterSetUpscope(context);
+			current_scope.pop_back();
+		}
+		while (current_scope.size() < scope.size()) {
+			fstWriterSetScope(context, FST_ST_VCD_MODULE, scope[current_scope.size()].c_str(), nullptr);
+			current_scope.push_back(scope[current_scope.size()]);
+		}
+	}
+
+	void emit_value(const variable &var) {
+		assert(streaming);
+		if (var.width <= 32) {
+			fstWriterEmitValueChange32(context, var.handle, var.width, var.curr[0]);
+			return;
+		}
+		bits.resize(var.width);
+		for (size_t bit = 0; bit < var.width; bit++) {
+			bool bit_curr = var.curr[bit / 32] & (uint32_t(1) << (bit % 32));
+			bits[var.width - 1 - bit] = (bit_curr ? '1' : '0');
+		}
+		fstWriterEmitValueChange(context, var.handle, bits.data());
+	}
+
+	void reset_outlines() {
+		for (auto &outline_it : outlines)
+			outline_it.second = /*warm=*/(outline_it.first == nullptr);
+	}
+
+	// Unlike in VCD, where aliases share an identifier, in FST each alias is a separate variable that refers
+	// to the handle of the first one, and only the first one is ever sampled.
+	void register_variable(enum fstVarType type, const std::string &name, size_t lsb_at, bool multipart,
+	                       size_t width, uint32_t *curr, bool constant = false, debug_outline *outline = nullptr) {
+		assert(!streaming);
+		std::string full_name = name;
+		if (multipart || name.back() == ']' || lsb_at != 0) {
+			if (width == 1)
+				full_name += " [" + std::to_string(lsb_at) + "]";
+			else
+				full_name += " [" + std::to_string(lsb_at + width - 1) + ":" + std::to_string(lsb_at) + "]";
+		}
+		if (aliases.count(curr)) {
+			fstWriterCreateVar(context, type, FST_VD_IMPLICIT, width, full_name.c_str(), aliases[curr]);
+		} else {
+			fstHandle handle = fstWriterCreateVar(context, type, FST_VD_IMPLICIT, width, full_name.c_str(), 0);
+			auto outline_it = outlines.emplace(outline, /*warm=*/(outline == nullptr)).first;
+			const size_t chunks = words_for_bits(width);
+			aliases[curr] = handle;
+			if (constant) {
+				variables.emplace_back(variable { handle, width, curr, (size_t)-1, outline_it->first, &outline_it->second });
+			} else {
+				variables.emplace_back(variable { handle, width, curr, cache.size(), outline_it->first, &outline_it->second });
+				cache.insert(cache.end(), &curr[0], &curr[chunks]);
+			}
+		}
+	}
+
+	bool test_variable(const variable &var) {
+		if (var.cache_offset == (size_t)-1)
+			return false; // constant
+		if (!*var.outline_warm) {
+			var.outline->eval();
+			*var.outline_warm = true;
+		}
+		const size_t chunks = words_for_bits(var.width);
+		if (std::equal(&var.curr[0], &var.curr[chunks], &cache[var.cache_offset])) {
+			return false;
+		} else {
+			std::copy(&var.curr[0], &var.curr[chunks], &cache[var.cache_offset]);
+			return true;
+		}
+	}
+
+	static std::vector<std::string> split_hierarchy(const std::string &hier_name) {
+		std::vector<std::string> hierarchy;
+		size_t prev = 0;
+		while (true) {
+			size_t curr = hier_name.find_first_of(' ', prev);
+			if (curr == std::string::npos) {
+				hierarchy.push_back(hier_name.substr(prev));
+				break;
+			} else {
+				hierarchy.push_back(hier_name.substr(prev, curr - prev));
+				prev = curr + 1;
+			}
+		}
+		return hierarchy;
+	}
+
+public:
+	fst_writer(const std::string &filename) {
+		context = fstWriterCreate(filename.c_str(), /*use_compressed_hier=*/1);
+		if (context) {
+			fstWriterSetVersion(context, "CXXRTL");
+			// LZ4 is the fastest of the supported compression methods, which matters most for long traces.
+			fstWriterSetPackType(context, FST_WR_PT_LZ4);
+		}
+	}
+
+	~fst_writer() {
+		close();
+	}
+
+	fst_writer(const fst_writer &) = delete;
+	fst_writer &operator=(const fst_writer &) = delete;
+
+	// Returns false if the output file could not be created.
+	bool is_open() const {
+		return context != nullptr;
+	}
+
+	void timescale(unsigned number, const std::string &unit) {
+		assert(!streaming);
+		assert(number == 1 || number == 10 || number == 100);
+		assert(unit == "s" || unit == "ms" || unit == "us" ||
+		       unit == "ns" || unit == "ps" || unit == "fs");
+		fstWriterSetTimescaleFromString(context, (std::to_string(number) + unit).c_str());
+	}
+
+	// Compress value change data on a background thread. Requires `fstapi.cc` to be compiled with
+	// `-DFST_WRITER_PARALLEL`; otherwise the FST library terminates the process when this is enabled.
+	void parallel(bool enable) {
+		fstWriterSetParallelMode(context, enable);
+	}
+
+	void add(const std::string &hier_name, const debug_item &item, bool multipart = false) {
+		std::vector<std::string> scope = split_hierarchy(hier_name);
+		std::string name = scope.back();
+		scope.pop_back();
+
+		emit_scope(scope);
+		switch (item.type) {
+			case debug_item::VALUE:
+				register_variable(FST_VT_VCD_WIRE, name, item.lsb_at, multipart,
+				                  item.width, item.curr, /*constant=*/item.next == nullptr);
+				break;
+			case debug_item::WIRE:
+				register_variable(FST_VT_VCD_REG, name, item.lsb_at, multipart,
+				                  item.width, item.curr);
+				break;
+			case debug_item::MEMORY: {
+				const size_t stride = words_per_row(item.width);
+				for (size_t index = 0; index < item.depth; index++) {
+					uint32_t *nth_curr = &item.curr[stride * index];
+					std::string nth_name = name + '[' + std::to_string(index) + ']';
+					register_variable(FST_VT_VCD_REG, nth_name, item.lsb_at, multipart,
+					                  item.width, nth_curr);
+				}
+				break;
+			}
+			case debug_item::ALIAS:
+				// See the comment in `vcd_writer::add()`.
+				register_variable(FST_VT_VCD_WIRE, name, item.lsb_at, multipart,
+				                  item.width, item.curr);
+				break;
+			case debug_item::OUTLINE:
+				register_variable(FST_VT_VCD_WIRE, name, item.lsb_at, multipart,
+				                  item.width, item.curr, /*constant=*/false, item.outline);
+				break;
+		}
+	}
+
+	template<class Filter>
+	void add(const debug_items &items, const Filter &filter) {
+		// `debug_items` is a map, so the items are already sorted in an order optimal for emitting
+		// scopes.
+		for (auto &it : items.table)
+			for (auto &part : it.second)
+				if (filter(it.first, part))
+					add(it.first, part, it.second.size() > 1);
+	}
+
+	void add(const debug_items &items) {
+		this->add(items, [](const std::string &, const debug_item &) {
+			return true;
+		});
+	}
+
+	void add_without_memories(const debug_items &items) {
+		this->add(items, [](const std::string &, const debug_item &item) {
+			return item.type != debug_item::MEMORY;
+		});
+	}
+
+	void sample(uint64_t timestamp) {
+		bool first_sample = !streaming;
+		if (first_sample) {
+			emit_scope({});
+			streaming = true;
+		}
+		reset_outlines();
+		fstWriterEmitTimeChange(context, timestamp);
+		for (auto &var : variables)
+			if (test_variable(var) || first_sample)
+				emit_value(var);
+	}
+
+	// Write the buffered value changes to the file.
+	void flush() {
+		fstWriterFlushContext(context);
+	}
+
+	// Finish writing the file. The writer can no longer be used afterwards.
+	void close() {
+		if (context) {
+			fstWriterClose(context);
+			context = nullptr;
+		}
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2020  whitequark <whitequark@whitequark.org>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+// This file is a part of the CXXRTL C API. It should be used together with `cxxrtl_fst_capi.h`.
+
+#include <backends/cxxrtl/cxxrtl_fst.h>
+#include <backends/cxxrtl/cxxrtl_fst_capi.h>
+
+extern const cxxrtl::debug_items &cxxrtl_debug_items_from_handle(cxxrtl_handle handle);
+
+struct _cxxrtl_fst {
+	cxxrtl::fst_writer writer;
+
+	_cxxrtl_fst(const char *filename) : writer(filename) {}
+};
+
+cxxrtl_fst cxxrtl_fst_create(const char *filename) {
+	cxxrtl_fst fst = new _cxxrtl_fst(filename);
+	if (!fst->writer.is_open()) {
+		delete fst;
+		return nullptr;
+	}
+	return fst;
+}
+
+void cxxrtl_fst_destroy(cxxrtl_fst fst) {
+	delete fst;
+}
+
+void cxxrtl_fst_timescale(cxxrtl_fst fst, int number, const char *unit) {
+	fst->writer.timescale(number, unit);
+}
+
+void cxxrtl_fst_parallel(cxxrtl_fst fst, int enable) {
+	fst->writer.parallel(enable != 0);
+}
+
+void cxxrtl_fst_add(cxxrtl_fst fst, const char *name, cxxrtl_object *object) {
+	// Note the copy. See `cxxrtl_vcd_add` for details.
+	fst->writer.add(name, cxxrtl::debug_item(*object));
+}
+
+void cxxrtl_fst_add_from(cxxrtl_fst fst, cxxrtl_handle handle) {
+	fst->writer.add(cxxrtl_debug_items_from_handle(handle));
+}
+
+void cxxrtl_fst_add_from_if(cxxrtl_fst fst, cxxrtl_handle handle, void *data,
+                            int (*filter)(void *data, const char *name,
+                                          const cxxrtl_object *object)) {
+	fst->writer.add(cxxrtl_debug_items_from_handle(handle),
+		[=](const std::string &name, const cxxrtl::debug_item &item) {
+			return filter(data, name.c_str(), static_cast<const cxxrtl_object*>(&item));
+		});
+}
+
+void cxxrtl_fst_add_from_without_memories(cxxrtl_fst fst, cxxrtl_handle handle) {
+	fst->writer.add_without_memories(cxxrtl_debug_items_from_handle(handle));
+}
+
+void cxxrtl_fst_sample(cxxrtl_fst fst, uint64_t time) {
+	fst->writer.sample(time);
+}
+
+void cxxrtl_fst_flush(cxxrtl_fst fst) {
+	fst->writer.flush();
+}
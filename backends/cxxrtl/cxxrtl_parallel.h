@@ -0,0 +1,175 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2020  whitequark <whitequark@whitequark.org>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+// This file is included by the designs generated with `write_cxxrtl -parallel`. It provides the thread pool that
+// is used to evaluate and commit independent submodule instances concurrently.
+
+#ifndef CXXRTL_PARALLEL_H
+#define CXXRTL_PARALLEL_H
+
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <backends/cxxrtl/cxxrtl.h>
+
+namespace cxxrtl {
+
+// A persistent pool of worker threads. The threads are started once and then reused for every batch of work, since
+// a simulation step typically runs many small batches and starting a thread per batch would dominate their cost.
+//
+// The thread calling `run()` participates in the batch, and `run()` returns only once every item has been completed,
+// which makes each call a barrier. Calls made from within a batch item (for example, by a submodule that is itself
+// evaluated in parallel), as well as calls made while another thread is using the pool, run serially on the calling
+// thread.
+class thread_pool {
+	std::vector<std::thread> workers;
+
+	// Held by the thread running a batch.
+	std::mutex batch_mutex;
+
+	// Guards every field below that is not atomic.
+	std::mutex mutex;
+	std::condition_variable wake, done;
+
+	bool shutdown = false;
+	uint64_t generation = 0;
+	size_t busy = 0;
+
+	// The batch being executed.
+	void (*invoke)(void *context, size_t index) = nullptr;
+	void *context = nullptr;
+	size_t count = 0;
+	std::atomic<size_t> next_index { 0 };
+	std::atomic<size_t> pending { 0 };
+
+	static bool &in_pool() {
+		static thread_local bool flag = false;
+		return flag;
+	}
+
+	void work(void (*batch_invoke)(void*, size_t), void *batch_context, size_t batch_count) {
+		size_t index;
+		while ((index = next_index.fetch_add(1, std::memory_order_relaxed)) < batch_count) {
+			batch_invoke(batch_context, index);
+			pending.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+
+	void worker_loop() {
+		in_pool() = true;
+		uint64_t seen_generation = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake.wait(lock, [&] { return shutdown || generation != seen_generation; });
+			if (shutdown)
+				return;
+			seen_generation = generation;
+			auto batch_invoke = invoke;
+			auto batch_context = context;
+			size_t batch_count = count;
+			busy++;
+			lock.unlock();
+			work(batch_invoke, batch_context, batch_count);
+			lock.lock();
+			if (--busy == 0)
+				done.notify_all();
+		}
+	}
+
+public:
+	explicit thread_pool(size_t threads) {
+		// The calling thread is one of the threads executing each batch.
+		for (size_t i = 1; i < threads; i++)
+			workers.emplace_back([this] { worker_loop(); });
+	}
+
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shutdown = true;
+		}
+		wake.notify_all();
+		for (auto &worker : workers)
+			worker.join();
+	}
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+
+	size_t size() const {
+		return workers.size() + 1;
+	}
+
+	// Calls `fn(index)` for each `index` in `[0, count)`, distributing the calls among the threads of the pool.
+	template<class Fn>
+	void run(size_t count, Fn &&fn) {
+		std::unique_lock<std::mutex> batch_lock(batch_mutex, std::defer_lock);
+		if (count < 2 || workers.empty() || in_pool() || !batch_lock.try_lock()) {
+			for (size_t index = 0; index < count; index++)
+				fn(index);
+			return;
+		}
+
+		typedef typename std::remove_reference<Fn>::type fn_type;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			// Workers that woke up late for the previous batch may still be looking at it.
+			done.wait(lock, [&] { return busy == 0; });
+			this->invoke = [](void *context, size_t index) { (*static_cast<fn_type*>(context))(index); };
+			this->context = static_cast<void*>(&fn);
+			this->count = count;
+			next_index.store(0, std::memory_order_relaxed);
+			pending.store(count, std::memory_order_relaxed);
+			generation++;
+		}
+		wake.notify_all();
+
+		in_pool() = true;
+		work(this->invoke, this->context, count);
+		in_pool() = false;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return pending.load(std::memory_order_acquire) == 0 && busy == 0; });
+	}
+
+	// The pool used by generated code. Its size is taken from the `CXXRTL_THREADS` environment variable if it is set,
+	// and is the number of hardware threads otherwise.
+	static thread_pool &global() {
+		static thread_pool pool(default_size());
+		return pool;
+	}
+
+	static size_t default_size() {
+		if (const char *threads = std::getenv("CXXRTL_THREADS")) {
+			long value = std::strtol(threads, nullptr, 10);
+			if (value > 0)
+				return (size_t)value;
+		}
+		unsigned hardware_threads = std::thread::hardware_concurrency();
+		return hardware_threads > 0 ? hardware_threads : 1;
+	}
+};
+
+} // namespace cxxrtl
+
+#endif
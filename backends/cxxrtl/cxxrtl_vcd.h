@@ -27,7 +27,7 @@ class vcd_writer {
 	struct variable {
 		size_t ident;
 		size_t width;
-		chunk_t *curr;
+		uint32_t *curr;
 		size_t cache_offset;
 		debug_outline *outline;
 		bool *outline_warm;
@@ -36,8 +36,8 @@ class vcd_writer {
 	std::vector<std::string> current_scope;
 	std::map<debug_outline*, bool> outlines;
 	std::vector<variable> variables;
-	std::vector<chunk_t> cache;
-	std::map<chunk_t*, size_t> aliases;
+	std::vector<uint32_t> cache;
+	std::map<uint32_t*, size_t> aliases;
 	bool streaming = false;
 
 	void emit_timescale(unsigned number, const std::string &unit) {
@@ -120,7 +120,7 @@ class vcd_writer {
 		assert(streaming);
 		buffer += 'b';
 		for (size_t bit = var.width - 1; bit != (size_t)-1; bit--) {
-			bool bit_curr = var.curr[bit / (8 * sizeof(chunk_t))] & (1 << (bit % (8 * sizeof(chunk_t))));
+			bool bit_curr = var.curr[bit / 32] & (uint32_t(1) << (bit % 32));
 			buffer += (bit_curr ? '1' : '0');
 		}
 		buffer += ' ';
@@ -133,12 +133,12 @@ class vcd_writer {
 			outline_it.second = /*warm=*/(outline_it.first == nullptr);
 	}
 
-	variable &register_variable(size_t width, chunk_t *curr, bool constant = false, debug_outline *outline = nullptr) {
+	variable &register_variable(size_t width, uint32_t *curr, bool constant = false, debug_outline *outline = nullptr) {
 		if (aliases.count(curr)) {
 			return variables[aliases[curr]];
 		} else {
 			auto outline_it = outlines.emplace(outline, /*warm=*/(outline == nullptr)).first;
-			const size_t chunks = (width + (sizeof(chunk_t) * 8 - 1)) / (sizeof(chunk_t) * 8);
+			const size_t chunks = words_for_bits(width);
 			aliases[curr] = variables.size();
 			if (constant) {
 				variables.emplace_back(variable { variables.size(), width, curr, (size_t)-1, outline_it->first, &outline_it->second });
@@ -157,7 +157,7 @@ class vcd_writer {
 			var.outline->eval();
 			*var.outline_warm = true;
 		}
-		const size_t chunks = (var.width + (sizeof(chunk_t) * 8 - 1)) / (sizeof(chunk_t) * 8);
+		const size_t chunks = words_for_bits(var.width);
 		if (std::equal(&var.curr[0], &var.curr[chunks], &cache[var.cache_offset])) {
 			return false;
 		} else {
@@ -206,9 +206,9 @@ public:
 				         "reg", name, item.lsb_at, multipart);
 				break;
 			case debug_item::MEMORY: {
-				const size_t stride = (item.width + (sizeof(chunk_t) * 8 - 1)) / (sizeof(chunk_t) * 8);
+				const size_t stride = words_per_row(item.width);
 				for (size_t index = 0; index < item.depth; index++) {
-					chunk_t *nth_curr = &item.curr[stride * index];
+					uint32_t *nth_curr = &item.curr[stride * index];
 					std::string nth_name = name + '[' + std::to_string(index) + ']';
 					emit_var(register_variable(item.width, nth_curr),
 					         "reg", nth_name, item.lsb_at, multipart);
@@ -418,7 +418,7 @@ YOSYS_NAMESPACE_END
 PRIVATE_NAMESPACE_BEGIN
 
 struct RTLILBackend : public Backend {
-	RTLILBackend() : Backend("rtlil", "write design to RTLIL file") { }
+	RTLILBackend() : Backend("rtlil", "write design to RTLIL file") { writes_lazy_modules = true; }
 	void help() override
 	{
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
@@ -431,6 +431,9 @@ struct RTLILBackend : public Backend {
 		log("    -selected\n");
 		log("        only write selected parts of the design.\n");
 		log("\n");
+		log("Lazily loaded modules that have not been inflated yet are decoded one at a\n");
+		log("time and written unchanged, unless -selected is used.\n");
+		log("\n");
 	}
 	void execute(std::ostream *&f, std::string filename, std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -447,18 +450,42 @@ struct RTLILBackend : public Backend {
 			}
 			break;
 		}
-		extra_args(f, filename, args, argidx);
+		extra_args(f, filename, args, argidx, false, design);
 
 		design->sort();
 
 		log("Output filename: %s\n", filename.c_str());
 		*f << stringf("# Generated by %s\n", yosys_version_str);
-		RTLIL_BACKEND::dump_design(*f, design, selected, true, false);
+
+		if (selected) {
+			RTLIL_BACKEND::dump_design(*f, design, selected, true, false);
+		} else {
+			// like dump_design(), but without inflating the lazily loaded modules
+			*f << stringf("autoidx %d\n", autoidx);
+
+			std::vector<RTLIL::IdString> names;
+			for (auto module : design->loaded_modules())
+				names.push_back(module->name);
+			for (auto &it : design->lazy_modules)
+				names.push_back(it.first);
+			std::sort(names.begin(), names.end(), RTLIL::sort_by_id_str());
+
+			for (auto &name : names) {
+				if (design->lazy_modules.count(name) == 0) {
+					RTLIL_BACKEND::dump_module(*f, "", design->modules_.at(name), design, false, true, false);
+					continue;
+				}
+				RTLIL::Module *module = design->lazy_modules.at(name)->decode_module(name);
+				module->sort();
+				RTLIL_BACKEND::dump_module(*f, "", module, design, false, true, false);
+				delete module;
+			}
+		}
 	}
 } RTLILBackend;
 
 struct IlangBackend : public Backend {
-	IlangBackend() : Backend("ilang", "(deprecated) alias of write_rtlil") { }
+	IlangBackend() : Backend("ilang", "(deprecated) alias of write_rtlil") { writes_lazy_modules = true; }
 	void help() override
 	{
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
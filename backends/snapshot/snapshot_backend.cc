@@ -0,0 +1,89 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/register.h"
+#include "kernel/snapshot.h"
+#include "kernel/log.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct SnapshotBackend : public Backend {
+	SnapshotBackend() : Backend("snapshot", "write design to binary snapshot file") { writes_lazy_modules = true; }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    write_snapshot [options] [filename]\n");
+		log("\n");
+		log("Write the current design to a binary snapshot file. Snapshots contain the same\n");
+		log("information as RTLIL files, but are much faster to write and read, and can be\n");
+		log("loaded one module at a time (see 'help read_snapshot').\n");
+		log("\n");
+		log("The snapshot format is not portable between hosts of different byte order\n");
+		log("and may change between yosys versions. Use write_rtlil for archival.\n");
+		log("\n");
+		log("    -selected\n");
+		log("        only write fully selected modules.\n");
+		log("\n");
+		log("Lazily loaded modules that have not been inflated yet are decoded one at a\n");
+		log("time and written unchanged, unless -selected is used.\n");
+		log("\n");
+	}
+	void execute(std::ostream *&f, std::string filename, std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		bool selected = false;
+
+		log_header(design, "Executing SNAPSHOT backend.\n");
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			std::string arg = args[argidx];
+			if (arg == "-selected") {
+				selected = true;
+				continue;
+			}
+			break;
+		}
+		extra_args(f, filename, args, argidx, true, design);
+
+		log("Output filename: %s\n", filename.c_str());
+
+		SnapshotWriter writer(*f);
+		int count = 0;
+		for (auto module : selected ? design->modules() : design->loaded_modules()) {
+			if (selected && !design->selected_whole_module(module))
+				continue;
+			writer.write_module(module);
+			count++;
+		}
+		if (!selected)
+			for (auto &it : design->lazy_modules) {
+				RTLIL::Module *module = it.second->decode_module(it.first);
+				writer.write_module(module);
+				delete module;
+				count++;
+			}
+		writer.finish();
+
+		log("Wrote %d modules.\n", count);
+	}
+} SnapshotBackend;
+
+PRIVATE_NAMESPACE_END
@@ -33,6 +33,70 @@ void rtlil_frontend_yyerror(char const *s)
 
 YOSYS_NAMESPACE_BEGIN
 
+static bool rtlil_parser_active = false;
+
+static void parse_rtlil(std::istream *f, RTLIL::Design *design)
+{
+	log_assert(!rtlil_parser_active);
+	rtlil_parser_active = true;
+
+	RTLIL_FRONTEND::lexin = f;
+	RTLIL_FRONTEND::current_design = design;
+	rtlil_frontend_yydebug = false;
+	rtlil_frontend_yyrestart(NULL);
+	rtlil_frontend_yyparse();
+	rtlil_frontend_yylex_destroy();
+
+	rtlil_parser_active = false;
+}
+
+// Loader for modules registered with "read_rtlil -lazy". The file is parsed
+// again each time one of its modules is inflated.
+struct RTLILFileLoader : public RTLIL::LazyModuleLoader
+{
+	std::string filename;
+
+	RTLILFileLoader(const std::string &filename) : filename(filename) { }
+
+	std::string source_file() const override
+	{
+		return filename;
+	}
+
+	RTLIL::Module *decode_module(RTLIL::IdString name) override
+	{
+		if (rtlil_parser_active)
+			log_error("Can't inflate lazily loaded module %s while parsing another RTLIL file.\n", log_id(name));
+
+		std::ifstream f(filename.c_str());
+		if (f.fail())
+			log_error("Can't open RTLIL file `%s' for reading: %s\n", filename.c_str(), strerror(errno));
+
+		bool flag_nooverwrite = RTLIL_FRONTEND::flag_nooverwrite;
+		bool flag_overwrite = RTLIL_FRONTEND::flag_overwrite;
+		bool flag_lib = RTLIL_FRONTEND::flag_lib;
+		RTLIL_FRONTEND::flag_nooverwrite = false;
+		RTLIL_FRONTEND::flag_overwrite = false;
+		RTLIL_FRONTEND::flag_lib = false;
+
+		RTLIL::Design *file_design = new RTLIL::Design;
+		parse_rtlil(&f, file_design);
+
+		RTLIL_FRONTEND::flag_nooverwrite = flag_nooverwrite;
+		RTLIL_FRONTEND::flag_overwrite = flag_overwrite;
+		RTLIL_FRONTEND::flag_lib = flag_lib;
+
+		auto it = file_design->modules_.find(name);
+		if (it == file_design->modules_.end())
+			log_error("Module %s not found in RTLIL file `%s'.\n", log_id(name), filename.c_str());
+		RTLIL::Module *module = it->second;
+		file_design->modules_.erase(it);
+		module->design = nullptr;
+		delete file_design;
+		return module;
+	}
+};
+
 struct RTLILFrontend : public Frontend {
 	RTLILFrontend() : Frontend("rtlil", "read modules from RTLIL file") { }
 	void help() override
@@ -55,12 +119,19 @@ struct RTLILFrontend : public Frontend {
 		log("    -lib\n");
 		log("        only create empty blackbox modules\n");
 		log("\n");
+		log("    -lazy\n");
+		log("        only scan the file for module names and parse it when one of its\n");
+		log("        modules is first used (see 'help read_snapshot' for the semantics of\n");
+		log("        lazily loaded modules). this is intended for designs stored as one\n");
+		log("        RTLIL file per module; the file is parsed again for each module.\n");
+		log("\n");
 	}
 	void execute(std::istream *&f, std::string filename, std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		RTLIL_FRONTEND::flag_nooverwrite = false;
 		RTLIL_FRONTEND::flag_overwrite = false;
 		RTLIL_FRONTEND::flag_lib = false;
+		bool flag_lazy = false;
 
 		log_header(design, "Executing RTLIL frontend.\n");
 
@@ -81,18 +152,42 @@ struct RTLILFrontend : public Frontend {
 				RTLIL_FRONTEND::flag_lib = true;
 				continue;
 			}
+			if (arg == "-lazy") {
+				flag_lazy = true;
+				continue;
+			}
 			break;
 		}
 		extra_args(f, filename, args, argidx);
 
 		log("Input filename: %s\n", filename.c_str());
 
-		RTLIL_FRONTEND::lexin = f;
-		RTLIL_FRONTEND::current_design = design;
-		rtlil_frontend_yydebug = false;
-		rtlil_frontend_yyrestart(NULL);
-		rtlil_frontend_yyparse();
-		rtlil_frontend_yylex_destroy();
+		if (flag_lazy)
+		{
+			if (RTLIL_FRONTEND::flag_lib || RTLIL_FRONTEND::flag_overwrite || RTLIL_FRONTEND::flag_nooverwrite)
+				log_cmd_error("Option -lazy can't be combined with -lib, -overwrite or -nooverwrite.\n");
+			if (filename.compare(0, 1, "<") == 0 || (filename.size() > 3 && filename.compare(filename.size()-3, std::string::npos, ".gz") == 0))
+				log_cmd_error("Option -lazy requires an uncompressed input file.\n");
+
+			std::shared_ptr<RTLIL::LazyModuleLoader> loader = std::make_shared<RTLILFileLoader>(filename);
+			int count = 0;
+			std::string line;
+			while (std::getline(*f, line)) {
+				size_t pos = line.find_first_not_of(" \t");
+				if (pos == std::string::npos || line.compare(pos, 7, "module ") != 0)
+					continue;
+				std::string name = line.substr(pos + 7);
+				name = name.substr(0, name.find_first_of(" \t\r"));
+				if (design->has(name))
+					log_error("RTLIL error: redefinition of module %s.\n", name.c_str());
+				design->lazy_modules[name] = loader;
+				count++;
+			}
+			log("Registered %d lazily loaded modules.\n", count);
+			return;
+		}
+
+		parse_rtlil(f, design);
 	}
 } RTLILFrontend;
 
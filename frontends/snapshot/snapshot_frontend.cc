@@ -0,0 +1,160 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/register.h"
+#include "kernel/snapshot.h"
+#include "kernel/log.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct SnapshotFrontend : public Frontend {
+	SnapshotFrontend() : Frontend("snapshot", "read modules from binary snapshot file") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    read_snapshot [options] [filename]\n");
+		log("\n");
+		log("Load modules from a binary snapshot file (as written by write_snapshot) to the\n");
+		log("current design. The file is memory-mapped and only the modules that are\n");
+		log("actually loaded are decoded.\n");
+		log("\n");
+		log("    -module <name>\n");
+		log("        only load the specified module and the modules instantiated in it\n");
+		log("        (recursively). this option can be used multiple times.\n");
+		log("\n");
+		log("    -lazy\n");
+		log("        do not decode any modules yet. modules are inflated when they are\n");
+		log("        first looked up by name, e.g. by a hierarchy walk or by a selection\n");
+		log("        that matches the module name, together with all modules instantiated\n");
+		log("        below them. write_rtlil and write_snapshot write modules that were\n");
+		log("        never inflated unchanged; all other backends inflate the entire\n");
+		log("        design first.\n");
+		log("\n");
+		log("        passes which iterate over all (selected) modules, such as 'opt' or\n");
+		log("        'stat', inflate all remaining modules first. to keep the unused\n");
+		log("        modules of a large snapshot lazy, select the modules of interest by\n");
+		log("        name, e.g. with 'hierarchy -top <name>' or 'select <pattern>'.\n");
+		log("\n");
+		log("    -nooverwrite\n");
+		log("        ignore re-definitions of modules. (the default behavior is to\n");
+		log("        create an error message if the existing module is not a blackbox\n");
+		log("        module, and overwrite the existing module if it is a blackbox module.)\n");
+		log("\n");
+		log("    -overwrite\n");
+		log("        overwrite existing modules with the same name\n");
+		log("\n");
+	}
+	void execute(std::istream *&f, std::string filename, std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		std::vector<std::string> module_names;
+		bool flag_nooverwrite = false;
+		bool flag_overwrite = false;
+		bool flag_lazy = false;
+
+		log_header(design, "Executing SNAPSHOT frontend.\n");
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			std::string arg = args[argidx];
+			if (arg == "-module" && argidx+1 < args.size()) {
+				module_names.push_back(RTLIL::escape_id(args[++argidx]));
+				continue;
+			}
+			if (arg == "-lazy") {
+				flag_lazy = true;
+				continue;
+			}
+			if (arg == "-nooverwrite") {
+				flag_nooverwrite = true;
+				flag_overwrite = false;
+				continue;
+			}
+			if (arg == "-overwrite") {
+				flag_nooverwrite = false;
+				flag_overwrite = true;
+				continue;
+			}
+			break;
+		}
+		extra_args(f, filename, args, argidx, true);
+
+		if (flag_lazy && !module_names.empty())
+			log_cmd_error("Options -lazy and -module are exclusive.\n");
+
+		log("Input filename: %s\n", filename.c_str());
+
+		std::shared_ptr<SnapshotReader> reader = std::make_shared<SnapshotReader>(filename);
+
+		std::vector<int> queue;
+		pool<int> queued;
+
+		if (module_names.empty()) {
+			for (int i = 0; i < reader->count_modules(); i++)
+				queue.push_back(i);
+		} else {
+			for (auto &name : module_names) {
+				int idx = reader->find_module(name);
+				if (idx < 0)
+					log_cmd_error("Module %s not found in snapshot file `%s'.\n", log_id(name), filename.c_str());
+				if (queued.insert(idx).second)
+					queue.push_back(idx);
+			}
+		}
+
+		int count = 0;
+		for (int i = 0; i < GetSize(queue); i++)
+		{
+			int idx = queue[i];
+			RTLIL::IdString name = reader->module_name(idx);
+
+			if (design->has(name)) {
+				RTLIL::Module *existing_mod = design->module(name);
+				if (!flag_nooverwrite && !flag_overwrite && !existing_mod->get_bool_attribute(ID::blackbox))
+					log_error("Snapshot error: redefinition of module %s.\n", log_id(name));
+				if (flag_nooverwrite) {
+					log("Ignoring re-definition of module %s.\n", log_id(name));
+					continue;
+				}
+				log("Replacing existing%s module %s.\n", existing_mod->get_bool_attribute(ID::blackbox) ? " blackbox" : "", log_id(name));
+				design->remove(existing_mod);
+			}
+
+			count++;
+			if (flag_lazy) {
+				design->lazy_modules[name] = reader;
+				continue;
+			}
+
+			RTLIL::Module *module = reader->load_module(design, idx);
+
+			if (!module_names.empty())
+				for (auto cell : module->cells()) {
+					int child_idx = reader->find_module(cell->type);
+					if (child_idx >= 0 && queued.insert(child_idx).second)
+						queue.push_back(child_idx);
+				}
+		}
+
+		log("%s %d of %d modules.\n", flag_lazy ? "Registered" : "Loaded", count, reader->count_modules());
+	}
+} SnapshotFrontend;
+
+PRIVATE_NAMESPACE_END
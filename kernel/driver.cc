@@ -221,6 +221,7 @@ int main(int argc, char **argv)
 	std::string depsfile = "";
 	std::string topmodule = "";
 	std::string perffile = "";
+	std::string profile_jsonfile;
 	bool scriptfile_tcl = false;
 	bool print_banner = true;
 	bool print_stats = true;
@@ -336,6 +337,10 @@ int main(int argc, char **argv)
 		printf("    -E <depsfile>\n");
 		printf("        write a Makefile dependencies file with in- and output file names\n");
 		printf("\n");
+		printf("    -J <jsonfile>\n");
+		printf("        record memory and design size for every executed command and write\n");
+		printf("        the profile to the specified JSON file on exit (see 'help profile')\n");
+		printf("\n");
 		printf("    -x <feature>\n");
 		printf("        do not print warnings for the specified experimental feature\n");
 		printf("\n");
@@ -368,7 +373,7 @@ int main(int argc, char **argv)
 	}
 
 	int opt;
-	while ((opt = getopt(argc, argv, "MXAQTVCSgm:f:Hh:b:o:p:l:L:qv:tds:c:W:w:e:r:D:P:E:x:B:")) != -1)
+	while ((opt = getopt(argc, argv, "MXAQTVCSgm:f:Hh:b:o:p:l:L:qv:tds:c:W:w:e:r:D:P:E:J:x:B:")) != -1)
 	{
 		switch (opt)
 		{
@@ -500,6 +505,10 @@ int main(int argc, char **argv)
 		case 'E':
 			depsfile = optarg;
 			break;
+		case 'J':
+			profile_jsonfile = optarg;
+			pass_profile_enabled = true;
+			break;
 		case 'x':
 			log_experimentals_ignored.insert(optarg);
 			break;
@@ -603,6 +612,11 @@ int main(int argc, char **argv)
 	for (auto it : pushed_designs)
 		it->check();
 
+	if (!profile_jsonfile.empty()) {
+		pass_profile_enabled = false;
+		Pass::call(yosys_design, std::vector<std::string>{"profile", "-json", profile_jsonfile});
+	}
+
 	if (!depsfile.empty())
 	{
 		FILE *f = fopen(depsfile.c_str(), "wt");
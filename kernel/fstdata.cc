@@ -18,6 +18,7 @@
  */
 
 #include "kernel/fstdata.h"
+#include "kernel/threading.h"
 
 USING_YOSYS_NAMESPACE
 
@@ -90,16 +91,20 @@ static void normalize_brackets(std::string &str)
 
 fstHandle FstData::getHandle(std::string name) { 
 	normalize_brackets(name);
-	if (name_to_handle.find(name) != name_to_handle.end())
-		return name_to_handle[name];
-	else 
+	if (name_to_handle.find(name) != name_to_handle.end()) {
+		fstHandle handle = name_to_handle[name];
+		requested_handles.insert(handle);
+		return handle;
+	} else
 		return 0;
 };
 
 dict<int,fstHandle> FstData::getMemoryHandles(std::string name) { 
-	if (memory_to_handle.find(name) != memory_to_handle.end())
+	if (memory_to_handle.find(name) != memory_to_handle.end()) {
+		for (auto &it : memory_to_handle[name])
+			requested_handles.insert(it.second);
 		return memory_to_handle[name];
-	else 
+	} else
 		return dict<int,fstHandle>();
 };
 
@@ -195,22 +200,23 @@ static void reconstruct_clb_attimes(void *user_data, uint64_t pnt_time, fstHandl
 	ptr->reconstruct_callback_attimes(pnt_time, pnt_facidx, pnt_value, plen);
 }
 
-void FstData::reconstruct_callback_attimes(uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value, uint32_t /* plen */)
+void FstData::updatePastData()
 {
-	if (pnt_time > end_time || !pnt_value) return;
-	// if we are past the timestamp
-	bool is_clock = false;
-	if (!all_samples) {
-		for(auto &s : clk_signals) {
-			if (s==pnt_facidx)  { 
-				is_clock=true;
-				break;
-			}
-		}
+	for (auto handle : changed_handles) {
+		past_data[handle] = last_data[handle];
+		past_valid[handle] = true;
+		handle_changed[handle] = false;
 	}
+	changed_handles.clear();
+}
+
+void FstData::reconstruct_callback_attimes(uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value, uint32_t plen)
+{
+	if (pnt_time > end_time || !pnt_value) return;
+	if (pnt_facidx >= last_data.size()) return;
 
 	if (pnt_time > past_time) {
-		past_data = last_data;
+		updatePastData();
 		past_time = pnt_time;
 	}
 
@@ -218,19 +224,149 @@ void FstData::reconstruct_callback_attimes(uint64_t pnt_time, fstHandle pnt_faci
 		if (all_samples) {
 			callback(last_time);
 			last_time = pnt_time;
-		} else {
-			if (is_clock) {
-				std::string val = std::string((const char *)pnt_value);
-				std::string prev = past_data[pnt_facidx];
-				if ((prev!="1" && val=="1") || (prev!="0" && val=="0")) {
-					callback(last_time);
-					last_time = pnt_time;
-				}
+		} else if (is_clock[pnt_facidx]) {
+			const std::string &prev = past_data[pnt_facidx];
+			past_valid[pnt_facidx] = true;
+			bool is_one = plen == 1 && pnt_value[0] == '1';
+			bool is_zero = plen == 1 && pnt_value[0] == '0';
+			if ((prev!="1" && is_one) || (prev!="0" && is_zero)) {
+				callback(last_time);
+				last_time = pnt_time;
 			}
 		}
 	}
 	// always update last_data
-	last_data[pnt_facidx] =  std::string((const char *)pnt_value);
+	last_data[pnt_facidx].assign((const char *)pnt_value, plen);
+	if (!handle_changed[pnt_facidx]) {
+		handle_changed[pnt_facidx] = true;
+		changed_handles.push_back(pnt_facidx);
+	}
+}
+
+#ifdef YOSYS_ENABLE_THREADS
+namespace {
+
+// Value changes decoded by the reader thread, stored back to back so that a
+// batch only needs a few allocations.
+struct FstChangeBatch
+{
+	std::vector<uint64_t> times;
+	std::vector<fstHandle> handles;
+	std::vector<uint32_t> offsets;
+	std::string values;
+
+	FstChangeBatch() { offsets.push_back(0); }
+	int size() const { return GetSize(handles); }
+};
+
+struct FstDecodeQueue
+{
+	static const int batch_changes = 16384;
+	static const int max_batches = 8;
+
+	void *ctx;
+	uint64_t end_time;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::unique_ptr<FstChangeBatch>> batches;
+	std::unique_ptr<FstChangeBatch> current;
+	bool done = false;
+	bool abort = false;
+	// only accessed by the reader thread
+	bool stopped = false;
+
+	void push_current(bool wait)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (wait)
+			cond.wait(lock, [this] { return GetSize(batches) < max_batches || abort; });
+		if (abort) {
+			// We can't unwind through fstapi, so drop everything that is
+			// still decoded and let fstReaderIterBlocks2 return normally.
+			// With an empty process mask the remaining blocks are skipped
+			// without decoding any values.
+			current.reset();
+			stopped = true;
+			fstReaderClrFacProcessMaskAll(ctx);
+			return;
+		}
+		batches.push_back(std::move(current));
+		cond.notify_all();
+	}
+
+	void add(uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value, uint32_t plen)
+	{
+		if (stopped || pnt_time > end_time || !pnt_value) return;
+		if (!current)
+			current.reset(new FstChangeBatch);
+		current->times.push_back(pnt_time);
+		current->handles.push_back(pnt_facidx);
+		current->values.append((const char *)pnt_value, plen);
+		current->offsets.push_back(GetSize(current->values));
+		if (current->size() >= batch_changes)
+			push_current(true);
+	}
+};
+
+void decode_clb_varlen(void *user_data, uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value, uint32_t plen)
+{
+	((FstDecodeQueue*)user_data)->add(pnt_time, pnt_facidx, pnt_value, plen);
+}
+
+void decode_clb(void *user_data, uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value)
+{
+	uint32_t plen = (pnt_value) ?  strlen((const char *)pnt_value) : 0;
+	((FstDecodeQueue*)user_data)->add(pnt_time, pnt_facidx, pnt_value, plen);
+}
+
+}
+#endif
+
+void FstData::iterBlocks()
+{
+#ifdef YOSYS_ENABLE_THREADS
+	// Decompressing the value change blocks is done in a separate thread
+	// while the changes are replayed (and the callback runs) in this one.
+	if (ThreadPool::pool_size(1, 1) > 0) {
+		FstDecodeQueue queue;
+		queue.ctx = ctx;
+		queue.end_time = end_time;
+		ThreadPool reader(1, [this, &queue](int) {
+			fstReaderIterBlocks2(ctx, decode_clb, decode_clb_varlen, &queue, nullptr);
+			if (queue.current)
+				queue.push_current(false);
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.done = true;
+			queue.cond.notify_all();
+		});
+
+		try {
+			while (1) {
+				std::unique_ptr<FstChangeBatch> batch;
+				{
+					std::unique_lock<std::mutex> lock(queue.mutex);
+					queue.cond.wait(lock, [&queue] { return !queue.batches.empty() || queue.done; });
+					if (queue.batches.empty())
+						break;
+					batch = std::move(queue.batches.front());
+					queue.batches.pop_front();
+					queue.cond.notify_all();
+				}
+				for (int i = 0; i < batch->size(); i++)
+					reconstruct_callback_attimes(batch->times[i], batch->handles[i],
+							(const unsigned char *)batch->values.data() + batch->offsets[i],
+							batch->offsets[i+1] - batch->offsets[i]);
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.abort = true;
+			queue.cond.notify_all();
+			throw;
+		}
+		return;
+	}
+#endif
+	fstReaderIterBlocks2(ctx, reconstruct_clb_attimes, reconstruct_clb_varlen_attimes, this, nullptr);
 }
 
 void FstData::reconstructAllAtTimes(std::vector<fstHandle> &signal, uint64_t start, uint64_t end, CallbackFunction cb)
@@ -239,26 +375,46 @@ void FstData::reconstructAllAtTimes(std::vector<fstHandle> &signal, uint64_t sta
 	callback = cb;
 	start_time = start;
 	end_time = end;
-	last_data.clear();
 	last_time = start_time;
-	past_data.clear();
 	past_time = start_time;
 	all_samples = clk_signals.empty();
 
+	size_t num_handles = fstReaderGetMaxHandle(ctx) + 1;
+	last_data.assign(num_handles, std::string());
+	past_data.assign(num_handles, std::string());
+	past_valid.assign(num_handles, false);
+	handle_changed.assign(num_handles, false);
+	changed_handles.clear();
+	is_clock.assign(num_handles, false);
+	for (auto s : clk_signals)
+		if (s < num_handles)
+			is_clock[s] = true;
+
+	// only decode the signals that were asked for and the clocks
 	fstReaderSetUnlimitedTimeRange(ctx);
-	fstReaderSetFacProcessMaskAll(ctx);
-	fstReaderIterBlocks2(ctx, reconstruct_clb_attimes, reconstruct_clb_varlen_attimes, this, nullptr);
+	if (request_all || requested_handles.empty()) {
+		fstReaderSetFacProcessMaskAll(ctx);
+	} else {
+		fstReaderClrFacProcessMaskAll(ctx);
+		for (auto handle : requested_handles)
+			fstReaderSetFacProcessMask(ctx, handle);
+		for (auto handle : clk_signals)
+			fstReaderSetFacProcessMask(ctx, handle);
+	}
+
+	iterBlocks();
+
 	if (last_time!=end_time) {
-		past_data = last_data;
+		updatePastData();
 		callback(last_time);
 	}
-	past_data = last_data;
+	updatePastData();
 	callback(end_time);
 }
 
-std::string FstData::valueOf(fstHandle signal)
+const std::string &FstData::valueOf(fstHandle signal)
 {
-	if (past_data.find(signal) == past_data.end())
+	if (signal >= past_data.size() || !past_valid[signal])
 		log_error("Signal id %d not found\n", (int)signal);
 	return past_data[signal];
 }
@@ -49,26 +49,40 @@ class FstData
 
 	std::vector<FstVar>& getVars() { return vars; };
 
+	// reconstructAllAtTimes() only decodes the signals returned by getHandle()
+	// and getMemoryHandles(), this makes it decode all of them
+	void requestAllVars() { request_all = true; }
+
 	void reconstruct_callback_attimes(uint64_t pnt_time, fstHandle pnt_facidx, const unsigned char *pnt_value, uint32_t plen);
 	void reconstructAllAtTimes(std::vector<fstHandle> &signal, uint64_t start_time, uint64_t end_time, CallbackFunction cb);
 
-	std::string valueOf(fstHandle signal);
+	const std::string &valueOf(fstHandle signal);
 	fstHandle getHandle(std::string name);
 	dict<int,fstHandle> getMemoryHandles(std::string name);
 	double getTimescale() { return timescale; }
 	const char *getTimescaleString() { return timescale_str.c_str(); }
 private:
 	void extractVarNames();
+	void updatePastData();
+	void iterBlocks();
 
 	struct fstReaderContext *ctx;
 	std::vector<FstVar> vars;
 	std::map<fstHandle, FstVar> handle_to_var;
 	std::map<std::string, fstHandle> name_to_handle;
 	std::map<std::string, dict<int, fstHandle>> memory_to_handle;
-	std::map<fstHandle, std::string> last_data;
+	pool<fstHandle> requested_handles;
+	bool request_all = false;
+	// per-signal values indexed by handle, past_data is only updated for
+	// the handles in changed_handles
+	std::vector<std::string> last_data;
 	uint64_t last_time;
-	std::map<fstHandle, std::string> past_data;
+	std::vector<std::string> past_data;
+	std::vector<bool> past_valid;
 	uint64_t past_time;
+	std::vector<fstHandle> changed_handles;
+	std::vector<bool> handle_changed;
+	std::vector<bool> is_clock;
 	double timescale;
 	std::string timescale_str;
 	uint64_t start_time;
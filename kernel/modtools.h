@@ -220,6 +220,12 @@ struct ModIndex : public RTLIL::Monitor
 		auto_reload_module = true;
 	}
 
+	void notify_wire_del(RTLIL::Module *mod, const pool<RTLIL::Wire*>&) override
+	{
+		log_assert(module == mod);
+		auto_reload_module = true;
+	}
+
 	void notify_blackout(RTLIL::Module *mod) override
 	{
 		log_assert(module == mod);
@@ -38,6 +38,8 @@ int QuickConeSat::importSigBit(SigBit bit)
 
 void QuickConeSat::prepare()
 {
+	int imported_count = 0;
+
 	while (!bits_queue.empty())
 	{
 		pool<ModWalker::PortBit> portbits;
@@ -68,13 +70,23 @@ void QuickConeSat::prepare()
 			bits_queue.insert(inputs.begin(), inputs.end());
 			satgen.importCell(pbit.cell);
 			imported_cells.insert(pbit.cell);
+			if (record_cell_state)
+				imported_cell_state[pbit.cell] = {pbit.cell->type, pbit.cell->parameters};
+			imported_count++;
 		}
 
-		if (max_cell_count && GetSize(imported_cells) > max_cell_count)
+		if (max_cell_count && imported_count > max_cell_count)
 			break;
 	}
 }
 
+void QuickConeSat::reset_effort()
+{
+	max_cell_complexity = 2;
+	max_cell_count = 0;
+	max_cell_outs = 0;
+}
+
 int QuickConeSat::cell_complexity(RTLIL::Cell *cell)
 {
 	if (cell->type.in(ID($concat), ID($slice), ID($pos), ID($_BUF_)))
@@ -100,3 +112,187 @@ int QuickConeSat::cell_complexity(RTLIL::Cell *cell)
 	// Unknown cell.
 	return 5;
 }
+
+QuickConeSatBatch::QuickConeSatBatch(ModWalker &modwalker, int num_queries, int queries_per_context, const QuickConeSat &effort) :
+		num_queries(num_queries), queries_per_context(queries_per_context)
+{
+	log_assert(queries_per_context > 0);
+	int num_contexts = (num_queries + queries_per_context - 1) / queries_per_context;
+	for (int i = 0; i < num_contexts; i++) {
+		contexts.emplace_back(new QuickConeSat(modwalker));
+		contexts.back()->max_cell_complexity = effort.max_cell_complexity;
+		contexts.back()->max_cell_count = effort.max_cell_count;
+		contexts.back()->max_cell_outs = effort.max_cell_outs;
+	}
+}
+
+QuickConeSat &QuickConeSatBatch::context(int query)
+{
+	return *contexts.at(query / queries_per_context);
+}
+
+void QuickConeSatBatch::solve(ParallelDispatcher *dispatcher, const std::function<void(int)> &solve)
+{
+	auto solve_context = [&](int ctx) {
+		int end = std::min(num_queries, (ctx + 1) * queries_per_context);
+		for (int i = ctx * queries_per_context; i < end; i++)
+			solve(i);
+	};
+	if (dispatcher != nullptr)
+		dispatcher->run(GetSize(contexts), solve_context);
+	else
+		for (int ctx = 0; ctx < GetSize(contexts); ctx++)
+			solve_context(ctx);
+}
+
+QuickConeSatCache::Context::Context(RTLIL::Module *module) : modwalker(module->design, module), qcsat(modwalker)
+{
+	qcsat.record_cell_state = true;
+}
+
+bool QuickConeSatCache::Context::cells_unchanged() const
+{
+	for (auto &it : qcsat.imported_cell_state)
+		if (it.first->type != it.second.first || it.first->parameters != it.second.second)
+			return false;
+	for (auto wire : qcsat.imported_onehot)
+		if (!wire->get_bool_attribute(ID::onehot))
+			return false;
+	return true;
+}
+
+QuickConeSatCache &QuickConeSatCache::instance()
+{
+	// Never destroyed, since designs may outlive static destructors.
+	static QuickConeSatCache *cache = new QuickConeSatCache;
+	return *cache;
+}
+
+QuickConeSatCache::Scope::Scope(RTLIL::Design *design) : design(design)
+{
+	QuickConeSatCache &cache = instance();
+	if (cache.scopes[design]++ == 0)
+		design->monitors.insert(&cache);
+}
+
+QuickConeSatCache::Scope::~Scope()
+{
+	QuickConeSatCache &cache = instance();
+	if (--cache.scopes.at(design) != 0)
+		return;
+
+	cache.scopes.erase(design);
+	design->monitors.erase(&cache);
+
+	std::vector<RTLIL::Module*> modules;
+	for (auto &it : cache.contexts)
+		if (it.first->design == design)
+			modules.push_back(it.first);
+	for (auto module : modules)
+		cache.drop(module);
+}
+
+QuickConeSat &QuickConeSatCache::get(RTLIL::Module *module)
+{
+	return instance().get_context(module);
+}
+
+QuickConeSat &QuickConeSatCache::get_context(RTLIL::Module *module)
+{
+	log_assert(module->design != nullptr);
+	log_assert(scopes.count(module->design) != 0);
+
+	// Contexts handed out earlier are no longer in use, so the stale ones
+	// can be dropped now.
+	std::vector<RTLIL::Module*> stale;
+	for (auto &it : contexts)
+		if (it.second->changed || (it.first == module && !it.second->cells_unchanged()))
+			stale.push_back(it.first);
+	for (auto stale_module : stale)
+		drop(stale_module);
+
+	Context *context;
+	auto it = contexts.find(module);
+	if (it == contexts.end()) {
+		if (GetSize(contexts) >= max_contexts) {
+			RTLIL::Module *lru = nullptr;
+			for (auto &it : contexts)
+				if (lru == nullptr || it.second->last_use < contexts.at(lru)->last_use)
+					lru = it.first;
+			drop(lru);
+		}
+		context = new Context(module);
+		contexts[module] = context;
+	} else {
+		context = it->second;
+	}
+
+	context->last_use = ++use_counter;
+	context->qcsat.reset_effort();
+	return context->qcsat;
+}
+
+void QuickConeSatCache::drop(RTLIL::Module *module)
+{
+	auto it = contexts.find(module);
+	if (it != contexts.end()) {
+		delete it->second;
+		contexts.erase(it);
+	}
+}
+
+void QuickConeSatCache::mark_changed(RTLIL::Module *module)
+{
+	auto it = contexts.find(module);
+	if (it != contexts.end())
+		it->second->changed = true;
+}
+
+void QuickConeSatCache::mark_design_changed(RTLIL::Design *design)
+{
+	// The cell types known to each ModWalker include the modules of the design.
+	for (auto &it : contexts)
+		if (it.first->design == design)
+			it.second->changed = true;
+}
+
+void QuickConeSatCache::notify_module_add(RTLIL::Module *module)
+{
+	mark_design_changed(module->design);
+}
+
+void QuickConeSatCache::notify_module_del(RTLIL::Module *module)
+{
+	drop(module);
+	mark_design_changed(module->design);
+}
+
+void QuickConeSatCache::notify_connect(RTLIL::Cell *cell, const RTLIL::IdString &, const RTLIL::SigSpec &, const RTLIL::SigSpec &)
+{
+	mark_changed(cell->module);
+}
+
+void QuickConeSatCache::notify_connect(RTLIL::Module *module, const RTLIL::SigSig &)
+{
+	mark_changed(module);
+}
+
+void QuickConeSatCache::notify_connect(RTLIL::Module *module, const std::vector<RTLIL::SigSig> &)
+{
+	mark_changed(module);
+}
+
+void QuickConeSatCache::notify_wire_del(RTLIL::Module *module, const pool<RTLIL::Wire*> &)
+{
+	mark_changed(module);
+}
+
+void QuickConeSatCache::notify_blackout(RTLIL::Module *module)
+{
+	mark_changed(module);
+}
+
+void QuickConeSatCache::notify_cell_del(RTLIL::Module *module, const pool<RTLIL::Cell*> &)
+{
+	mark_changed(module);
+}
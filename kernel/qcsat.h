@@ -22,6 +22,7 @@
 
 #include "kernel/satgen.h"
 #include "kernel/modtools.h"
+#include "kernel/threading.h"
 
 YOSYS_NAMESPACE_BEGIN
 
@@ -46,7 +47,8 @@ struct QuickConeSat {
 	// - 3: shifts
 	// - 4: multiplication, division, power
 	int max_cell_complexity = 2;
-	// The maximum number of cells to import, or 0 for no limit.
+	// The maximum number of cells to import in one prepare() call, or 0 for
+	// no limit.
 	int max_cell_count = 0;
 	// If non-0, skip importing cells with more than this number of output bits.
 	int max_cell_outs = 0;
@@ -56,6 +58,11 @@ struct QuickConeSat {
 	pool<RTLIL::Wire*> imported_onehot;
 	pool<RTLIL::SigBit> bits_queue;
 
+	// If set, the type and parameters of each cell are recorded when it is
+	// imported. Used by QuickConeSatCache to notice cells changed in place.
+	bool record_cell_state = false;
+	dict<RTLIL::Cell*, std::pair<RTLIL::IdString, dict<RTLIL::IdString, RTLIL::Const>>> imported_cell_state;
+
 	QuickConeSat(ModWalker &modwalker) : modwalker(modwalker), ez(), satgen(ez.get(), &modwalker.sigmap) {}
 
 	// Imports a signal into the SAT solver, queues its input cone to be
@@ -67,10 +74,102 @@ struct QuickConeSat {
 	// the SAT solver.
 	void prepare();
 
+	// Restores the effort level knobs to their defaults.
+	void reset_effort();
+
 	// Returns the "complexity level" of a given cell.
 	static int cell_complexity(RTLIL::Cell *cell);
 };
 
+// Solves a batch of independent queries on several QuickConeSat instances at
+// once. Each query is imported into its context() by the calling thread, since
+// importing reads the design, and solve() then solves the queries of different
+// contexts concurrently. Consecutive queries share a context, so that their
+// cones are imported only once. The split does not depend on the number of
+// threads, which makes the results the same for any thread count.
+struct QuickConeSatBatch
+{
+	// Creates the contexts for 'num_queries' queries, 'queries_per_context'
+	// of them sharing each, with the effort level knobs copied from 'effort'.
+	QuickConeSatBatch(ModWalker &modwalker, int num_queries, int queries_per_context, const QuickConeSat &effort);
+
+	// Returns the context query i is to be imported into.
+	QuickConeSat &context(int query);
+
+	// Calls solve(i) for every query, those of one context in order on the
+	// same thread. solve(i) may only use the ez of context(i); it must not
+	// touch the design, the other contexts or the log.
+	void solve(ParallelDispatcher *dispatcher, const std::function<void(int)> &solve);
+
+private:
+	int num_queries, queries_per_context;
+	std::vector<std::unique_ptr<QuickConeSat>> contexts;
+};
+
+// A design-level cache of QuickConeSat contexts, one per module. Passes that
+// get their context from here share the imported cones and the incremental
+// solver with all earlier queries on the same module, including those made by
+// earlier passes, instead of importing the same logic into a fresh solver.
+//
+// Contexts only live while a Scope for their design exists. Passes that use
+// the cache open a Scope in execute(), and a command that calls several of
+// them (like "opt") can open an outer one to share contexts between them.
+// When the last Scope of a design ends, its contexts are freed and the cache
+// stops monitoring the design. At most max_contexts contexts are kept; the
+// least recently used one is evicted first.
+//
+// A context is dropped once its module is changed. Changes made through the
+// RTLIL API are seen through the RTLIL::Monitor interface, and the imported
+// cells are checked for in-place type and parameter changes before a context
+// is handed out again. Since the solver is shared, queries must pass their
+// constraints as assumptions to solve() and must not call ez->assume() or
+// ez->non_incremental().
+struct QuickConeSatCache : RTLIL::Monitor
+{
+	static const int max_contexts = 8;
+
+	struct Scope {
+		RTLIL::Design *design;
+		Scope(RTLIL::Design *design);
+		~Scope();
+	};
+
+	// Returns the context for the given module, with the effort level knobs
+	// set to their defaults. It may only be used until the next call to get()
+	// and requires a Scope for the design of the module.
+	static QuickConeSat &get(RTLIL::Module *module);
+
+private:
+	struct Context {
+		ModWalker modwalker;
+		QuickConeSat qcsat;
+		bool changed = false;
+		int last_use = 0;
+
+		Context(RTLIL::Module *module);
+		bool cells_unchanged() const;
+	};
+
+	dict<RTLIL::Module*, Context*> contexts;
+	dict<RTLIL::Design*, int> scopes;
+	int use_counter = 0;
+
+	static QuickConeSatCache &instance();
+	QuickConeSat &get_context(RTLIL::Module *module);
+	void drop(RTLIL::Module *module);
+	void mark_changed(RTLIL::Module *module);
+	void mark_design_changed(RTLIL::Design *design);
+
+	void notify_module_add(RTLIL::Module *module) override;
+	void notify_module_del(RTLIL::Module *module) override;
+	void notify_connect(RTLIL::Cell *cell, const RTLIL::IdString &port, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig) override;
+	void notify_connect(RTLIL::Module *module, const RTLIL::SigSig &sigsig) override;
+	void notify_connect(RTLIL::Module *module, const std::vector<RTLIL::SigSig> &sigsig_vec) override;
+	void notify_wire_del(RTLIL::Module *module, const pool<RTLIL::Wire*> &wires) override;
+	void notify_blackout(RTLIL::Module *module) override;
+	void notify_cell_del(RTLIL::Module *module, const pool<RTLIL::Cell*> &cells) override;
+};
+
 YOSYS_NAMESPACE_END
 
 #endif
@@ -24,6 +24,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+
+#ifdef __GLIBC__
+#  include <malloc.h>
+#endif
 
 #ifdef YOSYS_ENABLE_ZLIB
 #include <zlib.h>
@@ -149,10 +159,72 @@ Pass::~Pass()
 {
 }
 
+bool pass_profile_enabled = false;
+std::vector<PassProfileRecord> pass_profile_records;
+static int pass_profile_depth = 0;
+static int pass_profile_generation = 0;
+
+void pass_profile_clear()
+{
+	pass_profile_records.clear();
+	pass_profile_generation++;
+}
+
+void PassProfileSample::sample(RTLIL::Design *design)
+{
+#if defined(__linux__)
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f != nullptr) {
+		long pages_total = 0, pages_resident = 0;
+		if (fscanf(f, "%ld %ld", &pages_total, &pages_resident) == 2)
+			rss_bytes = int64_t(pages_resident) * sysconf(_SC_PAGESIZE);
+		fclose(f);
+	}
+#endif
+#if defined(__linux__) || defined(__FreeBSD__)
+	struct rusage ru_buffer;
+	getrusage(RUSAGE_SELF, &ru_buffer);
+	peak_rss_bytes = int64_t(ru_buffer.ru_maxrss) * 1024;
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 mi = mallinfo2();
+	heap_bytes = int64_t(mi.uordblks) + int64_t(mi.hblkhd);
+#elif defined(__GLIBC__)
+	struct mallinfo mi = mallinfo();
+	heap_bytes = int64_t((unsigned int)mi.uordblks) + int64_t((unsigned int)mi.hblkhd);
+#endif
+
+	idstrings = GetSize(RTLIL::IdString::global_id_storage_) - GetSize(RTLIL::IdString::global_free_idx_list_);
+
+	modules = 0, wires = 0, cells = 0, bits = 0;
+	if (design == nullptr)
+		return;
+
+	// walk the containers directly: the pass may be called from inside an
+	// iteration over design->modules() and must not inflate lazy modules
+	for (auto &mod_it : design->modules_) {
+		modules++;
+		wires += GetSize(mod_it.second->wires_);
+		cells += GetSize(mod_it.second->cells_);
+		for (auto &wire_it : mod_it.second->wires_)
+			bits += wire_it.second->width;
+	}
+}
+
 Pass::pre_post_exec_state_t Pass::pre_execute()
 {
 	pre_post_exec_state_t state;
 	call_counter++;
+	state.profile_index = -1;
+	state.profile_generation = pass_profile_generation;
+	if (pass_profile_enabled) {
+		state.profile_index = GetSize(pass_profile_records);
+		pass_profile_records.emplace_back();
+		PassProfileRecord &rec = pass_profile_records.back();
+		rec.pass_name = pass_name;
+		rec.depth = pass_profile_depth++;
+		rec.before.sample(yosys_design);
+	}
 	state.begin_ns = PerformanceTimer::query();
 	state.parent_pass = current_pass;
 	current_pass = this;
@@ -170,6 +242,17 @@ void Pass::post_execute(Pass::pre_post_exec_state_t state)
 	current_pass = state.parent_pass;
 	if (current_pass)
 		current_pass->runtime_ns -= time_ns;
+
+	if (state.profile_index >= 0) {
+		pass_profile_depth--;
+		// the records may have been cleared in the meantime ('profile -clear')
+		if (state.profile_generation == pass_profile_generation) {
+			PassProfileRecord &rec = pass_profile_records.at(state.profile_index);
+			rec.complete = true;
+			rec.runtime_ns = time_ns;
+			rec.after.sample(yosys_design);
+		}
+	}
 }
 
 void Pass::help()
@@ -649,13 +732,41 @@ void Backend::execute(std::vector<std::string> args, RTLIL::Design *design)
 {
 	std::ostream *f = NULL;
 	auto state = pre_execute();
+	if (!writes_lazy_modules)
+		design->inflate_all();
 	execute(f, std::string(), args, design);
 	post_execute(state);
 	if (f != &std::cout)
 		delete f;
 }
 
-void Backend::extra_args(std::ostream *&f, std::string &filename, std::vector<std::string> args, size_t argidx, bool bin_output)
+// Lazily loaded modules are decoded from their source file when they are written, so the ones decoded from the
+// output file have to be inflated before it is truncated. (On Windows, st_ino is always zero and this inflates
+// all lazily loaded modules read from files on the same drive.)
+static void inflate_modules_from_file(RTLIL::Design *design, const std::string &filename)
+{
+	struct stat out_stat;
+	if (design == nullptr || design->lazy_modules.empty() || stat(filename.c_str(), &out_stat) != 0)
+		return;
+
+	std::vector<RTLIL::IdString> names;
+	for (auto &it : design->lazy_modules) {
+		std::string source = it.second->source_file();
+		struct stat source_stat;
+		if (!source.empty() && stat(source.c_str(), &source_stat) == 0 &&
+				source_stat.st_dev == out_stat.st_dev && source_stat.st_ino == out_stat.st_ino)
+			names.push_back(it.first);
+	}
+
+	if (!names.empty())
+		log("Inflating %d lazily loaded modules read from the output file.\n", GetSize(names));
+	for (auto &name : names)
+		if (design->lazy_modules.count(name))
+			design->inflate(name);
+}
+
+void Backend::extra_args(std::ostream *&f, std::string &filename, std::vector<std::string> args, size_t argidx, bool bin_output,
+		RTLIL::Design *design)
 {
 	bool called_with_fp = f != NULL;
 
@@ -676,6 +787,7 @@ void Backend::extra_args(std::ostream *&f, std::string &filename, std::vector<st
 
 		filename = arg;
 		rewrite_filename(filename);
+		inflate_modules_from_file(design, filename);
 		if (filename.size() > 3 && filename.compare(filename.size()-3, std::string::npos, ".gz") == 0) {
 #ifdef YOSYS_ENABLE_ZLIB
 			gzip_ostream *gf = new gzip_ostream;
@@ -732,11 +844,15 @@ void Backend::backend_call(RTLIL::Design *design, std::ostream *f, std::string f
 
 	if (f != NULL) {
 		auto state = backend_register[args[0]]->pre_execute();
+		if (!backend_register[args[0]]->writes_lazy_modules)
+			design->inflate_all();
 		backend_register[args[0]]->execute(f, filename, args, design);
 		backend_register[args[0]]->post_execute(state);
 	} else if (filename == "-") {
 		std::ostream *f_cout = &std::cout;
 		auto state = backend_register[args[0]]->pre_execute();
+		if (!backend_register[args[0]]->writes_lazy_modules)
+			design->inflate_all();
 		backend_register[args[0]]->execute(f_cout, "<stdout>", args, design);
 		backend_register[args[0]]->post_execute(state);
 	} else {
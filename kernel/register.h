@@ -45,6 +45,7 @@ struct Pass
 	struct pre_post_exec_state_t {
 		Pass *parent_pass;
 		int64_t begin_ns;
+		int profile_index, profile_generation;
 	};
 
 	pre_post_exec_state_t pre_execute();
@@ -72,6 +73,30 @@ struct Pass
 	virtual void on_shutdown();
 };
 
+// Per-invocation resource profile, collected by pre_execute()/post_execute()
+// while pass_profile_enabled is set (see the 'profile' command).
+struct PassProfileSample
+{
+	int64_t rss_bytes = 0, peak_rss_bytes = 0, heap_bytes = 0;
+	int idstrings = 0, modules = 0, wires = 0, cells = 0;
+	int64_t bits = 0;
+
+	void sample(RTLIL::Design *design);
+};
+
+struct PassProfileRecord
+{
+	std::string pass_name;
+	int depth = 0;
+	bool complete = false;
+	int64_t runtime_ns = 0;
+	PassProfileSample before, after;
+};
+
+extern bool pass_profile_enabled;
+extern std::vector<PassProfileRecord> pass_profile_records;
+void pass_profile_clear();
+
 struct ScriptPass : Pass
 {
 	bool block_active, help_mode;
@@ -112,13 +137,19 @@ struct Frontend : Pass
 struct Backend : Pass
 {
 	std::string backend_name;
+	// set by backends that write lazily loaded modules themselves. all other
+	// backends get a design with all lazily loaded modules inflated.
+	bool writes_lazy_modules = false;
 	Backend(std::string name, std::string short_help = "** document me **");
 	void run_register() override;
 	~Backend() override;
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override final;
 	virtual void execute(std::ostream *&f, std::string filename,  std::vector<std::string> args, RTLIL::Design *design) = 0;
 
-	void extra_args(std::ostream *&f, std::string &filename, std::vector<std::string> args, size_t argidx, bool bin_output = false);
+	// backends that write lazily loaded modules pass the design, so that modules which are decoded from the output
+	// file are inflated before the file is truncated
+	void extra_args(std::ostream *&f, std::string &filename, std::vector<std::string> args, size_t argidx, bool bin_output = false,
+			RTLIL::Design *design = nullptr);
 
 	static void backend_call(RTLIL::Design *design, std::ostream *f, std::string filename, std::string command);
 	static void backend_call(RTLIL::Design *design, std::ostream *f, std::string filename, std::vector<std::string> args);
@@ -610,13 +610,20 @@ void RTLIL::Selection::optimize(RTLIL::Design *design)
 		selected_modules.insert(mod_name);
 	}
 
-	if (selected_modules.size() == design->modules_.size()) {
+	if (selected_modules.size() == design->modules_.size() && design->lazy_modules.empty()) {
 		full_selection = true;
 		selected_modules.clear();
 		selected_members.clear();
 	}
 }
 
+void RTLIL::Monitor::notify_cell_del(RTLIL::Module*, const pool<RTLIL::Cell*> &cells)
+{
+	for (auto cell : cells)
+		for (auto &it : cell->connections_)
+			notify_connect(cell, it.first, it.second, RTLIL::SigSpec());
+}
+
 RTLIL::Design::Design()
   : verilog_defines (new define_map_t)
 {
@@ -634,8 +641,11 @@ RTLIL::Design::Design()
 
 RTLIL::Design::~Design()
 {
-	for (auto &pr : modules_)
+	for (auto &pr : modules_) {
+		for (auto mon : monitors)
+			mon->notify_module_del(pr.second);
 		delete pr.second;
+	}
 	for (auto n : bindings_)
 		delete n;
 	for (auto n : verilog_packages)
@@ -656,18 +666,33 @@ std::map<unsigned int, RTLIL::Design*> *RTLIL::Design::get_all_designs(void)
 #endif
 
 RTLIL::ObjRange<RTLIL::Module*> RTLIL::Design::modules()
+{
+	// modules can't be added while the design is being iterated, so lazily
+	// loaded modules are inflated up front rather than on lookup
+	inflate_all();
+	return RTLIL::ObjRange<RTLIL::Module*>(&modules_, &refcount_modules_);
+}
+
+RTLIL::ObjRange<RTLIL::Module*> RTLIL::Design::loaded_modules()
 {
 	return RTLIL::ObjRange<RTLIL::Module*>(&modules_, &refcount_modules_);
 }
 
 RTLIL::Module *RTLIL::Design::module(const RTLIL::IdString& name)
 {
-	return modules_.count(name) ? modules_.at(name) : NULL;
+	auto it = modules_.find(name);
+	if (it != modules_.end())
+		return it->second;
+	if (lazy_modules.count(name))
+		return inflate(name);
+	return NULL;
 }
 
 const RTLIL::Module *RTLIL::Design::module(const RTLIL::IdString& name) const
 {
-	return modules_.count(name) ? modules_.at(name) : NULL;
+	// inflating a lazy module does not change the logical content of the
+	// design, so it is allowed from a const lookup as well (like has()).
+	return const_cast<RTLIL::Design*>(this)->module(name);
 }
 
 RTLIL::Module *RTLIL::Design::top_module()
@@ -685,10 +710,49 @@ RTLIL::Module *RTLIL::Design::top_module()
 	return module_count == 1 ? module : nullptr;
 }
 
+RTLIL::Module *RTLIL::Design::inflate(const RTLIL::IdString &name)
+{
+	if (refcount_modules_ != 0)
+		log_error("Can't inflate module %s while iterating over the modules of the design.\n", log_id(name));
+
+	RTLIL::Module *result = nullptr;
+	std::vector<RTLIL::IdString> queue = { name };
+
+	for (int i = 0; i < GetSize(queue); i++)
+	{
+		auto it = lazy_modules.find(queue[i]);
+		if (it == lazy_modules.end())
+			continue;
+
+		std::shared_ptr<RTLIL::LazyModuleLoader> loader = it->second;
+		lazy_modules.erase(it);
+
+		RTLIL::Module *module = loader->decode_module(queue[i]);
+		log_assert(module->name == queue[i]);
+		add(module);
+
+		if (result == nullptr)
+			result = module;
+
+		for (auto cell : module->cells())
+			if (lazy_modules.count(cell->type))
+				queue.push_back(cell->type);
+	}
+
+	return result;
+}
+
+void RTLIL::Design::inflate_all()
+{
+	while (!lazy_modules.empty())
+		inflate(lazy_modules.begin()->first);
+}
+
 void RTLIL::Design::add(RTLIL::Module *module)
 {
 	log_assert(modules_.count(module->name) == 0);
 	log_assert(refcount_modules_ == 0);
+	lazy_modules.erase(module->name);
 	modules_[module->name] = module;
 	module->design = this;
 
@@ -886,6 +950,8 @@ bool RTLIL::Design::selected_whole_module(RTLIL::Module *mod) const
 
 std::vector<RTLIL::Module*> RTLIL::Design::selected_modules() const
 {
+	// see Design::module() const for why this is allowed
+	const_cast<RTLIL::Design*>(this)->inflate_all();
 	std::vector<RTLIL::Module*> result;
 	result.reserve(modules_.size());
 	for (auto &it : modules_)
@@ -896,6 +962,7 @@ std::vector<RTLIL::Module*> RTLIL::Design::selected_modules() const
 
 std::vector<RTLIL::Module*> RTLIL::Design::selected_whole_modules() const
 {
+	const_cast<RTLIL::Design*>(this)->inflate_all();
 	std::vector<RTLIL::Module*> result;
 	result.reserve(modules_.size());
 	for (auto &it : modules_)
@@ -906,6 +973,7 @@ std::vector<RTLIL::Module*> RTLIL::Design::selected_whole_modules() const
 
 std::vector<RTLIL::Module*> RTLIL::Design::selected_whole_modules_warn(bool include_wb) const
 {
+	const_cast<RTLIL::Design*>(this)->inflate_all();
 	std::vector<RTLIL::Module*> result;
 	result.reserve(modules_.size());
 	for (auto &it : modules_)
@@ -2138,10 +2206,18 @@ void RTLIL::Module::add(RTLIL::Binding *binding)
 	bindings_.push_back(binding);
 }
 
+
 void RTLIL::Module::remove(const pool<RTLIL::Wire*> &wires)
 {
 	log_assert(refcount_wires_ == 0);
 
+	for (auto mon : monitors)
+		mon->notify_wire_del(this, wires);
+
+	if (design)
+		for (auto mon : design->monitors)
+			mon->notify_wire_del(this, wires);
+
 	struct DeleteWireWorker
 	{
 		RTLIL::Module *module;
@@ -2183,6 +2259,44 @@ void RTLIL::Module::remove(const pool<RTLIL::Wire*> &wires)
 	}
 }
 
+void RTLIL::Module::remove(const pool<RTLIL::Cell*> &cells)
+{
+	log_assert(refcount_cells_ == 0);
+
+	if (cells.empty())
+		return;
+
+	if (yosys_xtrace) {
+		for (auto cell : cells)
+			while (!cell->connections_.empty())
+				cell->unsetPort(cell->connections_.begin()->first);
+	} else {
+		for (auto mon : monitors)
+			mon->notify_cell_del(this, cells);
+		if (design)
+			for (auto mon : design->monitors)
+				mon->notify_cell_del(this, cells);
+	}
+
+	// Rebuilding the index from the survivors is cheaper than erasing the
+	// cells one by one, and keeps the survivors in their order.
+	std::vector<std::pair<RTLIL::IdString, RTLIL::Cell*>> survivors;
+	survivors.reserve(GetSize(cells_) - GetSize(cells));
+	for (auto &it : cells_)
+		if (!cells.count(it.second))
+			survivors.push_back(it);
+	log_assert(GetSize(survivors) + GetSize(cells) == GetSize(cells_));
+
+	dict<RTLIL::IdString, RTLIL::Cell*> new_cells;
+	new_cells.reserve(GetSize(survivors));
+	for (auto it = survivors.rbegin(); it != survivors.rend(); ++it)
+		new_cells.insert(*it);
+	cells_.swap(new_cells);
+
+	for (auto cell : cells)
+		delete cell;
+}
+
 void RTLIL::Module::remove(RTLIL::Cell *cell)
 {
 	while (!cell->connections_.empty())
@@ -57,6 +57,7 @@ namespace RTLIL
 	struct AttrObject;
 	struct Selection;
 	struct Monitor;
+	struct LazyModuleLoader;
 	struct Design;
 	struct Module;
 	struct Wire;
@@ -1033,7 +1034,28 @@ struct RTLIL::Monitor
 	virtual void notify_connect(RTLIL::Cell*, const RTLIL::IdString&, const RTLIL::SigSpec&, const RTLIL::SigSpec&) { }
 	virtual void notify_connect(RTLIL::Module*, const RTLIL::SigSig&) { }
 	virtual void notify_connect(RTLIL::Module*, const std::vector<RTLIL::SigSig>&) { }
+	virtual void notify_wire_del(RTLIL::Module*, const pool<RTLIL::Wire*>&) { }
 	virtual void notify_blackout(RTLIL::Module*) { }
+
+	// called once by Module::remove(const pool<Cell*>&) before the cells are
+	// deleted, instead of a notify_connect() for each port that would have
+	// been unset; the default implementation makes these calls
+	virtual void notify_cell_del(RTLIL::Module*, const pool<RTLIL::Cell*> &cells);
+};
+
+// Source of modules that are kept in serialized form until they are first
+// used (see Design::lazy_modules).
+struct RTLIL::LazyModuleLoader
+{
+	virtual ~LazyModuleLoader() { }
+
+	// decode the named module into a new module object that is not yet
+	// added to any design
+	virtual RTLIL::Module *decode_module(RTLIL::IdString name) = 0;
+
+	// the file the modules are decoded from, or an empty string if they
+	// are not read from a file
+	virtual std::string source_file() const { return std::string(); }
 };
 
 // Forward declaration; defined in preproc.h.
@@ -1051,6 +1073,13 @@ struct RTLIL::Design
 	dict<RTLIL::IdString, RTLIL::Module*> modules_;
 	std::vector<RTLIL::Binding*> bindings_;
 
+	// modules that have not been decoded yet. they are inflated (together
+	// with the modules they instantiate) when they are looked up by name,
+	// e.g. by a hierarchy walk or a selection that matches their name, and
+	// all of them are inflated before modules() or selected_modules() start
+	// iterating, so that iterations include them.
+	dict<RTLIL::IdString, std::shared_ptr<RTLIL::LazyModuleLoader>> lazy_modules;
+
 	std::vector<AST::AstNode*> verilog_packages, verilog_globals;
 	std::unique_ptr<define_map_t> verilog_defines;
 
@@ -1062,14 +1091,20 @@ struct RTLIL::Design
 	~Design();
 
 	RTLIL::ObjRange<RTLIL::Module*> modules();
+	// like modules(), but without inflating lazily loaded modules. only for
+	// code that handles lazy_modules itself.
+	RTLIL::ObjRange<RTLIL::Module*> loaded_modules();
 	RTLIL::Module *module(const RTLIL::IdString &name);
 	const RTLIL::Module *module(const RTLIL::IdString &name) const;
 	RTLIL::Module *top_module();
 
 	bool has(const RTLIL::IdString &id) const {
-		return modules_.count(id) != 0;
+		return modules_.count(id) != 0 || lazy_modules.count(id) != 0;
 	}
 
+	RTLIL::Module *inflate(const RTLIL::IdString &name);
+	void inflate_all();
+
 	void add(RTLIL::Module *module);
 	void add(RTLIL::Binding *binding);
 
@@ -1234,6 +1269,8 @@ public:
 
 	// Removing wires is expensive. If you have to remove wires, remove them all at once.
 	void remove(const pool<RTLIL::Wire*> &wires);
+	// Removing many cells at once compacts the cell index in a single pass.
+	void remove(const pool<RTLIL::Cell*> &cells);
 	void remove(RTLIL::Cell *cell);
 	void remove(RTLIL::Process *process);
 
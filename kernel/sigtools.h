@@ -342,6 +342,108 @@ struct SigMap
 	}
 };
 
+// A SigMap that stays in sync with the module it was created for. It is
+// registered as a module monitor (like ModIndex) and merges new connections
+// into the union-find as they are made, so it only needs a full rebuild when
+// the connection list is replaced or wires are removed.
+//
+// A long-running caller (e.g. the "opt" pass) can keep an instance alive for
+// a module, and the passes it calls pick it up via MonitoredSigMap::get().
+struct MonitoredSigMap : public RTLIL::Monitor
+{
+	RTLIL::Module *module;
+	SigMap sigmap;
+	int auto_reload_counter;
+	bool auto_reload_module;
+
+	MonitoredSigMap(RTLIL::Module *module) : module(module)
+	{
+		auto_reload_counter = 0;
+		auto_reload_module = true;
+		module->monitors.insert(this);
+	}
+
+	~MonitoredSigMap()
+	{
+		module->monitors.erase(this);
+	}
+
+	void reload_module()
+	{
+		sigmap.set(module);
+		auto_reload_counter++;
+		auto_reload_module = false;
+	}
+
+	SigMap &get()
+	{
+		if (auto_reload_module)
+			reload_module();
+		return sigmap;
+	}
+
+	void notify_connect(RTLIL::Module *mod, const RTLIL::SigSig &sigsig) override
+	{
+		log_assert(module == mod);
+
+		if (auto_reload_module)
+			return;
+
+		// Module::connect() drops bits with a constant left-hand side
+		for (int i = 0; i < GetSize(sigsig.first); i++)
+			if (sigsig.first[i].wire != nullptr)
+				sigmap.add(sigsig.first[i], sigsig.second[i]);
+	}
+
+	void notify_connect(RTLIL::Module *mod, const std::vector<RTLIL::SigSig>&) override
+	{
+		log_assert(module == mod);
+		auto_reload_module = true;
+	}
+
+	void notify_wire_del(RTLIL::Module *mod, const pool<RTLIL::Wire*>&) override
+	{
+		log_assert(module == mod);
+		auto_reload_module = true;
+	}
+
+	void notify_blackout(RTLIL::Module *mod) override
+	{
+		log_assert(module == mod);
+		auto_reload_module = true;
+	}
+
+	void notify_cell_del(RTLIL::Module *mod, const pool<RTLIL::Cell*>&) override
+	{
+		// cell ports don't contribute to the map
+		log_assert(module == mod);
+	}
+
+	// Returns the shared monitored SigMap of the module, if there is one.
+	static MonitoredSigMap *find(RTLIL::Module *module)
+	{
+		for (auto mon : module->monitors) {
+			MonitoredSigMap *msm = dynamic_cast<MonitoredSigMap*>(mon);
+			if (msm != nullptr)
+				return msm;
+		}
+		return nullptr;
+	}
+
+	// Returns the shared monitored SigMap of the module if there is one,
+	// otherwise initializes and returns the caller-provided fallback. Callers
+	// must not add() mappings to the result that are not also made as module
+	// connections.
+	static SigMap &get(RTLIL::Module *module, SigMap &fallback)
+	{
+		MonitoredSigMap *msm = find(module);
+		if (msm != nullptr)
+			return msm->get();
+		fallback.set(module);
+		return fallback;
+	}
+};
+
 YOSYS_NAMESPACE_END
 
 #endif /* SIGTOOLS_H */
@@ -0,0 +1,714 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/snapshot.h"
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+static const char snapshot_magic[8] = { 'Y', 'S', 'S', 'N', 'A', 'P', '\0', '\0' };
+static const uint32_t snapshot_version = 1;
+static const uint32_t snapshot_byteorder = 0x01020304;
+static const uint32_t snapshot_const_chunk = 0xffffffff;
+
+static const size_t snapshot_header_size = 16;
+static const size_t snapshot_trailer_size = 40;
+static const size_t snapshot_index_entry_size = 24;
+
+enum SnapshotConstEncoding : uint32_t {
+	SNAPSHOT_CONST_BITS = 0,   // fully defined, 1 bit per state
+	SNAPSHOT_CONST_STATES = 1, // 4 bits per state
+	SNAPSHOT_CONST_STRING = 2, // string table reference (string constants)
+};
+
+enum SnapshotWireFlags : uint32_t {
+	SNAPSHOT_WIRE_INPUT = 1,
+	SNAPSHOT_WIRE_OUTPUT = 2,
+	SNAPSHOT_WIRE_UPTO = 4,
+	SNAPSHOT_WIRE_SIGNED = 8,
+};
+
+SnapshotWriter::SnapshotWriter(std::ostream &f) : f(f), file_pos(0), finished(false)
+{
+	uint32_t header[2] = { snapshot_version, snapshot_byteorder };
+	emit_bytes(snapshot_magic, sizeof(snapshot_magic));
+	emit_bytes(header, sizeof(header));
+	log_assert(file_pos == snapshot_header_size);
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+	log_assert(finished);
+}
+
+void SnapshotWriter::emit_bytes(const void *data, size_t len)
+{
+	f.write(static_cast<const char*>(data), len);
+	file_pos += len;
+}
+
+uint32_t SnapshotWriter::intern(RTLIL::IdString id)
+{
+	auto it = id_index.find(id);
+	if (it != id_index.end())
+		return it->second;
+	uint32_t idx = intern(id.str());
+	id_index[id] = idx;
+	return idx;
+}
+
+uint32_t SnapshotWriter::intern(const std::string &str)
+{
+	auto it = str_index.find(str);
+	if (it != str_index.end())
+		return it->second;
+	uint32_t idx = GetSize(strings);
+	strings.push_back(str);
+	str_index[str] = idx;
+	return idx;
+}
+
+void SnapshotWriter::put_const(const RTLIL::Const &value)
+{
+	int width = GetSize(value);
+	bool fully_def = value.is_fully_def();
+
+	put(width);
+
+	if ((value.flags & RTLIL::CONST_FLAG_STRING) && fully_def && width % 8 == 0) {
+		put(value.flags | (SNAPSHOT_CONST_STRING << 8));
+		std::string raw(width / 8, '\0');
+		for (int i = 0; i < width; i++)
+			if (value.bits[i] == State::S1)
+				raw[i / 8] |= 1 << (i % 8);
+		put(intern(raw));
+		return;
+	}
+
+	if (fully_def) {
+		put(value.flags | (SNAPSHOT_CONST_BITS << 8));
+		for (int i = 0; i < width; i += 32) {
+			uint32_t word = 0;
+			for (int j = 0; j < 32 && i + j < width; j++)
+				if (value.bits[i + j] == State::S1)
+					word |= 1u << j;
+			put(word);
+		}
+		return;
+	}
+
+	put(value.flags | (SNAPSHOT_CONST_STATES << 8));
+	for (int i = 0; i < width; i += 8) {
+		uint32_t word = 0;
+		for (int j = 0; j < 8 && i + j < width; j++)
+			word |= uint32_t(value.bits[i + j]) << (4 * j);
+		put(word);
+	}
+}
+
+void SnapshotWriter::put_sig(const RTLIL::SigSpec &sig)
+{
+	const std::vector<RTLIL::SigChunk> &chunks = sig.chunks();
+	put(GetSize(chunks));
+	for (auto &chunk : chunks) {
+		if (chunk.wire != nullptr) {
+			put(wire_index.at(chunk.wire));
+			put(chunk.offset);
+			put(chunk.width);
+		} else {
+			put(snapshot_const_chunk);
+			put_const(RTLIL::Const(chunk.data));
+		}
+	}
+}
+
+void SnapshotWriter::put_attrs(const RTLIL::AttrObject *obj)
+{
+	put(GetSize(obj->attributes));
+	for (auto &it : obj->attributes) {
+		put_id(it.first);
+		put_const(it.second);
+	}
+}
+
+void SnapshotWriter::put_case(const RTLIL::CaseRule *cs)
+{
+	put_attrs(cs);
+	put(GetSize(cs->compare));
+	for (auto &sig : cs->compare)
+		put_sig(sig);
+	put(GetSize(cs->actions));
+	for (auto &action : cs->actions) {
+		put_sig(action.first);
+		put_sig(action.second);
+	}
+	put(GetSize(cs->switches));
+	for (auto sw : cs->switches)
+		put_switch(sw);
+}
+
+void SnapshotWriter::put_switch(const RTLIL::SwitchRule *sw)
+{
+	put_attrs(sw);
+	put_sig(sw->signal);
+	put(GetSize(sw->cases));
+	for (auto cs : sw->cases)
+		put_case(cs);
+}
+
+void SnapshotWriter::put_sync(const RTLIL::SyncRule *sync)
+{
+	put(sync->type);
+	put_sig(sync->signal);
+	put(GetSize(sync->actions));
+	for (auto &action : sync->actions) {
+		put_sig(action.first);
+		put_sig(action.second);
+	}
+	put(GetSize(sync->mem_write_actions));
+	for (auto &mwa : sync->mem_write_actions) {
+		put_attrs(&mwa);
+		put_id(mwa.memid);
+		put_sig(mwa.address);
+		put_sig(mwa.data);
+		put_sig(mwa.enable);
+		put_const(mwa.priority_mask);
+	}
+}
+
+void SnapshotWriter::write_module(RTLIL::Module *module)
+{
+	log_assert(!finished);
+
+	buf.clear();
+	wire_index.clear();
+
+	put_id(module->name);
+	put_attrs(module);
+
+	put(GetSize(module->avail_parameters));
+	for (auto &param : module->avail_parameters)
+		put_id(param);
+	put(GetSize(module->parameter_default_values));
+	for (auto &it : module->parameter_default_values) {
+		put_id(it.first);
+		put_const(it.second);
+	}
+
+	// wires: flat records, followed by the attributes of those wires that have any
+	int num_wire_attrs = 0;
+	uint32_t wire_idx = 0;
+	put(GetSize(module->wires_));
+	for (auto wire : module->wires()) {
+		uint32_t flags = 0;
+		if (wire->port_input)
+			flags |= SNAPSHOT_WIRE_INPUT;
+		if (wire->port_output)
+			flags |= SNAPSHOT_WIRE_OUTPUT;
+		if (wire->upto)
+			flags |= SNAPSHOT_WIRE_UPTO;
+		if (wire->is_signed)
+			flags |= SNAPSHOT_WIRE_SIGNED;
+		wire_index[wire] = wire_idx++;
+		put_id(wire->name);
+		put(wire->width);
+		put(wire->start_offset);
+		put(wire->port_id);
+		put(flags);
+		if (!wire->attributes.empty())
+			num_wire_attrs++;
+	}
+	put(num_wire_attrs);
+	for (auto wire : module->wires())
+		if (!wire->attributes.empty()) {
+			put(wire_index.at(wire));
+			put_attrs(wire);
+		}
+
+	put(GetSize(module->memories));
+	for (auto &it : module->memories) {
+		put_id(it.second->name);
+		put(it.second->width);
+		put(it.second->start_offset);
+		put(it.second->size);
+		put_attrs(it.second);
+	}
+
+	// cells: flat records, followed by parameters and connections in cell
+	// order and the attributes of those cells that have any
+	int num_cell_attrs = 0;
+	put(GetSize(module->cells_));
+	for (auto cell : module->cells()) {
+		put_id(cell->name);
+		put_id(cell->type);
+		put(GetSize(cell->parameters));
+		put(GetSize(cell->connections_));
+		if (!cell->attributes.empty())
+			num_cell_attrs++;
+	}
+	for (auto cell : module->cells()) {
+		for (auto &it : cell->parameters) {
+			put_id(it.first);
+			put_const(it.second);
+		}
+		for (auto &it : cell->connections_) {
+			put_id(it.first);
+			put_sig(it.second);
+		}
+	}
+	put(num_cell_attrs);
+	int cell_idx = 0;
+	for (auto cell : module->cells()) {
+		if (!cell->attributes.empty()) {
+			put(cell_idx);
+			put_attrs(cell);
+		}
+		cell_idx++;
+	}
+
+	put(GetSize(module->connections()));
+	for (auto &conn : module->connections()) {
+		put_sig(conn.first);
+		put_sig(conn.second);
+	}
+
+	put(GetSize(module->processes));
+	for (auto &it : module->processes) {
+		RTLIL::Process *proc = it.second;
+		put_id(proc->name);
+		put_attrs(proc);
+		put_case(&proc->root_case);
+		put(GetSize(proc->syncs));
+		for (auto sync : proc->syncs)
+			put_sync(sync);
+	}
+
+	ModuleEntry entry;
+	entry.name = intern(module->name);
+	entry.offset = file_pos;
+	entry.size = buf.size() * sizeof(uint32_t);
+	module_entries.push_back(entry);
+
+	emit_bytes(buf.data(), entry.size);
+}
+
+void SnapshotWriter::finish()
+{
+	log_assert(!finished);
+	finished = true;
+
+	static const char padding[8] = { };
+	if (file_pos % 8 != 0)
+		emit_bytes(padding, 8 - file_pos % 8);
+
+	uint64_t strtab_offset = file_pos;
+	std::vector<uint64_t> offsets;
+	offsets.reserve(strings.size() + 1);
+	uint64_t str_pos = 0;
+	for (auto &str : strings) {
+		offsets.push_back(str_pos);
+		str_pos += str.size();
+	}
+	offsets.push_back(str_pos);
+	emit_bytes(offsets.data(), offsets.size() * sizeof(uint64_t));
+	for (auto &str : strings)
+		emit_bytes(str.data(), str.size());
+	if (file_pos % 8 != 0)
+		emit_bytes(padding, 8 - file_pos % 8);
+
+	uint64_t index_offset = file_pos;
+	for (auto &entry : module_entries) {
+		uint32_t words[2] = { entry.name, 0 };
+		uint64_t dwords[2] = { entry.offset, entry.size };
+		emit_bytes(words, sizeof(words));
+		emit_bytes(dwords, sizeof(dwords));
+	}
+
+	uint64_t trailer_offsets[2] = { strtab_offset, index_offset };
+	uint32_t trailer_words[4] = { uint32_t(GetSize(strings)), uint32_t(GetSize(module_entries)), uint32_t(autoidx), snapshot_byteorder };
+	emit_bytes(trailer_offsets, sizeof(trailer_offsets));
+	emit_bytes(trailer_words, sizeof(trailer_words));
+	emit_bytes(snapshot_magic, sizeof(snapshot_magic));
+
+	f.flush();
+	if (f.fail())
+		log_error("Failed to write snapshot data.\n");
+}
+
+SnapshotReader::SnapshotReader(const std::string &filename) :
+		filename(filename), data(nullptr), size(0), mapped(false), ptr(nullptr), end(nullptr)
+{
+#ifndef _WIN32
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		log_error("Can't open snapshot file `%s' for reading: %s\n", filename.c_str(), strerror(errno));
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		log_error("Can't stat snapshot file `%s': %s\n", filename.c_str(), strerror(errno));
+	size = st.st_size;
+	if (size > 0) {
+		void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+			log_error("Can't map snapshot file `%s': %s\n", filename.c_str(), strerror(errno));
+		data = static_cast<const char*>(p);
+		mapped = true;
+	}
+	close(fd);
+#else
+	std::ifstream f(filename.c_str(), std::ios::binary);
+	if (f.fail())
+		log_error("Can't open snapshot file `%s' for reading.\n", filename.c_str());
+	file_buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	data = file_buffer.data();
+	size = file_buffer.size();
+#endif
+
+	if (size < snapshot_header_size + snapshot_trailer_size ||
+			memcmp(data, snapshot_magic, sizeof(snapshot_magic)) ||
+			memcmp(data + size - sizeof(snapshot_magic), snapshot_magic, sizeof(snapshot_magic)))
+		log_error("File `%s' is not a yosys snapshot.\n", filename.c_str());
+
+	uint32_t header[2];
+	memcpy(header, data + sizeof(snapshot_magic), sizeof(header));
+	if (header[1] != snapshot_byteorder)
+		log_error("Snapshot file `%s' was written on a host with different byte order.\n", filename.c_str());
+	if (header[0] != snapshot_version)
+		log_error("Snapshot file `%s' has unsupported version %u.\n", filename.c_str(), header[0]);
+
+	uint64_t trailer_offsets[2];
+	uint32_t trailer_words[4];
+	const char *trailer = data + size - snapshot_trailer_size;
+	memcpy(trailer_offsets, trailer, sizeof(trailer_offsets));
+	memcpy(trailer_words, trailer + sizeof(trailer_offsets), sizeof(trailer_words));
+
+	uint64_t strtab_offset = trailer_offsets[0];
+	uint64_t index_offset = trailer_offsets[1];
+	num_strings = trailer_words[0];
+	uint32_t num_modules = trailer_words[1];
+	autoidx = std::max(autoidx, int(trailer_words[2]));
+
+	if (strtab_offset % 8 != 0 || strtab_offset + (num_strings + 1) * sizeof(uint64_t) > size ||
+			index_offset + num_modules * snapshot_index_entry_size > size - snapshot_trailer_size)
+		log_error("Snapshot file `%s' is corrupt.\n", filename.c_str());
+
+	string_offsets = reinterpret_cast<const uint64_t*>(data + strtab_offset);
+	string_data = data + strtab_offset + (num_strings + 1) * sizeof(uint64_t);
+	if (string_data + string_offsets[num_strings] > data + index_offset)
+		log_error("Snapshot file `%s' is corrupt.\n", filename.c_str());
+
+	id_cache.resize(num_strings);
+	id_cached.resize(num_strings);
+
+	module_entries.resize(num_modules);
+	for (uint32_t i = 0; i < num_modules; i++) {
+		const char *p = data + index_offset + i * snapshot_index_entry_size;
+		ModuleEntry &entry = module_entries[i];
+		memcpy(&entry.name, p, sizeof(uint32_t));
+		memcpy(&entry.offset, p + 8, sizeof(uint64_t));
+		memcpy(&entry.size, p + 16, sizeof(uint64_t));
+		if (entry.offset % 4 != 0 || entry.offset + entry.size > strtab_offset)
+			log_error("Snapshot file `%s' is corrupt.\n", filename.c_str());
+		module_index[get_id(entry.name)] = i;
+	}
+}
+
+SnapshotReader::~SnapshotReader()
+{
+#ifndef _WIN32
+	if (mapped)
+		munmap(const_cast<char*>(data), size);
+#endif
+}
+
+std::string SnapshotReader::get_str(uint32_t idx) const
+{
+	if (idx >= num_strings)
+		log_error("Invalid string reference in snapshot file `%s'.\n", filename.c_str());
+	return std::string(string_data + string_offsets[idx], string_offsets[idx+1] - string_offsets[idx]);
+}
+
+RTLIL::IdString SnapshotReader::get_id(uint32_t idx)
+{
+	if (idx >= num_strings)
+		log_error("Invalid string reference in snapshot file `%s'.\n", filename.c_str());
+	if (!id_cached[idx]) {
+		id_cache[idx] = get_str(idx);
+		id_cached[idx] = true;
+	}
+	return id_cache[idx];
+}
+
+RTLIL::IdString SnapshotReader::module_name(int idx)
+{
+	return get_id(module_entries.at(idx).name);
+}
+
+int SnapshotReader::find_module(RTLIL::IdString name)
+{
+	auto it = module_index.find(name);
+	return it == module_index.end() ? -1 : it->second;
+}
+
+RTLIL::Const SnapshotReader::get_const()
+{
+	int width = get();
+	uint32_t flags = get();
+	uint32_t encoding = flags >> 8;
+
+	RTLIL::Const value;
+	value.flags = flags & 0xff;
+	value.bits.resize(width);
+
+	switch (encoding)
+	{
+	case SNAPSHOT_CONST_STRING: {
+		std::string raw = get_str(get());
+		if (GetSize(raw) * 8 != width)
+			log_error("Invalid string constant in snapshot file `%s'.\n", filename.c_str());
+		for (int i = 0; i < width; i++)
+			value.bits[i] = (raw[i / 8] >> (i % 8)) & 1 ? State::S1 : State::S0;
+		break;
+	}
+	case SNAPSHOT_CONST_BITS:
+		for (int i = 0; i < width; i += 32) {
+			uint32_t word = get();
+			for (int j = 0; j < 32 && i + j < width; j++)
+				value.bits[i + j] = (word >> j) & 1 ? State::S1 : State::S0;
+		}
+		break;
+	case SNAPSHOT_CONST_STATES:
+		for (int i = 0; i < width; i += 8) {
+			uint32_t word = get();
+			for (int j = 0; j < 8 && i + j < width; j++)
+				value.bits[i + j] = RTLIL::State((word >> (4 * j)) & 15);
+		}
+		break;
+	default:
+		log_error("Invalid constant encoding in snapshot file `%s'.\n", filename.c_str());
+	}
+
+	return value;
+}
+
+RTLIL::SigSpec SnapshotReader::get_sig()
+{
+	RTLIL::SigSpec sig;
+	int num_chunks = get();
+	for (int i = 0; i < num_chunks; i++) {
+		uint32_t wire_idx = get();
+		if (wire_idx == snapshot_const_chunk) {
+			sig.append(get_const());
+			continue;
+		}
+		if (wire_idx >= wires.size())
+			log_error("Invalid wire reference in snapshot file `%s'.\n", filename.c_str());
+		int offset = get();
+		int width = get();
+		sig.append(RTLIL::SigSpec(wires[wire_idx], offset, width));
+	}
+	return sig;
+}
+
+void SnapshotReader::get_attrs(RTLIL::AttrObject *obj)
+{
+	int num_attrs = get();
+	for (int i = 0; i < num_attrs; i++) {
+		RTLIL::IdString key = get_id();
+		obj->attributes[key] = get_const();
+	}
+}
+
+void SnapshotReader::get_case(RTLIL::CaseRule *cs)
+{
+	get_attrs(cs);
+	int num_compare = get();
+	for (int i = 0; i < num_compare; i++)
+		cs->compare.push_back(get_sig());
+	int num_actions = get();
+	for (int i = 0; i < num_actions; i++) {
+		RTLIL::SigSpec lhs = get_sig();
+		cs->actions.push_back(RTLIL::SigSig(lhs, get_sig()));
+	}
+	int num_switches = get();
+	for (int i = 0; i < num_switches; i++)
+		cs->switches.push_back(get_switch());
+}
+
+RTLIL::SwitchRule *SnapshotReader::get_switch()
+{
+	RTLIL::SwitchRule *sw = new RTLIL::SwitchRule;
+	get_attrs(sw);
+	sw->signal = get_sig();
+	int num_cases = get();
+	for (int i = 0; i < num_cases; i++) {
+		RTLIL::CaseRule *cs = new RTLIL::CaseRule;
+		get_case(cs);
+		sw->cases.push_back(cs);
+	}
+	return sw;
+}
+
+RTLIL::SyncRule *SnapshotReader::get_sync()
+{
+	RTLIL::SyncRule *sync = new RTLIL::SyncRule;
+	sync->type = RTLIL::SyncType(get());
+	sync->signal = get_sig();
+	int num_actions = get();
+	for (int i = 0; i < num_actions; i++) {
+		RTLIL::SigSpec lhs = get_sig();
+		sync->actions.push_back(RTLIL::SigSig(lhs, get_sig()));
+	}
+	int num_mem_write_actions = get();
+	for (int i = 0; i < num_mem_write_actions; i++) {
+		RTLIL::MemWriteAction mwa;
+		get_attrs(&mwa);
+		mwa.memid = get_id();
+		mwa.address = get_sig();
+		mwa.data = get_sig();
+		mwa.enable = get_sig();
+		mwa.priority_mask = get_const();
+		sync->mem_write_actions.push_back(mwa);
+	}
+	return sync;
+}
+
+RTLIL::Module *SnapshotReader::decode_module(int idx)
+{
+	const ModuleEntry &entry = module_entries.at(idx);
+	ptr = reinterpret_cast<const uint32_t*>(data + entry.offset);
+	end = ptr + entry.size / sizeof(uint32_t);
+	wires.clear();
+
+	RTLIL::Module *module = new RTLIL::Module;
+	module->name = get_id();
+	get_attrs(module);
+
+	int num_params = get();
+	for (int i = 0; i < num_params; i++)
+		module->avail_parameters(get_id());
+	int num_param_defaults = get();
+	for (int i = 0; i < num_param_defaults; i++) {
+		RTLIL::IdString key = get_id();
+		module->parameter_default_values[key] = get_const();
+	}
+
+	int num_wires = get();
+	wires.reserve(num_wires);
+	for (int i = 0; i < num_wires; i++) {
+		RTLIL::IdString name = get_id();
+		RTLIL::Wire *wire = module->addWire(name, get());
+		wire->start_offset = get();
+		wire->port_id = get();
+		uint32_t flags = get();
+		wire->port_input = (flags & SNAPSHOT_WIRE_INPUT) != 0;
+		wire->port_output = (flags & SNAPSHOT_WIRE_OUTPUT) != 0;
+		wire->upto = (flags & SNAPSHOT_WIRE_UPTO) != 0;
+		wire->is_signed = (flags & SNAPSHOT_WIRE_SIGNED) != 0;
+		wires.push_back(wire);
+	}
+	int num_wire_attrs = get();
+	for (int i = 0; i < num_wire_attrs; i++)
+		get_attrs(wires.at(get()));
+
+	int num_memories = get();
+	for (int i = 0; i < num_memories; i++) {
+		RTLIL::Memory *memory = new RTLIL::Memory;
+		memory->name = get_id();
+		memory->width = get();
+		memory->start_offset = get();
+		memory->size = get();
+		get_attrs(memory);
+		module->memories[memory->name] = memory;
+	}
+
+	int num_cells = get();
+	std::vector<RTLIL::Cell*> cells;
+	std::vector<std::pair<int, int>> cell_sizes;
+	cells.reserve(num_cells);
+	cell_sizes.reserve(num_cells);
+	for (int i = 0; i < num_cells; i++) {
+		RTLIL::IdString name = get_id();
+		cells.push_back(module->addCell(name, get_id()));
+		int num_cell_params = get();
+		cell_sizes.push_back(std::make_pair(num_cell_params, int(get())));
+	}
+	for (int i = 0; i < num_cells; i++) {
+		RTLIL::Cell *cell = cells[i];
+		for (int j = 0; j < cell_sizes[i].first; j++) {
+			RTLIL::IdString key = get_id();
+			cell->parameters[key] = get_const();
+		}
+		for (int j = 0; j < cell_sizes[i].second; j++) {
+			RTLIL::IdString port = get_id();
+			cell->connections_[port] = get_sig();
+		}
+	}
+	int num_cell_attrs = get();
+	for (int i = 0; i < num_cell_attrs; i++)
+		get_attrs(cells.at(get()));
+
+	int num_conns = get();
+	std::vector<RTLIL::SigSig> conns;
+	conns.reserve(num_conns);
+	for (int i = 0; i < num_conns; i++) {
+		RTLIL::SigSpec lhs = get_sig();
+		conns.push_back(RTLIL::SigSig(lhs, get_sig()));
+	}
+	module->new_connections(conns);
+
+	int num_procs = get();
+	for (int i = 0; i < num_procs; i++) {
+		RTLIL::Process *proc = module->addProcess(get_id());
+		get_attrs(proc);
+		get_case(&proc->root_case);
+		int num_syncs = get();
+		for (int j = 0; j < num_syncs; j++)
+			proc->syncs.push_back(get_sync());
+	}
+
+	if (ptr != end)
+		log_error("Trailing data in module %s of snapshot file `%s'.\n", log_id(module->name), filename.c_str());
+
+	module->fixup_ports();
+	wires.clear();
+	return module;
+}
+
+RTLIL::Module *SnapshotReader::decode_module(RTLIL::IdString name)
+{
+	int idx = find_module(name);
+	if (idx < 0)
+		log_error("Module %s not found in snapshot file `%s'.\n", log_id(name), filename.c_str());
+	return decode_module(idx);
+}
+
+RTLIL::Module *SnapshotReader::load_module(RTLIL::Design *design, int idx)
+{
+	RTLIL::Module *module = decode_module(idx);
+	design->add(module);
+	return module;
+}
+
+YOSYS_NAMESPACE_END
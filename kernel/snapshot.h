@@ -0,0 +1,147 @@
+/* -*- c++ -*-
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+// Binary design snapshots
+//
+// A snapshot file stores a set of modules in a compact binary form that can
+// be memory-mapped and decoded one module at a time:
+//
+//   header     magic and format version (16 bytes)
+//   modules    one blob of 32-bit words per module
+//   strings    interned string table (all IdStrings and string constants)
+//   index      module table: name, blob offset and blob size
+//   trailer    offsets of the string table and module index (40 bytes)
+//
+// Inside a module blob, wires and cells are stored as flat fixed-size
+// records, signals refer to wires by their index in the module's wire array,
+// and constants are packed with one bit per state when they are fully
+// defined. Strings are referenced by their index in the string table and
+// are only turned into IdStrings when a module using them is decoded.
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "kernel/yosys.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+struct SnapshotWriter
+{
+	SnapshotWriter(std::ostream &f);
+	~SnapshotWriter();
+
+	void write_module(RTLIL::Module *module);
+	void finish();
+
+private:
+	struct ModuleEntry {
+		uint32_t name;
+		uint64_t offset, size;
+	};
+
+	std::ostream &f;
+	uint64_t file_pos;
+	bool finished;
+
+	dict<RTLIL::IdString, uint32_t> id_index;
+	dict<std::string, uint32_t> str_index;
+	std::vector<std::string> strings;
+	std::vector<ModuleEntry> module_entries;
+
+	std::vector<uint32_t> buf;
+	dict<RTLIL::Wire*, uint32_t> wire_index;
+
+	void emit_bytes(const void *data, size_t len);
+	uint32_t intern(RTLIL::IdString id);
+	uint32_t intern(const std::string &str);
+
+	void put(uint32_t word) { buf.push_back(word); }
+	void put_id(RTLIL::IdString id) { buf.push_back(intern(id)); }
+	void put_const(const RTLIL::Const &value);
+	void put_sig(const RTLIL::SigSpec &sig);
+	void put_attrs(const RTLIL::AttrObject *obj);
+	void put_case(const RTLIL::CaseRule *cs);
+	void put_switch(const RTLIL::SwitchRule *sw);
+	void put_sync(const RTLIL::SyncRule *sync);
+};
+
+struct SnapshotReader : public RTLIL::LazyModuleLoader
+{
+	std::string filename;
+
+	SnapshotReader(const std::string &filename);
+	~SnapshotReader() override;
+
+	int count_modules() const { return GetSize(module_entries); }
+	RTLIL::IdString module_name(int idx);
+	int find_module(RTLIL::IdString name);
+
+	// decode the module with the given index into a new module object that
+	// is not yet added to any design
+	RTLIL::Module *decode_module(int idx);
+	RTLIL::Module *decode_module(RTLIL::IdString name) override;
+	std::string source_file() const override { return filename; }
+
+	// decode the module with the given index and add it to the design
+	RTLIL::Module *load_module(RTLIL::Design *design, int idx);
+
+private:
+	struct ModuleEntry {
+		uint32_t name;
+		uint64_t offset, size;
+	};
+
+	const char *data;
+	size_t size;
+	bool mapped;
+	std::vector<char> file_buffer;
+
+	const uint64_t *string_offsets;
+	const char *string_data;
+	uint32_t num_strings;
+
+	std::vector<ModuleEntry> module_entries;
+	dict<RTLIL::IdString, int> module_index;
+
+	std::vector<RTLIL::IdString> id_cache;
+	std::vector<bool> id_cached;
+
+	const uint32_t *ptr, *end;
+	std::vector<RTLIL::Wire*> wires;
+
+	std::string get_str(uint32_t idx) const;
+	RTLIL::IdString get_id(uint32_t idx);
+
+	uint32_t get() {
+		if (ptr == end)
+			log_error("Unexpected end of module data in snapshot file `%s'.\n", filename.c_str());
+		return *ptr++;
+	}
+	RTLIL::IdString get_id() { return get_id(get()); }
+	RTLIL::Const get_const();
+	RTLIL::SigSpec get_sig();
+	void get_attrs(RTLIL::AttrObject *obj);
+	void get_case(RTLIL::CaseRule *cs);
+	RTLIL::SwitchRule *get_switch();
+	RTLIL::SyncRule *get_sync();
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
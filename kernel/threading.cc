@@ -0,0 +1,171 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/threading.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+int ThreadPool::pool_size(int reserved_cores, int max_threads)
+{
+#ifdef YOSYS_ENABLE_THREADS
+	int available = std::thread::hardware_concurrency();
+	const char *env = getenv("YOSYS_MAX_THREADS");
+	if (env != nullptr && atoi(env) > 0)
+		available = available > 0 ? std::min(available, atoi(env)) : atoi(env);
+	int num_threads = std::min(available - reserved_cores, max_threads);
+	return std::max(0, num_threads);
+#else
+	(void)reserved_cores;
+	(void)max_threads;
+	return 0;
+#endif
+}
+
+ThreadPool::ThreadPool(int pool_size, std::function<void(int)> b) : body(std::move(b))
+{
+#ifdef YOSYS_ENABLE_THREADS
+	threads.reserve(pool_size);
+	for (int i = 0; i < pool_size; i++)
+		threads.emplace_back([i, this]{ body(i); });
+#else
+	log_assert(pool_size == 0);
+#endif
+}
+
+ThreadPool::~ThreadPool()
+{
+#ifdef YOSYS_ENABLE_THREADS
+	for (auto &t : threads)
+		t.join();
+#endif
+}
+
+int ThreadPool::num_threads() const
+{
+#ifdef YOSYS_ENABLE_THREADS
+	return GetSize(threads);
+#else
+	return 0;
+#endif
+}
+
+ParallelDispatcher::ParallelDispatcher(int num_workers)
+{
+#ifdef YOSYS_ENABLE_THREADS
+	threads.reserve(num_workers);
+	for (int i = 0; i < num_workers; i++)
+		threads.emplace_back([this]{ worker(); });
+#else
+	log_assert(num_workers == 0);
+#endif
+}
+
+ParallelDispatcher::~ParallelDispatcher()
+{
+#ifdef YOSYS_ENABLE_THREADS
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shutdown = true;
+	}
+	work_cv.notify_all();
+	for (auto &t : threads)
+		t.join();
+#endif
+}
+
+int ParallelDispatcher::num_workers() const
+{
+#ifdef YOSYS_ENABLE_THREADS
+	return GetSize(threads);
+#else
+	return 0;
+#endif
+}
+
+void ParallelDispatcher::run(int items, const std::function<void(int)> &w)
+{
+#ifdef YOSYS_ENABLE_THREADS
+	if (!threads.empty() && items > 1)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		log_assert(pending_items == 0);
+		work = &w;
+		num_items = items;
+		next_item = 0;
+		pending_items = items;
+		work_cv.notify_all();
+
+		// the calling thread takes items like any other worker
+		while (next_item < num_items)
+			run_next_item(lock);
+
+		done_cv.wait(lock, [this]{ return pending_items == 0; });
+		work = nullptr;
+		num_items = 0;
+		if (error) {
+			std::exception_ptr e = error;
+			error = nullptr;
+			std::rethrow_exception(e);
+		}
+		return;
+	}
+#endif
+	for (int i = 0; i < items; i++)
+		w(i);
+}
+
+#ifdef YOSYS_ENABLE_THREADS
+// called and returns with the lock held
+void ParallelDispatcher::run_next_item(std::unique_lock<std::mutex> &lock)
+{
+	int i = next_item++;
+	const std::function<void(int)> *w = work;
+	bool skip = error != nullptr;
+	std::exception_ptr e;
+
+	lock.unlock();
+	if (!skip) {
+		try {
+			(*w)(i);
+		} catch (...) {
+			e = std::current_exception();
+		}
+	}
+	lock.lock();
+
+	if (e && !error)
+		error = e;
+	if (--pending_items == 0)
+		done_cv.notify_all();
+}
+
+void ParallelDispatcher::worker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (1)
+	{
+		work_cv.wait(lock, [this]{ return shutdown || next_item < num_items; });
+		if (shutdown)
+			return;
+		run_next_item(lock);
+	}
+}
+#endif
+
+YOSYS_NAMESPACE_END
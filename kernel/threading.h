@@ -0,0 +1,98 @@
+/* -*- c++ -*-
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef YOSYS_THREADING_H
+#define YOSYS_THREADING_H
+
+#include "kernel/yosys.h"
+
+#ifdef YOSYS_ENABLE_THREADS
+#  include <thread>
+#  include <mutex>
+#  include <condition_variable>
+#  include <exception>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+// A fixed set of worker threads all running the same function. Without
+// thread support (YOSYS_ENABLE_THREADS unset) no threads are started and the
+// caller has to do the work itself, so every user needs a serial fallback.
+class ThreadPool
+{
+public:
+	// Number of worker threads to start when 'reserved_cores' cores are
+	// already busy (usually with the calling thread), capped at 'max_threads'.
+	// The YOSYS_MAX_THREADS environment variable limits the total number of
+	// threads further. Returns 0 when threads are not available.
+	static int pool_size(int reserved_cores, int max_threads);
+
+	// start 'pool_size' threads, thread i runs b(i)
+	ThreadPool(int pool_size, std::function<void(int)> b);
+
+	// waits for all threads to finish
+	~ThreadPool();
+
+	int num_threads() const;
+
+private:
+	std::function<void(int)> body;
+#ifdef YOSYS_ENABLE_THREADS
+	std::vector<std::thread> threads;
+#endif
+};
+
+// A set of worker threads that stay alive between batches of independent
+// work items. run(n, work) calls work(i) once for every i < n, spread over the
+// workers and the calling thread, and returns when all items are done. Items
+// are handed out one at a time, so they should be reasonably coarse. If an
+// item throws, the items that have not been started yet are skipped and run()
+// rethrows the first exception once all running items have finished. Without
+// thread support everything runs on the calling thread.
+class ParallelDispatcher
+{
+public:
+	// start 'num_workers' threads in addition to the calling thread
+	ParallelDispatcher(int num_workers);
+
+	// stops and joins all workers
+	~ParallelDispatcher();
+
+	int num_workers() const;
+
+	void run(int num_items, const std::function<void(int)> &work);
+
+private:
+#ifdef YOSYS_ENABLE_THREADS
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable work_cv, done_cv;
+	const std::function<void(int)> *work = nullptr;
+	int num_items = 0, next_item = 0, pending_items = 0;
+	bool shutdown = false;
+	std::exception_ptr error;
+
+	void run_next_item(std::unique_lock<std::mutex> &lock);
+	void worker();
+#endif
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
@@ -343,8 +343,9 @@ struct DesignPass : public Pass {
 		{
 			RTLIL::Design *design_copy = new RTLIL::Design;
 
-			for (auto mod : design->modules())
+			for (auto mod : design->loaded_modules())
 				design_copy->add(mod->clone());
+			design_copy->lazy_modules = design->lazy_modules;
 
 			design_copy->selection_stack = design->selection_stack;
 			design_copy->selection_vars = design->selection_vars;
@@ -361,6 +362,7 @@ struct DesignPass : public Pass {
 
 		if (reset_mode || !load_name.empty() || push_mode || pop_mode)
 		{
+			design->lazy_modules.clear();
 			for (auto mod : design->modules().to_vector())
 				design->remove(mod);
 
@@ -388,8 +390,9 @@ struct DesignPass : public Pass {
 		{
 			RTLIL::Design *saved_design = pop_mode ? pushed_designs.back() : saved_designs.at(load_name);
 
-			for (auto mod : saved_design->modules())
+			for (auto mod : saved_design->loaded_modules())
 				design->add(mod->clone());
+			design->lazy_modules = saved_design->lazy_modules;
 
 			design->selection_stack = saved_design->selection_stack;
 			design->selection_vars = saved_design->selection_vars;
@@ -0,0 +1,223 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2014  Claire Xenia Wolf <claire@yosyshq.com>
+ *  Copyright (C) 2014  Johann Glaser <Johann.Glaser@gmx.at>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+static std::string json_string(const std::string &str)
+{
+	std::string newstr = "\"";
+	for (char c : str) {
+		if (c == '\\')
+			newstr += "\\\\";
+		else if (c == '"')
+			newstr += "\\\"";
+		else if (c == '\n')
+			newstr += "\\n";
+		else if (c == '\r')
+			newstr += "\\r";
+		else if (c == '\t')
+			newstr += "\\t";
+		else if ((unsigned char)c < 0x20)
+			newstr += stringf("\\u%04X", c);
+		else
+			newstr += c;
+	}
+	return newstr + "\"";
+}
+
+static void write_sample_json(std::ostream &f, const char *name, const PassProfileSample &s)
+{
+	f << "      \"" << name << "\": {";
+	f << " \"rss_bytes\": " << s.rss_bytes;
+	f << ", \"peak_rss_bytes\": " << s.peak_rss_bytes;
+	f << ", \"heap_bytes\": " << s.heap_bytes;
+	f << ", \"idstrings\": " << s.idstrings;
+	f << ", \"modules\": " << s.modules;
+	f << ", \"wires\": " << s.wires;
+	f << ", \"cells\": " << s.cells;
+	f << ", \"bits\": " << s.bits;
+	f << " }";
+}
+
+static std::string format_mb_delta(int64_t before, int64_t after)
+{
+	return stringf("%+.2f", (after - before) / (1024.0 * 1024.0));
+}
+
+struct ProfilePass : public Pass {
+	ProfilePass() : Pass("profile", "per-pass memory and size profiling") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    profile -start\n");
+		log("    profile -stop\n");
+		log("    profile -clear\n");
+		log("\n");
+		log("Start or stop recording a profile entry for every command invocation (including\n");
+		log("commands called by other commands), or discard the recorded entries. Each entry\n");
+		log("holds the run time and the following values, sampled before and after the\n");
+		log("command:\n");
+		log("\n");
+		log("    - resident set size and peak resident set size of the process\n");
+		log("    - heap bytes in use (only available with glibc)\n");
+		log("    - number of live IdStrings\n");
+		log("    - number of modules, wires, cells and wire bits in the design\n");
+		log("\n");
+		log("\n");
+		log("    profile [-top <N>] [-json <filename>]\n");
+		log("\n");
+		log("Print the recorded entries, ordered by the increase of the peak resident set\n");
+		log("size they caused.\n");
+		log("\n");
+		log("    -top <N>\n");
+		log("        only print the N entries with the largest increase (default: 20,\n");
+		log("        use 0 to print all entries in execution order)\n");
+		log("\n");
+		log("    -json <filename>\n");
+		log("        write all recorded entries in execution order to the given JSON file\n");
+		log("        instead of printing them\n");
+		log("\n");
+		log("To profile a complete script run 'profile -start' first, e.g.:\n");
+		log("\n");
+		log("    yosys -p 'profile -start' -s synth.ys -p 'profile -json profile.json'\n");
+		log("\n");
+		log("or use the equivalent command line option 'yosys -J profile.json -s synth.ys'.\n");
+		log("\n");
+	}
+	void write_json(const std::string &filename)
+	{
+		std::ofstream f;
+		f.open(filename.c_str(), std::ofstream::trunc);
+		if (f.fail())
+			log_cmd_error("Can't open file `%s' for writing: %s\n", filename.c_str(), strerror(errno));
+
+		log("Writing profile to `%s'.\n", filename.c_str());
+
+		f << "{\n";
+		f << "  \"generator\": \"" << yosys_version_str << "\",\n";
+		f << "  \"records\": [";
+
+		bool first = true;
+		for (int i = 0; i < GetSize(pass_profile_records); i++) {
+			auto &rec = pass_profile_records[i];
+			if (!rec.complete)
+				continue;
+			f << (first ? "\n" : ",\n");
+			f << "    {\n";
+			f << "      \"index\": " << i << ",\n";
+			f << "      \"pass\": " << json_string(rec.pass_name) << ",\n";
+			f << "      \"depth\": " << rec.depth << ",\n";
+			f << "      \"runtime_ns\": " << rec.runtime_ns << ",\n";
+			write_sample_json(f, "before", rec.before);
+			f << ",\n";
+			write_sample_json(f, "after", rec.after);
+			f << "\n    }";
+			first = false;
+		}
+		f << "\n  ]\n}\n";
+	}
+	void print_table(int top)
+	{
+		std::vector<int> order;
+		for (int i = 0; i < GetSize(pass_profile_records); i++)
+			if (pass_profile_records[i].complete)
+				order.push_back(i);
+
+		if (top > 0) {
+			std::stable_sort(order.begin(), order.end(), [](int a, int b) {
+				auto &ra = pass_profile_records[a], &rb = pass_profile_records[b];
+				return ra.after.peak_rss_bytes - ra.before.peak_rss_bytes > rb.after.peak_rss_bytes - rb.before.peak_rss_bytes;
+			});
+			if (GetSize(order) > top)
+				order.resize(top);
+		}
+
+		log("%6s %-24s %10s %10s %10s %10s %9s %9s %9s\n", "#", "command", "time/s", "RSS/MB", "peak/MB",
+				"heap/MB", "IdStrs", "cells", "bits");
+		for (int i : order) {
+			auto &rec = pass_profile_records[i];
+			log("%6d %-24s %10.3f %10s %10s %10s %+9d %+9d %+9lld\n", i,
+					(std::string(2*rec.depth, ' ') + rec.pass_name).c_str(), rec.runtime_ns / 1e9,
+					format_mb_delta(rec.before.rss_bytes, rec.after.rss_bytes).c_str(),
+					format_mb_delta(rec.before.peak_rss_bytes, rec.after.peak_rss_bytes).c_str(),
+					format_mb_delta(rec.before.heap_bytes, rec.after.heap_bytes).c_str(),
+					rec.after.idstrings - rec.before.idstrings, rec.after.cells - rec.before.cells,
+					(long long)(rec.after.bits - rec.before.bits));
+		}
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design*) override
+	{
+		bool flag_start = false, flag_stop = false, flag_clear = false;
+		std::string json_file;
+		int top = 20;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++)
+		{
+			if (args[argidx] == "-start") {
+				flag_start = true;
+				continue;
+			}
+			if (args[argidx] == "-stop") {
+				flag_stop = true;
+				continue;
+			}
+			if (args[argidx] == "-clear") {
+				flag_clear = true;
+				continue;
+			}
+			if (args[argidx] == "-top" && argidx+1 < args.size()) {
+				top = atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-json" && argidx+1 < args.size()) {
+				json_file = args[++argidx];
+				continue;
+			}
+			break;
+		}
+		if (argidx != args.size())
+			cmd_error(args, argidx, "Unknown option or extra argument.");
+
+		if (flag_start && flag_stop)
+			log_cmd_error("Options -start and -stop are mutually exclusive.\n");
+
+		if (flag_start || flag_stop || flag_clear) {
+			if (!json_file.empty())
+				log_cmd_error("Option -json can't be combined with -start, -stop or -clear.\n");
+			if (flag_clear)
+				pass_profile_clear();
+			if (flag_start || flag_stop)
+				pass_profile_enabled = flag_start;
+			return;
+		}
+
+		if (!json_file.empty())
+			write_json(json_file);
+		else
+			print_table(top);
+	}
+} ProfilePass;
+
+PRIVATE_NAMESPACE_END
@@ -805,7 +805,23 @@ static void select_stmt(RTLIL::Design *design, std::string arg, bool disable_emp
 	}
 
 	sel.full_selection = false;
-	for (auto mod : design->modules())
+
+	// inflate lazily loaded modules that this pattern could match
+	if (!design->lazy_modules.empty()) {
+		std::vector<RTLIL::IdString> inflate_names;
+		for (auto &it : design->lazy_modules) {
+			if (arg_mod.compare(0, 2, "A:") == 0)
+				inflate_names.push_back(it.first);
+			else if (arg_mod.compare(0, 2, "N:") == 0 ? match_ids(it.first, arg_mod.substr(2)) : match_ids(it.first, arg_mod))
+				inflate_names.push_back(it.first);
+		}
+		for (auto &name : inflate_names)
+			if (design->lazy_modules.count(name))
+				design->inflate(name);
+	}
+
+	// modules that can't match the pattern stay lazy
+	for (auto mod : design->loaded_modules())
 	{
 		if (!select_blackboxes && mod->get_blackbox_attribute())
 			continue;
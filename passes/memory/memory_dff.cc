@@ -607,8 +607,10 @@ struct MemoryDffWorker
 	void run()
 	{
 		std::vector<Mem> memories = Mem::get_selected_memories(module);
+		if (memories.empty())
+			return;
+		QuickConeSat &qcsat = QuickConeSatCache::get(module);
 		for (auto &mem : memories) {
-			QuickConeSat qcsat(modwalker);
 			for (int i = 0; i < GetSize(mem.rd_ports); i++) {
 				if (!mem.rd_ports[i].clk_enable)
 					handle_rd_port(mem, qcsat, i);
@@ -656,6 +658,7 @@ struct MemoryDffPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		QuickConeSatCache::Scope qcsat_scope(design);
 		for (auto mod : design->selected_modules()) {
 			MemoryDffWorker worker(mod, flag_no_rw_check);
 			worker.run();
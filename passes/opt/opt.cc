@@ -19,12 +19,134 @@
 
 #include "kernel/register.h"
 #include "kernel/log.h"
+#include "kernel/sigtools.h"
+#include "kernel/qcsat.h"
 #include <stdlib.h>
 #include <stdio.h>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+// Hashes the types and parameters of the cells of a module. The sum over the
+// cells doesn't depend on the order of the cells.
+static unsigned int cell_fingerprint(RTLIL::Module *module)
+{
+	unsigned int fingerprint = 0;
+	for (auto cell : module->cells()) {
+		unsigned int h = mkhash(cell->hash(), cell->type.hash());
+		for (auto &it : cell->parameters) {
+			h = mkhash(h, it.first.hash());
+			for (auto bit : it.second.bits)
+				h = mkhash(h, bit);
+		}
+		fingerprint += h;
+	}
+	return fingerprint;
+}
+
+// Records the modules changed by the opt_* passes, so that each iteration of
+// the opt loop only needs to revisit the modules changed by the previous one.
+// The opt_* passes are module-local, so a module that was not changed can not
+// have become optimizable.
+//
+// Cell types and parameters are changed in place (e.g. by opt_expr and
+// opt_dff) without going through the monitor interface. These changes are
+// found by comparing the fingerprints of the modules that are not dirty yet,
+// taken at the start of an iteration, after each pass.
+struct DirtyModulesMonitor : public RTLIL::Monitor
+{
+	RTLIL::Design *design;
+	pool<RTLIL::Module*> dirty;
+	dict<RTLIL::Module*, unsigned int> fingerprints;
+
+	DirtyModulesMonitor(RTLIL::Design *design) : design(design)
+	{
+		design->monitors.insert(this);
+	}
+
+	~DirtyModulesMonitor()
+	{
+		design->monitors.erase(this);
+	}
+
+	void take_fingerprints(const RTLIL::Selection &selection)
+	{
+		fingerprints.clear();
+		for (auto module : design->selected_modules())
+			if (selection.selected_module(module->name))
+				fingerprints[module] = cell_fingerprint(module);
+	}
+
+	// Marks the modules that were changed in place as dirty. Modules that are
+	// dirty already don't need to be checked again.
+	void check_fingerprints()
+	{
+		for (auto module : dirty)
+			fingerprints.erase(module);
+		for (auto it = fingerprints.begin(); it != fingerprints.end();)
+			if (cell_fingerprint(it->first) != it->second) {
+				dirty.insert(it->first);
+				it = fingerprints.erase(it);
+			} else
+				++it;
+	}
+
+	void notify_module_del(RTLIL::Module *module) override
+	{
+		dirty.erase(module);
+		fingerprints.erase(module);
+	}
+
+	void notify_connect(RTLIL::Cell *cell, const RTLIL::IdString&, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig) override
+	{
+		if (old_sig != sig)
+			dirty.insert(cell->module);
+	}
+
+	void notify_connect(RTLIL::Module *module, const RTLIL::SigSig&) override
+	{
+		dirty.insert(module);
+	}
+
+	void notify_connect(RTLIL::Module *module, const std::vector<RTLIL::SigSig>&) override
+	{
+		dirty.insert(module);
+	}
+
+	void notify_wire_del(RTLIL::Module *module, const pool<RTLIL::Wire*> &wires) override
+	{
+		if (!wires.empty())
+			dirty.insert(module);
+	}
+
+	void notify_blackout(RTLIL::Module *module) override
+	{
+		dirty.insert(module);
+	}
+
+	void notify_cell_del(RTLIL::Module *module, const pool<RTLIL::Cell*> &cells) override
+	{
+		if (!cells.empty())
+			dirty.insert(module);
+	}
+};
+
+// Returns the current selection restricted to the given modules, or the whole
+// current selection if modules is nullptr.
+RTLIL::Selection restrict_selection(RTLIL::Design *design, const pool<RTLIL::Module*> *modules)
+{
+	RTLIL::Selection selection(false);
+	for (auto module : design->selected_modules()) {
+		if (modules != nullptr && modules->count(module) == 0)
+			continue;
+		if (design->selected_whole_module(module->name))
+			selection.select(module);
+		else
+			selection.selected_members[module->name] = design->selection().selected_members.at(module->name);
+	}
+	return selection;
+}
+
 struct OptPass : public Pass {
 	OptPass() : Pass("opt", "perform simple optimizations") { }
 	void help() override
@@ -37,7 +159,7 @@ struct OptPass : public Pass {
 		log("a series of trivial optimizations and cleanups. This pass executes the other\n");
 		log("passes in the following order:\n");
 		log("\n");
-		log("    opt_expr [-mux_undef] [-mux_bool] [-undriven] [-noclkinv] [-fine] [-full] [-keepdc]\n");
+		log("    opt_expr [-mux_undef] [-mux_bool] [-undriven] [-noclkinv] [-fine] [-full] [-keepdc] [-j N]\n");
 		log("    opt_merge [-share_all] -nomux\n");
 		log("\n");
 		log("    do\n");
@@ -45,20 +167,24 @@ struct OptPass : public Pass {
 		log("        opt_reduce [-fine] [-full]\n");
 		log("        opt_merge [-share_all]\n");
 		log("        opt_share  (-full only)\n");
-		log("        opt_dff [-nodffe] [-nosdff] [-keepdc] [-sat]  (except when called with -noff)\n");
+		log("        opt_dff [-nodffe] [-nosdff] [-keepdc] [-sat] [-j N]  (except when called with -noff)\n");
 		log("        opt_clean [-purge]\n");
-		log("        opt_expr [-mux_undef] [-mux_bool] [-undriven] [-noclkinv] [-fine] [-full] [-keepdc]\n");
+		log("        opt_expr [-mux_undef] [-mux_bool] [-undriven] [-noclkinv] [-fine] [-full] [-keepdc] [-j N]\n");
 		log("    while <changed design>\n");
 		log("\n");
 		log("When called with -fast the following script is used instead:\n");
 		log("\n");
 		log("    do\n");
-		log("        opt_expr [-mux_undef] [-mux_bool] [-undriven] [-noclkinv] [-fine] [-full] [-keepdc]\n");
+		log("        opt_expr [-mux_undef] [-mux_bool] [-undriven] [-noclkinv] [-fine] [-full] [-keepdc] [-j N]\n");
 		log("        opt_merge [-share_all]\n");
-		log("        opt_dff [-nodffe] [-nosdff] [-keepdc] [-sat]  (except when called with -noff)\n");
+		log("        opt_dff [-nodffe] [-nosdff] [-keepdc] [-sat] [-j N]  (except when called with -noff)\n");
 		log("        opt_clean [-purge]\n");
 		log("    while <changed design in opt_dff>\n");
 		log("\n");
+		log("Only the first iteration of the loop works on the whole selection. Each later\n");
+		log("iteration only revisits the selected modules that were changed by the previous\n");
+		log("one.\n");
+		log("\n");
 		log("Note: Options in square brackets (such as [-keepdc]) are passed through to\n");
 		log("the opt_* commands when given to 'opt'.\n");
 		log("\n");
@@ -74,6 +200,7 @@ struct OptPass : public Pass {
 		bool opt_share = false;
 		bool fast_mode = false;
 		bool noff_mode = false;
+		bool sat_mode = false;
 
 		log_header(design, "Executing OPT pass (performing simple optimizations).\n");
 		log_push();
@@ -117,6 +244,12 @@ struct OptPass : public Pass {
 				opt_merge_args += " -keepdc";
 				continue;
 			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				std::string num_threads = args[++argidx];
+				opt_expr_args += " -j " + num_threads;
+				opt_dff_args += " -j " + num_threads;
+				continue;
+			}
 			if (args[argidx] == "-nodffe") {
 				opt_dff_args += " -nodffe";
 				continue;
@@ -127,6 +260,7 @@ struct OptPass : public Pass {
 			}
 			if (args[argidx] == "-sat") {
 				opt_dff_args += " -sat";
+				sat_mode = true;
 				continue;
 			}
 			if (args[argidx] == "-share_all") {
@@ -145,42 +279,107 @@ struct OptPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		// Keep one incrementally updated SigMap per module alive for the
+		// whole run, so the opt_* passes don't each rebuild it from scratch.
+		std::vector<std::unique_ptr<MonitoredSigMap>> shared_sigmaps;
+		for (auto module : design->selected_modules())
+			if (MonitoredSigMap::find(module) == nullptr)
+				shared_sigmaps.emplace_back(new MonitoredSigMap(module));
+
+		// Likewise keep the SAT contexts of opt_dff -sat between iterations.
+		std::unique_ptr<QuickConeSatCache::Scope> qcsat_scope;
+		if (sat_mode)
+			qcsat_scope.reset(new QuickConeSatCache::Scope(design));
+
+		// The first iteration works on the whole selection, every later one only
+		// on the modules that were changed by the previous iteration.
+		DirtyModulesMonitor monitor(design);
+		RTLIL::Selection selection = restrict_selection(design, nullptr);
+		int selected_count = GetSize(selection.selected_modules) + GetSize(selection.selected_members);
+
+		// Changes that are neither seen by the monitor nor by the fingerprints
+		// (e.g. to wire attributes) are not tracked. If a pass reports that it
+		// did something but didn't touch any module in a way we can see, we
+		// can't tell which module it changed and the next iteration has to cover
+		// the whole selection again.
+		bool untracked_changes = false;
+
+		auto call = [&](const std::string &command) {
+			bool did_something = design->scratchpad_get_bool("opt.did_something");
+			design->scratchpad_unset("opt.did_something");
+			pool<RTLIL::Module*> dirty_before;
+			std::swap(dirty_before, monitor.dirty);
+
+			Pass::call_on_selection(design, selection, command);
+			for (auto module : dirty_before)
+				monitor.fingerprints.erase(module);
+			monitor.check_fingerprints();
+
+			if (design->scratchpad_get_bool("opt.did_something")) {
+				if (monitor.dirty.empty())
+					untracked_changes = true;
+				did_something = true;
+			}
+			for (auto module : dirty_before)
+				monitor.dirty.insert(module);
+			if (did_something)
+				design->scratchpad_set_bool("opt.did_something", true);
+		};
+		auto select_dirty = [&]() {
+			bool full = untracked_changes || monitor.dirty.empty();
+			selection = restrict_selection(design, full ? nullptr : &monitor.dirty);
+			int dirty_count = GetSize(selection.selected_modules) + GetSize(selection.selected_members);
+			log("Revisiting %d of %d selected modules.\n", dirty_count, selected_count);
+		};
+
 		if (fast_mode)
 		{
 			while (1) {
-				Pass::call(design, "opt_expr" + opt_expr_args);
-				Pass::call(design, "opt_merge" + opt_merge_args);
+				monitor.dirty.clear();
+				monitor.take_fingerprints(selection);
+				untracked_changes = false;
+				call("opt_expr" + opt_expr_args);
+				call("opt_merge" + opt_merge_args);
 				design->scratchpad_unset("opt.did_something");
 				if (!noff_mode)
-					Pass::call(design, "opt_dff" + opt_dff_args);
+					call("opt_dff" + opt_dff_args);
 				if (design->scratchpad_get_bool("opt.did_something") == false)
 					break;
-				Pass::call(design, "opt_clean" + opt_clean_args);
+				call("opt_clean" + opt_clean_args);
 				log_header(design, "Rerunning OPT passes. (Removed registers in this run.)\n");
+				select_dirty();
 			}
-			Pass::call(design, "opt_clean" + opt_clean_args);
+			// Modules left out of the last iteration were cleaned when they were last visited.
+			call("opt_clean" + opt_clean_args);
 		}
 		else
 		{
-			Pass::call(design, "opt_expr" + opt_expr_args);
-			Pass::call(design, "opt_merge -nomux" + opt_merge_args);
+			call("opt_expr" + opt_expr_args);
+			call("opt_merge -nomux" + opt_merge_args);
 			while (1) {
+				monitor.dirty.clear();
+				monitor.take_fingerprints(selection);
+				untracked_changes = false;
 				design->scratchpad_unset("opt.did_something");
-				Pass::call(design, "opt_muxtree");
-				Pass::call(design, "opt_reduce" + opt_reduce_args);
-				Pass::call(design, "opt_merge" + opt_merge_args);
+				call("opt_muxtree");
+				call("opt_reduce" + opt_reduce_args);
+				call("opt_merge" + opt_merge_args);
 				if (opt_share)
-					Pass::call(design, "opt_share");
+					call("opt_share");
 				if (!noff_mode)
-					Pass::call(design, "opt_dff" + opt_dff_args);
-				Pass::call(design, "opt_clean" + opt_clean_args);
-				Pass::call(design, "opt_expr" + opt_expr_args);
+					call("opt_dff" + opt_dff_args);
+				call("opt_clean" + opt_clean_args);
+				call("opt_expr" + opt_expr_args);
 				if (design->scratchpad_get_bool("opt.did_something") == false)
 					break;
 				log_header(design, "Rerunning OPT passes. (Maybe there is more to do..)\n");
+				select_dirty();
 			}
 		}
 
+		shared_sigmaps.clear();
+		qcsat_scope.reset();
+
 		design->optimize();
 		design->sort();
 		design->check();
@@ -99,14 +99,89 @@ keep_cache_t keep_cache;
 CellTypes ct_reg, ct_all;
 int count_rm_cells, count_rm_wires;
 
+// Numbers the bits of all wires in a module densely, so that sets of bits can
+// be kept in flat bitsets instead of hash tables.
+struct BitIndex
+{
+	dict<RTLIL::Wire*, int> offsets;
+	int size = 0;
+
+	BitIndex(RTLIL::Module *module)
+	{
+		offsets.reserve(GetSize(module->wires_));
+		for (auto &it : module->wires_) {
+			offsets[it.second] = size;
+			size += it.second->width;
+		}
+	}
+
+	int operator()(RTLIL::SigBit bit) const
+	{
+		log_assert(bit.wire != nullptr);
+		return offsets.at(bit.wire) + bit.offset;
+	}
+};
+
+// A set of wire bits, with the same interface as SigPool.
+struct BitSet
+{
+	const BitIndex &index;
+	std::vector<bool> bits;
+
+	BitSet(const BitIndex &index) : index(index), bits(index.size) { }
+
+	void add(const RTLIL::SigSpec &sig)
+	{
+		for (auto &chunk : sig.chunks()) {
+			if (chunk.wire == nullptr)
+				continue;
+			int offset = index.offsets.at(chunk.wire) + chunk.offset;
+			std::fill(bits.begin() + offset, bits.begin() + offset + chunk.width, true);
+		}
+	}
+
+	bool check(RTLIL::SigBit bit) const
+	{
+		return bit.wire != nullptr && bits[index(bit)];
+	}
+
+	bool check_any(const RTLIL::SigSpec &sig) const
+	{
+		for (auto &chunk : sig.chunks()) {
+			if (chunk.wire == nullptr)
+				continue;
+			int offset = index.offsets.at(chunk.wire) + chunk.offset;
+			for (int i = 0; i < chunk.width; i++)
+				if (bits[offset + i])
+					return true;
+		}
+		return false;
+	}
+
+	bool check_all(const RTLIL::SigSpec &sig) const
+	{
+		for (auto &chunk : sig.chunks()) {
+			if (chunk.wire == nullptr)
+				continue;
+			int offset = index.offsets.at(chunk.wire) + chunk.offset;
+			for (int i = 0; i < chunk.width; i++)
+				if (!bits[offset + i])
+					return false;
+		}
+		return true;
+	}
+};
+
 void rmunused_module_cells(Module *module, bool verbose)
 {
 	SigMap sigmap(module);
-	dict<IdString, pool<Cell*>> mem2cells;
+	BitIndex index(module);
+	dict<IdString, std::vector<int>> mem2cells;
 	pool<IdString> mem_unused;
-	pool<Cell*> queue, unused;
-	pool<SigBit> used_raw_bits;
-	dict<SigBit, pool<Cell*>> wire2driver;
+	std::vector<Cell*> cells;
+	std::vector<bool> used_cells, used_bits(index.size);
+	std::vector<int> queue;
+	std::vector<std::pair<int, int>> bit_drivers;
 	dict<SigBit, vector<string>> driver_driver_logs;
 	FfInitVals ffinit(&sigmap, module);
 
@@ -122,15 +197,16 @@ void rmunused_module_cells(Module *module, bool verbose)
 		mem_unused.insert(it.first);
 	}
 
-	for (Cell *cell : module->cells()) {
+	cells.reserve(GetSize(module->cells_));
+	used_cells.reserve(GetSize(module->cells_));
+	for (auto &it : module->cells_) {
+		Cell *cell = it.second;
+		int cell_idx = GetSize(cells);
+		cells.push_back(cell);
 		if (cell->type.in(ID($memwr), ID($memwr_v2), ID($meminit), ID($meminit_v2))) {
 			IdString mem_id = cell->getParam(ID::MEMID).decode_string();
-			mem2cells[mem_id].insert(cell);
+			mem2cells[mem_id].push_back(cell_idx);
 		}
-	}
-
-	for (auto &it : module->cells_) {
-		Cell *cell = it.second;
 		for (auto &it2 : cell->connections()) {
 			if (ct_all.cell_known(cell->type) && !ct_all.cell_output(cell->type, it2.first))
 				continue;
@@ -143,70 +219,98 @@ void rmunused_module_cells(Module *module, bool verbose)
 							"for %s between cell %s.%s and constant %s in %s: Resolved using constant.",
 							log_signal(raw_bit), log_id(cell), log_id(it2.first), log_signal(bit), log_id(module)));
 				if (bit.wire != nullptr)
-					wire2driver[bit].insert(cell);
+					bit_drivers.emplace_back(index(bit), cell_idx);
 			}
 		}
-		if (keep_cache.query(cell))
-			queue.insert(cell);
-		else
-			unused.insert(cell);
+		used_cells.push_back(keep_cache.query(cell));
+		if (used_cells.back())
+			queue.push_back(cell_idx);
 	}
 
+	// The drivers of bit i are driver_cells[driver_start[i] .. driver_start[i+1]-1].
+	std::vector<int> driver_start(index.size + 1), driver_cells(GetSize(bit_drivers));
+	for (auto &it : bit_drivers)
+		driver_start[it.first + 1]++;
+	for (int i = 0; i < index.size; i++)
+		driver_start[i + 1] += driver_start[i];
+	std::vector<int> driver_fill(driver_start.begin(), driver_start.end() - 1);
+	for (auto &it : bit_drivers)
+		driver_cells[driver_fill[it.first]++] = it.second;
+	bit_drivers.clear();
+
+	auto mark_cell = [&](int cell_idx) {
+		if (!used_cells[cell_idx]) {
+			used_cells[cell_idx] = true;
+			queue.push_back(cell_idx);
+		}
+	};
+
+	auto mark_bit = [&](SigBit bit) {
+		if (bit.wire == nullptr)
+			return;
+		int bit_idx = index(bit);
+		if (used_bits[bit_idx])
+			return;
+		used_bits[bit_idx] = true;
+		for (int i = driver_start[bit_idx]; i < driver_start[bit_idx + 1]; i++)
+			mark_cell(driver_cells[i]);
+	};
+
+	// Raw bits are only needed to decide which driver-driver conflicts to report.
+	pool<SigBit> used_raw_bits;
+	bool need_raw_bits = !driver_driver_logs.empty();
+
 	for (auto &it : module->wires_) {
 		Wire *wire = it.second;
 		if (wire->port_output || wire->get_bool_attribute(ID::keep)) {
 			for (auto bit : sigmap(wire))
-			for (auto c : wire2driver[bit])
-				queue.insert(c), unused.erase(c);
-			for (auto raw_bit : SigSpec(wire))
-				used_raw_bits.insert(raw_sigmap(raw_bit));
+				mark_bit(bit);
+			if (need_raw_bits)
+				for (auto raw_bit : SigSpec(wire))
+					used_raw_bits.insert(raw_sigmap(raw_bit));
 		}
 	}
 
 	while (!queue.empty())
 	{
-		pool<SigBit> bits;
-		pool<IdString> mems;
-		for (auto cell : queue) {
-			for (auto &it : cell->connections())
-				if (!ct_all.cell_known(cell->type) || ct_all.cell_input(cell->type, it.first))
-					for (auto bit : sigmap(it.second))
-						bits.insert(bit);
-
-			if (cell->type.in(ID($memrd), ID($memrd_v2))) {
-				IdString mem_id = cell->getParam(ID::MEMID).decode_string();
-				if (mem_unused.count(mem_id)) {
-					mem_unused.erase(mem_id);
-					mems.insert(mem_id);
-				}
-			}
-		}
-
-		queue.clear();
+		Cell *cell = cells[queue.back()];
+		queue.pop_back();
 
-		for (auto bit : bits)
-		for (auto c : wire2driver[bit])
-			if (unused.count(c))
-				queue.insert(c), unused.erase(c);
+		for (auto &it : cell->connections())
+			if (!ct_all.cell_known(cell->type) || ct_all.cell_input(cell->type, it.first))
+				for (auto bit : sigmap(it.second))
+					mark_bit(bit);
 
-		for (auto mem : mems)
-		for (auto c : mem2cells[mem])
-			if (unused.count(c))
-				queue.insert(c), unused.erase(c);
+		if (cell->type.in(ID($memrd), ID($memrd_v2))) {
+			IdString mem_id = cell->getParam(ID::MEMID).decode_string();
+			if (mem_unused.count(mem_id)) {
+				mem_unused.erase(mem_id);
+				for (auto cell_idx : mem2cells[mem_id])
+					mark_cell(cell_idx);
+			}
+		}
 	}
 
+	pool<Cell*> unused;
+	for (int i = 0; i < GetSize(cells); i++)
+		if (!used_cells[i])
+			unused.insert(cells[i]);
+
 	unused.sort(RTLIL::sort_by_name_id<RTLIL::Cell>());
 
 	for (auto cell : unused) {
 		if (verbose)
 			log_debug("  removing unused `%s' cell `%s'.\n", cell->type.c_str(), cell->name.c_str());
-		module->design->scratchpad_set_bool("opt.did_something", true);
 		if (RTLIL::builtin_ff_cell_types().count(cell->type))
 			ffinit.remove_init(cell->getPort(ID::Q));
-		module->remove(cell);
 		count_rm_cells++;
 	}
 
+	if (!unused.empty()) {
+		module->design->scratchpad_set_bool("opt.did_something", true);
+		module->remove(unused);
+	}
+
 	for (auto it : mem_unused)
 	{
 		if (verbose)
@@ -215,6 +319,9 @@ void rmunused_module_cells(Module *module, bool verbose)
 		module->memories.erase(it);
 	}
 
+	if (!need_raw_bits)
+		return;
+
 	for (auto &it : module->cells_) {
 		Cell *cell = it.second;
 		for (auto &it2 : cell->connections()) {
@@ -240,7 +347,7 @@ int count_nontrivial_wire_attrs(RTLIL::Wire *w)
 	return count;
 }
 
-bool compare_signals(RTLIL::SigBit &s1, RTLIL::SigBit &s2, SigPool &regs, SigPool &conns, pool<RTLIL::Wire*> &direct_wires)
+bool compare_signals(RTLIL::SigBit &s1, RTLIL::SigBit &s2, const BitSet &regs, const BitSet &conns, pool<RTLIL::Wire*> &direct_wires)
 {
 	RTLIL::Wire *w1 = s1.wire;
 	RTLIL::Wire *w2 = s2.wire;
@@ -292,8 +399,9 @@ bool check_public_name(RTLIL::IdString id)
 
 bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbose)
 {
-	SigPool register_signals;
-	SigPool connected_signals;
+	BitIndex index(module);
+	BitSet register_signals(index);
+	BitSet connected_signals(index);
 
 	if (!purge_mode)
 		for (auto &it : module->cells_) {
@@ -332,11 +440,17 @@ bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbos
 		}
 	}
 
-	module->connections_.clear();
-
-	SigPool used_signals;
-	SigPool raw_used_signals;
-	SigPool used_signals_nodrivers;
+	// The connections are rebuilt from assign_map below. Keep the old ones, so
+	// that monitors are only notified if they actually changed. If they did,
+	// the monitors get the whole new vector, as some connections were dropped
+	// and a MonitoredSigMap has to be rebuilt instead of extended.
+	std::vector<RTLIL::SigSig> old_connections;
+	old_connections.swap(module->connections_);
+	std::vector<RTLIL::SigSig> new_connections;
+
+	BitSet used_signals(index);
+	BitSet raw_used_signals(index);
+	BitSet used_signals_nodrivers(index);
 	for (auto &it : module->cells_) {
 		RTLIL::Cell *cell = it.second;
 		for (auto &it2 : cell->connections_) {
@@ -446,7 +560,7 @@ bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbos
 					wire->attributes.at(ID::init) = initval;
 				used_signals.add(new_conn.first);
 				used_signals.add(new_conn.second);
-				module->connect(new_conn);
+				new_connections.push_back(new_conn);
 			}
 
 			if (!used_signals_nodrivers.check_all(s2)) {
@@ -470,6 +584,11 @@ bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbos
 		}
 	}
 
+	if (new_connections == old_connections)
+		module->connections_.swap(old_connections);
+	else
+		module->new_connections(new_connections);
+
 	int del_temp_wires_count = 0;
 	for (auto wire : del_wires_queue) {
 		if (ys_debug() || (check_public_name(wire->name) && verbose))
@@ -478,7 +597,8 @@ bool rmunused_module_signals(RTLIL::Module *module, bool purge_mode, bool verbos
 			del_temp_wires_count++;
 	}
 
-	module->remove(del_wires_queue);
+	if (!del_wires_queue.empty())
+		module->remove(del_wires_queue);
 	count_rm_wires += GetSize(del_wires_queue);
 
 	if (verbose && del_temp_wires_count)
@@ -586,14 +706,14 @@ void rmunused_module(RTLIL::Module *module, bool purge_mode, bool verbose, bool
 			module->connect(y, a);
 			delcells.push_back(cell);
 		}
-	for (auto cell : delcells) {
-		if (verbose)
+	if (verbose)
+		for (auto cell : delcells)
 			log_debug("  removing buffer cell `%s': %s = %s\n", cell->name.c_str(),
 					log_signal(cell->getPort(ID::Y)), log_signal(cell->getPort(ID::A)));
-		module->remove(cell);
-	}
-	if (!delcells.empty())
+	if (!delcells.empty()) {
+		module->remove(pool<RTLIL::Cell*>(delcells.begin(), delcells.end()));
 		module->design->scratchpad_set_bool("opt.did_something", true);
+	}
 
 	rmunused_module_cells(module, verbose);
 	while (rmunused_module_signals(module, purge_mode, verbose)) { }
@@ -26,6 +26,7 @@
 #include "kernel/sigtools.h"
 #include "kernel/ffinit.h"
 #include "kernel/ff.h"
+#include "kernel/threading.h"
 #include "passes/techmap/simplemap.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +41,7 @@ struct OptDffOptions
 	bool simple_dffe;
 	bool sat;
 	bool keepdc;
+	ParallelDispatcher *dispatcher;
 };
 
 struct OptDffWorker
@@ -734,9 +736,127 @@ struct OptDffWorker
 		return did_something;
 	}
 
+	// Returns the constant that bit i of the FF can be replaced with, or State::Sm
+	// if there is none. The SAT-based checks go through 'prove', which returns
+	// whether the Q bit can never change from the given value to a different D
+	// (or AD) value.
+	State find_const_bit(const FfData &ff, int i, const std::function<bool(SigBit, SigBit, State)> &prove)
+	{
+		State val = ff.val_init[i];
+		if (ff.has_arst)
+			val = combine_const(val, ff.val_arst[i]);
+		if (ff.has_srst)
+			val = combine_const(val, ff.val_srst[i]);
+		if (ff.has_sr) {
+			if (ff.sig_clr[i] != (ff.pol_clr ? State::S0 : State::S1))
+				val = combine_const(val, State::S0);
+			if (ff.sig_set[i] != (ff.pol_set ? State::S0 : State::S1))
+				val = combine_const(val, State::S1);
+		}
+		if (val == State::Sm)
+			return State::Sm;
+		if (ff.has_clk || ff.has_gclk) {
+			if (!ff.sig_d[i].wire) {
+				val = combine_const(val, ff.sig_d[i].data);
+				if (val == State::Sm)
+					return State::Sm;
+			} else {
+				if (!opt.sat)
+					return State::Sm;
+				if (val != State::S0 && val != State::S1)
+					return State::Sm;
+				// For each register bit, try to prove that it cannot change from the initial value. If so, remove it
+				if (!prove(ff.sig_q[i], ff.sig_d[i], val))
+					return State::Sm;
+			}
+		}
+		if (ff.has_aload) {
+			if (!ff.sig_ad[i].wire) {
+				val = combine_const(val, ff.sig_ad[i].data);
+				if (val == State::Sm)
+					return State::Sm;
+			} else {
+				if (!opt.sat)
+					return State::Sm;
+				if (val != State::S0 && val != State::S1)
+					return State::Sm;
+				// For each register bit, try to prove that it cannot change from the initial value. If so, remove it
+				if (!prove(ff.sig_q[i], ff.sig_ad[i], val))
+					return State::Sm;
+			}
+		}
+		return val;
+	}
+
 	bool run_constbits() {
-		ModWalker modwalker(module->design, module);
-		QuickConeSat qcsat(modwalker);
+		// Only the SAT-based checks need a solver context, which is shared with
+		// other passes through the cache.
+		QuickConeSat *qcsat = opt.sat ? &QuickConeSatCache::get(module) : nullptr;
+
+		std::function<bool(SigBit, SigBit, State)> prove = [&](SigBit sig_q, SigBit sig_d, State val) {
+			if (!qcsat->modwalker.has_drivers(qcsat->modwalker.sigmap(sig_d)))
+				return false;
+
+			int init_sat_pi = qcsat->importSigBit(val);
+			int q_sat_pi = qcsat->importSigBit(sig_q);
+			int d_sat_pi = qcsat->importSigBit(sig_d);
+
+			qcsat->prepare();
+
+			// Try to find out whether the register bit can change under some circumstances
+			bool counter_example_found = qcsat->ez->solve(qcsat->ez->IFF(q_sat_pi, init_sat_pi), qcsat->ez->NOT(qcsat->ez->IFF(d_sat_pi, init_sat_pi)));
+
+			// If the register bit cannot change, we can replace it with a constant
+			return !counter_example_found;
+		};
+
+		// With -j, all queries are collected up front and solved in parallel
+		// batches, and the loop below looks up their results. This gives the same
+		// answers, since the queries only look at the module as it was before any
+		// FF is changed either way.
+		typedef std::tuple<SigBit, SigBit, bool> const_query_t;
+		dict<const_query_t, bool> query_results;
+		if (opt.sat && opt.dispatcher != nullptr) {
+			std::vector<const_query_t> queries;
+			for (auto cell : module->selected_cells()) {
+				if (!RTLIL::builtin_ff_cell_types().count(cell->type))
+					continue;
+				FfData ff(&initvals, cell);
+				for (int i = 0; i < ff.width; i++)
+					find_const_bit(ff, i, [&](SigBit sig_q, SigBit sig_d, State val) {
+						const_query_t query(qcsat->modwalker.sigmap(sig_q), qcsat->modwalker.sigmap(sig_d), val == State::S1);
+						if (qcsat->modwalker.has_drivers(std::get<1>(query)) && !query_results.count(query)) {
+							query_results[query] = false;
+							queries.push_back(query);
+						}
+						// Assume the proof succeeds, so that any later query for this bit is collected too.
+						return true;
+					});
+			}
+
+			QuickConeSatBatch batch(qcsat->modwalker, GetSize(queries), 16, *qcsat);
+			std::vector<std::pair<int, int>> query_lits;
+			for (int i = 0; i < GetSize(queries); i++) {
+				QuickConeSat &ctx = batch.context(i);
+				int init_sat_pi = ctx.importSigBit(std::get<2>(queries[i]) ? State::S1 : State::S0);
+				int q_sat_pi = ctx.importSigBit(std::get<0>(queries[i]));
+				int d_sat_pi = ctx.importSigBit(std::get<1>(queries[i]));
+				ctx.prepare();
+				query_lits.push_back({ctx.ez->IFF(q_sat_pi, init_sat_pi), ctx.ez->NOT(ctx.ez->IFF(d_sat_pi, init_sat_pi))});
+			}
+
+			std::vector<char> proved(GetSize(queries));
+			batch.solve(opt.dispatcher, [&](int i) {
+				proved[i] = !batch.context(i).ez->solve(query_lits[i].first, query_lits[i].second);
+			});
+			for (int i = 0; i < GetSize(queries); i++)
+				query_results[queries[i]] = proved[i];
+
+			prove = [&](SigBit sig_q, SigBit sig_d, State val) {
+				auto it = query_results.find(const_query_t(qcsat->modwalker.sigmap(sig_q), qcsat->modwalker.sigmap(sig_d), val == State::S1));
+				return it != query_results.end() && it->second;
+			};
+		}
 
 		// Run as a separate sub-pass, so that we don't mutate (non-FF) cells under ModWalker.
 		bool did_something = false;
@@ -748,75 +868,9 @@ struct OptDffWorker
 			// Now check if any bit can be replaced by a constant.
 			pool<int> removed_sigbits;
 			for (int i = 0; i < ff.width; i++) {
-				State val = ff.val_init[i];
-				if (ff.has_arst)
-					val = combine_const(val, ff.val_arst[i]);
-				if (ff.has_srst)
-					val = combine_const(val, ff.val_srst[i]);
-				if (ff.has_sr) {
-					if (ff.sig_clr[i] != (ff.pol_clr ? State::S0 : State::S1))
-						val = combine_const(val, State::S0);
-					if (ff.sig_set[i] != (ff.pol_set ? State::S0 : State::S1))
-						val = combine_const(val, State::S1);
-				}
+				State val = find_const_bit(ff, i, prove);
 				if (val == State::Sm)
 					continue;
-				if (ff.has_clk || ff.has_gclk) {
-					if (!ff.sig_d[i].wire) {
-						val = combine_const(val, ff.sig_d[i].data);
-						if (val == State::Sm)
-							continue;
-					} else {
-						if (!opt.sat)
-							continue;
-						// For each register bit, try to prove that it cannot change from the initial value. If so, remove it
-						if (!modwalker.has_drivers(ff.sig_d.extract(i)))
-							continue;
-						if (val != State::S0 && val != State::S1)
-							continue;
-
-						int init_sat_pi = qcsat.importSigBit(val);
-						int q_sat_pi = qcsat.importSigBit(ff.sig_q[i]);
-						int d_sat_pi = qcsat.importSigBit(ff.sig_d[i]);
-
-						qcsat.prepare();
-
-						// Try to find out whether the register bit can change under some circumstances
-						bool counter_example_found = qcsat.ez->solve(qcsat.ez->IFF(q_sat_pi, init_sat_pi), qcsat.ez->NOT(qcsat.ez->IFF(d_sat_pi, init_sat_pi)));
-
-						// If the register bit cannot change, we can replace it with a constant
-						if (counter_example_found)
-							continue;
-					}
-				}
-				if (ff.has_aload) {
-					if (!ff.sig_ad[i].wire) {
-						val = combine_const(val, ff.sig_ad[i].data);
-						if (val == State::Sm)
-							continue;
-					} else {
-						if (!opt.sat)
-							continue;
-						// For each register bit, try to prove that it cannot change from the initial value. If so, remove it
-						if (!modwalker.has_drivers(ff.sig_ad.extract(i)))
-							continue;
-						if (val != State::S0 && val != State::S1)
-							continue;
-
-						int init_sat_pi = qcsat.importSigBit(val);
-						int q_sat_pi = qcsat.importSigBit(ff.sig_q[i]);
-						int d_sat_pi = qcsat.importSigBit(ff.sig_ad[i]);
-
-						qcsat.prepare();
-
-						// Try to find out whether the register bit can change under some circumstances
-						bool counter_example_found = qcsat.ez->solve(qcsat.ez->IFF(q_sat_pi, init_sat_pi), qcsat.ez->NOT(qcsat.ez->IFF(d_sat_pi, init_sat_pi)));
-
-						// If the register bit cannot change, we can replace it with a constant
-						if (counter_example_found)
-							continue;
-					}
-				}
 				log("Setting constant %d-bit at position %d on %s (%s) from module %s.\n", val ? 1 : 0,
 						i, log_id(cell), log_id(cell->type), log_id(module));
 
@@ -850,7 +904,7 @@ struct OptDffPass : public Pass {
 	{
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
 		log("\n");
-		log("    opt_dff [-nodffe] [-nosdff] [-keepdc] [-sat] [selection]\n");
+		log("    opt_dff [-nodffe] [-nosdff] [-keepdc] [-sat] [-j N] [selection]\n");
 		log("\n");
 		log("This pass converts flip-flops to a more suitable type by merging clock enables\n");
 		log("and synchronous reset multiplexers, removing unused control inputs, or\n");
@@ -878,6 +932,10 @@ struct OptDffPass : public Pass {
 		log("        all result bits to be set to x. this behavior changes when 'a+0' is\n");
 		log("        replaced by 'a'. the -keepdc option disables all such optimizations.\n");
 		log("\n");
+		log("    -j N\n");
+		log("        solve the SAT queries of -sat in parallel batches using N threads. the\n");
+		log("        result does not depend on N.\n");
+		log("\n");
 	}
 
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -889,6 +947,8 @@ struct OptDffPass : public Pass {
 		opt.simple_dffe = false;
 		opt.keepdc = false;
 		opt.sat = false;
+		opt.dispatcher = nullptr;
+		int num_threads = 1;
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
@@ -912,10 +972,27 @@ struct OptDffPass : public Pass {
 				opt.sat = true;
 				continue;
 			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				num_threads = atoi(args[++argidx].c_str());
+				if (num_threads < 1)
+					log_cmd_error("Invalid number of threads `%s'.\n", args[argidx].c_str());
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		std::unique_ptr<ParallelDispatcher> dispatcher;
+		if (num_threads > 1 && opt.sat) {
+#ifdef YOSYS_ENABLE_THREADS
+			dispatcher.reset(new ParallelDispatcher(num_threads - 1));
+#else
+			log_warning("Yosys was built without thread support, ignoring -j.\n");
+#endif
+		}
+		opt.dispatcher = dispatcher.get();
+
+		QuickConeSatCache::Scope qcsat_scope(design);
 		bool did_something = false;
 		for (auto mod : design->selected_modules()) {
 			OptDffWorker worker(opt, mod);
@@ -21,6 +21,7 @@
 #include "kernel/sigtools.h"
 #include "kernel/celltypes.h"
 #include "kernel/utils.h"
+#include "kernel/threading.h"
 #include "kernel/log.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -31,6 +32,271 @@ PRIVATE_NAMESPACE_BEGIN
 
 bool did_something;
 
+// The constant folding of a single cell, reduced to a function pointer and its
+// Const arguments. It never copies an IdString, so it can be evaluated on
+// worker threads (IdString refcounts are not thread-safe).
+struct ConstFold
+{
+	typedef RTLIL::Const (*fn_t)(const RTLIL::Const&, const RTLIL::Const&, bool, bool, int);
+	typedef RTLIL::Const (*fn2_t)(const RTLIL::Const&, const RTLIL::Const&);
+	typedef RTLIL::Const (*fn3_t)(const RTLIL::Const&, const RTLIL::Const&, const RTLIL::Const&);
+
+	fn_t fn = nullptr;
+	fn2_t fn2 = nullptr;
+	fn3_t fn3 = nullptr;
+	RTLIL::Const a, b, s;
+	bool a_signed = false, b_signed = false;
+	int y_width = 0;
+
+	ConstFold() { }
+	ConstFold(fn_t fn, const RTLIL::Const &a, const RTLIL::Const &b, bool a_signed, bool b_signed, int y_width) :
+			fn(fn), a(a), b(b), a_signed(a_signed), b_signed(b_signed), y_width(y_width) { }
+	ConstFold(fn2_t fn2, const RTLIL::Const &a, const RTLIL::Const &b) : fn2(fn2), a(a), b(b) { }
+	ConstFold(fn3_t fn3, const RTLIL::Const &a, const RTLIL::Const &b, const RTLIL::Const &s) : fn3(fn3), a(a), b(b), s(s) { }
+
+	RTLIL::Const eval() const
+	{
+		if (fn != nullptr)
+			return fn(a, b, a_signed, b_signed, y_width);
+		if (fn2 != nullptr)
+			return fn2(a, b);
+		return fn3(a, b, s);
+	}
+
+	bool operator==(const ConstFold &other) const
+	{
+		return fn == other.fn && fn2 == other.fn2 && fn3 == other.fn3 && a == other.a && b == other.b && s == other.s &&
+				a_signed == other.a_signed && b_signed == other.b_signed && y_width == other.y_width;
+	}
+};
+
+// With -j, replace_const_cells() folds the cells whose inputs are constant, or
+// driven by other such cells, on worker threads before its serial sweep. The
+// cells are folded level by level, with the results of a level taken as the
+// inputs of the next, like the sweep does when it replaces a folded cell by its
+// value. The sweep uses a precomputed result only if the cell still folds the
+// same function of the same arguments when it gets there, so the result does
+// not depend on -j.
+ParallelDispatcher *fold_dispatcher;
+dict<RTLIL::Cell*, std::pair<ConstFold, RTLIL::Const>> fold_results;
+
+RTLIL::Const const_fold(RTLIL::Cell *cell, const ConstFold &fold)
+{
+	auto it = fold_results.find(cell);
+	if (it != fold_results.end() && it->second.first == fold)
+		return it->second.second;
+	return fold.eval();
+}
+
+enum fold_kind { UNARY, BINARY, SIMPLE, MUX };
+
+struct fold_fn {
+	fold_kind kind;
+	ConstFold::fn_t fn;
+	ConstFold::fn2_t fn2;
+	ConstFold::fn3_t fn3;
+	RTLIL::IdString b_port;
+};
+
+// Returns how the FOLD_* cases of replace_const_cells() fold cells of the given
+// type, or nullptr if they don't.
+const fold_fn *find_fold_fn(RTLIL::IdString type)
+{
+	static const dict<RTLIL::IdString, fold_fn> fold_fns = {
+		{ ID($not),         { UNARY,  RTLIL::const_not,         nullptr, nullptr, {} } },
+		{ ID($and),         { BINARY, RTLIL::const_and,         nullptr, nullptr, {} } },
+		{ ID($or),          { BINARY, RTLIL::const_or,          nullptr, nullptr, {} } },
+		{ ID($xor),         { BINARY, RTLIL::const_xor,         nullptr, nullptr, {} } },
+		{ ID($xnor),        { BINARY, RTLIL::const_xnor,        nullptr, nullptr, {} } },
+		{ ID($reduce_and),  { UNARY,  RTLIL::const_reduce_and,  nullptr, nullptr, {} } },
+		{ ID($reduce_or),   { UNARY,  RTLIL::const_reduce_or,   nullptr, nullptr, {} } },
+		{ ID($reduce_xor),  { UNARY,  RTLIL::const_reduce_xor,  nullptr, nullptr, {} } },
+		{ ID($reduce_xnor), { UNARY,  RTLIL::const_reduce_xnor, nullptr, nullptr, {} } },
+		{ ID($reduce_bool), { UNARY,  RTLIL::const_reduce_bool, nullptr, nullptr, {} } },
+		{ ID($logic_not),   { UNARY,  RTLIL::const_logic_not,   nullptr, nullptr, {} } },
+		{ ID($logic_and),   { BINARY, RTLIL::const_logic_and,   nullptr, nullptr, {} } },
+		{ ID($logic_or),    { BINARY, RTLIL::const_logic_or,    nullptr, nullptr, {} } },
+		{ ID($shl),         { BINARY, RTLIL::const_shl,         nullptr, nullptr, {} } },
+		{ ID($shr),         { BINARY, RTLIL::const_shr,         nullptr, nullptr, {} } },
+		{ ID($sshl),        { BINARY, RTLIL::const_sshl,        nullptr, nullptr, {} } },
+		{ ID($sshr),        { BINARY, RTLIL::const_sshr,        nullptr, nullptr, {} } },
+		{ ID($shift),       { BINARY, RTLIL::const_shift,       nullptr, nullptr, {} } },
+		{ ID($shiftx),      { BINARY, RTLIL::const_shiftx,      nullptr, nullptr, {} } },
+		{ ID($lt),          { BINARY, RTLIL::const_lt,          nullptr, nullptr, {} } },
+		{ ID($le),          { BINARY, RTLIL::const_le,          nullptr, nullptr, {} } },
+		{ ID($eq),          { BINARY, RTLIL::const_eq,          nullptr, nullptr, {} } },
+		{ ID($ne),          { BINARY, RTLIL::const_ne,          nullptr, nullptr, {} } },
+		{ ID($gt),          { BINARY, RTLIL::const_gt,          nullptr, nullptr, {} } },
+		{ ID($ge),          { BINARY, RTLIL::const_ge,          nullptr, nullptr, {} } },
+		{ ID($eqx),         { BINARY, RTLIL::const_eqx,         nullptr, nullptr, {} } },
+		{ ID($nex),         { BINARY, RTLIL::const_nex,         nullptr, nullptr, {} } },
+		{ ID($add),         { BINARY, RTLIL::const_add,         nullptr, nullptr, {} } },
+		{ ID($sub),         { BINARY, RTLIL::const_sub,         nullptr, nullptr, {} } },
+		{ ID($mul),         { BINARY, RTLIL::const_mul,         nullptr, nullptr, {} } },
+		{ ID($div),         { BINARY, RTLIL::const_div,         nullptr, nullptr, {} } },
+		{ ID($mod),         { BINARY, RTLIL::const_mod,         nullptr, nullptr, {} } },
+		{ ID($divfloor),    { BINARY, RTLIL::const_divfloor,    nullptr, nullptr, {} } },
+		{ ID($modfloor),    { BINARY, RTLIL::const_modfloor,    nullptr, nullptr, {} } },
+		{ ID($pow),         { BINARY, RTLIL::const_pow,         nullptr, nullptr, {} } },
+		{ ID($pos),         { UNARY,  RTLIL::const_pos,         nullptr, nullptr, {} } },
+		{ ID($neg),         { UNARY,  RTLIL::const_neg,         nullptr, nullptr, {} } },
+		{ ID($mux),         { MUX,    nullptr, nullptr, RTLIL::const_mux,   {} } },
+		{ ID($pmux),        { MUX,    nullptr, nullptr, RTLIL::const_pmux,  {} } },
+		{ ID($bmux),        { SIMPLE, nullptr, RTLIL::const_bmux,  nullptr, ID::S } },
+		{ ID($demux),       { SIMPLE, nullptr, RTLIL::const_demux, nullptr, ID::S } },
+		{ ID($bweqx),       { SIMPLE, nullptr, RTLIL::const_bweqx, nullptr, ID::B } },
+		{ ID($bwmux),       { MUX,    nullptr, nullptr, RTLIL::const_bwmux, {} } },
+	};
+
+	auto it = fold_fns.find(type);
+	return it == fold_fns.end() ? nullptr : &it->second;
+}
+
+// Returns the folding the FOLD_* cases of replace_const_cells() would perform
+// on the cell right now, if any. Bits in 'known' are taken to have the given
+// value.
+bool get_const_fold(RTLIL::Cell *cell, const SigMap &assign_map, const dict<RTLIL::SigBit, RTLIL::State> &known, ConstFold &fold)
+{
+	const fold_fn *f = find_fold_fn(cell->type);
+	if (f == nullptr)
+		return false;
+
+	auto get_port = [&](RTLIL::IdString port) {
+		RTLIL::SigSpec sig = assign_map(cell->getPort(port));
+		for (auto &bit : sig)
+			if (bit.wire != nullptr) {
+				auto it = known.find(bit);
+				if (it != known.end())
+					bit = it->second;
+			}
+		return sig;
+	};
+
+	RTLIL::SigSpec a = get_port(ID::A);
+	if (!a.is_fully_const())
+		return false;
+	if (f->kind == UNARY || f->kind == BINARY) {
+		// Leave cells with missing parameters to the sweep, which adds them.
+		if (!cell->hasParam(ID::A_SIGNED) || !cell->hasParam(ID::Y_WIDTH) || (f->kind == BINARY && !cell->hasParam(ID::B_SIGNED)))
+			return false;
+		bool a_signed = cell->getParam(ID::A_SIGNED).as_bool();
+		int y_width = cell->getParam(ID::Y_WIDTH).as_int();
+		if (f->kind == UNARY) {
+			fold = ConstFold(f->fn, a.as_const(), RTLIL::Const(RTLIL::State::S0, 1), a_signed, false, y_width);
+			return true;
+		}
+		RTLIL::SigSpec b = get_port(ID::B);
+		if (!b.is_fully_const())
+			return false;
+		fold = ConstFold(f->fn, a.as_const(), b.as_const(), a_signed, cell->getParam(ID::B_SIGNED).as_bool(), y_width);
+		return true;
+	}
+	if (f->kind == SIMPLE) {
+		RTLIL::SigSpec b = get_port(f->b_port);
+		if (!b.is_fully_const())
+			return false;
+		fold = ConstFold(f->fn2, a.as_const(), b.as_const());
+		return true;
+	}
+	RTLIL::SigSpec b = get_port(ID::B);
+	RTLIL::SigSpec s = get_port(ID::S);
+	if (!b.is_fully_const() || !s.is_fully_const())
+		return false;
+	fold = ConstFold(f->fn3, a.as_const(), b.as_const(), s.as_const());
+	return true;
+}
+
+// Groups the cells that may fold by the longest chain of such cells driving
+// them. The cells are in topological order, so the drivers of a cell already
+// have their level when it is reached.
+std::vector<std::vector<RTLIL::Cell*>> get_fold_levels(const std::vector<RTLIL::Cell*> &cells, const SigMap &assign_map)
+{
+	std::vector<std::vector<RTLIL::Cell*>> levels;
+	dict<RTLIL::SigBit, int> bit_levels;
+
+	for (auto cell : cells)
+	{
+		const fold_fn *f = find_fold_fn(cell->type);
+		if (f == nullptr || !cell->hasPort(ID::Y))
+			continue;
+
+		std::vector<RTLIL::IdString> inputs = {ID::A};
+		if (f->kind == BINARY || f->kind == MUX)
+			inputs.push_back(ID::B);
+		if (f->kind == SIMPLE)
+			inputs.push_back(f->b_port);
+		if (f->kind == MUX)
+			inputs.push_back(ID::S);
+
+		int level = 0;
+		for (auto port : inputs) {
+			if (!cell->hasPort(port))
+				goto next_cell;
+			for (auto bit : assign_map(cell->getPort(port))) {
+				if (bit.wire == nullptr)
+					continue;
+				auto it = bit_levels.find(bit);
+				if (it == bit_levels.end())
+					goto next_cell;
+				level = std::max(level, it->second + 1);
+			}
+		}
+
+		for (auto bit : assign_map(cell->getPort(ID::Y)))
+			if (bit.wire != nullptr)
+				bit_levels[bit] = std::max(bit_levels[bit], level);
+		if (level >= GetSize(levels))
+			levels.resize(level + 1);
+		levels[level].push_back(cell);
+	next_cell:;
+	}
+
+	return levels;
+}
+
+void prefold_cells(const std::vector<RTLIL::Cell*> &cells, const SigMap &assign_map)
+{
+	fold_results.clear();
+
+	dict<RTLIL::SigBit, RTLIL::State> known;
+	for (auto &level : get_fold_levels(cells, assign_map))
+	{
+		std::vector<RTLIL::Cell*> fold_cells;
+		std::vector<ConstFold> folds;
+		for (auto cell : level) {
+			ConstFold fold;
+			if (get_const_fold(cell, assign_map, known, fold)) {
+				fold_cells.push_back(cell);
+				folds.push_back(std::move(fold));
+			}
+		}
+
+		// Each cell on the next level is driven by one on this level.
+		if (folds.empty())
+			break;
+
+		// Interleave the cells over a few chunks per thread, so that a run of
+		// expensive cells (e.g. wide $mul or $div) is spread over all of them.
+		std::vector<RTLIL::Const> results(GetSize(folds));
+		int num_chunks = std::min(GetSize(folds), 8 * (fold_dispatcher->num_workers() + 1));
+		fold_dispatcher->run(num_chunks, [&](int chunk) {
+			for (int i = chunk; i < GetSize(folds); i += num_chunks)
+				results[i] = folds[i].eval();
+		});
+
+		for (int i = 0; i < GetSize(folds); i++) {
+			// replace_cell() connects the output to the result, resized like this
+			RTLIL::SigSpec y = assign_map(fold_cells[i]->getPort(ID::Y));
+			RTLIL::SigSpec value = results[i];
+			value.extend_u0(GetSize(y), false);
+			for (int j = 0; j < GetSize(y); j++)
+				if (y[j].wire != nullptr)
+					known[y[j]] = value[j].data;
+			fold_results[fold_cells[i]] = std::make_pair(std::move(folds[i]), std::move(results[i]));
+		}
+	}
+}
+
 void replace_undriven(RTLIL::Module *module, const CellTypes &ct)
 {
 	SigMap sigmap(module);
@@ -440,6 +706,9 @@ void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, bool cons
 
 	cells.sort();
 
+	if (fold_dispatcher != nullptr)
+		prefold_cells(cells.sorted, assign_map);
+
 	for (auto cell : cells.sorted)
 	{
 #define ACTION_DO(_p_, _s_) do { cover("opt.opt_expr.action_" S__LINE__); replace_cell(assign_map, module, cell, input.as_string(), _p_, _s_); goto next_cell; } while (0)
@@ -1571,9 +1840,9 @@ skip_identity:
 			assign_map.apply(a); \
 			if (a.is_fully_const()) { \
 				RTLIL::Const dummy_arg(RTLIL::State::S0, 1); \
-				RTLIL::SigSpec y(RTLIL::const_ ## _t(a.as_const(), dummy_arg, \
+				RTLIL::SigSpec y(const_fold(cell, ConstFold(RTLIL::const_ ## _t, a.as_const(), dummy_arg, \
 						cell->parameters[ID::A_SIGNED].as_bool(), false, \
-						cell->parameters[ID::Y_WIDTH].as_int())); \
+						cell->parameters[ID::Y_WIDTH].as_int()))); \
 				cover("opt.opt_expr.const.$" #_t); \
 				replace_cell(assign_map, module, cell, stringf("%s", log_signal(a)), ID::Y, y); \
 				goto next_cell; \
@@ -1585,10 +1854,10 @@ skip_identity:
 			RTLIL::SigSpec b = cell->getPort(ID::B); \
 			assign_map.apply(a), assign_map.apply(b); \
 			if (a.is_fully_const() && b.is_fully_const()) { \
-				RTLIL::SigSpec y(RTLIL::const_ ## _t(a.as_const(), b.as_const(), \
+				RTLIL::SigSpec y(const_fold(cell, ConstFold(RTLIL::const_ ## _t, a.as_const(), b.as_const(), \
 						cell->parameters[ID::A_SIGNED].as_bool(), \
 						cell->parameters[ID::B_SIGNED].as_bool(), \
-						cell->parameters[ID::Y_WIDTH].as_int())); \
+						cell->parameters[ID::Y_WIDTH].as_int()))); \
 				cover("opt.opt_expr.const.$" #_t); \
 				replace_cell(assign_map, module, cell, stringf("%s, %s", log_signal(a), log_signal(b)), ID::Y, y); \
 				goto next_cell; \
@@ -1600,7 +1869,7 @@ skip_identity:
 			RTLIL::SigSpec b = cell->getPort(B_ID); \
 			assign_map.apply(a), assign_map.apply(b); \
 			if (a.is_fully_const() && b.is_fully_const()) { \
-				RTLIL::SigSpec y(RTLIL::const_ ## _t(a.as_const(), b.as_const())); \
+				RTLIL::SigSpec y(const_fold(cell, ConstFold(RTLIL::const_ ## _t, a.as_const(), b.as_const()))); \
 				cover("opt.opt_expr.const.$" #_t); \
 				replace_cell(assign_map, module, cell, stringf("%s, %s", log_signal(a), log_signal(b)), ID::Y, y); \
 				goto next_cell; \
@@ -1613,7 +1882,7 @@ skip_identity:
 			RTLIL::SigSpec s = cell->getPort(ID::S); \
 			assign_map.apply(a), assign_map.apply(b), assign_map.apply(s); \
 			if (a.is_fully_const() && b.is_fully_const() && s.is_fully_const()) { \
-				RTLIL::SigSpec y(RTLIL::const_ ## _t(a.as_const(), b.as_const(), s.as_const())); \
+				RTLIL::SigSpec y(const_fold(cell, ConstFold(RTLIL::const_ ## _t, a.as_const(), b.as_const(), s.as_const()))); \
 				cover("opt.opt_expr.const.$" #_t); \
 				replace_cell(assign_map, module, cell, stringf("%s, %s, %s", log_signal(a), log_signal(b), log_signal(s)), ID::Y, y); \
 				goto next_cell; \
@@ -2195,6 +2464,8 @@ skip_alu_split:
 #undef FOLD_1ARG_CELL
 #undef FOLD_2ARG_CELL
 	}
+
+	fold_results.clear();
 }
 
 void replace_const_connections(RTLIL::Module *module) {
@@ -2249,6 +2520,12 @@ struct OptExprPass : public Pass {
 		log("        all result bits to be set to x. this behavior changes when 'a+0' is\n");
 		log("        replaced by 'a'. the -keepdc option disables all such optimizations.\n");
 		log("\n");
+		log("    -j <N>\n");
+		log("        fold cells with constant inputs on up to N threads. before each sweep\n");
+		log("        over a module, the cells with constant inputs are evaluated in\n");
+		log("        parallel, then the cells driven by them, and so on. the sweep itself\n");
+		log("        stays serial, so the result is the same as without this option.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -2258,6 +2535,7 @@ struct OptExprPass : public Pass {
 		bool noclkinv = false;
 		bool do_fine = false;
 		bool keepdc = false;
+		int num_threads = 1;
 
 		log_header(design, "Executing OPT_EXPR pass (perform const folding).\n");
 		log_push();
@@ -2295,10 +2573,26 @@ struct OptExprPass : public Pass {
 				keepdc = true;
 				continue;
 			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				num_threads = atoi(args[++argidx].c_str());
+				if (num_threads < 1)
+					log_cmd_error("Invalid number of threads `%s'.\n", args[argidx].c_str());
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		std::unique_ptr<ParallelDispatcher> dispatcher;
+		if (num_threads > 1) {
+#ifdef YOSYS_ENABLE_THREADS
+			dispatcher.reset(new ParallelDispatcher(num_threads - 1));
+#else
+			log_warning("Yosys was built without thread support, ignoring -j.\n");
+#endif
+		}
+		fold_dispatcher = dispatcher.get();
+
 		CellTypes ct(design);
 		for (auto module : design->selected_modules())
 		{
@@ -2332,6 +2626,8 @@ struct OptExprPass : public Pass {
 			log_suppressed();
 		}
 
+		fold_dispatcher = nullptr;
+
 		log_pop();
 	}
 } OptExprPass;
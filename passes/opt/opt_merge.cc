@@ -35,13 +35,21 @@ struct OptMergeWorker
 {
 	RTLIL::Design *design;
 	RTLIL::Module *module;
-	SigMap assign_map;
+	SigMap local_assign_map;
+	SigMap &assign_map;
 	FfInitVals initvals;
 	bool mode_share_all;
 
 	CellTypes ct;
 	int total_count;
 
+	dict<uint64_t, RTLIL::Cell*> sharemap;
+	dict<RTLIL::Cell*, uint64_t> cell_hash;
+	dict<RTLIL::SigBit, std::vector<RTLIL::Cell*>> fanout;
+	std::vector<RTLIL::Cell*> worklist;
+	pool<RTLIL::Cell*> queued, removed;
+	std::vector<RTLIL::Cell*> removed_cells;
+
 	static void sort_pmux_conn(dict<RTLIL::IdString, RTLIL::SigSpec> &conn)
 	{
 		SigSpec sig_s = conn.at(ID::S);
@@ -225,8 +233,62 @@ struct OptMergeWorker
 		return !initvals(cell->getPort(ID::Q)).is_fully_def();
 	}
 
+	void requeue(RTLIL::Cell *cell)
+	{
+		if (!removed.count(cell) && queued.insert(cell).second)
+			worklist.push_back(cell);
+	}
+
+	// Replaces cell with the identical cell other, and re-queues the cells
+	// whose inputs were canonicalized differently as a result.
+	void merge_cell(RTLIL::Cell *cell, RTLIL::Cell *other)
+	{
+		log_debug("  Cell `%s' is identical to cell `%s'.\n", cell->name.c_str(), other->name.c_str());
+		for (auto &it : cell->connections()) {
+			if (cell->output(it.first)) {
+				RTLIL::SigSpec other_sig = other->getPort(it.first);
+				log_debug("    Redirecting output %s: %s = %s\n", it.first.c_str(),
+						log_signal(it.second), log_signal(other_sig));
+				RTLIL::SigSpec old_sig = assign_map(it.second);
+				RTLIL::SigSpec old_other_sig = assign_map(other_sig);
+				Const init = initvals(other_sig);
+				initvals.remove_init(it.second);
+				initvals.remove_init(other_sig);
+				module->connect(RTLIL::SigSig(it.second, other_sig));
+				assign_map.add(it.second, other_sig);
+				initvals.set_init(other_sig, init);
+
+				RTLIL::SigSpec new_sig = assign_map(it.second);
+				for (int i = 0; i < GetSize(new_sig); i++)
+					for (auto old_bit : {old_sig[i], old_other_sig[i]}) {
+						if (old_bit == new_sig[i])
+							continue;
+						auto fanout_it = fanout.find(old_bit);
+						if (fanout_it == fanout.end())
+							continue;
+						std::vector<RTLIL::Cell*> users;
+						users.swap(fanout_it->second);
+						fanout.erase(fanout_it);
+						for (auto user : users)
+							requeue(user);
+						if (new_sig[i].wire != nullptr) {
+							auto &new_users = fanout[new_sig[i]];
+							new_users.insert(new_users.end(), users.begin(), users.end());
+						}
+					}
+			}
+		}
+
+		// The cell is left in the fanout lists, so it is only removed from the
+		// module once the worklist is empty.
+		removed.insert(cell);
+		removed_cells.push_back(cell);
+		queued.erase(cell);
+		total_count++;
+	}
+
 	OptMergeWorker(RTLIL::Design *design, RTLIL::Module *module, bool mode_nomux, bool mode_share_all, bool mode_keepdc) :
-		design(design), module(module), assign_map(module), mode_share_all(mode_share_all)
+		design(design), module(module), assign_map(MonitoredSigMap::get(module, local_assign_map)), mode_share_all(mode_share_all)
 	{
 		total_count = 0;
 		ct.setup_internals();
@@ -247,63 +309,74 @@ struct OptMergeWorker
 		ct.cell_types.erase(ID($allconst));
 
 		log("Finding identical cells in module `%s'.\n", module->name.c_str());
-		assign_map.set(module);
 
 		initvals.set(&assign_map, module);
 
-		bool did_something = true;
-		while (did_something)
+		std::vector<RTLIL::Cell*> cells;
+		cells.reserve(module->cells_.size());
+		for (auto &it : module->cells_) {
+			if (!design->selected(module, it.second))
+				continue;
+			if (mode_keepdc && has_dont_care_initval(it.second))
+				continue;
+			if (ct.cell_known(it.second->type) || (mode_share_all && it.second->known()))
+				cells.push_back(it.second);
+		}
+
+		// Each cell is hashed once. Merging a cell only changes the hash of the
+		// cells reading its outputs, so only those are re-hashed afterwards.
+		for (auto cell : cells)
+			for (auto &it : cell->connections())
+				if (!cell->output(it.first))
+					for (auto bit : it.second) {
+						assign_map.apply(bit);
+						if (bit.wire != nullptr)
+							fanout[bit].push_back(cell);
+					}
+
+		worklist = cells;
+		queued.insert(cells.begin(), cells.end());
+
+		for (int i = 0; i < GetSize(worklist); i++)
 		{
-			std::vector<RTLIL::Cell*> cells;
-			cells.reserve(module->cells_.size());
-			for (auto &it : module->cells_) {
-				if (!design->selected(module, it.second))
-					continue;
-				if (mode_keepdc && has_dont_care_initval(it.second))
-					continue;
-				if (ct.cell_known(it.second->type) || (mode_share_all && it.second->known()))
-					cells.push_back(it.second);
-			}
+			RTLIL::Cell *cell = worklist[i];
+			if (queued.erase(cell) == 0)
+				continue;
 
-			did_something = false;
-                        dict<uint64_t, RTLIL::Cell*> sharemap;
-			for (auto cell : cells)
-			{
-				if ((!mode_share_all && !ct.cell_known(cell->type)) || !cell->known())
-					continue;
+			if ((!mode_share_all && !ct.cell_known(cell->type)) || !cell->known())
+				continue;
 
-				uint64_t hash = hash_cell_parameters_and_connections(cell);
-				auto r = sharemap.insert(std::make_pair(hash, cell));
-				if (!r.second) {
-					if (compare_cell_parameters_and_connections(cell, r.first->second)) {
-						if (cell->has_keep_attr()) {
-							if (r.first->second->has_keep_attr())
-								continue;
-							std::swap(r.first->second, cell);
-						}
+			auto it = cell_hash.find(cell);
+			if (it != cell_hash.end()) {
+				sharemap.erase(it->second);
+				cell_hash.erase(it);
+			}
 
+			uint64_t hash = hash_cell_parameters_and_connections(cell);
+			auto r = sharemap.insert(std::make_pair(hash, cell));
+			if (r.second) {
+				cell_hash[cell] = hash;
+				continue;
+			}
 
-						did_something = true;
-						log_debug("  Cell `%s' is identical to cell `%s'.\n", cell->name.c_str(), r.first->second->name.c_str());
-						for (auto &it : cell->connections()) {
-							if (cell->output(it.first)) {
-								RTLIL::SigSpec other_sig = r.first->second->getPort(it.first);
-								log_debug("    Redirecting output %s: %s = %s\n", it.first.c_str(),
-										log_signal(it.second), log_signal(other_sig));
-								Const init = initvals(other_sig);
-								initvals.remove_init(it.second);
-								initvals.remove_init(other_sig);
-								module->connect(RTLIL::SigSig(it.second, other_sig));
-								assign_map.add(it.second, other_sig);
-								initvals.set_init(other_sig, init);
-							}
-						}
-						log_debug("    Removing %s cell `%s' from module `%s'.\n", cell->type.c_str(), cell->name.c_str(), module->name.c_str());
-						module->remove(cell);
-						total_count++;
-					}
-				}
+			RTLIL::Cell *other = r.first->second;
+			if (!compare_cell_parameters_and_connections(cell, other))
+				continue;
+			if (cell->has_keep_attr()) {
+				if (other->has_keep_attr())
+					continue;
+				std::swap(other, cell);
+				r.first->second = other;
+				cell_hash.erase(cell);
+				cell_hash[other] = hash;
 			}
+
+			merge_cell(cell, other);
+		}
+
+		for (auto cell : removed_cells) {
+			log_debug("  Removing %s cell `%s' from module `%s'.\n", cell->type.c_str(), cell->name.c_str(), module->name.c_str());
+			module->remove(cell);
 		}
 
 		log_suppressed();
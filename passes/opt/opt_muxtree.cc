@@ -34,7 +34,8 @@ struct OptMuxtreeWorker
 {
 	RTLIL::Design *design;
 	RTLIL::Module *module;
-	SigMap assign_map;
+	SigMap local_assign_map;
+	SigMap &assign_map;
 	int removed_count;
 	int glob_abort_cnt = 100000;
 
@@ -67,7 +68,7 @@ struct OptMuxtreeWorker
 	pool<int> root_mux_rerun;
 
 	OptMuxtreeWorker(RTLIL::Design *design, RTLIL::Module *module) :
-			design(design), module(module), assign_map(module), removed_count(0)
+			design(design), module(module), assign_map(MonitoredSigMap::get(module, local_assign_map)), removed_count(0)
 	{
 		log("Running muxtree optimizer on module %s..\n", module->name.c_str());
 
@@ -19,6 +19,7 @@
 
 #include "kernel/yosys.h"
 #include "kernel/qcsat.h"
+#include "kernel/threading.h"
 #include "kernel/sigtools.h"
 #include "kernel/modtools.h"
 #include "kernel/utils.h"
@@ -36,6 +37,7 @@ struct ShareWorkerConfig
 	bool opt_force;
 	bool opt_aggressive;
 	bool opt_fast;
+	ParallelDispatcher *dispatcher;
 	pool<RTLIL::IdString> generic_uni_ops, generic_bin_ops, generic_cbin_ops, generic_other_ops;
 };
 
@@ -972,6 +974,24 @@ struct ShareWorker
 		}
 	}
 
+	void filter_pair_activation_patterns(RTLIL::Cell *cell, const pool<ssc_pair_t> &cell_activation_patterns,
+			RTLIL::Cell *other_cell, const pool<ssc_pair_t> &other_cell_activation_patterns,
+			std::set<RTLIL::SigBit> &union_forbidden_controls, pool<ssc_pair_t> &filtered_cell_activation_patterns,
+			pool<ssc_pair_t> &filtered_other_cell_activation_patterns)
+	{
+		const pool<RTLIL::SigBit> &cell_forbidden_controls = find_forbidden_controls(cell);
+		const pool<RTLIL::SigBit> &other_cell_forbidden_controls = find_forbidden_controls(other_cell);
+
+		union_forbidden_controls.insert(cell_forbidden_controls.begin(), cell_forbidden_controls.end());
+		union_forbidden_controls.insert(other_cell_forbidden_controls.begin(), other_cell_forbidden_controls.end());
+
+		filter_activation_patterns(filtered_cell_activation_patterns, cell_activation_patterns, union_forbidden_controls);
+		filter_activation_patterns(filtered_other_cell_activation_patterns, other_cell_activation_patterns, union_forbidden_controls);
+
+		optimize_activation_patterns(filtered_cell_activation_patterns);
+		optimize_activation_patterns(filtered_other_cell_activation_patterns);
+	}
+
 	RTLIL::SigSpec make_cell_activation_logic(const pool<ssc_pair_t> &activation_patterns, pool<RTLIL::Cell*> &supercell_aux)
 	{
 		RTLIL::Wire *all_cases_wire = module->addWire(NEW_ID, 0);
@@ -990,6 +1010,101 @@ struct ShareWorker
 	}
 
 
+	// ---------------------------------------------------------------------------------
+	// SAT queries for a pair of cells -- can they be active, and both at the same time
+	// ---------------------------------------------------------------------------------
+
+	struct pair_query_t
+	{
+		RTLIL::SigSpec all_ctrl_signals;
+		int sub1, sub2;
+		std::vector<int> sat_model;
+
+		bool cell_active = false, other_cell_active = false, both_active = false;
+		std::vector<bool> sat_model_values;
+		int sat_cells = 0, cnf_variables = 0, cnf_clauses = 0;
+	};
+
+	// Importing reads the module, so it always runs on the main thread.
+	void import_pair_query(QuickConeSat &qcsat, pair_query_t &query,
+			const pool<ssc_pair_t> &cell_activation_patterns, const pool<ssc_pair_t> &other_cell_activation_patterns)
+	{
+		std::vector<int> cell_active, other_cell_active;
+
+		for (auto &p : cell_activation_patterns) {
+			cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
+			query.all_ctrl_signals.append(p.first);
+		}
+
+		for (auto &p : other_cell_activation_patterns) {
+			other_cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
+			query.all_ctrl_signals.append(p.first);
+		}
+
+		query.all_ctrl_signals.sort_and_unify();
+		query.sat_model = qcsat.importSig(query.all_ctrl_signals);
+
+		qcsat.prepare();
+
+		query.sub1 = qcsat.ez->expression(qcsat.ez->OpOr, cell_active);
+		query.sub2 = qcsat.ez->expression(qcsat.ez->OpOr, other_cell_active);
+	}
+
+	// Only uses the solver, so with -j it runs on a worker thread.
+	static void solve_pair_query(QuickConeSat &qcsat, pair_query_t &query)
+	{
+		query.cell_active = qcsat.ez->solve(query.sub1);
+		if (!query.cell_active)
+			return;
+
+		query.other_cell_active = qcsat.ez->solve(query.sub2);
+		if (!query.other_cell_active)
+			return;
+
+		query.sat_cells = GetSize(qcsat.imported_cells);
+		query.cnf_variables = qcsat.ez->numCnfVariables();
+		query.cnf_clauses = qcsat.ez->numCnfClauses();
+		query.both_active = qcsat.ez->solve(query.sat_model, query.sat_model_values, qcsat.ez->AND(query.sub1, query.sub2));
+	}
+
+	// With -j, the queries for the next candidates of a cell, starting at
+	// 'first', are solved in parallel, one per thread. The candidates are then
+	// still tried in order, so a few queries past the first candidate that can
+	// be shared are wasted. Each query gets a solver of its own, which makes its
+	// result independent of the others. Without an import budget this gives the
+	// same verdicts as the shared solver, since both import the complete cones
+	// of the query; with -fast the serial path uses a solver per query as well.
+	void solve_pair_queries(QuickConeSat &qcsat, RTLIL::Cell *cell, const pool<ssc_pair_t> &cell_activation_patterns,
+			const std::vector<RTLIL::Cell*> &candidates, int first, dict<RTLIL::Cell*, pair_query_t> &results)
+	{
+		std::vector<RTLIL::Cell*> query_cells;
+		for (int i = first; i < GetSize(candidates) && GetSize(query_cells) <= config.dispatcher->num_workers(); i++) {
+			const pool<ssc_pair_t> &other_cell_activation_patterns = find_cell_activation_patterns(candidates[i], "      ");
+			if (!other_cell_activation_patterns.empty() && !other_cell_activation_patterns.count(ssc_pair_t()))
+				query_cells.push_back(candidates[i]);
+		}
+
+		QuickConeSatBatch batch(qcsat.modwalker, GetSize(query_cells), 1, qcsat);
+		std::vector<pair_query_t> queries(GetSize(query_cells));
+
+		for (int i = 0; i < GetSize(query_cells); i++) {
+			std::set<RTLIL::SigBit> union_forbidden_controls;
+			pool<ssc_pair_t> filtered_cell_activation_patterns;
+			pool<ssc_pair_t> filtered_other_cell_activation_patterns;
+			filter_pair_activation_patterns(cell, cell_activation_patterns, query_cells[i], activation_patterns_cache.at(query_cells[i]),
+					union_forbidden_controls, filtered_cell_activation_patterns, filtered_other_cell_activation_patterns);
+			import_pair_query(batch.context(i), queries[i], filtered_cell_activation_patterns, filtered_other_cell_activation_patterns);
+		}
+
+		batch.solve(config.dispatcher, [&](int i) {
+			solve_pair_query(batch.context(i), queries[i]);
+		});
+
+		for (int i = 0; i < GetSize(query_cells); i++)
+			results[query_cells[i]] = std::move(queries[i]);
+	}
+
+
 	// -------------------------------------------------------------------------------------
 	// Helper functions used to make sure that this pass does not introduce new logic loops.
 	// -------------------------------------------------------------------------------------
@@ -1171,6 +1286,16 @@ struct ShareWorker
 		log("Found %d cells in module %s that may be considered for resource sharing.\n",
 				GetSize(shareable_cells), log_id(module));
 
+		// All candidate pairs are checked on one solver, so the input cones
+		// imported for one pair are reused by the others. The import budget of
+		// -fast applies per pair though, so then each pair gets a fresh solver
+		// (and only the ModWalker is shared).
+		QuickConeSat &qcsat = QuickConeSatCache::get(module);
+		if (config.opt_fast) {
+			qcsat.max_cell_outs = 3;
+			qcsat.max_cell_count = 100;
+		}
+
 		while (!shareable_cells.empty() && config.limit != 0)
 		{
 			RTLIL::Cell *cell = *shareable_cells.begin();
@@ -1207,8 +1332,11 @@ struct ShareWorker
 				log(" %s", log_id(c));
 			log("\n");
 
-			for (auto other_cell : candidates)
+			dict<RTLIL::Cell*, pair_query_t> batch_queries;
+
+			for (int candidate_idx = 0; candidate_idx < GetSize(candidates); candidate_idx++)
 			{
+				RTLIL::Cell *other_cell = candidates[candidate_idx];
 				log("    Analyzing resource sharing with %s (%s):\n", log_id(other_cell), log_id(other_cell->type));
 
 				const pool<ssc_pair_t> &other_cell_activation_patterns = find_cell_activation_patterns(other_cell, "      ");
@@ -1230,82 +1358,59 @@ struct ShareWorker
 				log("      Found %d activation_patterns using ctrl signal %s.\n",
 						GetSize(other_cell_activation_patterns), log_signal(other_cell_activation_signals));
 
-				const pool<RTLIL::SigBit> &cell_forbidden_controls = find_forbidden_controls(cell);
-				const pool<RTLIL::SigBit> &other_cell_forbidden_controls = find_forbidden_controls(other_cell);
-
 				std::set<RTLIL::SigBit> union_forbidden_controls;
-				union_forbidden_controls.insert(cell_forbidden_controls.begin(), cell_forbidden_controls.end());
-				union_forbidden_controls.insert(other_cell_forbidden_controls.begin(), other_cell_forbidden_controls.end());
-
-				if (!union_forbidden_controls.empty())
-					log("      Forbidden control signals for this pair of cells: %s\n", log_signal(union_forbidden_controls));
-
 				pool<ssc_pair_t> filtered_cell_activation_patterns;
 				pool<ssc_pair_t> filtered_other_cell_activation_patterns;
 
-				filter_activation_patterns(filtered_cell_activation_patterns, cell_activation_patterns, union_forbidden_controls);
-				filter_activation_patterns(filtered_other_cell_activation_patterns, other_cell_activation_patterns, union_forbidden_controls);
-
-				optimize_activation_patterns(filtered_cell_activation_patterns);
-				optimize_activation_patterns(filtered_other_cell_activation_patterns);
+				filter_pair_activation_patterns(cell, cell_activation_patterns, other_cell, other_cell_activation_patterns,
+						union_forbidden_controls, filtered_cell_activation_patterns, filtered_other_cell_activation_patterns);
 
-				QuickConeSat qcsat(modwalker);
-				if (config.opt_fast) {
-					qcsat.max_cell_outs = 3;
-					qcsat.max_cell_count = 100;
-				}
-
-				pool<RTLIL::Cell*> sat_cells;
-				std::set<RTLIL::SigBit> bits_queue;
-
-				std::vector<int> cell_active, other_cell_active;
-				RTLIL::SigSpec all_ctrl_signals;
+				if (!union_forbidden_controls.empty())
+					log("      Forbidden control signals for this pair of cells: %s\n", log_signal(union_forbidden_controls));
 
-				for (auto &p : filtered_cell_activation_patterns) {
+				for (auto &p : filtered_cell_activation_patterns)
 					log("      Activation pattern for cell %s: %s = %s\n", log_id(cell), log_signal(p.first), log_signal(p.second));
-					cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
-					all_ctrl_signals.append(p.first);
-				}
 
-				for (auto &p : filtered_other_cell_activation_patterns) {
+				for (auto &p : filtered_other_cell_activation_patterns)
 					log("      Activation pattern for cell %s: %s = %s\n", log_id(other_cell), log_signal(p.first), log_signal(p.second));
-					other_cell_active.push_back(qcsat.ez->vec_eq(qcsat.importSig(p.first), qcsat.importSig(p.second)));
-					all_ctrl_signals.append(p.first);
-				}
 
-				qcsat.prepare();
+				pair_query_t query;
+				if (config.dispatcher != nullptr && !batch_queries.count(other_cell))
+					solve_pair_queries(qcsat, cell, cell_activation_patterns, candidates, candidate_idx, batch_queries);
+				auto query_it = batch_queries.find(other_cell);
+				if (query_it != batch_queries.end()) {
+					query = std::move(query_it->second);
+				} else if (config.opt_fast) {
+					QuickConeSatBatch single(qcsat.modwalker, 1, 1, qcsat);
+					import_pair_query(single.context(0), query, filtered_cell_activation_patterns, filtered_other_cell_activation_patterns);
+					solve_pair_query(single.context(0), query);
+				} else {
+					import_pair_query(qcsat, query, filtered_cell_activation_patterns, filtered_other_cell_activation_patterns);
+					solve_pair_query(qcsat, query);
+				}
+				const RTLIL::SigSpec &all_ctrl_signals = query.all_ctrl_signals;
 
-				int sub1 = qcsat.ez->expression(qcsat.ez->OpOr, cell_active);
-				if (!qcsat.ez->solve(sub1)) {
+				if (!query.cell_active) {
 					log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(cell));
 					cells_to_remove.insert(cell);
 					break;
 				}
 
-				int sub2 = qcsat.ez->expression(qcsat.ez->OpOr, other_cell_active);
-				if (!qcsat.ez->solve(sub2)) {
+				if (!query.other_cell_active) {
 					log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(other_cell));
 					cells_to_remove.insert(other_cell);
 					shareable_cells.erase(other_cell);
 					continue;
 				}
 
-				qcsat.ez->non_incremental();
-
-				all_ctrl_signals.sort_and_unify();
-				std::vector<int> sat_model = qcsat.importSig(all_ctrl_signals);
-				std::vector<bool> sat_model_values;
-
-				qcsat.ez->assume(qcsat.ez->AND(sub1, sub2));
-
 				log("      Size of SAT problem: %d cells, %d variables, %d clauses\n",
-						GetSize(sat_cells), qcsat.ez->numCnfVariables(), qcsat.ez->numCnfClauses());
+						query.sat_cells, query.cnf_variables, query.cnf_clauses);
 
-				if (qcsat.ez->solve(sat_model, sat_model_values)) {
+				if (query.both_active) {
 					log("      According to the SAT solver this pair of cells can not be shared.\n");
-					log("      Model from SAT solver: %s = %d'", log_signal(all_ctrl_signals), GetSize(sat_model_values));
-					for (int i = GetSize(sat_model_values)-1; i >= 0; i--)
-						log("%c", sat_model_values[i] ? '1' : '0');
+					log("      Model from SAT solver: %s = %d'", log_signal(all_ctrl_signals), GetSize(query.sat_model_values));
+					for (int i = GetSize(query.sat_model_values)-1; i >= 0; i--)
+						log("%c", query.sat_model_values[i] ? '1' : '0');
 					log("\n");
 					continue;
 				}
@@ -1439,6 +1544,10 @@ struct SharePass : public Pass {
 		log("  -limit N\n");
 		log("    Only perform the first N merges, then stop. This is useful for debugging.\n");
 		log("\n");
+		log("  -j N\n");
+		log("    Solve the SAT problems for up to N sharing candidates of a cell at once,\n");
+		log("    using N threads. The result does not depend on N.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -1448,6 +1557,8 @@ struct SharePass : public Pass {
 		config.opt_force = false;
 		config.opt_aggressive = false;
 		config.opt_fast = false;
+		config.dispatcher = nullptr;
+		int num_threads = 1;
 
 		config.generic_uni_ops.insert(ID($not));
 		// config.generic_uni_ops.insert(ID($pos));
@@ -1509,10 +1620,27 @@ struct SharePass : public Pass {
 				config.limit = atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				num_threads = atoi(args[++argidx].c_str());
+				if (num_threads < 1)
+					log_cmd_error("Invalid number of threads `%s'.\n", args[argidx].c_str());
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		std::unique_ptr<ParallelDispatcher> dispatcher;
+		if (num_threads > 1) {
+#ifdef YOSYS_ENABLE_THREADS
+			dispatcher.reset(new ParallelDispatcher(num_threads - 1));
+#else
+			log_warning("Yosys was built without thread support, ignoring -j.\n");
+#endif
+		}
+		config.dispatcher = dispatcher.get();
+
+		QuickConeSatCache::Scope qcsat_scope(design);
 		ShareWorker sw(config, design);
 
 		for (auto module : design->selected_modules())
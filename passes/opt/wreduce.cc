@@ -31,6 +31,7 @@ struct WreduceConfig
 	pool<IdString> supported_cell_types;
 	bool keepdc = false;
 	bool mux_undef = false;
+	bool memx = false;
 
 	WreduceConfig()
 	{
@@ -465,6 +466,313 @@ struct WreduceWorker
 	}
 };
 
+static void wreduce_module(WreduceConfig *config, Module *module)
+{
+	if (module->has_processes_warn())
+		return;
+
+	for (auto c : module->selected_cells())
+	{
+		if (c->type.in(ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
+				ID($lt), ID($le), ID($eq), ID($ne), ID($eqx), ID($nex), ID($ge), ID($gt),
+				ID($logic_not), ID($logic_and), ID($logic_or)) && GetSize(c->getPort(ID::Y)) > 1) {
+			SigSpec sig = c->getPort(ID::Y);
+			if (!sig.has_const()) {
+				c->setPort(ID::Y, sig[0]);
+				c->setParam(ID::Y_WIDTH, 1);
+				sig.remove(0);
+				module->connect(sig, Const(0, GetSize(sig)));
+			}
+		}
+
+		if (c->type.in(ID($div), ID($mod), ID($divfloor), ID($modfloor), ID($pow)))
+		{
+			SigSpec A = c->getPort(ID::A);
+			int original_a_width = GetSize(A);
+			if (c->getParam(ID::A_SIGNED).as_bool()) {
+				while (GetSize(A) > 1 && A[GetSize(A)-1] == State::S0 && A[GetSize(A)-2] == State::S0)
+					A.remove(GetSize(A)-1, 1);
+			} else {
+				while (GetSize(A) > 0 && A[GetSize(A)-1] == State::S0)
+					A.remove(GetSize(A)-1, 1);
+			}
+			if (original_a_width != GetSize(A)) {
+				log("Removed top %d bits (of %d) from port A of cell %s.%s (%s).\n",
+						original_a_width-GetSize(A), original_a_width, log_id(module), log_id(c), log_id(c->type));
+				c->setPort(ID::A, A);
+				c->setParam(ID::A_WIDTH, GetSize(A));
+			}
+
+			SigSpec B = c->getPort(ID::B);
+			int original_b_width = GetSize(B);
+			if (c->getParam(ID::B_SIGNED).as_bool()) {
+				while (GetSize(B) > 1 && B[GetSize(B)-1] == State::S0 && B[GetSize(B)-2] == State::S0)
+					B.remove(GetSize(B)-1, 1);
+			} else {
+				while (GetSize(B) > 0 && B[GetSize(B)-1] == State::S0)
+					B.remove(GetSize(B)-1, 1);
+			}
+			if (original_b_width != GetSize(B)) {
+				log("Removed top %d bits (of %d) from port B of cell %s.%s (%s).\n",
+						original_b_width-GetSize(B), original_b_width, log_id(module), log_id(c), log_id(c->type));
+				c->setPort(ID::B, B);
+				c->setParam(ID::B_WIDTH, GetSize(B));
+			}
+		}
+
+		if (!config->memx && c->type.in(ID($memrd), ID($memrd_v2), ID($memwr), ID($memwr_v2), ID($meminit), ID($meminit_v2))) {
+			IdString memid = c->getParam(ID::MEMID).decode_string();
+			RTLIL::Memory *mem = module->memories.at(memid);
+			if (mem->start_offset >= 0) {
+				int cur_addrbits = c->getParam(ID::ABITS).as_int();
+				int max_addrbits = ceil_log2(mem->start_offset + mem->size);
+				if (cur_addrbits > max_addrbits) {
+					log("Removed top %d address bits (of %d) from memory %s port %s.%s (%s).\n",
+							cur_addrbits-max_addrbits, cur_addrbits,
+							c->type == ID($memrd) ? "read" : c->type == ID($memwr) ? "write" : "init",
+							log_id(module), log_id(c), log_id(memid));
+					c->setParam(ID::ABITS, max_addrbits);
+					c->setPort(ID::ADDR, c->getPort(ID::ADDR).extract(0, max_addrbits));
+				}
+			}
+		}
+	}
+
+	WreduceWorker worker(config, module);
+	worker.run();
+}
+
+// Narrows module ports across the hierarchy (wreduce -hier). The port bits
+// that can be removed are found from per-module summaries of the used bits,
+// which are only updated for modules changed in the previous round. Within a
+// round a summary may miss some changes, which only ever makes it keep more
+// bits, and the next round picks them up.
+struct WreduceHierWorker
+{
+	WreduceConfig *config;
+	Design *design;
+
+	struct ModuleInfo {
+		SigMap sigmap;
+		pool<SigBit> used_bits;
+	};
+
+	dict<Module*, ModuleInfo> infos;
+	dict<Module*, std::vector<Cell*>> instances;
+
+	WreduceHierWorker(WreduceConfig *config, Design *design) : config(config), design(design) { }
+
+	void index_module(Module *module)
+	{
+		ModuleInfo &info = infos[module];
+		info.sigmap.set(module);
+		info.used_bits.clear();
+
+		for (auto wire : module->wires())
+			if (wire->port_output || wire->get_bool_attribute(ID::keep))
+				for (auto bit : info.sigmap(wire))
+					info.used_bits.insert(bit);
+
+		for (auto cell : module->cells())
+		for (auto &conn : cell->connections())
+			if (cell->input(conn.first) || !cell->output(conn.first))
+				for (auto bit : info.sigmap(conn.second))
+					info.used_bits.insert(bit);
+	}
+
+	bool can_narrow(Module *module)
+	{
+		if (module == design->top_module() || module->get_blackbox_attribute() || module->has_processes() ||
+				module->get_bool_attribute(ID::keep_hierarchy) || module->get_bool_attribute(ID::is_interface) ||
+				!design->selected_whole_module(module))
+			return false;
+
+		if (!instances.count(module))
+			return false;
+
+		// Instances with parameters or positional connections have not been
+		// elaborated by the hierarchy pass yet.
+		for (auto cell : instances.at(module)) {
+			if (cell->module->has_processes() || !design->selected_whole_module(cell->module) || !cell->parameters.empty())
+				return false;
+			for (auto &conn : cell->connections()) {
+				Wire *port = module->wire(conn.first);
+				if (port == nullptr || port->port_id == 0)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Removes the top bits of the ports of the module that neither the module
+	// nor any of its instances need. Returns true if some port was narrowed.
+	bool narrow_ports(Module *module)
+	{
+		const ModuleInfo &info = infos.at(module);
+		const std::vector<Cell*> &cells = instances.at(module);
+		bool did_something = false;
+
+		for (auto port_name : module->ports)
+		{
+			Wire *wire = module->wire(port_name);
+			int width = GetSize(wire);
+
+			if (wire->port_input == wire->port_output || wire->upto || width == 0)
+				continue;
+			if (WreduceWorker::count_nontrivial_wire_attrs(wire) > 0)
+				continue;
+
+			bool bad_connection = false;
+			for (auto cell : cells)
+				if (cell->hasPort(port_name) && GetSize(cell->getPort(port_name)) != width)
+					bad_connection = true;
+			if (bad_connection)
+				continue;
+
+			// The constant each removed bit is known to have, or State::Sm.
+			std::vector<State> removed_values;
+
+			for (int i = width-1; i >= 0; i--)
+			{
+				SigBit bit = info.sigmap(SigBit(wire, i));
+				State value = State::Sm;
+				bool unused = true;
+
+				if (wire->port_input) {
+					unused = !info.used_bits.count(bit);
+					for (auto cell : cells) {
+						State parent_value = State::Sm;
+						if (cell->hasPort(port_name)) {
+							SigBit parent_bit = infos.at(cell->module).sigmap(cell->getPort(port_name)[i]);
+							if (parent_bit == State::S0 || parent_bit == State::S1)
+								parent_value = parent_bit.data;
+						}
+						if (cell == cells.front())
+							value = parent_value;
+						else if (value != parent_value)
+							value = State::Sm;
+					}
+				} else {
+					if (bit == State::S0 || bit == State::S1)
+						value = bit.data;
+					for (auto cell : cells)
+						if (cell->hasPort(port_name)) {
+							const ModuleInfo &parent_info = infos.at(cell->module);
+							if (parent_info.used_bits.count(parent_info.sigmap(cell->getPort(port_name)[i])))
+								unused = false;
+						}
+				}
+
+				if (!unused && value == State::Sm)
+					break;
+				removed_values.push_back(value);
+			}
+
+			if (removed_values.empty())
+				continue;
+
+			int new_width = width - GetSize(removed_values);
+			log("Removed top %d bits (of %d) from port %s of module %s.\n",
+					GetSize(removed_values), width, log_id(port_name), log_id(module));
+
+			if (new_width > 0) {
+				Wire *new_wire = module->addWire(NEW_ID, new_width);
+				new_wire->start_offset = wire->start_offset;
+				new_wire->port_id = wire->port_id;
+				new_wire->port_input = wire->port_input;
+				new_wire->port_output = wire->port_output;
+				if (wire->attributes.count(ID::src))
+					new_wire->attributes[ID::src] = wire->attributes.at(ID::src);
+				module->swap_names(wire, new_wire);
+				if (wire->port_input)
+					module->connect(SigSpec(wire).extract(0, new_width), new_wire);
+				else
+					module->connect(new_wire, SigSpec(wire).extract(0, new_width));
+			}
+
+			// The removed bits of an input port are driven by the constant all
+			// instances agree on, those of an output port are driven by the
+			// constant the module had for them in every parent.
+			for (int k = 0; k < GetSize(removed_values); k++) {
+				int i = width-1-k;
+				if (removed_values[k] == State::Sm)
+					continue;
+				if (wire->port_input) {
+					module->connect(SigBit(wire, i), removed_values[k]);
+				} else {
+					for (auto cell : cells)
+						if (cell->hasPort(port_name) && cell->getPort(port_name)[i].wire)
+							cell->module->connect(cell->getPort(port_name)[i], removed_values[k]);
+				}
+			}
+
+			for (auto cell : cells) {
+				if (!cell->hasPort(port_name))
+					continue;
+				if (new_width > 0)
+					cell->setPort(port_name, cell->getPort(port_name).extract(0, new_width));
+				else
+					cell->unsetPort(port_name);
+			}
+
+			wire->port_id = 0;
+			wire->port_input = false;
+			wire->port_output = false;
+			did_something = true;
+		}
+
+		if (did_something)
+			module->fixup_ports();
+		return did_something;
+	}
+
+	void run()
+	{
+		for (auto module : design->modules())
+			for (auto cell : module->cells())
+				if (design->module(cell->type) != nullptr)
+					instances[design->module(cell->type)].push_back(cell);
+
+		for (auto module : design->modules())
+			index_module(module);
+
+		pool<Module*> dirty_modules;
+		for (auto module : design->selected_modules())
+			dirty_modules.insert(module);
+
+		for (int round = 1; !dirty_modules.empty(); round++)
+		{
+			log("Round %d: reducing %d modules.\n", round, GetSize(dirty_modules));
+			for (auto module : design->selected_modules())
+				if (dirty_modules.count(module)) {
+					wreduce_module(config, module);
+					index_module(module);
+				}
+
+			// A module's ports depend on the module itself and its parents.
+			std::vector<Module*> candidates;
+			for (auto module : design->modules()) {
+				bool candidate = dirty_modules.count(module) != 0;
+				if (!candidate && instances.count(module))
+					for (auto cell : instances.at(module))
+						if (dirty_modules.count(cell->module))
+							candidate = true;
+				if (candidate && can_narrow(module))
+					candidates.push_back(module);
+			}
+
+			dirty_modules.clear();
+			for (auto module : candidates)
+				if (narrow_ports(module)) {
+					dirty_modules.insert(module);
+					for (auto cell : instances.at(module))
+						dirty_modules.insert(cell->module);
+				}
+		}
+	}
+};
+
 struct WreducePass : public Pass {
 	WreducePass() : Pass("wreduce", "reduce the word size of operations if possible") { }
 	void help() override
@@ -492,18 +800,28 @@ struct WreducePass : public Pass {
 		log("    -keepdc\n");
 		log("        Do not optimize explicit don't-care values.\n");
 		log("\n");
+		log("    -hier\n");
+		log("        Also reduce the width of module ports, based on how all instances of a\n");
+		log("        module are used. The top bits of an output port are removed when no\n");
+		log("        instance uses them or the module drives them with a constant, and the\n");
+		log("        top bits of an input port when the module does not use them or all\n");
+		log("        instances drive them with the same constant. The selected modules are\n");
+		log("        processed until no more ports change, without flattening the design.\n");
+		log("        Only fully selected modules below the top module are changed, and only\n");
+		log("        if all their instances are in fully selected modules.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, Design *design) override
 	{
 		WreduceConfig config;
-		bool opt_memx = false;
+		bool opt_hier = false;
 
 		log_header(design, "Executing WREDUCE pass (reducing word size of cells).\n");
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
 			if (args[argidx] == "-memx") {
-				opt_memx = true;
+				config.memx = true;
 				continue;
 			}
 			if (args[argidx] == "-keepdc") {
@@ -514,84 +832,20 @@ struct WreducePass : public Pass {
 				config.mux_undef = true;
 				continue;
 			}
+			if (args[argidx] == "-hier") {
+				opt_hier = true;
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
-		for (auto module : design->selected_modules())
-		{
-			if (module->has_processes_warn())
-				continue;
-
-			for (auto c : module->selected_cells())
-			{
-				if (c->type.in(ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
-						ID($lt), ID($le), ID($eq), ID($ne), ID($eqx), ID($nex), ID($ge), ID($gt),
-						ID($logic_not), ID($logic_and), ID($logic_or)) && GetSize(c->getPort(ID::Y)) > 1) {
-					SigSpec sig = c->getPort(ID::Y);
-					if (!sig.has_const()) {
-						c->setPort(ID::Y, sig[0]);
-						c->setParam(ID::Y_WIDTH, 1);
-						sig.remove(0);
-						module->connect(sig, Const(0, GetSize(sig)));
-					}
-				}
-
-				if (c->type.in(ID($div), ID($mod), ID($divfloor), ID($modfloor), ID($pow)))
-				{
-					SigSpec A = c->getPort(ID::A);
-					int original_a_width = GetSize(A);
-					if (c->getParam(ID::A_SIGNED).as_bool()) {
-						while (GetSize(A) > 1 && A[GetSize(A)-1] == State::S0 && A[GetSize(A)-2] == State::S0)
-							A.remove(GetSize(A)-1, 1);
-					} else {
-						while (GetSize(A) > 0 && A[GetSize(A)-1] == State::S0)
-							A.remove(GetSize(A)-1, 1);
-					}
-					if (original_a_width != GetSize(A)) {
-						log("Removed top %d bits (of %d) from port A of cell %s.%s (%s).\n",
-								original_a_width-GetSize(A), original_a_width, log_id(module), log_id(c), log_id(c->type));
-						c->setPort(ID::A, A);
-						c->setParam(ID::A_WIDTH, GetSize(A));
-					}
-
-					SigSpec B = c->getPort(ID::B);
-					int original_b_width = GetSize(B);
-					if (c->getParam(ID::B_SIGNED).as_bool()) {
-						while (GetSize(B) > 1 && B[GetSize(B)-1] == State::S0 && B[GetSize(B)-2] == State::S0)
-							B.remove(GetSize(B)-1, 1);
-					} else {
-						while (GetSize(B) > 0 && B[GetSize(B)-1] == State::S0)
-							B.remove(GetSize(B)-1, 1);
-					}
-					if (original_b_width != GetSize(B)) {
-						log("Removed top %d bits (of %d) from port B of cell %s.%s (%s).\n",
-								original_b_width-GetSize(B), original_b_width, log_id(module), log_id(c), log_id(c->type));
-						c->setPort(ID::B, B);
-						c->setParam(ID::B_WIDTH, GetSize(B));
-					}
-				}
-
-				if (!opt_memx && c->type.in(ID($memrd), ID($memrd_v2), ID($memwr), ID($memwr_v2), ID($meminit), ID($meminit_v2))) {
-					IdString memid = c->getParam(ID::MEMID).decode_string();
-					RTLIL::Memory *mem = module->memories.at(memid);
-					if (mem->start_offset >= 0) {
-						int cur_addrbits = c->getParam(ID::ABITS).as_int();
-						int max_addrbits = ceil_log2(mem->start_offset + mem->size);
-						if (cur_addrbits > max_addrbits) {
-							log("Removed top %d address bits (of %d) from memory %s port %s.%s (%s).\n",
-									cur_addrbits-max_addrbits, cur_addrbits,
-									c->type == ID($memrd) ? "read" : c->type == ID($memwr) ? "write" : "init",
-									log_id(module), log_id(c), log_id(memid));
-							c->setParam(ID::ABITS, max_addrbits);
-							c->setPort(ID::ADDR, c->getPort(ID::ADDR).extract(0, max_addrbits));
-						}
-					}
-				}
-			}
-
-			WreduceWorker worker(&config, module);
+		if (opt_hier) {
+			WreduceHierWorker worker(&config, design);
 			worker.run();
+		} else {
+			for (auto module : design->selected_modules())
+				wreduce_module(&config, module);
 		}
 	}
 } WreducePass;
@@ -26,6 +26,7 @@
 #include "kernel/yw.h"
 #include "kernel/json.h"
 #include "kernel/fmt.h"
+#include "kernel/threading.h"
 
 #include <ctime>
 
@@ -39,6 +40,11 @@ enum class SimulationMode {
 	gate,
 };
 
+enum class SimulationEngine {
+	interpreted,
+	compiled,
+};
+
 static const std::map<std::string, int> g_units =
 {
 	{ "",    -9 }, // default is ns
@@ -73,7 +79,13 @@ struct OutputWriter
 {
 	OutputWriter(SimWorker *w) { worker = w;};
 	virtual ~OutputWriter() {};
-	virtual void write(std::map<int, bool> &use_signal) = 0;
+	// writers are either streamed (write_header() once, then write_step() for
+	// every step as it is simulated) or fed all buffered steps via write()
+	virtual void write_header(std::map<int, bool> &use_signal) = 0;
+	virtual void write_step(int t, const std::map<int, Const> &data) = 0;
+	virtual void flush() { }
+	virtual void finish() { }
+	void write(std::map<int, bool> &use_signal);
 	SimWorker *worker;
 };
 
@@ -82,9 +94,10 @@ struct TriggeredAssertion {
 	int step;
 	SimInstance *instance;
 	Cell *cell;
+	int lane;
 
-	TriggeredAssertion(int step, SimInstance *instance, Cell *cell) :
-		step(step), instance(instance), cell(cell)
+	TriggeredAssertion(int step, SimInstance *instance, Cell *cell, int lane = -1) :
+		step(step), instance(instance), cell(cell), lane(lane)
 	{ }
 };
 
@@ -101,10 +114,12 @@ struct SimShared
 	double start_time = 0;
 	double stop_time = -1;
 	SimulationMode sim_mode = SimulationMode::sim;
+	SimulationEngine engine = SimulationEngine::interpreted;
 	bool cycles_set = false;
 	std::vector<std::unique_ptr<OutputWriter>> outputfiles;
 	std::vector<std::pair<int,std::map<int,Const>>> output_data;
 	bool ignore_x = false;
+	bool stream = false;
 	bool date = false;
 	bool multiclock = false;
 	int next_output_id = 0;
@@ -112,6 +127,85 @@ struct SimShared
 	std::vector<TriggeredAssertion> triggered_assertions;
 	bool serious_asserts = false;
 	bool initstate = true;
+	std::vector<std::string> observe;
+	bool observe_formal = false;
+	std::unique_ptr<ParallelDispatcher> dispatcher;
+};
+
+// Binary image of the simulation state for sim -checkpoint-file/-restore.
+// Constants are stored with two states per byte.
+struct SimStateImage
+{
+	std::string filename;
+	std::string data;
+	size_t pos = 0;
+
+	void put_int(int64_t value)
+	{
+		for (int i = 0; i < 8; i++)
+			data.push_back(char(uint64_t(value) >> (8*i)));
+	}
+
+	int64_t get_int()
+	{
+		if (pos + 8 > data.size())
+			log_error("Unexpected end of checkpoint file `%s'.\n", filename.c_str());
+		uint64_t value = 0;
+		for (int i = 0; i < 8; i++)
+			value |= uint64_t(uint8_t(data[pos++])) << (8*i);
+		return int64_t(value);
+	}
+
+	void put_str(const std::string &str)
+	{
+		put_int(GetSize(str));
+		data += str;
+	}
+
+	std::string get_str()
+	{
+		size_t len = get_int();
+		if (pos + len > data.size())
+			log_error("Unexpected end of checkpoint file `%s'.\n", filename.c_str());
+		pos += len;
+		return data.substr(pos - len, len);
+	}
+
+	void put_const(const Const &value)
+	{
+		put_int(GetSize(value));
+		for (int i = 0; i < GetSize(value); i += 2)
+			data.push_back(char(int(value[i]) | (i+1 < GetSize(value) ? int(value[i+1]) << 4 : 0)));
+	}
+
+	Const get_const(int width)
+	{
+		if (get_int() != width)
+			log_error("Checkpoint file `%s' does not match the simulated design.\n", filename.c_str());
+		if (pos + (width+1)/2 > data.size())
+			log_error("Unexpected end of checkpoint file `%s'.\n", filename.c_str());
+		Const value;
+		value.bits.reserve(width);
+		for (int i = 0; i < width; i++) {
+			int nibble = (uint8_t(data[pos + i/2]) >> (4*(i%2))) & 15;
+			if (nibble > int(State::Sm))
+				log_error("Invalid value in checkpoint file `%s'.\n", filename.c_str());
+			value.bits.push_back(State(nibble));
+		}
+		pos += (width+1)/2;
+		return value;
+	}
+
+	State get_state()
+	{
+		return get_const(1)[0];
+	}
+
+	void expect(int64_t value)
+	{
+		if (get_int() != value)
+			log_error("Checkpoint file `%s' does not match the simulated design.\n", filename.c_str());
+	}
 };
 
 void zinit(State &v)
@@ -126,6 +220,171 @@ void zinit(Const &v)
 		zinit(bit);
 }
 
+// single-bit logic functions of the compiled engine, these must match the
+// semantics of the corresponding functions in kernel/calc.cc
+static inline State sim_not(State a)
+{
+	if (a == State::S0) return State::S1;
+	if (a == State::S1) return State::S0;
+	return State::Sx;
+}
+
+static inline State sim_gate_not(State a)
+{
+	if (a == State::S0) return State::S1;
+	if (a == State::S1) return State::S0;
+	return a;
+}
+
+static inline State sim_and(State a, State b)
+{
+	if (a == State::S0 || b == State::S0) return State::S0;
+	if (a != State::S1 || b != State::S1) return State::Sx;
+	return State::S1;
+}
+
+static inline State sim_or(State a, State b)
+{
+	if (a == State::S1 || b == State::S1) return State::S1;
+	if (a != State::S0 || b != State::S0) return State::Sx;
+	return State::S0;
+}
+
+static inline State sim_xor(State a, State b)
+{
+	if ((a != State::S0 && a != State::S1) || (b != State::S0 && b != State::S1)) return State::Sx;
+	return a != b ? State::S1 : State::S0;
+}
+
+static inline State sim_mux(State a, State b, State s)
+{
+	if (s == State::S0) return a;
+	if (s == State::S1) return b;
+	return a == b ? a : State::Sx;
+}
+
+// Orders instructions so that each one comes after the drivers of its input
+// slots. Instructions on combinational loops (and everything depending on
+// them) can't be ordered like this and are appended in their original order,
+// 'num_cyclic' is set to their number.
+static std::vector<int> sim_levelize(int num_slots, int first_net_slot, const std::vector<std::vector<int>> &inputs,
+		const std::vector<std::vector<int>> &outputs, int &num_cyclic)
+{
+	int num_instr = GetSize(inputs);
+	std::vector<int> slot_driver(num_slots, -1);
+	for (int i = 0; i < num_instr; i++)
+		for (int slot : outputs[i])
+			if (slot >= first_net_slot)
+				slot_driver[slot] = i;
+
+	std::vector<std::vector<int>> successors(num_instr);
+	std::vector<int> indegree(num_instr);
+	for (int i = 0; i < num_instr; i++) {
+		pool<int> drivers;
+		for (int slot : inputs[i]) {
+			int driver = slot_driver[slot];
+			if (driver >= 0 && driver != i && drivers.insert(driver).second) {
+				successors[driver].push_back(i);
+				indegree[i]++;
+			}
+		}
+	}
+
+	std::vector<int> order;
+	std::vector<bool> ordered(num_instr);
+	for (int i = 0; i < num_instr; i++)
+		if (indegree[i] == 0)
+			order.push_back(i);
+	for (int k = 0; k < GetSize(order); k++)
+		for (int succ : successors[order[k]])
+			if (--indegree[succ] == 0)
+				order.push_back(succ);
+	for (int i : order)
+		ordered[i] = true;
+	num_cyclic = 0;
+	for (int i = 0; i < num_instr; i++)
+		if (!ordered[i]) {
+			order.push_back(i);
+			num_cyclic++;
+		}
+	return order;
+}
+
+// Direct evaluator for the word-level cells of the compiled engine, with the
+// operand signedness resolved when the program is compiled. Unlike
+// CellTypes::eval() it never copies an IdString, so it can be used on worker
+// threads (IdString refcounts are not thread-safe). Other cells have no
+// evaluator and go through CellTypes::eval().
+struct SimEval
+{
+	typedef RTLIL::Const (*fn2_t)(const RTLIL::Const&, const RTLIL::Const&, bool, bool, int);
+	typedef RTLIL::Const (*fn3_t)(const RTLIL::Const&, const RTLIL::Const&, const RTLIL::Const&);
+
+	fn2_t fn2 = nullptr;
+	fn3_t fn3 = nullptr;
+	bool signed1 = false, signed2 = false;
+	int result_len = -1;
+
+	SimEval() { }
+
+	SimEval(Cell *cell)
+	{
+		static const dict<IdString, fn2_t> fn2_table = {
+#define SIM_CONST_FN(_t) { ID($##_t), RTLIL::const_ ## _t },
+			SIM_CONST_FN(not) SIM_CONST_FN(and) SIM_CONST_FN(or) SIM_CONST_FN(xor) SIM_CONST_FN(xnor)
+			SIM_CONST_FN(reduce_and) SIM_CONST_FN(reduce_or) SIM_CONST_FN(reduce_xor) SIM_CONST_FN(reduce_xnor)
+			SIM_CONST_FN(reduce_bool) SIM_CONST_FN(logic_not) SIM_CONST_FN(logic_and) SIM_CONST_FN(logic_or)
+			SIM_CONST_FN(shl) SIM_CONST_FN(shr) SIM_CONST_FN(sshl) SIM_CONST_FN(sshr) SIM_CONST_FN(shift) SIM_CONST_FN(shiftx)
+			SIM_CONST_FN(lt) SIM_CONST_FN(le) SIM_CONST_FN(eq) SIM_CONST_FN(ne) SIM_CONST_FN(eqx) SIM_CONST_FN(nex)
+			SIM_CONST_FN(ge) SIM_CONST_FN(gt) SIM_CONST_FN(add) SIM_CONST_FN(sub) SIM_CONST_FN(mul) SIM_CONST_FN(div)
+			SIM_CONST_FN(mod) SIM_CONST_FN(divfloor) SIM_CONST_FN(modfloor) SIM_CONST_FN(pow) SIM_CONST_FN(pos) SIM_CONST_FN(neg)
+#undef SIM_CONST_FN
+			{ ID($bmux), [](const RTLIL::Const &a, const RTLIL::Const &s, bool, bool, int) { return RTLIL::const_bmux(a, s); } },
+			{ ID($demux), [](const RTLIL::Const &a, const RTLIL::Const &s, bool, bool, int) { return RTLIL::const_demux(a, s); } },
+			{ ID($bweqx), [](const RTLIL::Const &a, const RTLIL::Const &b, bool, bool, int) { return RTLIL::const_bweqx(a, b); } },
+		};
+		static const dict<IdString, fn3_t> fn3_table = {
+			{ ID($pmux), RTLIL::const_pmux },
+			{ ID($bwmux), RTLIL::const_bwmux },
+		};
+
+		auto it3 = fn3_table.find(cell->type);
+		if (it3 != fn3_table.end()) {
+			fn3 = it3->second;
+			return;
+		}
+
+		auto it2 = fn2_table.find(cell->type);
+		if (it2 == fn2_table.end())
+			return;
+
+		// same as CellTypes::eval()
+		signed1 = cell->hasParam(ID::A_SIGNED) && cell->getParam(ID::A_SIGNED).as_bool();
+		signed2 = cell->hasParam(ID::B_SIGNED) && cell->getParam(ID::B_SIGNED).as_bool();
+		result_len = cell->hasParam(ID::Y_WIDTH) ? cell->getParam(ID::Y_WIDTH).as_int() : -1;
+
+		fn2 = it2->second;
+		if (cell->type == ID($sshr) && !signed1)
+			fn2 = RTLIL::const_shr;
+		if (cell->type == ID($sshl) && !signed1)
+			fn2 = RTLIL::const_shl;
+
+		if (!cell->type.in(ID($sshr), ID($sshl), ID($shr), ID($shl), ID($shift), ID($shiftx), ID($pos), ID($neg), ID($not)) &&
+				(!signed1 || !signed2))
+			signed1 = false, signed2 = false;
+	}
+
+	RTLIL::Const operator()(const RTLIL::Const &arg1, const RTLIL::Const &arg2) const
+	{
+		return fn2(arg1, arg2, signed1, signed2, result_len);
+	}
+
+	RTLIL::Const operator()(const RTLIL::Const &arg1, const RTLIL::Const &arg2, const RTLIL::Const &arg3) const
+	{
+		return fn3(arg1, arg2, arg3);
+	}
+};
+
 struct SimInstance
 {
 	SimShared *shared;
@@ -143,13 +402,84 @@ struct SimInstance
 	dict<SigBit, pool<Wire*>> upd_outports;
 
 	dict<SigBit, SigBit> in_parent_drivers;
+	std::vector<std::pair<Wire*, SigSpec>> parent_inputs;
 	dict<SigBit, SigBit> clk2fflogic_drivers;
 
+	// observation cone (sim -observe), only the cells in it are simulated
+	bool pruned = false;
+	pool<SigBit> cone_bits;
+	pool<Cell*> cone_cells;
+	pool<Cell*> pruned_cells;
+	pool<IdString> pruned_memories;
+
 	pool<SigBit> dirty_bits;
 	pool<Cell*> dirty_cells;
-	pool<IdString> dirty_memories;
 	pool<SimInstance*, hash_ptr_ops> dirty_children;
 
+	// Compiled engine: every net bit gets a slot in a flat state array (the
+	// first slots hold the constant states) and the cells of the module are
+	// levelized into a linear program with precomputed operand slots.
+	enum sim_op_t {
+		SIM_OP_CELL,	// fall back to update_cell()
+		SIM_OP_EVAL2,	// CellTypes::eval() with two arguments
+		SIM_OP_EVAL3,	// CellTypes::eval() with three arguments
+		SIM_OP_BUF,
+		SIM_OP_NOT,
+		SIM_OP_GATE_NOT,
+		SIM_OP_AND,
+		SIM_OP_NAND,
+		SIM_OP_OR,
+		SIM_OP_NOR,
+		SIM_OP_XOR,
+		SIM_OP_XNOR,
+		SIM_OP_ANDNOT,
+		SIM_OP_ORNOT,
+		SIM_OP_MUX,
+		SIM_OP_AOI3,
+		SIM_OP_OAI3,
+	};
+
+	struct sim_instr_t
+	{
+		Cell *cell;
+		sim_op_t op;
+		// offsets into instr_operands
+		int a, b, c, y;
+		int a_len, b_len, c_len, y_len;
+	};
+
+	static constexpr int num_const_slots = int(State::Sm) + 1;
+
+	bool compiled = false;
+	dict<SigBit, int> net_slots;
+	std::vector<State> slot_values;
+	std::vector<int> slot_readers_begin, slot_readers;
+	std::vector<bool> slot_outport;
+	dict<int, std::vector<Wire*>> slot_outport_wires;
+	std::vector<int> dirty_outport_slots;
+
+	std::vector<sim_instr_t> program;
+	std::vector<SimEval> instr_eval;
+	std::vector<int> instr_operands;
+	std::vector<bool> instr_dirty;
+	int dirty_pc = 0, sweep_pc = INT_MAX;
+
+	// Parallel evaluation (sim -j): a parallel-safe instance and everything
+	// below it only touches its own state, so sibling subtrees can run on
+	// different threads. While 'deferring' is set on the root of such a
+	// subtree, the writes to its parent ports and to the shared memory trace
+	// are queued on the root and applied by the parent after the barrier.
+	bool parallel_safe = false;
+	SimInstance *defer_root = nullptr;
+	bool deferring = false;
+	std::vector<std::pair<Wire*, Const>> deferred_outputs;
+	struct deferred_mem_addr_t {
+		SimInstance *instance;
+		const IdString *memid;
+		int addr;
+	};
+	std::vector<deferred_mem_addr_t> deferred_mem_addrs;
+
 	struct ff_state_t
 	{
 		Const past_d;
@@ -202,6 +532,7 @@ struct SimInstance
 	pool<Cell*> formal_database;
 	pool<Cell*> initstate_database;
 	dict<Cell*, IdString> mem_cells;
+	pool<mem_state_t*, hash_ptr_ops> dirty_memories;
 	std::vector<print_state_t> print_database;
 
 	std::vector<Mem> memories;
@@ -229,6 +560,10 @@ struct SimInstance
 		if (parent) {
 			log_assert(parent->children.count(instance) == 0);
 			parent->children[instance] = this;
+
+			for (auto &conn : instance->connections())
+				if (instance->input(conn.first) && GetSize(conn.second))
+					parent_inputs.emplace_back(module->wire(conn.first), conn.second);
 		}
 
 		for (auto wire : module->wires())
@@ -364,6 +699,113 @@ struct SimInstance
 				zinit(mem.data);
 			}
 		}
+
+		if (parent == nullptr)
+			prepare_hierarchy();
+	}
+
+	// called for the top-level instance once the whole hierarchy exists
+	void prepare_hierarchy();
+
+	void compile_hierarchy()
+	{
+		compile_program();
+		for (auto &it : children)
+			it.second->compile_hierarchy();
+	}
+
+	// whether this instance and all instances below it can be evaluated on a
+	// worker thread, which rules out anything that logs or falls back to
+	// update_cell() for anything other than memories and child instances
+	bool check_parallel_safe()
+	{
+		parallel_safe = compiled && !shared->debug;
+
+		std::vector<bool> reachable(GetSize(program));
+		for (int pc : slot_readers)
+			reachable[pc] = true;
+
+		for (int pc = 0; pc < GetSize(program); pc++) {
+			Cell *cell = program[pc].cell;
+			if (!reachable[pc])
+				continue;
+			if (program[pc].op == SIM_OP_CELL && !mem_cells.count(cell) && !children.count(cell))
+				parallel_safe = false;
+			if (program[pc].op == SIM_OP_EVAL2 && instr_eval[pc].fn2 == nullptr)
+				parallel_safe = false;
+			if (program[pc].op == SIM_OP_EVAL3 && instr_eval[pc].fn3 == nullptr)
+				parallel_safe = false;
+		}
+
+		for (auto &mem : memories)
+			for (auto &port : mem.rd_ports)
+				if (port.clk_enable)
+					parallel_safe = false;
+
+		for (auto &it : children)
+			if (!it.second->check_parallel_safe())
+				parallel_safe = false;
+
+		return parallel_safe;
+	}
+
+	// make every parallel-safe child of an instance that runs on the calling
+	// thread the root of a subtree that is evaluated as a whole on a worker
+	void assign_defer_roots(SimInstance *root, int &num_roots)
+	{
+		defer_root = root;
+		for (auto &it : children) {
+			SimInstance *child = it.second;
+			if (root == nullptr && child->parallel_safe)
+				num_roots++;
+			child->assign_defer_roots(root != nullptr ? root : child->parallel_safe ? child : nullptr, num_roots);
+		}
+	}
+
+	bool in_cone(Wire *wire)
+	{
+		for (auto bit : sigmap(wire))
+			if (bit.wire != nullptr && !cone_bits.count(bit))
+				return false;
+		return true;
+	}
+
+	// drop everything outside of the observation cone
+	void apply_cone(int &kept_cells, int &total_cells)
+	{
+		pruned = true;
+
+		for (auto cell : module->cells())
+			if (!cone_cells.count(cell))
+				pruned_cells.insert(cell);
+
+		for (auto cell : pruned_cells) {
+			ff_database.erase(cell);
+			formal_database.erase(cell);
+			if (mem_cells.count(cell))
+				pruned_memories.insert(mem_cells.at(cell));
+		}
+
+		for (auto &it : mem_cells)
+			if (!pruned_cells.count(it.first))
+				pruned_memories.erase(it.second);
+
+		print_database.erase(std::remove_if(print_database.begin(), print_database.end(),
+				[&](const print_state_t &print) { return pruned_cells.count(print.cell) != 0; }), print_database.end());
+
+		for (auto &it : upd_cells) {
+			pool<Cell*> kept;
+			for (auto cell : it.second)
+				if (!pruned_cells.count(cell))
+					kept.insert(cell);
+			it.second.swap(kept);
+		}
+
+		kept_cells += GetSize(cone_cells);
+		total_cells += GetSize(module->cells());
+
+		for (auto &it : children)
+			it.second->apply_cone(kept_cells, total_cells);
 	}
 
 	~SimInstance()
@@ -409,7 +851,10 @@ struct SimInstance
 		for (auto bit : sigmap(sig))
 			if (bit.wire == nullptr)
 				value.bits.push_back(bit.data);
-			else if (state_nets.count(bit))
+			else if (compiled) {
+				auto it = net_slots.find(bit);
+				value.bits.push_back(it != net_slots.end() ? slot_values[it->second] : State::Sz);
+			} else if (state_nets.count(bit))
 				value.bits.push_back(state_nets.at(bit));
 			else
 				value.bits.push_back(State::Sz);
@@ -427,7 +872,10 @@ struct SimInstance
 		log_assert(GetSize(sig) <= GetSize(value));
 
 		for (int i = 0; i < GetSize(sig); i++)
-			if (value[i] != State::Sa && state_nets.at(sig[i]) != value[i]) {
+			if (compiled) {
+				if (write_slot(net_slots.at(sig[i]), value[i]))
+					did_something = true;
+			} else if (value[i] != State::Sa && state_nets.at(sig[i]) != value[i]) {
 				state_nets.at(sig[i]) = value[i];
 				dirty_bits.insert(sig[i]);
 				did_something = true;
@@ -476,7 +924,7 @@ struct SimInstance
 					dirty = true, state.data.bits[i+offset] = data.bits[i];
 
 		if (dirty)
-			dirty_memories.insert(memid);
+			dirty_memories.insert(&state);
 	}
 
 	void set_memory_state_bit(IdString memid, int offset, State data)
@@ -486,7 +934,7 @@ struct SimInstance
 			log_error("Addressing out of bounds bit %d/%d of memory %s\n", offset, state.mem->size * state.mem->width, log_id(memid));
 		if (state.data.bits[offset] != data) {
 			state.data.bits[offset] = data;
-			dirty_memories.insert(memid);
+			dirty_memories.insert(&state);
 		}
 	}
 
@@ -500,18 +948,17 @@ struct SimInstance
 
 		if (mem_cells.count(cell))
 		{
-			dirty_memories.insert(mem_cells[cell]);
+			dirty_memories.insert(&mem_database.at(mem_cells.at(cell)));
 			return;
 		}
 
 		if (children.count(cell))
 		{
 			auto child = children.at(cell);
-			for (auto &conn: cell->connections())
-				if (cell->input(conn.first) && GetSize(conn.second)) {
-					Const value = get_state(conn.second);
-					child->set_state(child->module->wire(conn.first), value);
-				}
+			for (auto &it : child->parent_inputs) {
+				Const value = get_state(it.second);
+				child->set_state(it.first, value);
+			}
 			dirty_children.insert(child);
 			return;
 		}
@@ -572,8 +1019,7 @@ struct SimInstance
 		log_error("Unsupported cell type: %s (%s.%s)\n", log_id(cell->type), log_id(module), log_id(cell));
 	}
 
-	void update_memory(IdString id) {
-		auto &mdb = mem_database[id];
+	void update_memory(mem_state_t &mdb) {
 		auto &mem = *mdb.mem;
 
 		for (int port_idx = 0; port_idx < GetSize(mem.rd_ports); port_idx++)
@@ -592,7 +1038,7 @@ struct SimInstance
 					data = mdb.data.extract(index*mem.width, mem.width << port.wide_log2);
 
 				for (int offset = 0; offset < 1 << port.wide_log2; offset++) {
-					register_memory_addr(id, addr_int + offset);
+					register_memory_addr(mem.memid, addr_int + offset);
 				}
 			}
 
@@ -600,67 +1046,472 @@ struct SimInstance
 		}
 	}
 
-	void update_ph1()
+	int sig_slot(SigBit bit) const
 	{
-		pool<Cell*> queue_cells;
-		pool<Wire*> queue_outports;
+		if (bit.wire == nullptr)
+			return int(bit.data);
+		return net_slots.at(bit);
+	}
 
-		queue_cells.swap(dirty_cells);
+	void mark_slot(int slot)
+	{
+		for (int k = slot_readers_begin[slot]; k < slot_readers_begin[slot+1]; k++) {
+			int pc = slot_readers[k];
+			if (instr_dirty[pc])
+				continue;
+			instr_dirty[pc] = true;
+			// instructions after the one currently running are picked up by
+			// the running sweep, earlier ones need another sweep
+			if (pc <= sweep_pc && pc < dirty_pc)
+				dirty_pc = pc;
+		}
+		if (slot_outport[slot])
+			dirty_outport_slots.push_back(slot);
+	}
 
-		while (1)
+	bool write_slot(int slot, State value)
+	{
+		if (value == State::Sa || slot < num_const_slots || slot_values[slot] == value)
+			return false;
+		slot_values[slot] = value;
+		mark_slot(slot);
+		return true;
+	}
+
+	Const read_slots(int offset, int len) const
+	{
+		Const value;
+		value.bits.reserve(len);
+		for (int i = 0; i < len; i++)
+			value.bits.push_back(slot_values[instr_operands[offset + i]]);
+		return value;
+	}
+
+	void write_slots(int offset, int len, const Const &value)
+	{
+		log_assert(len <= GetSize(value));
+		for (int i = 0; i < len; i++)
+			write_slot(instr_operands[offset + i], value.bits[i]);
+	}
+
+	static sim_op_t fast_op(Cell *cell)
+	{
+		static const dict<IdString, sim_op_t> gate_ops = {
+			{ ID($_BUF_), SIM_OP_BUF },
+			{ ID($_NOT_), SIM_OP_GATE_NOT },
+			{ ID($_AND_), SIM_OP_AND },
+			{ ID($_NAND_), SIM_OP_NAND },
+			{ ID($_OR_), SIM_OP_OR },
+			{ ID($_NOR_), SIM_OP_NOR },
+			{ ID($_XOR_), SIM_OP_XOR },
+			{ ID($_XNOR_), SIM_OP_XNOR },
+			{ ID($_ANDNOT_), SIM_OP_ANDNOT },
+			{ ID($_ORNOT_), SIM_OP_ORNOT },
+			{ ID($_MUX_), SIM_OP_MUX },
+			{ ID($_AOI3_), SIM_OP_AOI3 },
+			{ ID($_OAI3_), SIM_OP_OAI3 },
+			{ ID($mux), SIM_OP_MUX },
+		};
+
+		auto it = gate_ops.find(cell->type);
+		if (it != gate_ops.end())
+			return it->second;
+
+		// word-level bitwise cells only without any operand extension
+		if (cell->type.in(ID($not), ID($pos)) && cell->getParam(ID::A_WIDTH) == cell->getParam(ID::Y_WIDTH))
+			return cell->type == ID($not) ? SIM_OP_NOT : SIM_OP_BUF;
+
+		if (cell->type.in(ID($and), ID($or), ID($xor), ID($xnor)) && cell->getParam(ID::A_WIDTH) == cell->getParam(ID::Y_WIDTH) &&
+				cell->getParam(ID::B_WIDTH) == cell->getParam(ID::Y_WIDTH)) {
+			if (cell->type == ID($and)) return SIM_OP_AND;
+			if (cell->type == ID($or)) return SIM_OP_OR;
+			if (cell->type == ID($xor)) return SIM_OP_XOR;
+			return SIM_OP_XNOR;
+		}
+
+		return SIM_OP_CELL;
+	}
+
+	void compile_program()
+	{
+		compiled = true;
+
+		for (int i = 0; i < num_const_slots; i++)
+			slot_values.push_back(State(i));
+		for (auto &it : state_nets) {
+			net_slots[it.first] = GetSize(slot_values);
+			slot_values.push_back(it.second);
+		}
+		state_nets.clear();
+
+		slot_outport.resize(GetSize(slot_values));
+		for (auto &it : upd_outports) {
+			int slot = net_slots.at(it.first);
+			slot_outport[slot] = true;
+			for (auto wire : it.second)
+				slot_outport_wires[slot].push_back(wire);
+		}
+
+		// collect one instruction per cell that update_cell() would not ignore
+
+		struct proto_t {
+			Cell *cell;
+			sim_op_t op;
+			std::vector<int> a, b, c, y, inputs;
+		};
+		std::vector<proto_t> protos;
+
+		for (auto cell : module->cells())
 		{
-			for (auto bit : dirty_bits)
+			if (ff_database.count(cell) || formal_database.count(cell) || cell->type == ID($print) || pruned_cells.count(cell))
+				continue;
+
+			proto_t proto;
+			proto.cell = cell;
+			proto.op = SIM_OP_CELL;
+
+			for (auto &port : cell->connections())
+				if (cell->input(port.first))
+					for (auto bit : sigmap(port.second))
+						proto.inputs.push_back(sig_slot(bit));
+
+			if (!mem_cells.count(cell) && !children.count(cell) && yosys_celltypes.cell_evaluable(cell->type))
 			{
-				if (upd_cells.count(bit))
-					for (auto cell : upd_cells.at(bit))
-						queue_cells.insert(cell);
+				bool has_a = cell->hasPort(ID::A), has_b = cell->hasPort(ID::B), has_c = cell->hasPort(ID::C);
+				bool has_d = cell->hasPort(ID::D), has_s = cell->hasPort(ID::S), has_y = cell->hasPort(ID::Y);
 
-				if (upd_outports.count(bit) && parent != nullptr)
-					for (auto wire : upd_outports.at(bit))
-						queue_outports.insert(wire);
+				// same port patterns as in update_cell()
+				if (has_a && !has_d && has_y && (!has_c || (has_b && !has_s)) && (!has_s || !has_c))
+				{
+					for (auto bit : sigmap(cell->getPort(ID::A)))
+						proto.a.push_back(sig_slot(bit));
+					if (has_b)
+						for (auto bit : sigmap(cell->getPort(ID::B)))
+							proto.b.push_back(sig_slot(bit));
+					if (has_c || has_s)
+						for (auto bit : sigmap(cell->getPort(has_c ? ID::C : ID::S)))
+							proto.c.push_back(sig_slot(bit));
+					for (auto bit : sigmap(cell->getPort(ID::Y)))
+						proto.y.push_back(sig_slot(bit));
+
+					proto.op = fast_op(cell);
+					if (proto.op == SIM_OP_CELL)
+						proto.op = (has_c || has_s) && has_b ? SIM_OP_EVAL3 : SIM_OP_EVAL2;
+					if (proto.op == SIM_OP_EVAL2 && has_s)
+						proto.b.swap(proto.c);
+				}
 			}
 
-			dirty_bits.clear();
+			std::sort(proto.inputs.begin(), proto.inputs.end());
+			proto.inputs.erase(std::unique(proto.inputs.begin(), proto.inputs.end()), proto.inputs.end());
+			protos.push_back(std::move(proto));
+		}
 
-			if (!queue_cells.empty())
-			{
-				for (auto cell : queue_cells)
-					update_cell(cell);
+		std::vector<std::vector<int>> proto_inputs, proto_outputs;
+		for (auto &proto : protos) {
+			proto_inputs.push_back(proto.inputs);
+			proto_outputs.push_back(proto.y);
+		}
+		int num_cyclic;
+		std::vector<int> order = sim_levelize(GetSize(slot_values), num_const_slots, proto_inputs, proto_outputs, num_cyclic);
 
-				queue_cells.clear();
-				continue;
+		// emit the program and the slot -> reader table
+
+		std::vector<int> reader_count(GetSize(slot_values) + 1);
+		for (int i : order)
+		{
+			auto &proto = protos[i];
+			sim_instr_t instr;
+			instr.cell = proto.cell;
+			instr.op = proto.op;
+			instr.a = GetSize(instr_operands), instr.a_len = GetSize(proto.a);
+			instr_operands.insert(instr_operands.end(), proto.a.begin(), proto.a.end());
+			instr.b = GetSize(instr_operands), instr.b_len = GetSize(proto.b);
+			instr_operands.insert(instr_operands.end(), proto.b.begin(), proto.b.end());
+			instr.c = GetSize(instr_operands), instr.c_len = GetSize(proto.c);
+			instr_operands.insert(instr_operands.end(), proto.c.begin(), proto.c.end());
+			instr.y = GetSize(instr_operands), instr.y_len = GetSize(proto.y);
+			instr_operands.insert(instr_operands.end(), proto.y.begin(), proto.y.end());
+			program.push_back(instr);
+			instr_eval.push_back(instr.op == SIM_OP_EVAL2 || instr.op == SIM_OP_EVAL3 ? SimEval(instr.cell) : SimEval());
+
+			for (int slot : proto.inputs)
+				reader_count[slot]++;
+		}
+
+		slot_readers_begin.resize(GetSize(slot_values) + 1);
+		for (int slot = 0; slot < GetSize(slot_values); slot++)
+			slot_readers_begin[slot+1] = slot_readers_begin[slot] + reader_count[slot];
+		slot_readers.resize(slot_readers_begin.back());
+		std::vector<int> reader_pos(slot_readers_begin.begin(), slot_readers_begin.end() - 1);
+		for (int pc = 0; pc < GetSize(order); pc++)
+			for (int slot : protos[order[pc]].inputs)
+				slot_readers[reader_pos[slot]++] = pc;
+
+		instr_dirty.resize(GetSize(program));
+		dirty_pc = GetSize(program);
+
+		for (auto bit : dirty_bits)
+			mark_slot(sig_slot(bit));
+		dirty_bits.clear();
+		upd_cells.clear();
+
+		if (shared->debug)
+			log("[%s] compiled %d cells into %d instructions over %d state slots\n", hiername().c_str(),
+					GetSize(module->cells()), GetSize(program), GetSize(slot_values));
+	}
+
+	void exec_instr(int pc)
+	{
+		const sim_instr_t &instr = program[pc];
+		const int *a = instr_operands.data() + instr.a;
+		const int *b = instr_operands.data() + instr.b;
+		const int *c = instr_operands.data() + instr.c;
+		const int *y = instr_operands.data() + instr.y;
+		const State *v = slot_values.data();
+
+		if (shared->debug && instr.op != SIM_OP_CELL)
+			log("[%s] eval %s (%s)\n", hiername().c_str(), log_id(instr.cell), log_id(instr.cell->type));
+
+		switch (instr.op)
+		{
+		case SIM_OP_CELL:
+			update_cell(instr.cell);
+			break;
+		case SIM_OP_EVAL2:
+			if (instr_eval[pc].fn2 != nullptr)
+				write_slots(instr.y, instr.y_len, instr_eval[pc](read_slots(instr.a, instr.a_len), read_slots(instr.b, instr.b_len)));
+			else
+				write_slots(instr.y, instr.y_len, CellTypes::eval(instr.cell, read_slots(instr.a, instr.a_len), read_slots(instr.b, instr.b_len)));
+			break;
+		case SIM_OP_EVAL3:
+			if (instr_eval[pc].fn3 != nullptr)
+				write_slots(instr.y, instr.y_len, instr_eval[pc](read_slots(instr.a, instr.a_len),
+						read_slots(instr.b, instr.b_len), read_slots(instr.c, instr.c_len)));
+			else
+				write_slots(instr.y, instr.y_len, CellTypes::eval(instr.cell, read_slots(instr.a, instr.a_len),
+						read_slots(instr.b, instr.b_len), read_slots(instr.c, instr.c_len)));
+			break;
+		case SIM_OP_BUF:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], v[a[i]]);
+			break;
+		case SIM_OP_NOT:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_not(v[a[i]]));
+			break;
+		case SIM_OP_GATE_NOT:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_gate_not(v[a[i]]));
+			break;
+		case SIM_OP_AND:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_and(v[a[i]], v[b[i]]));
+			break;
+		case SIM_OP_NAND:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_gate_not(sim_and(v[a[i]], v[b[i]])));
+			break;
+		case SIM_OP_OR:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_or(v[a[i]], v[b[i]]));
+			break;
+		case SIM_OP_NOR:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_gate_not(sim_or(v[a[i]], v[b[i]])));
+			break;
+		case SIM_OP_XOR:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_xor(v[a[i]], v[b[i]]));
+			break;
+		case SIM_OP_XNOR:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_not(sim_xor(v[a[i]], v[b[i]])));
+			break;
+		case SIM_OP_ANDNOT:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_and(v[a[i]], sim_gate_not(v[b[i]])));
+			break;
+		case SIM_OP_ORNOT:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_or(v[a[i]], sim_gate_not(v[b[i]])));
+			break;
+		case SIM_OP_MUX:
+			for (int i = 0; i < instr.y_len; i++)
+				write_slot(y[i], sim_mux(v[a[i]], v[b[i]], v[c[0]]));
+			break;
+		case SIM_OP_AOI3:
+			write_slot(y[0], sim_gate_not(sim_or(sim_and(v[a[0]], v[b[0]]), v[c[0]])));
+			break;
+		case SIM_OP_OAI3:
+			write_slot(y[0], sim_gate_not(sim_and(sim_or(v[a[0]], v[b[0]]), v[c[0]])));
+			break;
+		}
+	}
+
+	void run_program()
+	{
+		while (dirty_pc < GetSize(program))
+		{
+			int pc = dirty_pc;
+			dirty_pc = GetSize(program);
+
+			for (; pc < GetSize(program); pc++) {
+				if (!instr_dirty[pc])
+					continue;
+				instr_dirty[pc] = false;
+				sweep_pc = pc;
+				exec_instr(pc);
 			}
 
-			for (auto &memid : dirty_memories)
-				update_memory(memid);
+			sweep_pc = INT_MAX;
+		}
+	}
+
+	void update_ph1_compiled()
+	{
+		pool<Wire*> queue_outports;
+
+		while (1)
+		{
+			run_program();
+
+			for (auto mdb : dirty_memories)
+				update_memory(*mdb);
 			dirty_memories.clear();
 
+			if (parent != nullptr)
+				for (int slot : dirty_outport_slots)
+					for (auto wire : slot_outport_wires.at(slot))
+						queue_outports.insert(wire);
+			dirty_outport_slots.clear();
+
 			for (auto wire : queue_outports)
 				if (instance->hasPort(wire->name)) {
 					Const value = get_state(wire);
-					parent->set_state(instance->getPort(wire->name), value);
+					if (deferring)
+						deferred_outputs.emplace_back(wire, value);
+					else
+						parent->set_state(instance->getPort(wire->name), value);
 				}
 
 			queue_outports.clear();
 
-			for (auto child : dirty_children)
-				child->update_ph1();
-
-			dirty_children.clear();
+			update_children_ph1();
 
-			if (dirty_bits.empty())
+			if (dirty_pc >= GetSize(program) && dirty_outport_slots.empty() && dirty_memories.empty())
 				break;
 		}
 	}
 
-	bool update_ph2(bool gclk, bool stable_past_update = false)
+	// Runs the parallel-safe children in 'batch' on the worker threads. The
+	// calling thread waits for all of them and then applies their deferred
+	// port writes and memory trace updates in batch order.
+	template<typename F>
+	void run_deferred(const std::vector<SimInstance*> &batch, F work)
 	{
-		bool did_something = false;
+		for (auto child : batch)
+			child->deferring = true;
+
+		shared->dispatcher->run(GetSize(batch), [&](int i) { work(i, batch[i]); });
+
+		for (auto child : batch) {
+			child->deferring = false;
+			for (auto &it : child->deferred_outputs)
+				set_state(child->instance->getPort(it.first->name), it.second);
+			child->deferred_outputs.clear();
+			for (auto &it : child->deferred_mem_addrs)
+				it.instance->register_memory_addr(*it.memid, it.addr);
+			child->deferred_mem_addrs.clear();
+		}
+	}
 
-		for (auto &it : ff_database)
-		{
-			ff_state_t &ff = it.second;
-			FfData &ff_data = ff.data;
+	void update_children_ph1()
+	{
+		if (defer_root != nullptr || shared->dispatcher == nullptr) {
+			for (auto child : dirty_children)
+				child->update_ph1();
+			dirty_children.clear();
+			return;
+		}
+
+		std::vector<SimInstance*> batch;
+		for (auto child : dirty_children)
+			if (child->defer_root == child)
+				batch.push_back(child);
+			else
+				child->update_ph1();
+		dirty_children.clear();
+
+		run_deferred(batch, [](int, SimInstance *child) { child->update_ph1(); });
+	}
+
+	void update_ph1()
+	{
+		if (compiled) {
+			update_ph1_compiled();
+			return;
+		}
+
+		pool<Cell*> queue_cells;
+		pool<Wire*> queue_outports;
+
+		queue_cells.swap(dirty_cells);
+
+		while (1)
+		{
+			for (auto bit : dirty_bits)
+			{
+				if (upd_cells.count(bit))
+					for (auto cell : upd_cells.at(bit))
+						queue_cells.insert(cell);
+
+				if (upd_outports.count(bit) && parent != nullptr)
+					for (auto wire : upd_outports.at(bit))
+						queue_outports.insert(wire);
+			}
+
+			dirty_bits.clear();
+
+			if (!queue_cells.empty())
+			{
+				for (auto cell : queue_cells)
+					update_cell(cell);
+
+				queue_cells.clear();
+				continue;
+			}
+
+			for (auto mdb : dirty_memories)
+				update_memory(*mdb);
+			dirty_memories.clear();
+
+			for (auto wire : queue_outports)
+				if (instance->hasPort(wire->name)) {
+					Const value = get_state(wire);
+					parent->set_state(instance->getPort(wire->name), value);
+				}
+
+			queue_outports.clear();
+
+			for (auto child : dirty_children)
+				child->update_ph1();
+
+			dirty_children.clear();
+
+			if (dirty_bits.empty())
+				break;
+		}
+	}
+
+	bool update_ph2(bool gclk, bool stable_past_update = false)
+	{
+		bool did_something = false;
+
+		for (auto &it : ff_database)
+		{
+			ff_state_t &ff = it.second;
+			FfData &ff_data = ff.data;
 
 			Const current_q = get_state(ff.data.sig_q);
 
@@ -723,6 +1574,9 @@ struct SimInstance
 			mem_state_t &mdb = it.second;
 			auto &mem = *mdb.mem;
 
+			if (pruned_memories.count(it.first))
+				continue;
+
 			for (int port_idx = 0; port_idx < GetSize(mem.wr_ports); port_idx++)
 			{
 				auto &port = mem.wr_ports[port_idx];
@@ -756,7 +1610,7 @@ struct SimInstance
 						for (int i = 0; i < (mem.width << port.wide_log2); i++)
 							if (enable[i] == State::S1 && mdb.data.bits.at(index*mem.width+i) != data[i]) {
 								mdb.data.bits.at(index*mem.width+i) = data[i];
-								dirty_memories.insert(mem.memid);
+								dirty_memories.insert(&mdb);
 								did_something = true;
 							}
 
@@ -766,12 +1620,25 @@ struct SimInstance
 			}
 		}
 
+		std::vector<SimInstance*> batch;
 		for (auto it : children)
-			if (it.second->update_ph2(gclk, stable_past_update)) {
+			if (defer_root == nullptr && it.second->defer_root == it.second)
+				batch.push_back(it.second);
+			else if (it.second->update_ph2(gclk, stable_past_update)) {
 				dirty_children.insert(it.second);
 				did_something = true;
 			}
 
+		if (!batch.empty()) {
+			std::vector<char> changed(GetSize(batch));
+			run_deferred(batch, [&](int i, SimInstance *child) { changed[i] = child->update_ph2(gclk, stable_past_update); });
+			for (int i = 0; i < GetSize(batch); i++)
+				if (changed[i]) {
+					dirty_children.insert(batch[i]);
+					did_something = true;
+				}
+		}
+
 		return did_something;
 	}
 
@@ -801,6 +1668,9 @@ struct SimInstance
 		{
 			mem_state_t &mem = it.second;
 
+			if (pruned_memories.count(it.first))
+				continue;
+
 			for (int i = 0; i < GetSize(mem.mem->wr_ports); i++) {
 				auto &port = mem.mem->wr_ports[i];
 				mem.past_wr_clk[i]  = get_state(port.clk);
@@ -939,6 +1809,159 @@ struct SimInstance
 			it.second->writeback(wbmods);
 	}
 
+	[[noreturn]] void state_mismatch(SimStateImage &image, const char *what, const char *kind, IdString name)
+	{
+		log_error("Checkpoint file `%s' does not match the simulated design: %s %s `%s.%s'.\n",
+				image.filename.c_str(), what, kind, hiername().c_str(), log_id(name));
+	}
+
+	// Reads the name of the next record of the given kind and checks that it
+	// is one of the expected objects and has not been seen before.
+	IdString get_state_name(SimStateImage &image, const char *kind, const pool<IdString> &expected, pool<IdString> &seen)
+	{
+		IdString name = image.get_str();
+		if (!expected.count(name) || !seen.insert(name).second)
+			state_mismatch(image, "unexpected", kind, name);
+		return name;
+	}
+
+	void check_state_names(SimStateImage &image, const char *kind, const pool<IdString> &expected, const pool<IdString> &seen)
+	{
+		for (auto name : expected)
+			if (!seen.count(name))
+				state_mismatch(image, "no state for", kind, name);
+	}
+
+	// All records are keyed by the name of the wire, cell or memory they
+	// belong to, so that restoring does not depend on iteration order.
+	void save_state(SimStateImage &image)
+	{
+		image.put_str(module->name.str());
+
+		image.put_int(GetSize(module->wires()));
+		for (auto wire : module->wires()) {
+			image.put_str(wire->name.str());
+			image.put_const(get_state(wire));
+		}
+
+		image.put_int(GetSize(ff_database));
+		for (auto &it : ff_database) {
+			ff_state_t &ff = it.second;
+			image.put_str(it.first->name.str());
+			image.put_const(ff.past_d);
+			image.put_const(ff.past_ad);
+			image.put_const(Const(ff.past_clk));
+			image.put_const(Const(ff.past_ce));
+			image.put_const(Const(ff.past_srst));
+		}
+
+		image.put_int(GetSize(memories));
+		for (auto &mem : memories) {
+			mem_state_t &mdb = mem_database.at(mem.memid);
+			image.put_str(mem.memid.str());
+			image.put_const(mdb.data);
+			for (int i = 0; i < GetSize(mem.wr_ports); i++) {
+				image.put_const(mdb.past_wr_clk[i]);
+				image.put_const(mdb.past_wr_en[i]);
+				image.put_const(mdb.past_wr_addr[i]);
+				image.put_const(mdb.past_wr_data[i]);
+			}
+		}
+
+		image.put_int(GetSize(print_database));
+		for (auto &print : print_database) {
+			image.put_str(print.cell->name.str());
+			image.put_const(print.past_trg);
+			image.put_const(print.past_en);
+			image.put_const(print.past_args);
+		}
+
+		image.put_int(GetSize(children));
+		for (auto &it : children) {
+			image.put_str(it.first->name.str());
+			it.second->save_state(image);
+		}
+	}
+
+	void restore_state(SimStateImage &image)
+	{
+		if (image.get_str() != module->name.str())
+			log_error("Checkpoint file `%s' does not match the simulated design (at %s).\n", image.filename.c_str(), hiername().c_str());
+
+		pool<IdString> expected, seen;
+		for (auto wire : module->wires())
+			expected.insert(wire->name);
+		for (int64_t i = 0, n = image.get_int(); i < n; i++) {
+			Wire *wire = module->wire(get_state_name(image, "wire", expected, seen));
+			set_state(wire, image.get_const(GetSize(wire)));
+		}
+		check_state_names(image, "wire", expected, seen);
+
+		expected.clear(), seen.clear();
+		for (auto &it : ff_database)
+			expected.insert(it.first->name);
+		for (int64_t i = 0, n = image.get_int(); i < n; i++) {
+			ff_state_t &ff = ff_database.at(module->cell(get_state_name(image, "flip-flop", expected, seen)));
+			ff.past_d = image.get_const(ff.data.width);
+			ff.past_ad = image.get_const(ff.data.width);
+			ff.past_clk = image.get_state();
+			ff.past_ce = image.get_state();
+			ff.past_srst = image.get_state();
+		}
+		check_state_names(image, "flip-flop", expected, seen);
+
+		dict<IdString, Mem*> mems_by_name;
+		expected.clear(), seen.clear();
+		for (auto &mem : memories) {
+			mems_by_name[mem.memid] = &mem;
+			expected.insert(mem.memid);
+		}
+		for (int64_t k = 0, n = image.get_int(); k < n; k++) {
+			Mem &mem = *mems_by_name.at(get_state_name(image, "memory", expected, seen));
+			mem_state_t &mdb = mem_database.at(mem.memid);
+			mdb.data = image.get_const(GetSize(mdb.data));
+			for (int i = 0; i < GetSize(mem.wr_ports); i++) {
+				mdb.past_wr_clk[i] = image.get_const(GetSize(mdb.past_wr_clk[i]));
+				mdb.past_wr_en[i] = image.get_const(GetSize(mdb.past_wr_en[i]));
+				mdb.past_wr_addr[i] = image.get_const(GetSize(mdb.past_wr_addr[i]));
+				mdb.past_wr_data[i] = image.get_const(GetSize(mdb.past_wr_data[i]));
+			}
+			dirty_memories.insert(&mdb);
+		}
+		check_state_names(image, "memory", expected, seen);
+
+		dict<IdString, print_state_t*> prints_by_name;
+		expected.clear(), seen.clear();
+		for (auto &print : print_database) {
+			prints_by_name[print.cell->name] = &print;
+			expected.insert(print.cell->name);
+		}
+		for (int64_t i = 0, n = image.get_int(); i < n; i++) {
+			print_state_t &print = *prints_by_name.at(get_state_name(image, "print cell", expected, seen));
+			print.past_trg = image.get_const(GetSize(print.past_trg));
+			print.past_en = image.get_const(GetSize(print.past_en));
+			print.past_args = image.get_const(GetSize(print.past_args));
+		}
+		check_state_names(image, "print cell", expected, seen);
+
+		expected.clear(), seen.clear();
+		for (auto &it : children)
+			expected.insert(it.first->name);
+		for (int64_t i = 0, n = image.get_int(); i < n; i++)
+			children.at(module->cell(get_state_name(image, "instance", expected, seen)))->restore_state(image);
+		check_state_names(image, "instance", expected, seen);
+	}
+
+	bool has_memories() const
+	{
+		if (!mem_database.empty())
+			return true;
+		for (auto child : children)
+			if (child.second->has_memories())
+				return true;
+		return false;
+	}
+
 	void register_signals(int &id)
 	{
 		for (auto wire : module->wires())
@@ -946,10 +1969,20 @@ struct SimInstance
 			if (shared->hide_internal && wire->name[0] == '$')
 				continue;
 
+			if (pruned && !in_cone(wire))
+				continue;
+
 			signal_database[wire] = make_pair(id, Const());
 			id++;
 		}
 
+		// the header of a streamed output file is written before the first
+		// step, so all memory words have to be traced from the beginning
+		if (shared->stream)
+			for (auto &mem : memories)
+				for (int index = 0; index < mem.size; index++)
+					register_memory_addr(mem.memid, mem.start_offset + index);
+
 		for (auto child : children)
 			child.second->register_signals(id);
 	}
@@ -1035,8 +2068,13 @@ struct SimInstance
 			exit_scope();
 	}
 
-	void register_memory_addr(IdString memid, int addr)
+	void register_memory_addr(const IdString &memid, int addr)
 	{
+		if (defer_root != nullptr && defer_root->deferring) {
+			defer_root->deferred_mem_addrs.push_back({this, &memid, addr});
+			return;
+		}
+
 		auto &mdb = mem_database.at(memid);
 		auto &mem = *mdb.mem;
 		int index = addr - mem.start_offset;
@@ -1193,6 +2231,7 @@ struct SimInstance
 		bool retVal = false;
 		for(auto &item : fst_handles) {
 			if (item.second==0) continue; // Ignore signals not found
+			if (pruned && !in_cone(item.first)) continue;
 			Const fst_val = Const::from_string(shared->fst->valueOf(item.second));
 			Const sim_val = get_state(item.first);
 			if (sim_val.size()!=fst_val.size()) {
@@ -1230,6 +2269,150 @@ struct SimInstance
 	}
 };
 
+// Transitive fan-in of the observed signals across the hierarchy (sim
+// -observe). Bits are followed backwards through cells (including
+// flip-flops and memories), instance output ports and module inputs.
+struct SimCone
+{
+	struct driver_t {
+		Cell *cell;
+		IdString port;
+		int offset;
+	};
+
+	dict<SimInstance*, dict<SigBit, std::vector<driver_t>>, hash_ptr_ops> drivers;
+	std::vector<std::pair<SimInstance*, SigBit>> queue;
+
+	void index(SimInstance *inst)
+	{
+		auto &inst_drivers = drivers[inst];
+		for (auto cell : inst->module->cells())
+			for (auto &conn : cell->connections())
+				if (cell->output(conn.first))
+					for (int i = 0; i < GetSize(conn.second); i++) {
+						SigBit bit = inst->sigmap(conn.second[i]);
+						if (bit.wire != nullptr)
+							inst_drivers[bit].push_back({cell, conn.first, i});
+					}
+		for (auto &it : inst->children)
+			index(it.second);
+	}
+
+	void add_bit(SimInstance *inst, SigBit bit)
+	{
+		bit = inst->sigmap(bit);
+		if (bit.wire != nullptr && inst->cone_bits.insert(bit).second)
+			queue.emplace_back(inst, bit);
+	}
+
+	void add_cell(SimInstance *inst, Cell *cell)
+	{
+		if (!inst->cone_cells.insert(cell).second)
+			return;
+
+		// for submodules only the used outputs are followed
+		if (inst->children.count(cell))
+			return;
+
+		for (auto &conn : cell->connections())
+			if (cell->input(conn.first))
+				for (auto bit : conn.second)
+					add_bit(inst, bit);
+
+		// all ports of a memory share its contents
+		if (inst->mem_cells.count(cell)) {
+			IdString memid = inst->mem_cells.at(cell);
+			for (auto &it : inst->mem_cells)
+				if (it.second == memid)
+					add_cell(inst, it.first);
+		}
+	}
+
+	void add_formal(SimInstance *inst)
+	{
+		for (auto cell : inst->formal_database)
+			add_cell(inst, cell);
+		for (auto &it : inst->children)
+			add_formal(it.second);
+	}
+
+	void run()
+	{
+		while (!queue.empty())
+		{
+			SimInstance *inst = queue.back().first;
+			SigBit bit = queue.back().second;
+			queue.pop_back();
+
+			auto &inst_drivers = drivers.at(inst);
+			auto it = inst_drivers.find(bit);
+			if (it != inst_drivers.end())
+				for (auto &driver : it->second) {
+					add_cell(inst, driver.cell);
+					if (inst->children.count(driver.cell)) {
+						SimInstance *child = inst->children.at(driver.cell);
+						Wire *port = child->module->wire(driver.port);
+						if (port != nullptr && driver.offset < GetSize(port))
+							add_bit(child, SigBit(port, driver.offset));
+					}
+				}
+
+			// module inputs are driven by the parent through the instance
+			auto parent_it = inst->in_parent_drivers.find(bit);
+			if (parent_it != inst->in_parent_drivers.end()) {
+				add_cell(inst->parent, inst->instance);
+				add_bit(inst->parent, parent_it->second);
+			}
+		}
+	}
+};
+
+void SimInstance::prepare_hierarchy()
+{
+	if (!shared->observe.empty() || shared->observe_formal)
+	{
+		SimCone cone;
+		cone.index(this);
+
+		for (auto &path : shared->observe) {
+			SimInstance *inst = this;
+			std::vector<std::string> parts = split_tokens(path, ".");
+			for (int i = 0; i+1 < GetSize(parts); i++) {
+				Cell *cell = inst->module->cell(RTLIL::escape_id(parts[i]));
+				if (cell == nullptr || !inst->children.count(cell))
+					log_cmd_error("Can't find instance %s in %s for observed signal `%s'.\n", parts[i].c_str(), inst->hiername().c_str(), path.c_str());
+				inst = inst->children.at(cell);
+			}
+			Wire *wire = parts.empty() ? nullptr : inst->module->wire(RTLIL::escape_id(parts.back()));
+			if (wire == nullptr)
+				log_cmd_error("Can't find observed signal `%s'.\n", path.c_str());
+			for (auto bit : SigSpec(wire))
+				cone.add_bit(inst, bit);
+		}
+
+		if (shared->observe_formal)
+			cone.add_formal(this);
+
+		cone.run();
+
+		int kept_cells = 0, total_cells = 0;
+		apply_cone(kept_cells, total_cells);
+		log("Simulating %d of %d cells in the observation cone.\n", kept_cells, total_cells);
+	}
+
+	if (shared->engine == SimulationEngine::compiled)
+		compile_hierarchy();
+
+	if (shared->dispatcher != nullptr)
+	{
+		int num_roots = 0;
+		check_parallel_safe();
+		assign_defer_roots(nullptr, num_roots);
+		log("Evaluating %d independent child instance%s on %d threads.\n", num_roots, num_roots == 1 ? "" : "s",
+				shared->dispatcher->num_workers() + 1);
+	}
+}
+
 struct SimWorker : SimShared
 {
 	SimInstance *top = nullptr;
@@ -1239,6 +2422,13 @@ struct SimWorker : SimShared
 	std::string map_filename;
 	std::string summary_filename;
 	std::string scope;
+	std::string checkpoint_filename;
+	std::string restore_filename;
+	int checkpoint_at = -1;
+
+	bool streaming = false;
+	bool stream_header_written = false;
+	int streamed_steps = 0;
 
 	~SimWorker()
 	{
@@ -1248,19 +2438,55 @@ struct SimWorker : SimShared
 
 	void register_signals()
 	{
+		// Steps are only buffered when the output depends on the whole trace:
+		// -x needs to know which signals are never defined, and memory words
+		// are only traced once they are accessed unless -stream is given.
+		streaming = outputfiles.empty() || stream || (!ignore_x && !top->has_memories());
+
 		next_output_id = 1;
 		top->register_signals(top->shared->next_output_id);
 	}
 
 	void register_output_step(int t)
 	{
+		if (streaming && outputfiles.empty())
+			return;
+
 		std::map<int,Const> data;
 		top->register_output_step_values(&data);
-		output_data.emplace_back(t, data);
+
+		if (!streaming) {
+			output_data.emplace_back(t, data);
+			return;
+		}
+
+		if (!stream_header_written) {
+			std::map<int, bool> use_signal;
+			for (auto &it : data)
+				use_signal[it.first] = true;
+			for (auto &writer : outputfiles)
+				writer->write_header(use_signal);
+			stream_header_written = true;
+		}
+
+		for (auto &writer : outputfiles)
+			writer->write_step(t, data);
+
+		if (++streamed_steps % 1024 == 0)
+			for (auto &writer : outputfiles)
+				writer->flush();
 	}
 
 	void write_output_files()
 	{
+		if (streaming) {
+			if (stream_header_written)
+				for (auto &writer : outputfiles)
+					writer->finish();
+			write_writeback();
+			return;
+		}
+
 		std::map<int, bool> use_signal;
 		bool first = ignore_x;
 		for(auto& d : output_data)
@@ -1277,7 +2503,12 @@ struct SimWorker : SimShared
 		}
 		for(auto& writer : outputfiles)
 			writer->write(use_signal);
-		
+
+		write_writeback();
+	}
+
+	void write_writeback()
+	{
 		if (writeback) {
 			pool<Module*> wbmods;
 			top->writeback(wbmods);
@@ -1331,6 +2562,55 @@ struct SimWorker : SimShared
 		top->update_ph3(true);
 	}
 
+	void write_checkpoint(int cycle)
+	{
+		SimStateImage image;
+		image.filename = checkpoint_filename;
+		image.data = "YSIMCKPT";
+		image.put_int(1);
+		image.put_int(cycle);
+		image.put_int(step);
+		top->save_state(image);
+
+		std::ofstream f(checkpoint_filename, std::ios::binary);
+		if (f.fail())
+			log_error("Can't open checkpoint file `%s' for writing: %s\n", checkpoint_filename.c_str(), strerror(errno));
+		f.write(image.data.data(), image.data.size());
+		f.close();
+		if (f.fail())
+			log_error("Failed to write checkpoint file `%s'.\n", checkpoint_filename.c_str());
+
+		log("Wrote checkpoint after cycle %d to `%s'.\n", cycle, checkpoint_filename.c_str());
+	}
+
+	// returns the number of cycles simulated before the checkpoint
+	int read_checkpoint()
+	{
+		SimStateImage image;
+		image.filename = restore_filename;
+
+		std::ifstream f(restore_filename, std::ios::binary);
+		if (f.fail())
+			log_error("Can't open checkpoint file `%s' for reading: %s\n", restore_filename.c_str(), strerror(errno));
+		std::stringstream buf;
+		buf << f.rdbuf();
+		image.data = buf.str();
+
+		if (image.data.compare(0, 8, "YSIMCKPT") != 0)
+			log_error("File `%s' is not a sim checkpoint.\n", restore_filename.c_str());
+		image.pos = 8;
+		if (image.get_int() != 1)
+			log_error("Unsupported version of checkpoint file `%s'.\n", restore_filename.c_str());
+		int cycle = image.get_int();
+		step = image.get_int();
+		top->restore_state(image);
+		if (image.pos != image.data.size())
+			log_error("Checkpoint file `%s' does not match the simulated design.\n", restore_filename.c_str());
+
+		log("Restored state after cycle %d from `%s'.\n", cycle, restore_filename.c_str());
+		return cycle;
+	}
+
 	void set_inports(pool<IdString> ports, State value)
 	{
 		for (auto portname : ports)
@@ -1350,24 +2630,36 @@ struct SimWorker : SimShared
 		top = new SimInstance(this, scope, topmod);
 		register_signals();
 
-		if (debug)
-			log("\n===== 0 =====\n");
-		else if (verbose)
-			log("Simulating cycle 0.\n");
+		int first_cycle = 0;
 
-		set_inports(reset, State::S1);
-		set_inports(resetn, State::S0);
+		if (!restore_filename.empty()) {
+			first_cycle = read_checkpoint();
+			if (first_cycle > numcycles)
+				log_cmd_error("Checkpoint was taken after cycle %d, but only %d cycles are simulated.\n", first_cycle, numcycles);
+			register_output_step(10*first_cycle);
+		} else {
+			if (debug)
+				log("\n===== 0 =====\n");
+			else if (verbose)
+				log("Simulating cycle 0.\n");
 
-		set_inports(clock, State::Sx);
-		set_inports(clockn, State::Sx);
+			set_inports(reset, State::S1);
+			set_inports(resetn, State::S0);
 
-		top->set_initstate_outputs(initstate ? State::S1 : State::S0);
+			set_inports(clock, State::Sx);
+			set_inports(clockn, State::Sx);
 
-		update(false);
+			top->set_initstate_outputs(initstate ? State::S1 : State::S0);
 
-		register_output_step(0);
+			update(false);
 
-		for (int cycle = 0; cycle < numcycles; cycle++)
+			register_output_step(0);
+
+			if (checkpoint_at == 0)
+				write_checkpoint(0);
+		}
+
+		for (int cycle = first_cycle; cycle < numcycles; cycle++)
 		{
 			if (debug)
 				log("\n===== %d =====\n", 10*cycle + 5);
@@ -1397,6 +2689,9 @@ struct SimWorker : SimShared
 
 			update(true);
 			register_output_step(10*cycle + 10);
+
+			if (cycle+1 == checkpoint_at)
+				write_checkpoint(cycle+1);
 		}
 
 		register_output_step(10*numcycles + 2);
@@ -1893,12 +3188,12 @@ struct SimWorker : SimShared
 		return hierarchy;
 	}
 
-	void set_yw_state(const ReadWitness &yw, const YwHierarchy &hierarchy, int t)
+	void set_yw_state(const ReadWitness &yw, const YwHierarchy &hierarchy, int t, bool skip_init = false)
 	{
 		log_assert(t >= 0 && t < GetSize(yw.steps));
 
 		for (auto &signal : yw.signals) {
-			if (signal.init_only && t >= 1)
+			if (signal.init_only && (t >= 1 || skip_init))
 				continue;
 			auto found_path_it = hierarchy.paths.find(signal.path);
 			if (found_path_it == hierarchy.paths.end())
@@ -1960,6 +3255,38 @@ struct SimWorker : SimShared
 
 		YwHierarchy hierarchy = prepare_yw_hierarchy(yw);
 
+		if (!restore_filename.empty()) {
+			// the witness continues the restored state, its first step only
+			// provides inputs
+			int first_cycle = read_checkpoint();
+			register_output_step(10 * first_cycle);
+
+			for (int t = 0; t < GetSize(yw.steps) + append; t++)
+			{
+				int cycle = first_cycle + 1 + t;
+				if (verbose)
+					log("Simulating cycle %d.\n", cycle);
+				if (t < GetSize(yw.steps))
+					set_yw_state(yw, hierarchy, t, true);
+				set_yw_clocks(yw, hierarchy, true);
+				update(true);
+				register_output_step(10 * cycle);
+
+				if (!yw.clocks.empty()) {
+					set_yw_clocks(yw, hierarchy, false);
+					update(false);
+					register_output_step(5 + 10 * cycle);
+				}
+
+				if (cycle == checkpoint_at)
+					write_checkpoint(cycle);
+			}
+
+			register_output_step(10 * (first_cycle + 1 + GetSize(yw.steps) + append));
+			write_output_files();
+			return;
+		}
+
 		if (yw.steps.empty()) {
 			log_warning("Yosys witness file `%s` contains no time steps\n", yw.filename.c_str());
 		} else {
@@ -1977,6 +3304,9 @@ struct SimWorker : SimShared
 				register_output_step(5);
 			}
 			top->set_initstate_outputs(State::S0);
+
+			if (checkpoint_at == 0)
+				write_checkpoint(0);
 		}
 
 		for (int cycle = 1; cycle < GetSize(yw.steps) + append; cycle++)
@@ -1996,13 +3326,16 @@ struct SimWorker : SimShared
 				update(false);
 				register_output_step(5 + 10 * cycle);
 			}
+
+			if (cycle == checkpoint_at)
+				write_checkpoint(cycle);
 		}
 
 		register_output_step(10 * (GetSize(yw.steps) + append));
 		write_output_files();
 	}
 
-	void write_summary()
+	void write_summary(Module *topmod)
 	{
 		if (summary_filename.empty())
 			return;
@@ -2015,14 +3348,19 @@ struct SimWorker : SimShared
 		json.entry("version", "Yosys sim summary");
 		json.entry("generator", yosys_version_str);
 		json.entry("steps", step);
-		json.entry("top", log_id(top->module->name));
+		json.entry("top", log_id(topmod->name));
 		json.name("assertions");
 		json.begin_array();
 		for (auto &assertion : triggered_assertions) {
 			json.begin_object();
 			json.entry("step", assertion.step);
 			json.entry("type", log_id(assertion.cell->type));
-			json.entry("path", assertion.instance->witness_full_path(assertion.cell));
+			if (assertion.instance != nullptr)
+				json.entry("path", assertion.instance->witness_full_path(assertion.cell));
+			else
+				json.entry("path", witness_path(assertion.cell));
+			if (assertion.lane >= 0)
+				json.entry("lane", assertion.lane);
 			auto src = assertion.cell->get_string_attribute(ID::src);
 			if (!src.empty()) {
 				json.entry("src", src);
@@ -2182,6 +3520,7 @@ struct SimWorker : SimShared
 		log("Writing data to `%s`\n", (tb_filename+".txt").c_str());
 		std::ofstream data_file(tb_filename+".txt");
 		std::stringstream initstate;
+		fst->requestAllVars();
 		try {
 			fst->reconstructAllAtTimes(fst_clock, startCount, stopCount, [&](uint64_t time) {
 				for(auto &item : clocks)
@@ -2252,34 +3591,805 @@ struct SimWorker : SimShared
 	}
 };
 
-struct VCDWriter : public OutputWriter
+// two-plane encoding of one bit in 64 lanes used by SimBatch, a lane holds
+// 0 (v=0, u=0), 1 (v=1, u=0) or x (v=0, u=1)
+struct lane_word
 {
-	VCDWriter(SimWorker *worker, std::string filename) : OutputWriter(worker) {
-		vcdfile.open(filename.c_str());
-	}
+	uint64_t v, u;
+};
 
-	void write(std::map<int, bool> &use_signal) override
-	{
-		if (!vcdfile.is_open()) return;
-		vcdfile << stringf("$version %s $end\n", worker->date ? yosys_version_str : "Yosys");
+static inline lane_word lane_not(lane_word a)
+{
+	return {~a.v & ~a.u, a.u};
+}
 
-		if (worker->date) {
-			std::time_t t = std::time(nullptr);
-			char mbstr[255];
-			if (std::strftime(mbstr, sizeof(mbstr), "%c", std::localtime(&t))) {
-				vcdfile << stringf("$date ") << mbstr << stringf(" $end\n");
-			}
-		}
+static inline lane_word lane_and(lane_word a, lane_word b)
+{
+	return {a.v & b.v, (a.u | b.u) & (a.v | a.u) & (b.v | b.u)};
+}
 
-		if (!worker->timescale.empty())
-			vcdfile << stringf("$timescale %s $end\n", worker->timescale.c_str());
+static inline lane_word lane_or(lane_word a, lane_word b)
+{
+	uint64_t v = a.v | b.v;
+	return {v, (a.u | b.u) & ~v};
+}
 
-		worker->top->write_output_header(
-			[this](IdString name) { vcdfile << stringf("$scope module %s $end\n", log_id(name)); },
-			[this]() { vcdfile << stringf("$upscope $end\n");},
-			[this,use_signal](const char *name, int size, Wire *, int id, bool is_reg) {
-				if (use_signal.at(id)) {
-					// Works around gtkwave trying to parse everything past the last [ in a signal
+static inline lane_word lane_xor(lane_word a, lane_word b)
+{
+	uint64_t u = a.u | b.u;
+	return {(a.v ^ b.v) & ~u, u};
+}
+
+static inline lane_word lane_mux(lane_word a, lane_word b, lane_word s)
+{
+	uint64_t s0 = ~s.v & ~s.u;
+	uint64_t eq = ~(a.v ^ b.v) & ~(a.u ^ b.u);
+	return {(s0 & a.v) | (s.v & b.v) | (s.u & eq & a.v),
+			(s0 & a.u) | (s.v & b.u) | (s.u & (~eq | a.u))};
+}
+
+static inline lane_word lane_blend(lane_word a, lane_word b, uint64_t mask)
+{
+	return {(a.v & ~mask) | (b.v & mask), (a.u & ~mask) | (b.u & mask)};
+}
+
+// lanes in which a control signal is active with the given polarity
+static inline uint64_t lane_active(lane_word a, bool pol)
+{
+	return pol ? a.v : ~a.v & ~a.u;
+}
+
+static inline lane_word lane_const(State s)
+{
+	if (s == State::S0) return {0, 0};
+	if (s == State::S1) return {~uint64_t(0), 0};
+	return {0, ~uint64_t(0)};
+}
+
+// Batch simulation (sim -lanes): a flattened module is simulated for many
+// independent stimuli at once. Every net bit stores one bit per lane in
+// 64-bit words, so one pass over the levelized netlist advances 64 lanes per
+// word. Gates and bitwise cells are evaluated on whole words, other cells
+// fall back to CellTypes::eval() lane by lane. x and z are not distinguished.
+struct SimBatch
+{
+	SimWorker *worker;
+	Module *module;
+	SigMap sigmap;
+	int lanes, words;
+
+	// slot 0..2 hold the constants 0, 1 and x, followed by one slot per net
+	// bit, lane word w of slot s is at index s*words+w
+	static constexpr int num_const_slots = 3;
+	dict<SigBit, int> net_slots;
+	std::vector<uint64_t> slot_val, slot_undef;
+	bool changed = false;
+
+	std::vector<SimInstance::sim_instr_t> program;
+	std::vector<int> instr_operands;
+	int num_cyclic = 0;
+
+	struct ff_t
+	{
+		FfData data;
+		std::vector<int> q, d, ad, clr, set;
+		int clk, ce, srst, arst, aload;
+		// past values, one lane word per bit (past_ctrl: clk, ce, srst)
+		std::vector<lane_word> past_d, past_ad, past_ctrl;
+	};
+
+	struct formal_t
+	{
+		Cell *cell;
+		int a, en;
+		std::vector<uint64_t> triggered;
+		int first_lane = -1, first_step = -1;
+	};
+
+	std::vector<ff_t> ffs;
+	std::vector<formal_t> formals;
+	std::vector<int> initstate_slots;
+	std::vector<int> anyconst_slots, anyseq_slots;
+	dict<IdPath, Wire*> witness_wires;
+
+	uint64_t rng_state = 1;
+
+	SimBatch(SimWorker *worker, Module *module, int lanes) :
+			worker(worker), module(module), sigmap(module), lanes(lanes), words((lanes + 63) / 64)
+	{
+		if (module->has_processes())
+			log_error("Found processes in module %s. Run 'proc' first.\n", log_id(module));
+
+		for (int i = 0; i < num_const_slots; i++)
+			add_slot(lane_const(State(i)));
+
+		for (auto wire : module->wires())
+			for (auto bit : sigmap(wire))
+				if (bit.wire != nullptr && !net_slots.count(bit))
+					net_slots[bit] = add_slot(lane_const(State::Sx));
+
+		for (auto wire : module->wires())
+			if (wire->attributes.count(ID::init)) {
+				Const initval = wire->attributes.at(ID::init);
+				SigSpec sig = sigmap(wire);
+				for (int i = 0; i < GetSize(sig) && i < GetSize(initval); i++)
+					if (initval[i] == State::S0 || initval[i] == State::S1)
+						set_all(sig_slot(sig[i]), initval[i]);
+			}
+
+		std::vector<std::vector<int>> inputs, outputs;
+		std::vector<SimInstance::sim_instr_t> protos;
+		std::vector<std::vector<int>> proto_a, proto_b, proto_c;
+
+		for (auto cell : module->cells())
+		{
+			if (module->design->module(cell->type) != nullptr)
+				log_cmd_error("Batch simulation requires a flattened design, found instance %s of module %s. Run 'flatten' first.\n",
+						log_id(cell), log_id(cell->type));
+
+			if (cell->is_mem_cell())
+				log_cmd_error("Batch simulation does not support memories, found %s (%s). Run 'memory_map' first.\n",
+						log_id(cell), log_id(cell->type));
+
+			if (RTLIL::builtin_ff_cell_types().count(cell->type) || cell->type == ID($anyinit)) {
+				add_ff(cell);
+				continue;
+			}
+
+			if (cell->type.in(ID($assert), ID($cover), ID($assume))) {
+				formal_t formal;
+				formal.cell = cell;
+				formal.a = sig_slot(sigmap(cell->getPort(ID::A))[0]);
+				formal.en = sig_slot(sigmap(cell->getPort(ID::EN))[0]);
+				formal.triggered.resize(words);
+				formals.push_back(formal);
+				continue;
+			}
+
+			if (cell->type.in(ID($initstate), ID($anyconst), ID($anyseq), ID($allconst), ID($allseq))) {
+				auto &slots = cell->type == ID($initstate) ? initstate_slots :
+						cell->type.in(ID($anyseq), ID($allseq)) ? anyseq_slots : anyconst_slots;
+				for (auto bit : sigmap(cell->getPort(ID::Y)))
+					slots.push_back(sig_slot(bit));
+				continue;
+			}
+
+			if (cell->type == ID($print))
+				continue;
+
+			bool has_a = cell->hasPort(ID::A), has_b = cell->hasPort(ID::B), has_c = cell->hasPort(ID::C);
+			bool has_d = cell->hasPort(ID::D), has_s = cell->hasPort(ID::S), has_y = cell->hasPort(ID::Y);
+
+			if (!yosys_celltypes.cell_evaluable(cell->type) || !has_a || has_d || !has_y || (has_c && (!has_b || has_s)))
+				log_error("Unsupported cell type for batch simulation: %s (%s.%s)\n", log_id(cell->type), log_id(module), log_id(cell));
+
+			SimInstance::sim_instr_t instr;
+			instr.cell = cell;
+			instr.op = SimInstance::fast_op(cell);
+			if (instr.op == SimInstance::SIM_OP_CELL)
+				instr.op = (has_c || has_s) && has_b ? SimInstance::SIM_OP_EVAL3 : SimInstance::SIM_OP_EVAL2;
+
+			std::vector<int> a, b, c, y, in;
+			for (auto bit : sigmap(cell->getPort(ID::A)))
+				a.push_back(sig_slot(bit));
+			if (has_b)
+				for (auto bit : sigmap(cell->getPort(ID::B)))
+					b.push_back(sig_slot(bit));
+			if (has_c || has_s)
+				for (auto bit : sigmap(cell->getPort(has_c ? ID::C : ID::S)))
+					c.push_back(sig_slot(bit));
+			for (auto bit : sigmap(cell->getPort(ID::Y)))
+				y.push_back(sig_slot(bit));
+			if (instr.op == SimInstance::SIM_OP_EVAL2 && has_s)
+				b.swap(c);
+
+			in.insert(in.end(), a.begin(), a.end());
+			in.insert(in.end(), b.begin(), b.end());
+			in.insert(in.end(), c.begin(), c.end());
+			std::sort(in.begin(), in.end());
+			in.erase(std::unique(in.begin(), in.end()), in.end());
+
+			protos.push_back(instr);
+			proto_a.push_back(a);
+			proto_b.push_back(b);
+			proto_c.push_back(c);
+			inputs.push_back(in);
+			outputs.push_back(y);
+		}
+
+		for (int i : sim_levelize(GetSize(slot_val) / words, num_const_slots, inputs, outputs, num_cyclic))
+		{
+			auto instr = protos[i];
+			instr.a = GetSize(instr_operands), instr.a_len = GetSize(proto_a[i]);
+			instr_operands.insert(instr_operands.end(), proto_a[i].begin(), proto_a[i].end());
+			instr.b = GetSize(instr_operands), instr.b_len = GetSize(proto_b[i]);
+			instr_operands.insert(instr_operands.end(), proto_b[i].begin(), proto_b[i].end());
+			instr.c = GetSize(instr_operands), instr.c_len = GetSize(proto_c[i]);
+			instr_operands.insert(instr_operands.end(), proto_c[i].begin(), proto_c[i].end());
+			instr.y = GetSize(instr_operands), instr.y_len = GetSize(outputs[i]);
+			instr_operands.insert(instr_operands.end(), outputs[i].begin(), outputs[i].end());
+			program.push_back(instr);
+		}
+
+		if (worker->zinit)
+			for (auto &ff : ffs) {
+				for (auto &w : ff.past_d)
+					w = {w.v, 0};
+				for (auto &w : ff.past_ad)
+					w = {w.v, 0};
+				for (int slot : ff.q)
+					for (int w = 0; w < words; w++)
+						slot_undef[slot*words + w] = 0;
+			}
+
+		witness_hierarchy(module, 0, [&](IdPath const &path, WitnessHierarchyItem item, int) {
+			if (item.wire != nullptr)
+				witness_wires.emplace(path, item.wire);
+			return 0;
+		});
+
+		log("Compiled %d cells into %d instructions and %d flip-flops for %d lanes.\n",
+				GetSize(module->cells()), GetSize(program), GetSize(ffs), lanes);
+	}
+
+	int add_slot(lane_word value)
+	{
+		int slot = GetSize(slot_val) / words;
+		slot_val.insert(slot_val.end(), words, value.v);
+		slot_undef.insert(slot_undef.end(), words, value.u);
+		return slot;
+	}
+
+	int sig_slot(SigBit bit) const
+	{
+		if (bit.wire == nullptr)
+			return bit.data == State::S0 ? 0 : bit.data == State::S1 ? 1 : 2;
+		return net_slots.at(bit);
+	}
+
+	std::vector<int> sig_slots(const SigSpec &sig) const
+	{
+		std::vector<int> slots;
+		for (auto bit : sigmap(sig))
+			slots.push_back(sig_slot(bit));
+		return slots;
+	}
+
+	void add_ff(Cell *cell)
+	{
+		ff_t ff;
+		ff.data = FfData(nullptr, cell);
+		ff.q = sig_slots(ff.data.sig_q);
+		ff.d = sig_slots(ff.data.sig_d);
+		ff.ad = sig_slots(ff.data.sig_ad);
+		ff.clr = sig_slots(ff.data.sig_clr);
+		ff.set = sig_slots(ff.data.sig_set);
+		ff.clk = ff.data.has_clk ? sig_slot(sigmap(ff.data.sig_clk[0])) : 0;
+		ff.ce = ff.data.has_ce ? sig_slot(sigmap(ff.data.sig_ce[0])) : 0;
+		ff.srst = ff.data.has_srst ? sig_slot(sigmap(ff.data.sig_srst[0])) : 0;
+		ff.arst = ff.data.has_arst ? sig_slot(sigmap(ff.data.sig_arst[0])) : 0;
+		ff.aload = ff.data.has_aload ? sig_slot(sigmap(ff.data.sig_aload[0])) : 0;
+		ff.past_d.assign(ff.data.width * words, lane_const(State::Sx));
+		ff.past_ad.assign(ff.data.width * words, lane_const(State::Sx));
+		ff.past_ctrl.assign(3 * words, lane_const(State::Sx));
+		ffs.push_back(ff);
+	}
+
+	lane_word get(int slot, int w) const
+	{
+		return {slot_val[slot*words + w], slot_undef[slot*words + w]};
+	}
+
+	void put(int slot, int w, lane_word value)
+	{
+		if (slot < num_const_slots)
+			return;
+		uint64_t &v = slot_val[slot*words + w], &u = slot_undef[slot*words + w];
+		changed |= ((v ^ value.v) | (u ^ value.u)) != 0;
+		v = value.v, u = value.u;
+	}
+
+	State get_lane(int slot, int lane) const
+	{
+		uint64_t mask = uint64_t(1) << (lane % 64);
+		int idx = slot*words + lane / 64;
+		if (slot_undef[idx] & mask)
+			return State::Sx;
+		return (slot_val[idx] & mask) ? State::S1 : State::S0;
+	}
+
+	void set_lane(int slot, int lane, State value)
+	{
+		if (value == State::Sa)
+			return;
+		uint64_t mask = uint64_t(1) << (lane % 64);
+		lane_word w = get(slot, lane / 64);
+		put(slot, lane / 64, lane_blend(w, lane_const(value), mask));
+	}
+
+	void set_all(int slot, State value)
+	{
+		for (int w = 0; w < words; w++)
+			put(slot, w, lane_const(value));
+	}
+
+	uint64_t lane_mask(int w) const
+	{
+		int n = lanes - 64*w;
+		return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+	}
+
+	uint64_t random_word()
+	{
+		// xorshift64*
+		rng_state ^= rng_state >> 12;
+		rng_state ^= rng_state << 25;
+		rng_state ^= rng_state >> 27;
+		return rng_state * 0x2545F4914F6CDD1DULL;
+	}
+
+	void randomize(const std::vector<int> &slots)
+	{
+		for (int slot : slots)
+			for (int w = 0; w < words; w++)
+				put(slot, w, {random_word(), 0});
+	}
+
+	template<typename F>
+	void exec_bitwise(const SimInstance::sim_instr_t &instr, F f)
+	{
+		const int *a = instr_operands.data() + instr.a;
+		const int *b = instr_operands.data() + instr.b;
+		const int *c = instr_operands.data() + instr.c;
+		const int *y = instr_operands.data() + instr.y;
+
+		for (int i = 0; i < instr.y_len; i++) {
+			int sb = instr.b_len ? b[i] : 0;
+			int sc = instr.c_len ? c[instr.c_len == 1 ? 0 : i] : 0;
+			for (int w = 0; w < words; w++)
+				put(y[i], w, f(get(a[i], w), get(sb, w), get(sc, w)));
+		}
+	}
+
+	Const get_lane_const(int offset, int len, int lane) const
+	{
+		Const value;
+		value.bits.reserve(len);
+		for (int i = 0; i < len; i++)
+			value.bits.push_back(get_lane(instr_operands[offset + i], lane));
+		return value;
+	}
+
+	void exec_lanes(const SimInstance::sim_instr_t &instr)
+	{
+		for (int lane = 0; lane < lanes; lane++) {
+			Const a = get_lane_const(instr.a, instr.a_len, lane);
+			Const b = get_lane_const(instr.b, instr.b_len, lane);
+			Const y = instr.op == SimInstance::SIM_OP_EVAL3 ?
+					CellTypes::eval(instr.cell, a, b, get_lane_const(instr.c, instr.c_len, lane)) :
+					CellTypes::eval(instr.cell, a, b);
+			for (int i = 0; i < instr.y_len && i < GetSize(y); i++)
+				set_lane(instr_operands[instr.y + i], lane, y[i]);
+		}
+	}
+
+	void exec_instr(const SimInstance::sim_instr_t &instr)
+	{
+		typedef SimInstance S;
+		switch (instr.op)
+		{
+		case S::SIM_OP_BUF:
+			exec_bitwise(instr, [](lane_word a, lane_word, lane_word) { return a; });
+			break;
+		case S::SIM_OP_NOT:
+		case S::SIM_OP_GATE_NOT:
+			exec_bitwise(instr, [](lane_word a, lane_word, lane_word) { return lane_not(a); });
+			break;
+		case S::SIM_OP_AND:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_and(a, b); });
+			break;
+		case S::SIM_OP_NAND:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_not(lane_and(a, b)); });
+			break;
+		case S::SIM_OP_OR:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_or(a, b); });
+			break;
+		case S::SIM_OP_NOR:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_not(lane_or(a, b)); });
+			break;
+		case S::SIM_OP_XOR:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_xor(a, b); });
+			break;
+		case S::SIM_OP_XNOR:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_not(lane_xor(a, b)); });
+			break;
+		case S::SIM_OP_ANDNOT:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_and(a, lane_not(b)); });
+			break;
+		case S::SIM_OP_ORNOT:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word) { return lane_or(a, lane_not(b)); });
+			break;
+		case S::SIM_OP_MUX:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word s) { return lane_mux(a, b, s); });
+			break;
+		case S::SIM_OP_AOI3:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word c) { return lane_not(lane_or(lane_and(a, b), c)); });
+			break;
+		case S::SIM_OP_OAI3:
+			exec_bitwise(instr, [](lane_word a, lane_word b, lane_word c) { return lane_not(lane_and(lane_or(a, b), c)); });
+			break;
+		default:
+			exec_lanes(instr);
+			break;
+		}
+	}
+
+	void eval_comb()
+	{
+		int num_acyclic = GetSize(program) - num_cyclic;
+		for (int pc = 0; pc < num_acyclic; pc++)
+			exec_instr(program[pc]);
+
+		// combinational loops: iterate until all lanes settle
+		for (int iter = 0; num_cyclic > 0; iter++) {
+			if (iter == 1000) {
+				log_warning("Combinational loop in module %s did not settle.\n", log_id(module));
+				break;
+			}
+			changed = false;
+			for (int pc = num_acyclic; pc < GetSize(program); pc++)
+				exec_instr(program[pc]);
+			if (!changed)
+				break;
+		}
+	}
+
+	bool update_ff(bool gclk, bool stable_past_update)
+	{
+		changed = false;
+
+		for (auto &ff : ffs)
+		{
+			FfData &data = ff.data;
+			for (int w = 0; w < words; w++)
+			{
+				uint64_t edge = 0, ce = ~uint64_t(0), srst = 0, aload = 0, arst = 0;
+
+				if (data.has_clk && !stable_past_update) {
+					lane_word past_clk = ff.past_ctrl[w], clk = get(ff.clk, w);
+					edge = data.pol_clk ? (~past_clk.v & ~past_clk.u) & (clk.v | clk.u) : past_clk.v & ~clk.v;
+					if (data.has_ce)
+						ce = lane_active(ff.past_ctrl[words + w], data.pol_ce);
+					if (data.has_srst)
+						srst = edge & lane_active(ff.past_ctrl[2*words + w], data.pol_srst) & (data.ce_over_srst ? ce : ~uint64_t(0));
+				}
+				if (data.has_aload)
+					aload = lane_active(get(ff.aload, w), data.pol_aload);
+				if (data.has_arst)
+					arst = lane_active(get(ff.arst, w), data.pol_arst);
+
+				for (int i = 0; i < data.width; i++) {
+					lane_word q = get(ff.q[i], w);
+					q = lane_blend(q, ff.past_d[i*words + w], edge & ce);
+					if (data.has_srst)
+						q = lane_blend(q, lane_const(data.val_srst[i]), srst);
+					if (data.has_aload)
+						q = lane_blend(q, data.has_clk && !stable_past_update ? ff.past_ad[i*words + w] : get(ff.ad[i], w), aload);
+					if (data.has_arst)
+						q = lane_blend(q, lane_const(data.val_arst[i]), arst);
+					if (data.has_sr) {
+						uint64_t clr = lane_active(get(ff.clr[i], w), data.pol_clr);
+						uint64_t set = lane_active(get(ff.set[i], w), data.pol_set) & ~clr;
+						q = lane_blend(lane_blend(q, lane_const(State::S0), clr), lane_const(State::S1), set);
+					}
+					if (data.has_gclk && gclk)
+						q = ff.past_d[i*words + w];
+					put(ff.q[i], w, q);
+				}
+			}
+		}
+
+		return changed;
+	}
+
+	void update_past(bool check_assertions)
+	{
+		for (auto &ff : ffs)
+			for (int w = 0; w < words; w++) {
+				for (int i = 0; i < ff.data.width; i++) {
+					if (ff.data.has_aload)
+						ff.past_ad[i*words + w] = get(ff.ad[i], w);
+					if (ff.data.has_clk || ff.data.has_gclk)
+						ff.past_d[i*words + w] = get(ff.d[i], w);
+				}
+				if (ff.data.has_clk)
+					ff.past_ctrl[w] = get(ff.clk, w);
+				if (ff.data.has_ce)
+					ff.past_ctrl[words + w] = get(ff.ce, w);
+				if (ff.data.has_srst)
+					ff.past_ctrl[2*words + w] = get(ff.srst, w);
+			}
+
+		if (!check_assertions)
+			return;
+
+		for (auto &formal : formals)
+			for (int w = 0; w < words; w++) {
+				lane_word a = get(formal.a, w), en = get(formal.en, w);
+				uint64_t hit = en.v & (formal.cell->type == ID($cover) ? a.v : ~a.v) & lane_mask(w);
+				uint64_t first = hit & ~formal.triggered[w];
+				formal.triggered[w] |= hit;
+				for (int bit = 0; first != 0; bit++, first >>= 1) {
+					if (!(first & 1))
+						continue;
+					int lane = 64*w + bit;
+					if (formal.first_lane < 0)
+						formal.first_lane = lane, formal.first_step = worker->step;
+					worker->triggered_assertions.emplace_back(worker->step, nullptr, formal.cell, lane);
+					if (worker->debug)
+						log("%s %s triggered in lane %d at step %d.\n", log_id(formal.cell->type), log_id(formal.cell), lane, worker->step);
+				}
+			}
+	}
+
+	void update(bool gclk)
+	{
+		if (gclk)
+			worker->step += 1;
+
+		while (1) {
+			eval_comb();
+			if (!update_ff(gclk, false))
+				break;
+		}
+
+		update_past(gclk);
+	}
+
+	void initialize_stable_past()
+	{
+		while (1) {
+			eval_comb();
+			if (!update_ff(false, true))
+				break;
+		}
+
+		update_past(true);
+	}
+
+	void set_inports(const pool<IdString> &ports, State value)
+	{
+		for (auto portname : ports)
+		{
+			Wire *w = module->wire(portname);
+
+			if (w == nullptr)
+				log_error("Can't find port %s on module %s.\n", log_id(portname), log_id(module));
+
+			for (int slot : sig_slots(w))
+				set_all(slot, value);
+		}
+	}
+
+	void set_initstate(State value)
+	{
+		for (int slot : initstate_slots)
+			set_all(slot, value);
+	}
+
+	// clocked simulation like SimWorker::run(), with random stimulus the
+	// inputs change while the clock is low
+	void run(int numcycles, bool random, uint64_t seed)
+	{
+		rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+		std::vector<int> input_slots;
+		if (random) {
+			for (auto wire : module->wires())
+				if (wire->port_input && !worker->clock.count(wire->name) && !worker->clockn.count(wire->name) &&
+						!worker->reset.count(wire->name) && !worker->resetn.count(wire->name))
+					for (int slot : sig_slots(wire))
+						input_slots.push_back(slot);
+		} else {
+			anyconst_slots.clear();
+			anyseq_slots.clear();
+		}
+
+		if (worker->verbose)
+			log("Simulating cycle 0.\n");
+
+		set_inports(worker->reset, State::S1);
+		set_inports(worker->resetn, State::S0);
+		set_inports(worker->clock, State::Sx);
+		set_inports(worker->clockn, State::Sx);
+		set_initstate(worker->initstate ? State::S1 : State::S0);
+		randomize(anyconst_slots);
+		randomize(anyseq_slots);
+		randomize(input_slots);
+
+		update(false);
+
+		for (int cycle = 0; cycle < numcycles; cycle++)
+		{
+			if (worker->verbose)
+				log("Simulating cycle %d.\n", (cycle*2)+1);
+			set_inports(worker->clock, State::S0);
+			set_inports(worker->clockn, State::S1);
+			if (cycle > 0) {
+				randomize(anyseq_slots);
+				randomize(input_slots);
+			}
+
+			update(true);
+
+			if (cycle == 0)
+				set_initstate(State::S0);
+
+			if (worker->verbose)
+				log("Simulating cycle %d.\n", (cycle*2)+2);
+			set_inports(worker->clock, State::S1);
+			set_inports(worker->clockn, State::S0);
+
+			if (cycle+1 == worker->rstlen) {
+				set_inports(worker->reset, State::S0);
+				set_inports(worker->resetn, State::S1);
+			}
+
+			update(true);
+		}
+	}
+
+	void set_yw_state(const ReadWitness &yw, int lane, int t)
+	{
+		for (auto &signal : yw.signals) {
+			if (signal.init_only && t >= 1)
+				continue;
+			auto it = witness_wires.find(signal.path);
+			if (it == witness_wires.end())
+				continue;
+			Const value = yw.get_bits(t, signal.bits_offset, signal.width);
+			for (int i = 0; i < signal.width && signal.offset + i < it->second->width; i++)
+				set_lane(sig_slot(sigmap(SigBit(it->second, signal.offset + i))), lane, value[i]);
+		}
+	}
+
+	void set_yw_clocks(const ReadWitness &yw, int lane, bool active_edge)
+	{
+		for (auto &clock : yw.clocks) {
+			if (clock.is_negedge == clock.is_posedge)
+				continue;
+			auto it = witness_wires.find(clock.path);
+			if (it == witness_wires.end())
+				continue;
+			set_lane(sig_slot(sigmap(SigBit(it->second, clock.offset))), lane,
+					active_edge == clock.is_posedge ? State::S1 : State::S0);
+		}
+	}
+
+	// one Yosys witness file per lane, lanes with shorter traces keep their
+	// last inputs
+	void run_yw_witness(const std::vector<std::string> &filenames, int append)
+	{
+		std::vector<ReadWitness> yws;
+		int num_steps = 0;
+		bool has_clocks = false;
+		for (auto &filename : filenames) {
+			yws.emplace_back(filename);
+			num_steps = std::max(num_steps, GetSize(yws.back().steps));
+			has_clocks |= !yws.back().clocks.empty();
+			for (auto &signal : yws.back().signals)
+				if (!witness_wires.count(signal.path))
+					log_warning("Yosys witness path `%s` was not found in this design, ignoring\n", signal.path.str().c_str());
+		}
+
+		if (num_steps == 0)
+			return;
+
+		set_initstate(worker->initstate ? State::S1 : State::S0);
+		for (int lane = 0; lane < lanes; lane++)
+			if (!yws[lane].steps.empty()) {
+				set_yw_state(yws[lane], lane, 0);
+				set_yw_clocks(yws[lane], lane, true);
+			}
+		initialize_stable_past();
+
+		if (has_clocks) {
+			for (int lane = 0; lane < lanes; lane++)
+				set_yw_clocks(yws[lane], lane, false);
+			update(false);
+		}
+		set_initstate(State::S0);
+
+		for (int cycle = 1; cycle < num_steps + append; cycle++)
+		{
+			if (worker->verbose)
+				log("Simulating cycle %d.\n", cycle);
+			for (int lane = 0; lane < lanes; lane++) {
+				if (cycle < GetSize(yws[lane].steps))
+					set_yw_state(yws[lane], lane, cycle);
+				set_yw_clocks(yws[lane], lane, true);
+			}
+			update(true);
+
+			if (has_clocks) {
+				for (int lane = 0; lane < lanes; lane++)
+					set_yw_clocks(yws[lane], lane, false);
+				update(false);
+			}
+		}
+	}
+
+	void report()
+	{
+		int num_failed = 0;
+		for (auto &formal : formals)
+		{
+			int count = 0;
+			for (int w = 0; w < words; w++)
+				for (uint64_t bits = formal.triggered[w]; bits != 0; bits &= bits - 1)
+					count++;
+			if (count == 0)
+				continue;
+
+			string label = log_id(formal.cell);
+			if (formal.cell->attributes.count(ID::src))
+				label = formal.cell->attributes.at(ID::src).decode_string();
+
+			if (formal.cell->type == ID($cover)) {
+				log("Cover %s (%s) reached in %d of %d lanes (first in lane %d at step %d).\n",
+						log_id(formal.cell), label.c_str(), count, lanes, formal.first_lane, formal.first_step);
+			} else if (formal.cell->type == ID($assume)) {
+				log("Assumption %s (%s) failed in %d of %d lanes (first in lane %d at step %d).\n",
+						log_id(formal.cell), label.c_str(), count, lanes, formal.first_lane, formal.first_step);
+			} else {
+				log_warning("Assert %s (%s) failed in %d of %d lanes (first in lane %d at step %d).\n",
+						log_id(formal.cell), label.c_str(), count, lanes, formal.first_lane, formal.first_step);
+				num_failed++;
+			}
+		}
+
+		if (num_failed && worker->serious_asserts)
+			log_error("%d assertion(s) failed in batch simulation.\n", num_failed);
+	}
+};
+
+void OutputWriter::write(std::map<int, bool> &use_signal)
+{
+	write_header(use_signal);
+	for (auto &d : worker->output_data)
+		write_step(d.first, d.second);
+	finish();
+}
+
+struct VCDWriter : public OutputWriter
+{
+	VCDWriter(SimWorker *worker, std::string filename) : OutputWriter(worker) {
+		vcdfile.open(filename.c_str());
+	}
+
+	void write_header(std::map<int, bool> &use_signal) override
+	{
+		if (!vcdfile.is_open()) return;
+		this->use_signal = use_signal;
+		vcdfile << stringf("$version %s $end\n", worker->date ? yosys_version_str : "Yosys");
+
+		if (worker->date) {
+			std::time_t t = std::time(nullptr);
+			char mbstr[255];
+			if (std::strftime(mbstr, sizeof(mbstr), "%c", std::localtime(&t))) {
+				vcdfile << stringf("$date ") << mbstr << stringf(" $end\n");
+			}
+		}
+
+		if (!worker->timescale.empty())
+			vcdfile << stringf("$timescale %s $end\n", worker->timescale.c_str());
+
+		worker->top->write_output_header(
+			[this](IdString name) { vcdfile << stringf("$scope module %s $end\n", log_id(name)); },
+			[this]() { vcdfile << stringf("$upscope $end\n");},
+			[this](const char *name, int size, Wire *, int id, bool is_reg) {
+				if (this->use_signal.at(id)) {
+					// Works around gtkwave trying to parse everything past the last [ in a signal
 					// name. While the emitted range doesn't necessarily match the wire's range,
 					// this is consistent with the range gtkwave makes up if it doesn't find a
 					// range
@@ -2291,29 +4401,41 @@ struct VCDWriter : public OutputWriter
 		);
 
 		vcdfile << stringf("$enddefinitions $end\n");
+	}
 
-		for(auto& d : worker->output_data)
+	void write_step(int t, const std::map<int, Const> &data) override
+	{
+		if (!vcdfile.is_open()) return;
+		vcdfile << stringf("#%d\n", t);
+		for (auto &it : data)
 		{
-			vcdfile << stringf("#%d\n", d.first);
-			for (auto &data : d.second)
-			{
-				if (!use_signal.at(data.first)) continue;
-				Const value = data.second;
-				vcdfile << "b";
-				for (int i = GetSize(value)-1; i >= 0; i--) {
-					switch (value[i]) {
-						case State::S0: vcdfile << "0"; break;
-						case State::S1: vcdfile << "1"; break;
-						case State::Sx: vcdfile << "x"; break;
-						default: vcdfile << "z";
-					}
+			if (!use_signal.at(it.first)) continue;
+			const Const &value = it.second;
+			vcdfile << "b";
+			for (int i = GetSize(value)-1; i >= 0; i--) {
+				switch (value[i]) {
+					case State::S0: vcdfile << "0"; break;
+					case State::S1: vcdfile << "1"; break;
+					case State::Sx: vcdfile << "x"; break;
+					default: vcdfile << "z";
 				}
-				vcdfile << stringf(" n%d\n", data.first);
 			}
+			vcdfile << stringf(" n%d\n", it.first);
 		}
 	}
 
+	void flush() override
+	{
+		vcdfile.flush();
+	}
+
+	void finish() override
+	{
+		vcdfile.flush();
+	}
+
 	std::ofstream vcdfile;
+	std::map<int, bool> use_signal;
 };
 
 struct FSTWriter : public OutputWriter
@@ -2327,9 +4449,10 @@ struct FSTWriter : public OutputWriter
 		fstWriterClose(fstfile);
 	}
 
-	void write(std::map<int, bool> &use_signal) override
+	void write_header(std::map<int, bool> &use_signal) override
 	{
 		if (!fstfile) return;
+		this->use_signal = use_signal;
 		std::time_t t = std::time(nullptr);
 		fstWriterSetVersion(fstfile, worker->date ? yosys_version_str : "Yosys");
 		if (worker->date)
@@ -2341,41 +4464,50 @@ struct FSTWriter : public OutputWriter
 
 		fstWriterSetPackType(fstfile, FST_WR_PT_FASTLZ);
 		fstWriterSetRepackOnClose(fstfile, 1);
-	   
-	   	worker->top->write_output_header(
+
+		worker->top->write_output_header(
 			[this](IdString name) { fstWriterSetScope(fstfile, FST_ST_VCD_MODULE, stringf("%s",log_id(name)).c_str(), nullptr); },
 			[this]() { fstWriterSetUpscope(fstfile); },
-			[this,use_signal](const char *name, int size, Wire *, int id, bool is_reg) {
-				if (!use_signal.at(id)) return;
+			[this](const char *name, int size, Wire *, int id, bool is_reg) {
+				if (!this->use_signal.at(id)) return;
 				fstHandle fst_id = fstWriterCreateVar(fstfile, is_reg ? FST_VT_VCD_REG : FST_VT_VCD_WIRE, FST_VD_IMPLICIT, size,
 												name, 0);
 				mapping.emplace(id, fst_id);
 			}
 		);
+	}
 
-		for(auto& d : worker->output_data)
+	void write_step(int t, const std::map<int, Const> &data) override
+	{
+		if (!fstfile) return;
+		fstWriterEmitTimeChange(fstfile, t);
+		for (auto &it : data)
 		{
-			fstWriterEmitTimeChange(fstfile, d.first);
-			for (auto &data : d.second)
-			{
-				if (!use_signal.at(data.first)) continue;
-				Const value = data.second;
-				std::stringstream ss;
-				for (int i = GetSize(value)-1; i >= 0; i--) {
-					switch (value[i]) {
-						case State::S0: ss << "0"; break;
-						case State::S1: ss << "1"; break;
-						case State::Sx: ss << "x"; break;
-						default: ss << "z";
-					}
+			if (!use_signal.at(it.first)) continue;
+			const Const &value = it.second;
+			std::string str;
+			str.reserve(GetSize(value));
+			for (int i = GetSize(value)-1; i >= 0; i--) {
+				switch (value[i]) {
+					case State::S0: str += '0'; break;
+					case State::S1: str += '1'; break;
+					case State::Sx: str += 'x'; break;
+					default: str += 'z';
 				}
-				fstWriterEmitValueChange(fstfile, mapping[data.first], ss.str().c_str());
 			}
+			fstWriterEmitValueChange(fstfile, mapping[it.first], str.c_str());
 		}
 	}
 
+	void flush() override
+	{
+		if (fstfile)
+			fstWriterFlushContext(fstfile);
+	}
+
 	struct fstContext *fstfile = nullptr;
 	std::map<int,fstHandle> mapping;
+	std::map<int, bool> use_signal;
 };
 
 struct AIWWriter : public OutputWriter
@@ -2389,7 +4521,7 @@ struct AIWWriter : public OutputWriter
 		aiwfile << '.' << '\n';
 	}
 
-	void write(std::map<int, bool> &) override
+	void write_header(std::map<int, bool> &) override
 	{
 		if (!aiwfile.is_open()) return;
 		if (worker->map_filename.empty())
@@ -2398,7 +4530,6 @@ struct AIWWriter : public OutputWriter
 		std::ifstream mf(worker->map_filename);
 		std::string type, symbol;
 		int variable, index;
-		int max_input = 0;
 		if (mf.fail())
 			log_cmd_error("Not able to read AIGER witness map file.\n");
 		while (mf >> type >> variable >> index >> symbol) {
@@ -2432,64 +4563,74 @@ struct AIWWriter : public OutputWriter
 			[]() {},
 			[this](const char */*name*/, int /*size*/, Wire *wire, int id, bool) { if (wire != nullptr) mapping[wire] = id; }
 		);
+	}
 
-		std::map<int, Yosys::RTLIL::Const> current;
-		bool first = true;
-		for (auto iter = worker->output_data.begin(); iter != std::prev(worker->output_data.end()); ++iter)
+	void write_step(int, const std::map<int, Const> &data) override
+	{
+		if (!aiwfile.is_open()) return;
+		// the final step is not part of the witness, so each step is only
+		// written once the next one arrives
+		if (has_pending)
+			write_pending();
+		pending = data;
+		has_pending = true;
+	}
+
+	void flush() override
+	{
+		aiwfile.flush();
+	}
+
+	void write_pending()
+	{
+		for (auto &data : pending)
 		{
-			auto& d = *iter;
-			for (auto &data : d.second)
+			current[data.first] = data.second;
+		}
+		if (first) {
+			for (int i = 0;; i++)
 			{
-				current[data.first] = data.second;
-			}
-			if (first) {
-				for (int i = 0;; i++)
-				{
-					if (aiw_latches.count(i)) {
-						aiwfile << '0';
-						continue;
-					}
-					aiwfile << '\n';
-					break;
+				if (aiw_latches.count(i)) {
+					aiwfile << '0';
+					continue;
 				}
-				first = false;
+				aiwfile << '\n';
+				break;
 			}
+			first = false;
+		}
 
-			bool skip = false;
-			for (auto it : clocks)
-			{
-				auto val = it.second ? State::S1 : State::S0;
-				SigBit bit = aiw_inputs.at(it.first);
+		for (auto it : clocks)
+		{
+			auto val = it.second ? State::S1 : State::S0;
+			SigBit bit = aiw_inputs.at(it.first);
+			auto v = current[mapping[bit.wire]].bits.at(bit.offset);
+			if (v == val)
+				return;
+		}
+		for (int i = 0; i <= max_input; i++)
+		{
+			if (aiw_inputs.count(i)) {
+				SigBit bit = aiw_inputs.at(i);
 				auto v = current[mapping[bit.wire]].bits.at(bit.offset);
-				if (v == val)
-					skip = true;
+				if (v == State::S1)
+					aiwfile << '1';
+				else
+					aiwfile << '0';
+				continue;
 			}
-			if (skip)
+			if (aiw_inits.count(i)) {
+				SigBit bit = aiw_inits.at(i);
+				auto v = current[mapping[bit.wire]].bits.at(bit.offset);
+				if (v == State::S1)
+					aiwfile << '1';
+				else
+					aiwfile << '0';
 				continue;
-			for (int i = 0; i <= max_input; i++)
-			{
-				if (aiw_inputs.count(i)) {
-					SigBit bit = aiw_inputs.at(i);
-					auto v = current[mapping[bit.wire]].bits.at(bit.offset);
-					if (v == State::S1)
-						aiwfile << '1';
-					else
-						aiwfile << '0';
-					continue;
-				}
-				if (aiw_inits.count(i)) {
-					SigBit bit = aiw_inits.at(i);
-					auto v = current[mapping[bit.wire]].bits.at(bit.offset);
-					if (v == State::S1)
-						aiwfile << '1';
-					else
-						aiwfile << '0';
-					continue;
-				}
-				aiwfile << '0';
 			}
-			aiwfile << '\n';
-		} 
+			aiwfile << '0';
+		}
+		aiwfile << '\n';
 	}
 
 	std::ofstream aiwfile;
@@ -2497,6 +4638,11 @@ struct AIWWriter : public OutputWriter
 	dict<int, SigBit> aiw_inputs, aiw_inits;
 	dict<int, bool> clocks;
 	std::map<Wire*,int> mapping;
+	int max_input = 0;
+
+	std::map<int, Yosys::RTLIL::Const> current, pending;
+	bool has_pending = false;
+	bool first = true;
 };
 
 struct SimPass : public Pass {
@@ -2526,6 +4672,13 @@ struct SimPass : public Pass {
 		log("    -x\n");
 		log("        ignore constant x outputs in simulation file.\n");
 		log("\n");
+		log("    -stream\n");
+		log("        always write the simulation results while simulating. Without this\n");
+		log("        option the results are buffered until the end of the simulation\n");
+		log("        when -x is used or the design contains memories (which are traced\n");
+		log("        only for the accessed addresses). With this option all memory words\n");
+		log("        are traced from the start. Can't be combined with -x.\n");
+		log("\n");
 		log("    -date\n");
 		log("        include date and full version info in output.\n");
 		log("\n");
@@ -2607,6 +4760,65 @@ struct SimPass : public Pass {
 		log("        fail the simulation command if, in the course of simulating,\n");
 		log("        any of the asserts in the design fail\n");
 		log("\n");
+		log("    -observe <signal>\n");
+		log("        only simulate the transitive fan-in of the given signal, including\n");
+		log("        flip-flops, memories and the ports of submodules. The signal is a\n");
+		log("        wire of the top module or a hierarchical path like 'inst.sub.wire'.\n");
+		log("        Can be given multiple times. Signals outside of the cone are not\n");
+		log("        updated and are left out of the output files and comparisons, cells\n");
+		log("        outside of it (including $print and formal cells) are skipped.\n");
+		log("\n");
+		log("    -observe-formal\n");
+		log("        add all $assert, $assume and $cover cells to the observed signals\n");
+		log("\n");
+		log("    -checkpoint-at <integer>\n");
+		log("    -checkpoint-file <filename>\n");
+		log("        save the complete simulation state (nets, flip-flops, memories and\n");
+		log("        the past values used for edge detection, for the whole hierarchy)\n");
+		log("        to the given file after the given number of clock cycles (or\n");
+		log("        Yosys witness steps), 0 saves the initial state\n");
+		log("\n");
+		log("    -restore <filename>\n");
+		log("        continue the simulation from a state saved with -checkpoint-file\n");
+		log("        for the same design. Without -r the simulation continues up to the\n");
+		log("        total number of cycles given with -n. A Yosys witness given with -r\n");
+		log("        provides the inputs for the cycles following the checkpoint, its\n");
+		log("        initial state values are ignored.\n");
+		log("\n");
+		log("    -lanes <N>\n");
+		log("        batch mode: simulate N independent stimuli at once. Each net bit\n");
+		log("        holds one bit per lane, packed into 64-bit words, so gates and\n");
+		log("        bitwise cells are evaluated for 64 lanes per operation. Requires a\n");
+		log("        flattened design without memories (see 'flatten' and 'memory_map'),\n");
+		log("        does not distinguish x and z and only reports the asserts, assumes\n");
+		log("        and covers triggered in each lane (see -summary, -assert). The\n");
+		log("        stimulus is either random (-random) or one Yosys witness file per\n");
+		log("        lane (-r given N times), without either the inputs stay undefined.\n");
+		log("\n");
+		log("    -random\n");
+		log("        with -lanes, drive all top-level inputs other than clocks and resets\n");
+		log("        and all $anyseq/$anyconst cells with random values, the inputs change\n");
+		log("        while the clock is low\n");
+		log("\n");
+		log("    -seed <integer>\n");
+		log("        seed for -random (default: 1)\n");
+		log("\n");
+		log("    -engine <interpreted|compiled>\n");
+		log("        select the simulation engine. The default 'interpreted' engine\n");
+		log("        propagates changes cell by cell. The 'compiled' engine assigns every\n");
+		log("        net a slot in a flat state array and evaluates the levelized cells of\n");
+		log("        each module as a linear program, which is much faster for large\n");
+		log("        designs. Both engines produce the same results.\n");
+		log("\n");
+		log("    -j <N>\n");
+		log("        with the compiled engine, evaluate independent child instances on up\n");
+		log("        to N threads. Within each delta cycle the dirty children of an\n");
+		log("        instance run in parallel and their outputs are written back to the\n");
+		log("        parent after all of them have finished. Only instances whose cells\n");
+		log("        the compiled engine can evaluate on its own (no $lut, $sop, $slice,\n");
+		log("        $concat or clocked memory read ports below them) are run in\n");
+		log("        parallel, the others are evaluated serially as before.\n");
+		log("\n");
 		log("    -q\n");
 		log("        disable per-cycle/sample log message\n");
 		log("\n");
@@ -2626,6 +4838,11 @@ struct SimPass : public Pass {
 		SimWorker worker;
 		int numcycles = 20;
 		int append = 0;
+		int lanes = 0;
+		int num_threads = 1;
+		bool random = false;
+		uint64_t seed = 1;
+		std::vector<std::string> sim_filenames;
 		bool start_set = false, stop_set = false, at_set = false;
 
 		log_header(design, "Executing SIM pass (simulate the circuit).\n");
@@ -2711,6 +4928,7 @@ struct SimPass : public Pass {
 				std::string sim_filename = args[++argidx];
 				rewrite_filename(sim_filename);
 				worker.sim_filename = sim_filename;
+				sim_filenames.push_back(sim_filename);
 				continue;
 			}
 			if (args[argidx] == "-append" && argidx+1 < args.size()) {
@@ -2765,6 +4983,62 @@ struct SimPass : public Pass {
 				worker.sim_mode = SimulationMode::gate;
 				continue;
 			}
+			if (args[argidx] == "-engine" && argidx+1 < args.size()) {
+				std::string engine = args[++argidx];
+				if (engine == "interpreted")
+					worker.engine = SimulationEngine::interpreted;
+				else if (engine == "compiled")
+					worker.engine = SimulationEngine::compiled;
+				else
+					log_cmd_error("Unknown simulation engine `%s'.\n", engine.c_str());
+				continue;
+			}
+			if (args[argidx] == "-j" && argidx+1 < args.size()) {
+				num_threads = atoi(args[++argidx].c_str());
+				if (num_threads < 1)
+					log_cmd_error("Invalid number of threads `%s'.\n", args[argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-observe" && argidx+1 < args.size()) {
+				worker.observe.push_back(args[++argidx]);
+				continue;
+			}
+			if (args[argidx] == "-observe-formal") {
+				worker.observe_formal = true;
+				continue;
+			}
+			if (args[argidx] == "-checkpoint-at" && argidx+1 < args.size()) {
+				worker.checkpoint_at = atoi(args[++argidx].c_str());
+				if (worker.checkpoint_at < 0)
+					log_cmd_error("Invalid checkpoint cycle `%s'.\n", args[argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-checkpoint-file" && argidx+1 < args.size()) {
+				std::string checkpoint_filename = args[++argidx];
+				rewrite_filename(checkpoint_filename);
+				worker.checkpoint_filename = checkpoint_filename;
+				continue;
+			}
+			if (args[argidx] == "-restore" && argidx+1 < args.size()) {
+				std::string restore_filename = args[++argidx];
+				rewrite_filename(restore_filename);
+				worker.restore_filename = restore_filename;
+				continue;
+			}
+			if (args[argidx] == "-lanes" && argidx+1 < args.size()) {
+				lanes = atoi(args[++argidx].c_str());
+				if (lanes < 1)
+					log_cmd_error("Invalid number of lanes `%s'.\n", args[argidx].c_str());
+				continue;
+			}
+			if (args[argidx] == "-random") {
+				random = true;
+				continue;
+			}
+			if (args[argidx] == "-seed" && argidx+1 < args.size()) {
+				seed = strtoull(args[++argidx].c_str(), nullptr, 0);
+				continue;
+			}
 			if (args[argidx] == "-assert") {
 				worker.serious_asserts = true;
 				continue;
@@ -2773,6 +5047,10 @@ struct SimPass : public Pass {
 				worker.ignore_x = true;
 				continue;
 			}
+			if (args[argidx] == "-stream") {
+				worker.stream = true;
+				continue;
+			}
 			if (args[argidx] == "-date") {
 				worker.date = true;
 				continue;
@@ -2788,6 +5066,27 @@ struct SimPass : public Pass {
 			log_error("'at' option can only be defined separate of 'start','stop' and 'n'\n");
 		if (stop_set && worker.cycles_set)
 			log_error("'stop' and 'n' can only be used exclusively'\n");
+		if (worker.stream && worker.ignore_x)
+			log_cmd_error("Options -stream and -x are mutually exclusive.\n");
+		if (lanes == 0 && (random || GetSize(sim_filenames) > 1))
+			log_cmd_error("Options -random and multiple -r require -lanes.\n");
+		if ((!worker.observe.empty() || worker.observe_formal) && (worker.writeback || lanes > 0))
+			log_cmd_error("Options -observe and -observe-formal can't be combined with -w or -lanes.\n");
+		if (num_threads > 1 && (worker.engine != SimulationEngine::compiled || lanes > 0))
+			log_cmd_error("Option -j requires -engine compiled and can't be combined with -lanes.\n");
+		if (num_threads > 1) {
+#ifdef YOSYS_ENABLE_THREADS
+			worker.dispatcher.reset(new ParallelDispatcher(num_threads - 1));
+#else
+			log_warning("Yosys was built without thread support, ignoring -j.\n");
+#endif
+		}
+		if ((worker.checkpoint_at >= 0) != !worker.checkpoint_filename.empty())
+			log_cmd_error("Options -checkpoint-at and -checkpoint-file must be used together.\n");
+		bool uses_checkpoints = worker.checkpoint_at >= 0 || !worker.restore_filename.empty();
+		if (uses_checkpoints && (lanes > 0 || (!worker.sim_filename.empty() &&
+				(worker.sim_filename.size() <= 3 || worker.sim_filename.compare(worker.sim_filename.size()-3, std::string::npos, ".yw") != 0))))
+			log_cmd_error("Checkpoints are only supported for plain simulation and Yosys witness input.\n");
 
 		Module *top_mod = nullptr;
 
@@ -2803,7 +5102,27 @@ struct SimPass : public Pass {
 			top_mod = mods.front();
 		}
 
-		if (worker.sim_filename.empty())
+		if (lanes > 0) {
+			if (!worker.outputfiles.empty() || worker.writeback)
+				log_cmd_error("Writing simulation results is not supported with -lanes.\n");
+			if (random && !sim_filenames.empty())
+				log_cmd_error("Options -random and -r are mutually exclusive.\n");
+			for (auto &filename : sim_filenames)
+				if (filename.size() <= 3 || filename.compare(filename.size()-3, std::string::npos, ".yw") != 0)
+					log_cmd_error("Only Yosys witness files can be used as stimulus with -lanes.\n");
+			if (!sim_filenames.empty() && GetSize(sim_filenames) != lanes)
+				log_cmd_error("With -lanes %d, -r must be given once per lane.\n", lanes);
+			if (!sim_filenames.empty() && (!worker.clock.empty() || !worker.reset.empty()))
+				log_cmd_error("The -clock and -reset options are not supported when reading Yosys witness files.\n");
+
+			SimBatch batch(&worker, top_mod, lanes);
+			if (sim_filenames.empty())
+				batch.run(numcycles, random, seed);
+			else
+				batch.run_yw_witness(sim_filenames, append);
+			log("Simulated %d lanes for %d steps.\n", lanes, worker.step);
+			batch.report();
+		} else if (worker.sim_filename.empty())
 			worker.run(top_mod, numcycles);
 		else {
 			std::string filename_trim = file_base_name(worker.sim_filename);
@@ -2823,7 +5142,7 @@ struct SimPass : public Pass {
 			}
 		}
 
-		worker.write_summary();
+		worker.write_summary(top_mod);
 	}
 } SimPass;
 
@@ -53,9 +53,12 @@ test_cxxrtl () {
 	../../yosys -p "read_verilog ${subtest}.v; proc; clean; write_cxxrtl -print-output std::cerr yosys-${subtest}.cc"
 	${CC:-gcc} -std=c++11 -o yosys-${subtest} -I../.. ${subtest}_tb.cc -lstdc++
 	./yosys-${subtest} 2>yosys-${subtest}.log
+	${CC:-gcc} -std=c++11 -DCXXRTL_CHUNK_BITS=64 -o yosys-${subtest}-chunk64 -I../.. ${subtest}_tb.cc -lstdc++
+	./yosys-${subtest}-chunk64 2>yosys-${subtest}-chunk64.log
 	iverilog -o iverilog-${subtest} ${subtest}.v ${subtest}_tb.v
 	./iverilog-${subtest} |grep -v '\$finish called' >iverilog-${subtest}.log
 	diff iverilog-${subtest}.log yosys-${subtest}.log
+	diff iverilog-${subtest}.log yosys-${subtest}-chunk64.log
 }
 
 test_cxxrtl always_full
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/sigtools.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// Both maps must partition the bits of the module in the same way. The
+// representatives may differ, so check that they correspond one to one.
+static void expect_same_partition(RTLIL::Module *module, SigMap &sigmap)
+{
+	SigMap fresh(module);
+	dict<SigBit, SigBit> fwd, bwd;
+	for (auto wire : module->wires())
+		for (auto bit : SigSpec(wire)) {
+			SigBit a = sigmap(bit), b = fresh(bit);
+			if (a.wire == nullptr || b.wire == nullptr)
+				EXPECT_EQ(a, b) << log_signal(bit);
+			auto f = fwd.emplace(a, b), r = bwd.emplace(b, a);
+			EXPECT_EQ(f.first->second, b) << log_signal(bit);
+			EXPECT_EQ(r.first->second, a) << log_signal(bit);
+		}
+}
+
+TEST(KernelSigtoolsTest, monitoredSigMapTracksEdits)
+{
+	RTLIL::Design design;
+	RTLIL::Module *module = design.addModule(ID(top));
+	RTLIL::Wire *a = module->addWire(ID(a), 4);
+	RTLIL::Wire *b = module->addWire(ID(b), 4);
+	RTLIL::Wire *c = module->addWire(ID(c), 4);
+	RTLIL::Wire *d = module->addWire(ID(d), 4);
+	RTLIL::Wire *y = module->addWire(ID(y), 4);
+	module->connect(b, a);
+
+	MonitoredSigMap msm(module);
+	expect_same_partition(module, msm.get());
+	int reloads = msm.auto_reload_counter;
+
+	// incremental: single connections are merged without a rebuild
+	module->connect(c, b);
+	expect_same_partition(module, msm.get());
+	module->connect(SigSpec(d).extract(0, 2), SigSpec(State::S1, 2));
+	expect_same_partition(module, msm.get());
+	module->connect(SigSpec(d).extract(2, 2), SigSpec(a).extract(0, 2));
+	expect_same_partition(module, msm.get());
+	EXPECT_EQ(msm.auto_reload_counter, reloads);
+
+	// setPort doesn't change the connectivity
+	RTLIL::Cell *cell = module->addNot(NEW_ID, a, y);
+	cell->setPort(ID::A, c);
+	cell->setPort(ID::Y, y);
+	expect_same_partition(module, msm.get());
+	EXPECT_EQ(msm.auto_reload_counter, reloads);
+
+	// deleting wires and replacing the connection list need a rebuild
+	module->remove(cell);
+	module->remove(pool<RTLIL::Wire*>{b});
+	expect_same_partition(module, msm.get());
+	EXPECT_EQ(msm.auto_reload_counter, ++reloads);
+
+	std::vector<RTLIL::SigSig> conns = module->connections();
+	conns.pop_back();
+	module->new_connections(conns);
+	expect_same_partition(module, msm.get());
+	EXPECT_EQ(msm.auto_reload_counter, ++reloads);
+
+	module->connect(y, d);
+	expect_same_partition(module, msm.get());
+	EXPECT_EQ(msm.auto_reload_counter, reloads);
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include "kernel/yosys.h"
+#include "kernel/threading.h"
+
+#include <atomic>
+#include <stdexcept>
+
+YOSYS_NAMESPACE_BEGIN
+
+#ifdef YOSYS_ENABLE_THREADS
+static const int test_workers = 3;
+#else
+static const int test_workers = 0;
+#endif
+
+TEST(KernelThreadingTest, parallelDispatcherRunsAllItems)
+{
+	ParallelDispatcher dispatcher(test_workers);
+	std::vector<int> hits(100);
+	dispatcher.run(GetSize(hits), [&](int i) { hits[i]++; });
+	for (int i = 0; i < GetSize(hits); i++)
+		EXPECT_EQ(hits[i], 1);
+}
+
+TEST(KernelThreadingTest, parallelDispatcherRethrows)
+{
+	ParallelDispatcher dispatcher(test_workers);
+	for (int thrower : {0, 50, 99}) {
+		std::atomic<int> started(0);
+		EXPECT_THROW(dispatcher.run(100, [&](int i) {
+			started++;
+			if (i == thrower)
+				throw std::runtime_error("item failed");
+		}), std::runtime_error);
+		EXPECT_GE(started.load(), 1);
+		EXPECT_LE(started.load(), 100);
+
+		// the dispatcher is usable again after an exception
+		std::atomic<int> count(0);
+		dispatcher.run(100, [&](int) { count++; });
+		EXPECT_EQ(count.load(), 100);
+	}
+}
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,89 @@
+#include "cxxrtl_coverage.cc"
+
+#include <cstdio>
+#include <map>
+
+// Counts the bits that differ between `prev` and `curr` into `counters`, like the generated code does.
+static void toggle(std::vector<uint64_t> &counters, uint32_t prev, uint32_t curr)
+{
+	for (size_t bit = 0; bit < counters.size(); bit++)
+		if (((prev ^ curr) >> bit) & 1)
+			counters[bit]++;
+}
+
+// Drives the design with random inputs, computes the counters it should have from the same inputs, and compares
+// them with the ones collected by the model, as described by `coverage_info()`.
+int main()
+{
+	cxxrtl_design::p_top top;
+
+	std::map<std::string, std::vector<uint64_t>> toggles = {
+		{ "clk", std::vector<uint64_t>(1) },
+		{ "s", std::vector<uint64_t>(1) },
+		{ "a", std::vector<uint64_t>(8) },
+		{ "b", std::vector<uint64_t>(8) },
+		{ "q", std::vector<uint64_t>(8) },
+	};
+	uint64_t mux[2] = {}, cover = 0;
+
+	uint32_t seed = 1;
+	uint32_t prev_clk = 0, prev_s = 0, prev_a = 0, prev_b = 0, q = 0;
+	for (int cycle = 0; cycle < 1000; cycle++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t s = (seed >> 30) & 1, a = (seed >> 8) & 0xff, b = (seed >> 28) < 4 ? a : (seed >> 16) & 0xff;
+		top.p_s.set(s);
+		top.p_a.set(a);
+		top.p_b.set(b);
+		for (uint32_t clk = 0; clk < 2; clk++) {
+			top.p_clk.set(clk);
+			top.step();
+
+			mux[s]++;
+			if (a == b)
+				cover++;
+			if (clk && !prev_clk) {
+				uint32_t next_q = s ? a : b;
+				toggle(toggles["q"], q, next_q);
+				q = next_q;
+			}
+			toggle(toggles["clk"], prev_clk, clk);
+			toggle(toggles["s"], prev_s, s);
+			toggle(toggles["a"], prev_a, a);
+			toggle(toggles["b"], prev_b, b);
+			prev_clk = clk, prev_s = s, prev_a = a, prev_b = b;
+		}
+	}
+
+	std::vector<cxxrtl::coverage_point> points;
+	top.coverage_info(points);
+	if (points.size() != top.coverage_size()) {
+		fprintf(stderr, "%zu coverage points, %zu counters\n", points.size(), top.coverage_size());
+		return 1;
+	}
+
+	size_t checked = 0;
+	for (auto &point : points) {
+		uint64_t expected;
+		switch (point.type) {
+			case cxxrtl::coverage_point::TOGGLE:
+				expected = toggles.at(point.name).at(point.detail);
+				break;
+			case cxxrtl::coverage_point::MUX:
+				expected = mux[point.detail];
+				break;
+			case cxxrtl::coverage_point::COVER:
+				expected = cover;
+				break;
+			default:
+				return 1;
+		}
+		uint64_t actual = top.coverage_counters()[point.index];
+		if (actual != expected) {
+			fprintf(stderr, "%u %s[%zu]: expected %llu, got %llu\n", point.type, point.name.c_str(), point.detail,
+			        (unsigned long long)expected, (unsigned long long)actual);
+			return 1;
+		}
+		checked++;
+	}
+	return checked == 1 + 1 + 8 + 8 + 8 + 2 + 1 ? 0 : 1;
+}
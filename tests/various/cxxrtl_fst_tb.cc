@@ -0,0 +1,47 @@
+#define CXXRTL_INCLUDE_FST_CAPI_IMPL
+#include "cxxrtl_fst.cc"
+
+#include <cstdio>
+
+// Dumps a simulation of the design through the FST C API. The waveform is read back by `sim -r`.
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <file.fst>\n", argv[0]);
+		return 1;
+	}
+
+	cxxrtl_handle design = cxxrtl_create_at(cxxrtl_design_create(), "top");
+	cxxrtl_object *clk = cxxrtl_get(design, "top clk");
+	cxxrtl_object *d = cxxrtl_get(design, "top d");
+	if (clk == nullptr || d == nullptr)
+		return 1;
+
+	cxxrtl_fst fst = cxxrtl_fst_create(argv[1]);
+	if (fst == nullptr)
+		return 1;
+	cxxrtl_fst_timescale(fst, 1, "ns");
+	cxxrtl_fst_add_from(fst, design);
+
+	uint32_t seed = 1;
+	uint64_t time = 0;
+	cxxrtl_step(design);
+	cxxrtl_fst_sample(fst, time);
+	for (int cycle = 0; cycle < 100; cycle++) {
+		// inputs change on the falling edge, so that they are stable at the rising edge
+		for (uint32_t level = 0; level < 2; level++) {
+			if (level == 0) {
+				seed = seed * 1103515245 + 12345;
+				d->next[0] = (seed >> 16) & 0xff;
+			}
+			clk->next[0] = level;
+			cxxrtl_step(design);
+			time += 5;
+			cxxrtl_fst_sample(fst, time);
+		}
+	}
+
+	cxxrtl_fst_destroy(fst);
+	cxxrtl_destroy(design);
+	return 0;
+}
@@ -0,0 +1,15 @@
+module sub(input clk, input [7:0] d, output reg [7:0] q);
+	reg [7:0] mem [0:3];
+	always @(posedge clk) begin
+		mem[d[1:0]] <= d;
+		q <= mem[q[1:0]] + d;
+	end
+endmodule
+
+module top(input clk, input [7:0] d, output [7:0] q);
+	wire [7:0] t0, t1, t2;
+	sub s0 (.clk(clk), .d(d), .q(t0));
+	sub s1 (.clk(clk), .d(d), .q(t1));
+	sub s2 (.clk(clk), .d(d), .q(t2));
+	sub s3 (.clk(clk), .d(t0 ^ t1 ^ t2), .q(q));
+endmodule
@@ -0,0 +1,71 @@
+#include "cxxrtl_state.cc"
+
+#include <cstdio>
+
+static uint8_t cycle(cxxrtl_design::p_top &top, uint8_t d)
+{
+	top.p_d.set(d);
+	top.p_clk.set(false);
+	top.step();
+	top.p_clk.set(true);
+	top.step();
+	return top.p_q.get<uint8_t>();
+}
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "line %d: check failed: %s\n", __LINE__, #cond); return 1; } } while (0)
+
+int main()
+{
+	cxxrtl_design::p_top top;
+	for (int i = 0; i < 10; i++)
+		cycle(top, i * 37 + 1);
+
+	std::vector<uint8_t> snapshot;
+	std::vector<std::string> differences;
+	top.save_state(snapshot);
+	CHECK(snapshot.size() == top.state_size());
+	CHECK(top.diff_state(snapshot, differences) && differences.empty());
+
+	// run ahead of the snapshot, then go back and replay the same inputs
+	std::vector<uint8_t> trace;
+	for (int i = 0; i < 20; i++)
+		trace.push_back(cycle(top, i * 11 + 3));
+	std::vector<uint8_t> ahead;
+	top.save_state(ahead);
+	CHECK(top.diff_state(snapshot, differences) && !differences.empty());
+
+	CHECK(top.load_state(snapshot));
+	differences.clear();
+	CHECK(top.diff_state(snapshot, differences) && differences.empty());
+	for (int i = 0; i < 20; i++)
+		CHECK(cycle(top, i * 11 + 3) == trace[i]);
+	std::vector<uint8_t> replayed;
+	top.save_state(replayed);
+	CHECK(replayed == ahead);
+
+	// differences are reported by hierarchical name, with memory rows listed individually
+	CHECK(top.load_state(snapshot));
+	top.cell_p_s1.memory_p_mem.data[2] = top.cell_p_s1.memory_p_mem.data[2].bit_not();
+	top.cell_p_s2.p_q.curr = top.cell_p_s2.p_q.curr.bit_not();
+	differences.clear();
+	CHECK(top.diff_state(snapshot, differences));
+	CHECK(differences.size() == 2);
+	CHECK(differences[0] == "s1 mem[2]");
+	CHECK(differences[1] == "s2 q");
+
+	// snapshots with a different layout are rejected, and leave the state alone
+	std::vector<uint8_t> current;
+	top.save_state(current);
+	std::vector<uint8_t> corrupted = snapshot;
+	corrupted[4] ^= 1;
+	CHECK(!top.load_state(corrupted));
+	CHECK(!top.diff_state(corrupted, differences));
+	corrupted = snapshot;
+	corrupted.pop_back();
+	CHECK(!top.load_state(corrupted));
+	std::vector<uint8_t> after;
+	top.save_state(after);
+	CHECK(after == current);
+	return 0;
+}